@@ -64,6 +64,8 @@
 #define E1000_ICR_RXO       (1 << 6)   // Receiver Overrun
 #define E1000_ICR_RXT0      (1 << 7)   // Receiver Timer Interrupt
 
+#define E1000_RX_IRQ_MASK   (E1000_ICR_RXT0 | E1000_ICR_RXO | E1000_ICR_RXDMT0)
+
 // Transmit Descriptor Command
 #define E1000_TXD_CMD_EOP   (1 << 0)   // End of Packet
 #define E1000_TXD_CMD_IFCS  (1 << 1)   // Insert FCS
@@ -77,6 +79,17 @@
 #define E1000_RXD_STAT_DD   (1 << 0)   // Descriptor Done
 #define E1000_RXD_STAT_EOP  (1 << 1)   // End of Packet
 
+// Interrupt moderation. ITR counts 256 ns units between interrupts;
+// RDTR/RADV count 1.024 us units.
+#define E1000_ITR_LOWEST_LATENCY  195     // ~20000 interrupts/s
+#define E1000_ITR_LOW_LATENCY     488     // ~8000 interrupts/s
+#define E1000_ITR_BULK            1953    // ~2000 interrupts/s
+#define E1000_RDTR_DEFAULT        0
+#define E1000_RADV_DEFAULT        8
+
+// Frames handled per poll before yielding with RX still masked
+#define E1000_NAPI_BUDGET   16
+
 // Descriptor counts
 #define E1000_NUM_RX_DESC   32
 #define E1000_NUM_TX_DESC   8
@@ -122,10 +135,24 @@ typedef struct {
     int initialized;
 } e1000_device_t;
 
+typedef struct {
+    uint64_t interrupts;         // RX interrupts taken
+    uint64_t polls;              // Poll passes over the RX ring
+    uint64_t packets;            // Frames handed to the stack
+    uint64_t budget_exhausted;   // Polls that hit E1000_NAPI_BUDGET
+    uint64_t rx_overruns;        // ICR.RXO seen
+    uint32_t max_per_poll;
+    uint32_t itr;                // Current ITR setting
+} e1000_stats_t;
+
 // Function prototypes
 int e1000_init(void);
 int e1000_send_packet(const void *data, uint16_t length);
 void e1000_interrupt_handler(void);
+// Give queued RX frames a chance to be processed from a polling loop
+void e1000_poll(void);
+const e1000_stats_t* e1000_get_stats(void);
+void e1000_print_stats(void);
 void e1000_get_mac_address(uint8_t *mac);
 int e1000_link_status(void);
 
@@ -11,12 +11,36 @@
 #define PCI_DEVICE_ID      0x02
 #define PCI_COMMAND        0x04
 #define PCI_STATUS         0x06
+#define PCI_PROG_IF        0x09
+#define PCI_SUBCLASS       0x0A
 #define PCI_CLASS_CODE     0x0B
 #define PCI_HEADER_TYPE    0x0E
 #define PCI_BAR0           0x10
 #define PCI_BAR1           0x14
+#define PCI_BAR4           0x20
+#define PCI_BAR5           0x24
+#define PCI_CAP_PTR        0x34
 #define PCI_INTERRUPT_LINE 0x3C
 
+#define PCI_COMMAND_IO           0x0001
+#define PCI_COMMAND_MEMORY       0x0002
+#define PCI_COMMAND_MASTER       0x0004
+#define PCI_COMMAND_INTX_DISABLE (1 << 10)
+#define PCI_STATUS_CAP_LIST      (1 << 4)
+
+#define PCI_CLASS_STORAGE  0x01
+
+// Capability IDs
+#define PCI_CAP_ID_MSI     0x05
+#define PCI_CAP_ID_MSIX    0x11
+
+// MSI / MSI-X message control bits
+#define PCI_MSI_ENABLE      (1 << 0)
+#define PCI_MSI_MME_MASK    (7 << 4)
+#define PCI_MSI_64BIT       (1 << 7)
+#define PCI_MSIX_FUNC_MASK  (1 << 14)
+#define PCI_MSIX_ENABLE     (1 << 15)
+
 static inline uint32_t pci_read_dword(uint8_t bus, uint8_t device, 
                                       uint8_t function, uint8_t offset) {
     uint32_t address = (1U << 31) | ((uint32_t)bus << 16) | 
@@ -49,7 +73,7 @@ static inline void pci_write_dword(uint8_t bus, uint8_t device,
                        (offset & 0xFC);
     
 __asm__ volatile("outl %0, %1" : : "a"(address), "dN"((uint16_t)PCI_CONFIG_ADDRESS));
-__asm__ volatile("inl %1, %0" : "=a"(value) : "dN"((uint16_t)PCI_CONFIG_DATA));
+__asm__ volatile("outl %0, %1" : : "a"(value), "dN"((uint16_t)PCI_CONFIG_DATA));
 
 }
 
@@ -61,4 +85,21 @@ static inline void pci_write_word(uint8_t bus, uint8_t device,
     pci_write_dword(bus, device, function, offset & 0xFC, dword);
 }
 
+// Walk the capability list; returns the config offset of cap_id or 0
+static inline uint8_t pci_find_capability(uint8_t bus, uint8_t device,
+                                          uint8_t function, uint8_t cap_id) {
+    if (!(pci_read_word(bus, device, function, PCI_STATUS) & PCI_STATUS_CAP_LIST)) {
+        return 0;
+    }
+
+    uint8_t ptr = pci_read_byte(bus, device, function, PCI_CAP_PTR) & 0xFC;
+    for (int guard = 0; ptr && guard < 48; guard++) {
+        if (pci_read_byte(bus, device, function, ptr) == cap_id) {
+            return ptr;
+        }
+        ptr = pci_read_byte(bus, device, function, ptr + 1) & 0xFC;
+    }
+    return 0;
+}
+
 #endif // PCI_H
\ No newline at end of file
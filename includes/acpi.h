@@ -0,0 +1,83 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+typedef struct {
+    char     signature[8];       // "RSD PTR "
+    uint8_t  checksum;
+    char     oem_id[6];
+    uint8_t  revision;           // 0 = ACPI 1.0, 2 = ACPI 2.0+
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t  extended_checksum;
+    uint8_t  reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    char     signature[4];
+    uint32_t length;
+    uint8_t  revision;
+    uint8_t  checksum;
+    char     oem_id[6];
+    char     oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+// MADT ("APIC") and its variable-length entries
+typedef struct {
+    acpi_sdt_header_t header;
+    uint32_t lapic_address;
+    uint32_t flags;              // Bit 0: dual 8259 PICs installed
+} __attribute__((packed)) acpi_madt_t;
+
+#define MADT_ENTRY_LAPIC          0
+#define MADT_ENTRY_IOAPIC         1
+#define MADT_ENTRY_ISO            2
+#define MADT_ENTRY_LAPIC_NMI      4
+#define MADT_ENTRY_LAPIC_OVERRIDE 5
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) madt_entry_t;
+
+typedef struct {
+    madt_entry_t entry;
+    uint8_t  processor_id;
+    uint8_t  apic_id;
+    uint32_t flags;
+} __attribute__((packed)) madt_lapic_t;
+
+typedef struct {
+    madt_entry_t entry;
+    uint8_t  ioapic_id;
+    uint8_t  reserved;
+    uint32_t address;
+    uint32_t gsi_base;
+} __attribute__((packed)) madt_ioapic_t;
+
+typedef struct {
+    madt_entry_t entry;
+    uint8_t  bus;                // Always 0 (ISA)
+    uint8_t  source;             // ISA IRQ
+    uint32_t gsi;
+    uint16_t flags;              // Polarity bits 0-1, trigger mode bits 2-3
+} __attribute__((packed)) madt_iso_t;
+
+typedef struct {
+    madt_entry_t entry;
+    uint16_t reserved;
+    uint64_t address;
+} __attribute__((packed)) madt_lapic_override_t;
+
+// Locate the RSDP through the EFI configuration table.
+int acpi_init(void);
+
+// Find a table by its 4-character signature, NULL if absent.
+acpi_sdt_header_t* acpi_find_table(const char *signature);
+
+#endif // ACPI_H
@@ -0,0 +1,170 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdint.h>
+#include "list.h"
+#include "blkdev.h"
+
+#define PCI_SUBCLASS_SATA       0x06
+#define PCI_PROGIF_AHCI         0x01
+
+// HBA registers (ABAR = BAR5)
+#define AHCI_CAP                0x00
+#define AHCI_GHC                0x04
+#define AHCI_IS                 0x08
+#define AHCI_PI                 0x0C
+#define AHCI_VS                 0x10
+
+#define AHCI_CAP_NCS_SHIFT      8       // Command slots - 1, 5 bits
+#define AHCI_CAP_SNCQ           (1U << 30)
+#define AHCI_CAP_S64A           (1U << 31)
+
+#define AHCI_GHC_IE             (1U << 1)
+#define AHCI_GHC_AE             (1U << 31)
+
+// Port registers, 0x80 bytes each from 0x100
+#define AHCI_PORT_BASE          0x100
+#define AHCI_PORT_SIZE          0x80
+#define PX_CLB                  0x00
+#define PX_CLBU                 0x04
+#define PX_FB                   0x08
+#define PX_FBU                  0x0C
+#define PX_IS                   0x10
+#define PX_IE                   0x14
+#define PX_CMD                  0x18
+#define PX_TFD                  0x20
+#define PX_SIG                  0x24
+#define PX_SSTS                 0x28
+#define PX_SERR                 0x30
+#define PX_SACT                 0x34
+#define PX_CI                   0x38
+
+#define PX_CMD_ST               (1U << 0)
+#define PX_CMD_FRE              (1U << 4)
+#define PX_CMD_FR               (1U << 14)
+#define PX_CMD_CR               (1U << 15)
+
+#define PX_IS_DHRS              (1U << 0)   // D2H register FIS
+#define PX_IS_PSS               (1U << 1)   // PIO setup FIS
+#define PX_IS_SDBS              (1U << 3)   // Set device bits FIS (NCQ completion)
+#define PX_IS_IFS               (1U << 27)
+#define PX_IS_HBDS              (1U << 28)
+#define PX_IS_HBFS              (1U << 29)
+#define PX_IS_TFES              (1U << 30)
+#define PX_IS_ERRORS            (PX_IS_IFS | PX_IS_HBDS | PX_IS_HBFS | PX_IS_TFES)
+
+#define PX_TFD_ERR              0x01
+#define PX_TFD_DRQ              0x08
+#define PX_TFD_BSY              0x80
+
+#define PX_SSTS_DET_PRESENT     0x3
+#define PX_SSTS_IPM_ACTIVE      0x1
+#define SATA_SIG_ATA            0x00000101
+
+#define FIS_TYPE_REG_H2D        0x27
+
+#define ATA_CMD_READ_FPDMA_QUEUED  0x60
+#define ATA_CMD_WRITE_FPDMA_QUEUED 0x61
+
+#define AHCI_MAX_PORTS          32
+#define AHCI_MAX_SLOTS          32
+#define AHCI_MAX_DISKS          4
+#define AHCI_PRDT_ENTRIES       32          // One per block-layer segment
+#define AHCI_PRD_MAX_BYTES      0x400000    // 4 MiB per PRD entry
+#define AHCI_MAX_SECTORS        128         // Per command
+#define AHCI_TIMEOUT            5000        // ms
+
+#define AHCI_OP_READ            0
+#define AHCI_OP_WRITE           1
+#define AHCI_OP_FLUSH           2
+
+// Command list entry
+typedef struct {
+    uint16_t flags;           // CFL in dwords, bit 6 write
+    uint16_t prdtl;
+    volatile uint32_t prdbc;  // Bytes transferred
+    uint32_t ctba;
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} __attribute__((packed)) ahci_cmd_header_t;
+
+#define AHCI_CMD_WRITE          (1 << 6)
+
+typedef struct {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;             // Byte count - 1, bit 31 interrupt on completion
+} __attribute__((packed)) ahci_prd_t;
+
+typedef struct {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    ahci_prd_t prdt[AHCI_PRDT_ENTRIES];
+} __attribute__((packed)) ahci_cmd_table_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t flags;            // Bit 7: command, not control
+    uint8_t command;
+    uint8_t feature_lo;
+    uint8_t lba0, lba1, lba2;
+    uint8_t device;
+    uint8_t lba3, lba4, lba5;
+    uint8_t feature_hi;
+    uint8_t count_lo;
+    uint8_t count_hi;
+    uint8_t icc;
+    uint8_t control;
+    uint8_t reserved[4];
+} __attribute__((packed)) fis_reg_h2d_t;
+
+typedef struct ahci_request {
+    uint64_t lba;
+    uint32_t count;
+    blk_seg_t segs[BLK_MAX_SEGS];   // Scatter list covering count sectors
+    uint32_t nsegs;
+    int op;                   // AHCI_OP_*
+    void (*complete)(struct ahci_request *req);  // Optional, after done is set
+    void *private_data;
+    volatile int done;
+    volatile int status;      // 0 on success, -1 on error
+    list_head_t link;         // Port pending queue
+} ahci_request_t;
+
+typedef struct {
+    int port;
+    volatile uint8_t *regs;
+    int ncq;
+    uint32_t queue_depth;     // Slots used: min(HBA slots, drive NCQ depth), 1 without NCQ
+    uint64_t sectors;
+    char model[41];
+
+    ahci_cmd_header_t *cmd_list;
+    uint8_t *fis;
+    ahci_cmd_table_t *tables;
+
+    ahci_request_t *slots[AHCI_MAX_SLOTS];
+    uint32_t issued;          // Slots with a command outstanding
+    int unqueued_active;      // A non-NCQ command owns the port
+    list_head_t pending;
+
+    uint64_t commands;
+    uint64_t errors;
+    uint32_t max_outstanding;
+
+    blkdev_t blk;
+    ahci_request_t blk_reqs[AHCI_MAX_SLOTS];  // Carry block-layer ios
+    uint32_t blk_busy;                        // blk_reqs in use
+} ahci_port_t;
+
+int ahci_init(void);
+
+// Queue a request on a disk; completion sets req->done from the interrupt
+int ahci_submit(ahci_port_t *port, ahci_request_t *req);
+int ahci_wait(ahci_port_t *port, ahci_request_t *req);
+
+void ahci_print_info(void);
+
+#endif // AHCI_H
@@ -0,0 +1,64 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include "irq.h"
+
+// Local APIC register offsets
+#define LAPIC_REG_ID        0x020
+#define LAPIC_REG_VERSION   0x030
+#define LAPIC_REG_TPR       0x080
+#define LAPIC_REG_EOI       0x0B0
+#define LAPIC_REG_SVR       0x0F0
+#define LAPIC_REG_ESR       0x280
+#define LAPIC_REG_LVT_TIMER 0x320
+#define LAPIC_REG_LVT_ERROR 0x370
+
+#define LAPIC_SVR_ENABLE    (1 << 8)
+#define LAPIC_LVT_MASKED    (1 << 16)
+#define IA32_APIC_BASE_MSR  0x1B
+#define IA32_APIC_BASE_EN   (1 << 11)
+
+// I/O APIC registers (indirect through IOREGSEL / IOWIN)
+#define IOAPIC_REG_ID       0x00
+#define IOAPIC_REG_VERSION  0x01
+#define IOAPIC_REG_REDTBL   0x10
+
+#define IOAPIC_ACTIVE_LOW   (1 << 13)
+#define IOAPIC_LEVEL        (1 << 15)
+#define IOAPIC_MASKED       (1 << 16)
+
+#define APIC_SPURIOUS_VECTOR 0xFF
+#define MSI_ADDRESS_BASE     0xFEE00000
+
+#define MAX_IOAPICS 4
+
+// Single MMIO write used by the EOI path; NULL while running on the 8259
+extern volatile uint32_t *lapic_eoi_reg;
+
+int apic_init(void);
+int apic_enabled(void);
+
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+
+// Route an ISA IRQ (through any MADT override) or a PCI INTx line
+// to a vector on this CPU, starting masked.
+int ioapic_route_irq(uint8_t irq, uint8_t vector, int pci);
+void ioapic_mask_irq(uint8_t irq);
+void ioapic_unmask_irq(uint8_t irq);
+int ioapic_irq_masked(uint8_t irq);
+int ioapic_irq_vector(uint8_t irq);
+
+// MSI / MSI-X through PCI capabilities. Return 0 on success.
+int pci_enable_msi(uint8_t bus, uint8_t dev, uint8_t func, uint8_t vector);
+int pci_enable_msix(uint8_t bus, uint8_t dev, uint8_t func, uint8_t vector);
+
+// Give a PCI function its own vector: MSI-X, then MSI, then its INTx line
+// through the I/O APIC, falling back to the shared 8259 line.
+// Returns the vector, or -1.
+int pci_irq_setup(uint8_t bus, uint8_t dev, uint8_t func, irq_handler_t handler);
+
+void apic_print_info(void);
+
+#endif // APIC_H
@@ -13,11 +13,27 @@
 #define ATA_PRIMARY_COMMAND     0x1F7
 #define ATA_PRIMARY_STATUS      0x1F7
 #define ATA_PRIMARY_CONTROL     0x3F6
+#define ATA_PRIMARY_ALTSTATUS   0x3F6   // Read side of CONTROL, does not ack the IRQ
 
-#define ATA_CMD_READ_SECTORS    0x20
-#define ATA_CMD_WRITE_SECTORS   0x30
-#define ATA_CMD_IDENTIFY        0xEC
-#define ATA_CMD_FLUSH_CACHE     0xE7
+#define ATA_CMD_READ_SECTORS       0x20
+#define ATA_CMD_READ_SECTORS_EXT   0x24
+#define ATA_CMD_READ_DMA_EXT       0x25
+#define ATA_CMD_READ_MULTIPLE_EXT  0x29
+#define ATA_CMD_WRITE_SECTORS      0x30
+#define ATA_CMD_WRITE_SECTORS_EXT  0x34
+#define ATA_CMD_WRITE_DMA_EXT      0x35
+#define ATA_CMD_WRITE_MULTIPLE_EXT 0x39
+#define ATA_CMD_READ_MULTIPLE      0xC4
+#define ATA_CMD_WRITE_MULTIPLE     0xC5
+#define ATA_CMD_SET_MULTIPLE       0xC6
+#define ATA_CMD_READ_DMA           0xC8
+#define ATA_CMD_WRITE_DMA          0xCA
+#define ATA_CMD_FLUSH_CACHE        0xE7
+#define ATA_CMD_FLUSH_CACHE_EXT    0xEA
+#define ATA_CMD_IDENTIFY           0xEC
+
+#define ATA_CTRL_NIEN           0x02
+#define ATA_CTRL_SRST           0x04
 
 #define ATA_STATUS_ERR          0x01
 #define ATA_STATUS_IDX          0x02
@@ -32,8 +48,29 @@
 
 #define SECTOR_SIZE             512
 
+#define ATA_LBA28_MAX           0x0FFFFFFF
+#define ATA_MAX_TRANSFER        256     // Sectors per command
+
+typedef struct {
+    int present;
+    int lba48;
+    int dma;                   // Multiword/Ultra DMA supported
+    uint64_t sectors;          // Addressable sectors from IDENTIFY
+    uint16_t multiple;         // Sectors per DRQ block, 0 if READ/WRITE MULTIPLE is off
+    char model[41];
+} ata_device_t;
+
 void ata_init(void);
-int ata_read_sectors(uint32_t lba, uint8_t sector_count, uint8_t *buffer);
-int ata_write_sectors(uint32_t lba, uint8_t sector_count, uint8_t *buffer);
+int ata_read_sectors(uint64_t lba, uint32_t sector_count, uint8_t *buffer);
+int ata_write_sectors(uint64_t lba, uint32_t sector_count, uint8_t *buffer);
+int ata_flush(void);
+const ata_device_t* ata_get_device(void);
+
+// Task file helpers shared with the bus-master DMA path
+int ata_wait_ready(void);
+// SRST the channel and wait for BSY to clear; leaves nIEN set
+int ata_reset_channel(void);
+int ata_needs_ext(uint64_t lba, uint32_t count);
+void ata_setup_command(uint64_t lba, uint32_t count, int ext);
 
 #endif
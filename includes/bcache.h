@@ -0,0 +1,59 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+#include "list.h"
+
+#define BCACHE_BUFFERS          1024    // 512 KB of cached sectors
+#define BCACHE_HASH_SIZE        256
+#define BCACHE_BATCH            32      // Sectors per coalesced disk read
+#define BCACHE_FLUSH_WINDOW     64      // Write-back requests queued at once
+#define BCACHE_FLUSH_INTERVAL   1000    // Flusher period (ms)
+#define BCACHE_DIRTY_EXPIRE     3000    // Age before a dirty sector is written back (ms)
+
+#define BCACHE_VALID            0x01
+#define BCACHE_DIRTY            0x02
+
+typedef struct bcache_buf {
+    uint32_t dev;
+    uint32_t lba;
+    uint32_t flags;
+    uint64_t dirty_since;     // Timer tick of the first write since last flush
+    list_head_t hash_link;    // Bucket chain
+    list_head_t lru_link;     // lru_list, most recently used first
+    uint8_t data[512];
+} bcache_buf_t;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t reads;           // Disk read commands issued
+    uint64_t writes;          // Write requests handed to the block layer
+    uint64_t sectors_written;
+    uint64_t evictions;
+    uint64_t dirty_evictions; // Evictions that had to write back first
+    uint32_t dirty;           // Currently dirty buffers
+    uint32_t cached;          // Currently valid buffers
+} bcache_stats_t;
+
+int bcache_init(void);
+
+// Copy sectors of block device `dev` (a blkdev.h id) through the cache.
+// Writes are write-back: they reach the disk from the flusher thread,
+// on eviction, or on bcache_sync().
+int bcache_read(uint32_t dev, uint32_t lba, uint32_t count, uint8_t *buffer);
+int bcache_write(uint32_t dev, uint32_t lba, uint32_t count, const uint8_t *buffer);
+
+int bcache_sync(void);
+void bcache_invalidate(uint32_t dev);
+
+// Write everything back, then keep the cache, and with it the flusher, off
+// the disks until bcache_resume(). Cache users block meanwhile.
+int bcache_quiesce(void);
+void bcache_resume(void);
+
+void bcache_start_flusher(void);
+void bcache_get_stats(bcache_stats_t *stats);
+void bcache_print_stats(void);
+
+#endif // BCACHE_H
@@ -0,0 +1,118 @@
+#ifndef BLKDEV_H
+#define BLKDEV_H
+
+#include <stdint.h>
+#include "list.h"
+
+#define BLKDEV_MAX      8
+#define BLKDEV_NAME_LEN 16
+#define BLK_SECTOR_SIZE 512
+
+#define BLK_READ            0
+#define BLK_WRITE           1
+
+#define BLK_REQ_SEGS        4       // Segments a caller may hand in per request
+#define BLK_MAX_SEGS        32      // Segments in a merged dispatch
+#define BLK_MAX_SECTORS     128     // Largest merged dispatch
+#define BLK_IO_POOL         64      // Dispatch units shared by all queues
+#define BLK_READ_EXPIRE     500     // ms before a queued read jumps the elevator
+#define BLK_WRITE_EXPIRE    5000
+#define BLK_FIFO_BATCH      16      // Sorted dispatches before directions are reconsidered
+#define BLK_WRITES_STARVED  2       // Read batches allowed while writes wait
+#define BLK_TIMEOUT         5000    // ms before a waiter starts polling the driver
+
+// A run of sectors in memory; a request's segments cover consecutive LBAs
+typedef struct {
+    uint8_t *buffer;
+    uint32_t sectors;
+} blk_seg_t;
+
+// What callers submit. The queue may merge it with neighbours on disk.
+typedef struct blk_request {
+    int op;                   // BLK_READ / BLK_WRITE
+    uint64_t lba;
+    blk_seg_t segs[BLK_REQ_SEGS];
+    uint32_t nsegs;
+    void (*complete)(struct blk_request *req);  // Optional; may run in interrupt context
+    void *private_data;
+    volatile int done;
+    volatile int status;      // 0 on success, -1 on error
+    list_head_t link;         // Owning blk_io_t.requests
+} blk_request_t;
+
+// What the elevator hands a driver: one command's worth of merged requests
+typedef struct blk_io {
+    uint32_t dev;
+    int op;
+    uint64_t lba;
+    uint32_t count;
+    blk_seg_t segs[BLK_MAX_SEGS];
+    uint32_t nsegs;
+    uint64_t expires;         // Tick after which it is dispatched ahead of LBA order
+    list_head_t requests;
+    list_head_t sort_link;    // Queue's per-direction LBA order
+    list_head_t fifo_link;    // Queue's per-direction arrival order, or the free pool
+} blk_io_t;
+
+// A sector-addressed disk. Drivers fill one in and register it; the buffer
+// cache and filesystems address it by the id blkdev_register returns.
+typedef struct blkdev {
+    char name[BLKDEV_NAME_LEN];
+    uint64_t sectors;
+    void *private_data;
+
+    // Synchronous path, used by the queue when there is no submit()
+    int (*read)(struct blkdev *dev, uint64_t lba, uint32_t count, uint8_t *buffer);
+    int (*write)(struct blkdev *dev, uint64_t lba, uint32_t count, uint8_t *buffer);
+
+    // Asynchronous path: start io and finish it later with blk_io_done().
+    // Called with interrupts off, possibly from the completion interrupt.
+    int (*submit)(struct blkdev *dev, blk_io_t *io);
+    void (*poll)(struct blkdev *dev);      // Reap completions with interrupts off
+    uint32_t queue_depth;                  // ios submit() accepts at once
+
+    int (*flush)(struct blkdev *dev);      // Optional: commit the drive write cache
+} blkdev_t;
+
+typedef struct {
+    uint64_t submitted;       // Requests
+    uint64_t merged;          // Requests folded into an existing io
+    uint64_t dispatched;      // ios sent to the driver
+    uint64_t sectors;
+    uint64_t expired;         // ios dispatched by deadline rather than LBA order
+    uint32_t queued;          // ios waiting
+    uint32_t in_flight;
+    uint32_t max_queued;
+} blk_queue_stats_t;
+
+int blkdev_register(blkdev_t *dev);
+blkdev_t* blkdev_get(uint32_t id);
+int blkdev_lookup(const char *name);
+uint32_t blkdev_count(void);
+
+// Blocking helpers on top of the request queue
+int blkdev_read(uint32_t id, uint64_t lba, uint32_t count, uint8_t *buffer);
+int blkdev_write(uint32_t id, uint64_t lba, uint32_t count, uint8_t *buffer);
+int blkdev_flush(uint32_t id);
+
+void blkdev_print_list(void);
+
+// Request queue (blkqueue.c)
+void blk_queue_init(uint32_t id);
+int blk_submit(uint32_t id, blk_request_t *req);
+int blk_wait(uint32_t id, blk_request_t *req);
+
+// While plugged, submissions only queue, so a burst can merge before dispatch.
+// Unplug before waiting on anything submitted in between.
+void blk_plug(uint32_t id);
+void blk_unplug(uint32_t id);
+
+// Stop dispatching and wait for the ios in flight, for code that drives the
+// hardware directly; submissions queue up until blk_resume()
+void blk_quiesce(uint32_t id);
+void blk_resume(uint32_t id);
+
+void blk_io_done(blk_io_t *io, int status);
+void blk_get_queue_stats(uint32_t id, blk_queue_stats_t *stats);
+
+#endif // BLKDEV_H
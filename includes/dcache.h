@@ -0,0 +1,55 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include <stdint.h>
+#include "list.h"
+#include "vfs.h"
+
+#define DCACHE_ENTRIES          512
+#define DCACHE_HASH_SIZE        256
+#define DCACHE_NAME_LEN         64      // Longer names are never cached
+
+// One path component: the name `name` in directory `parent` of `fs`
+typedef struct dentry {
+    filesystem_t *fs;
+    uint32_t parent;          // Inode of the directory holding the name
+    uint32_t hash;
+    uint32_t len;
+    char name[DCACHE_NAME_LEN];
+    vfs_node_t *node;         // NULL for a negative entry (name does not exist)
+    uint32_t refcount;        // Pinned entries are never evicted
+    int hashed;               // Cleared on invalidation, then freed once unpinned
+    list_head_t hash_link;    // Bucket chain
+    list_head_t lru_link;     // lru_list, most recently used first
+} dentry_t;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t negative_hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t invalidations;
+    uint32_t cached;          // Currently hashed entries
+    uint32_t pinned;          // Entries with a nonzero refcount
+} dcache_stats_t;
+
+void dcache_init(void);
+
+// `name` is a path component of `len` bytes and need not be NUL-terminated.
+// Lookups return the cached entry, positive or negative, or NULL on a miss.
+// Both calls pin the entry they return; drop it with dcache_put().
+dentry_t* dcache_lookup(vfs_node_t *dir, const char *name, uint32_t len);
+dentry_t* dcache_add(vfs_node_t *dir, const char *name, uint32_t len, vfs_node_t *node);
+
+void dcache_get(dentry_t *dentry);
+void dcache_put(dentry_t *dentry);
+
+// Drop the entry for one name, every entry inside a directory, or a whole fs
+void dcache_invalidate(vfs_node_t *dir, const char *name, uint32_t len);
+void dcache_invalidate_dir(filesystem_t *fs, uint32_t inode);
+void dcache_invalidate_fs(filesystem_t *fs);
+
+void dcache_get_stats(dcache_stats_t *stats);
+void dcache_print_stats(void);
+
+#endif // DCACHE_H
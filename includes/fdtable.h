@@ -0,0 +1,48 @@
+#ifndef FDTABLE_H
+#define FDTABLE_H
+
+#include <stdint.h>
+#include "list.h"
+#include "vfs.h"
+
+#define FDT_RESERVED    3       // stdin, stdout, stderr: no VFS file behind them
+#define FDT_MIN_SLOTS   64
+#define FDT_MAX_SLOTS   65536   // Summary bitmap stays within 16 words
+
+// A process's descriptors: slot i holds the open file behind fd i. A bit
+// per slot, plus a summary bit per bitmap word that has no free slot left,
+// finds the lowest free descriptor by skipping full words 64 at a time.
+// Every thread of a process uses its table, and a process created by
+// another shares the creator's table until it exits, hence the count.
+typedef struct fd_table {
+    uint32_t refcount;
+    uint32_t size;            // Slots, a multiple of 64
+    uint32_t count;           // Open descriptors
+    file_descriptor_t **files;
+    uint64_t *used;           // Bit per slot
+    uint64_t *full;           // Bit per word of `used` with every bit set
+    list_head_t link;         // All tables
+} fd_table_t;
+
+fd_table_t* fdt_create(void);
+void fdt_get(fd_table_t *fdt);
+// Dropping the last reference closes whatever is still open
+void fdt_put(fd_table_t *fdt);
+
+// The calling thread's process's table, or the kernel's before any
+// process runs
+fd_table_t* fdt_current(void);
+
+// Bind `file` to the lowest free descriptor, growing the table as needed.
+// -1 once FDT_MAX_SLOTS are in use.
+int fdt_alloc(fd_table_t *fdt, file_descriptor_t *file);
+// The file behind fd with a reference taken; drop it with vfs_file_put()
+file_descriptor_t* fdt_lookup(fd_table_t *fdt, int fd);
+// Unbind fd and hand back its file, which the caller releases
+file_descriptor_t* fdt_remove(fd_table_t *fdt, int fd);
+
+// Nonzero if any table has a file of `fs` open
+int fdt_uses_fs(filesystem_t *fs);
+void fdt_print(fd_table_t *fdt);
+
+#endif // FDTABLE_H
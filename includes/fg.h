@@ -3,7 +3,9 @@
 #define FG_H
 
 #include <stdint.h>
+#include "list.h"
 
+// Only bounds the legacy bg_thread_data scratch array; the job table itself is unbounded
 #define MAX_JOBS 32
 
 typedef enum {
@@ -22,6 +24,8 @@ typedef struct {
     int is_background;
     uint64_t sleep_until;
     char command[256];
+    list_head_t link;            // job_list
+    list_head_t thread_link;     // thread_t.jobs of the tracked thread
 } job_t;
 
 typedef struct {
@@ -39,6 +43,8 @@ void remove_job(int job_id);
 void list_jobs(void);
 void list_bg_jobs(void);
 job_t* get_job(int job_id);
+job_t* get_job_by_tid(uint32_t tid);
+int count_active_jobs(void);
 void update_jobs(void);
 void scheduler_enable(void);
 void update_jobs_safe(void);
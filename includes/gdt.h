@@ -34,8 +34,10 @@ struct __attribute__((packed)) TSS64 {
 #define GDT_NULL_ENTRY     0
 #define GDT_KERNEL_CODE    1
 #define GDT_KERNEL_DATA    2
-#define GDT_USER_CODE      3
-#define GDT_USER_DATA      4
+// User data precedes user code: SYSRET loads SS from STAR[63:48]+8
+// and CS from STAR[63:48]+16
+#define GDT_USER_DATA      3
+#define GDT_USER_CODE      4
 #define GDT_TSS_ENTRY      5
 
 // Selector values
@@ -0,0 +1,79 @@
+#ifndef IDE_DMA_H
+#define IDE_DMA_H
+
+#include <stdint.h>
+#include "list.h"
+#include "blkdev.h"
+
+// PCI IDE controller (PIIX3/PIIX4)
+#define PCI_SUBCLASS_IDE         0x01
+#define PCI_IDE_PROGIF_BUSMASTER 0x80
+#define PCI_IDE_PROGIF_NATIVE0   0x01   // Primary channel in PCI native mode
+
+// Bus master registers (BAR4), primary channel; secondary is +8
+#define BM_COMMAND              0x00
+#define BM_STATUS               0x02
+#define BM_PRDT                 0x04
+
+#define BM_CMD_START            0x01
+#define BM_CMD_READ             0x08    // Device to memory
+
+#define BM_STATUS_ACTIVE        0x01
+#define BM_STATUS_ERR           0x02
+#define BM_STATUS_IRQ           0x04
+
+#define IDE_PRIMARY_IRQ         14
+
+#define PRD_EOT                 0x8000
+#define IDE_DMA_PRD_MAX         64      // A segment of up to 64 KiB splits into at most 2
+#define IDE_DMA_BOUNCE_SECTORS  256
+#define IDE_DMA_TIMEOUT         5000    // ms before a request is aborted
+
+// Physical region descriptor: one contiguous run, must not cross 64 KiB
+typedef struct {
+    uint32_t addr;
+    uint16_t bytes;           // 0 means 64 KiB
+    uint16_t flags;
+} __attribute__((packed)) ide_prd_t;
+
+typedef struct ide_dma_request {
+    uint64_t lba;
+    uint32_t count;
+    blk_seg_t segs[BLK_MAX_SEGS];   // Scatter list covering count sectors
+    uint32_t nsegs;
+    int write;
+    void (*complete)(struct ide_dma_request *req);  // Optional, from the IRQ after done is set
+    void *private_data;
+    volatile int done;
+    volatile int status;      // 0 on success, -1 on device or bus error
+    int bounced;              // Data staged through the bounce buffer
+    list_head_t link;         // Pending queue
+} ide_dma_request_t;
+
+typedef struct {
+    uint64_t requests;
+    uint64_t sectors;
+    uint64_t irqs;
+    uint64_t spurious;        // IRQ14 without the bus master IRQ bit (PIO commands)
+    uint64_t bounced;
+    uint64_t errors;
+    uint64_t timeouts;
+    uint32_t max_depth;       // Deepest the pending queue has been
+} ide_dma_stats_t;
+
+int ide_dma_init(void);
+int ide_dma_available(void);
+
+// Queue a request; completion is signalled on IRQ14 by setting req->done.
+// Once DMA is up, the ata0 block device submits through here.
+int ide_dma_submit(ide_dma_request_t *req);
+
+// Block the calling thread (yield, or hlt before the scheduler runs) until done
+int ide_dma_wait(ide_dma_request_t *req);
+
+void ide_dma_get_stats(ide_dma_stats_t *stats);
+
+// Sequential read throughput of PIO against DMA over the first `sectors`
+void ide_dma_benchmark(uint32_t sectors);
+
+#endif // IDE_DMA_H
@@ -0,0 +1,44 @@
+#ifndef IDR_H
+#define IDR_H
+
+#include <stdint.h>
+
+// Radix-tree ID allocator: maps small integer IDs to pointers.
+// Each layer resolves IDR_BITS of the ID, so lookup, insert and
+// removal cost O(log64 n) and free-ID search skips full subtrees
+// through a per-layer bitmap.
+#define IDR_BITS       6
+#define IDR_SIZE       (1 << IDR_BITS)
+#define IDR_MASK       (IDR_SIZE - 1)
+#define IDR_MAX_LAYERS 6
+#define IDR_ID_MAX     0x7FFFFFFF
+
+typedef struct idr_layer {
+    uint64_t full;               // Bit set: leaf slot used / child subtree full
+    uint64_t present;            // Bit set: slot non-empty
+    void *slots[IDR_SIZE];
+} idr_layer_t;
+
+typedef struct {
+    idr_layer_t *top;
+    int layers;                  // Tree height, 0 when empty
+    uint32_t base;               // Lowest ID ever handed out
+    uint32_t cursor;             // Next ID tried by idr_alloc
+    uint32_t count;
+} idr_t;
+
+void idr_init(idr_t *idr, uint32_t base);
+
+// Allocate the next free ID at or after the cursor (wrapping to base)
+// and bind it to ptr. Returns the ID, or -1 when out of memory / IDs.
+int idr_alloc(idr_t *idr, void *ptr);
+
+void* idr_find(idr_t *idr, uint32_t id);
+void* idr_remove(idr_t *idr, uint32_t id);
+
+// Return the entry with the smallest ID >= *id and store that ID in *id.
+void* idr_get_next(idr_t *idr, uint32_t *id);
+
+uint32_t idr_count(idr_t *idr);
+
+#endif // IDR_H
@@ -6,6 +6,51 @@
 
 typedef void (*irq_handler_t)(void);
 
+#define IRQ_VECTOR_BASE      32      // Legacy IRQ n arrives on vector 32 + n
+#define IRQ_VECTOR_DYN_FIRST 0x30    // First vector handed out by irq_alloc_vector
+#define IRQ_VECTOR_DYN_LAST  0xEF
+#define IRQ_SHARED_MAX       4       // Handlers chained on one vector
+
+
+// IRQ-off window accounting (irqstat.c); a window opens when IF goes 1 -> 0
+void irqoff_begin(const char *func, int line);
+void irqoff_end(void);
+
+static inline uint64_t irq_save_at(const char *func, int line) {
+    uint64_t flags;
+    __asm__ volatile("pushfq\n pop %0\n cli" : "=r"(flags) : : "memory");
+    if (flags & 0x200) {
+        irqoff_begin(func, line);
+    }
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & 0x200) {
+        irqoff_end();
+        __asm__ volatile("sti" : : : "memory");
+    }
+}
+
+static inline void irq_disable_at(const char *func, int line) {
+    __asm__ volatile("cli" : : : "memory");
+    irqoff_begin(func, line);
+}
+
+static inline void irq_enable(void) {
+    irqoff_end();
+    __asm__ volatile("sti" : : : "memory");
+}
+
+static inline int irq_enabled(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq\n pop %0" : "=r"(flags) : : "memory");
+    return (flags & 0x200) != 0;
+}
+
+#define irq_save()    irq_save_at(__func__, __LINE__)
+#define irq_disable() irq_disable_at(__func__, __LINE__)
+
 
 void pic_send_eoi(int irq);
 
@@ -20,6 +65,22 @@ void irq_uninstall_handler(int irq);
 void irq_common_handler(int irq_num);
 
 
+// Route-independent line control: I/O APIC when enabled, 8259 otherwise
+void irq_mask(uint8_t irq);
+void irq_unmask(uint8_t irq);
+int irq_is_masked(uint8_t irq);
+void irq_send_eoi(int irq);
+
+
+int irq_alloc_vector(void);
+void irq_free_vector(int vector);
+int irq_install_vector(int vector, irq_handler_t handler);
+void irq_uninstall_vector(int vector, irq_handler_t handler);
+
+// Entry from the irq_stub_table stubs
+void irq_dispatch(uint64_t vector);
+
+
 void pit_init(uint32_t frequency);
 
 void timer_irq_handler(void);
@@ -0,0 +1,45 @@
+#ifndef IRQSTAT_H
+#define IRQSTAT_H
+
+#include <stdint.h>
+
+// Latency histograms are log2 of TSC cycles: bucket 0 holds < 2^IRQSTAT_HIST_SHIFT,
+// bucket n holds [2^(n+SHIFT-1), 2^(n+SHIFT)), the last bucket is open-ended.
+#define IRQSTAT_HIST_BUCKETS 16
+#define IRQSTAT_HIST_SHIFT   8
+#define IRQSTAT_MAX_NESTING  8
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+    uint32_t hist[IRQSTAT_HIST_BUCKETS];
+} irqstat_vector_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+    const char *max_func;    // Where the longest window was opened
+    int max_line;            // Source line, or the vector for handler windows
+    uint32_t hist[IRQSTAT_HIST_BUCKETS];
+} irqstat_off_t;
+
+// Handler bracketing; interrupts are off between the two
+void irqstat_enter(uint64_t vector);
+void irqstat_exit(uint64_t vector);
+
+// Called before a context switch: closes every in-flight handler
+// so time spent in other threads is not charged to them
+void irqstat_switch(void);
+
+void irqstat_reset(void);
+uint64_t irqstat_tsc_per_us(void);
+const irqstat_vector_t* irqstat_get(uint8_t vector);
+const irqstat_off_t* irqstat_get_off(void);
+
+// Shell: no argument prints the summary, a vector number prints its
+// histogram, "reset" clears everything
+void irqstat_command(const char *arg);
+
+#endif // IRQSTAT_H
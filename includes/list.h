@@ -0,0 +1,69 @@
+#ifndef LIST_H
+#define LIST_H
+
+#include <stddef.h>
+
+// Intrusive doubly linked list. Embed a list_head_t in the owning struct
+// and recover the owner with list_entry().
+typedef struct list_head {
+    struct list_head *next;
+    struct list_head *prev;
+} list_head_t;
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+
+#define container_of(ptr, type, member) \
+    ((type*)((char*)(ptr) - offsetof(type, member)))
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define list_first_entry(head, type, member) \
+    list_entry((head)->next, type, member)
+
+static inline void list_init(list_head_t *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static inline int list_empty(const list_head_t *head) {
+    return head->next == head;
+}
+
+static inline void list_insert(list_head_t *node, list_head_t *prev, list_head_t *next) {
+    next->prev = node;
+    node->next = next;
+    node->prev = prev;
+    prev->next = node;
+}
+
+// Insert right after head (stack order)
+static inline void list_add(list_head_t *node, list_head_t *head) {
+    list_insert(node, head, head->next);
+}
+
+// Insert right before head (queue order)
+static inline void list_add_tail(list_head_t *node, list_head_t *head) {
+    list_insert(node, head->prev, head);
+}
+
+// Unlink and re-initialise, so deleting a detached node is a no-op
+static inline void list_del(list_head_t *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = node;
+    node->prev = node;
+}
+
+#define list_for_each_entry(pos, head, type, member)                 \
+    for (pos = list_entry((head)->next, type, member);               \
+         &pos->member != (head);                                     \
+         pos = list_entry(pos->member.next, type, member))
+
+// Safe against removal of pos while iterating
+#define list_for_each_entry_safe(pos, tmp, head, type, member)       \
+    for (pos = list_entry((head)->next, type, member),               \
+         tmp = list_entry(pos->member.next, type, member);           \
+         &pos->member != (head);                                     \
+         pos = tmp, tmp = list_entry(tmp->member.next, type, member))
+
+#endif // LIST_H
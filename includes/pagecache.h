@@ -0,0 +1,57 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stdint.h>
+#include "list.h"
+#include "vfs.h"
+
+#define PCACHE_PAGE_SIZE        4096
+#define PCACHE_PAGES            512     // 2 MB of cached file data
+#define PCACHE_HASH_SIZE        256
+#define PCACHE_RA_MIN           4       // Pages read ahead on the first sequential read
+#define PCACHE_RA_MAX           32      // Window cap (128 KB)
+
+#define PCACHE_VALID            0x01
+
+// One page of a file, backed by a physical page so it can be mapped
+typedef struct pcache_page {
+    filesystem_t *fs;
+    uint32_t inode;
+    uint32_t index;           // Page number within the file
+    uint32_t flags;
+    uint32_t refcount;        // Pinned pages (mapped ones) are never evicted; atomic
+    uint8_t *data;
+    list_head_t hash_link;    // Bucket chain
+    list_head_t lru_link;     // lru_list, most recently used first
+} pcache_page_t;
+
+typedef struct {
+    uint64_t hits;            // Pages found cached
+    uint64_t misses;          // Pages that had to be read
+    uint64_t readahead;       // Pages read before they were asked for
+    uint64_t fills;           // Read calls made to filesystems
+    uint64_t evictions;
+    uint32_t cached;
+} pcache_stats_t;
+
+int pcache_init(void);
+
+// Read through the cache. Only regular files are cached; others go
+// straight to the filesystem.
+int pcache_read(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset, vfs_readahead_t *ra);
+
+// Writes go to the filesystem first; this brings cached pages up to date
+void pcache_write(vfs_node_t *node, const uint8_t *buffer, uint32_t size, uint32_t offset);
+
+// Pinned page for mapping; NULL past end of file, for RAM filesystems
+// (nothing to cache) or when every page is pinned
+pcache_page_t* pcache_get_page(vfs_node_t *node, uint32_t index);
+void pcache_put_page(pcache_page_t *page);
+
+void pcache_invalidate(filesystem_t *fs, uint32_t inode);
+void pcache_invalidate_fs(filesystem_t *fs);
+
+void pcache_get_stats(pcache_stats_t *stats);
+void pcache_print_stats(void);
+
+#endif // PAGECACHE_H
@@ -4,12 +4,21 @@
 
 #include <stdint.h>
 
+// Field offsets are used by syscall_entry through %gs
+#define PERCPU_KERNEL_STACK 0
+#define PERCPU_USER_STACK   8
+#define PERCPU_USER_MODE    32
+
+#define MSR_GS_BASE         0xC0000101
+#define MSR_KERNEL_GS_BASE  0xC0000102
+
 typedef struct {
-    uint64_t kernel_stack;
-    uint64_t user_stack;
+    uint64_t kernel_stack;   // Running thread's kernel stack, for ring 3 callers
+    uint64_t user_stack;     // Caller RSP, scratch during syscall entry
     uint32_t cpu_id;
     uint32_t current_tid;
     void *scratch;
+    uint64_t user_mode;      // Running thread's thread_t.user_mode
 } __attribute__((packed)) percpu_t;
 
 void percpu_init(void);
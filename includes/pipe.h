@@ -0,0 +1,57 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <stdint.h>
+#include "process.h"
+#include "vfs.h"
+
+#define PIPE_PAGE_SIZE  4096
+#define PIPE_SLOTS      16      // Pages in flight: 64 KB between writer and reader
+
+struct pcache_page;
+
+// One page of pipe data. Written bytes land in pages the pipe owns;
+// spliced ones stay in the page cache page they came from, pinned until
+// the reader is done with it.
+typedef struct pipe_slot {
+    uint8_t *data;
+    struct pcache_page *cached;   // Set for spliced pages
+    uint32_t start;               // Next unread byte
+    uint32_t end;                 // One past the last written byte
+} pipe_slot_t;
+
+// A ring of page slots between one writer and one reader. Each side only
+// advances its own index; a writer with every slot full, or a reader with
+// none, sleeps until the other side moves. Reads see end of file once the
+// last writer is gone, and writes fail once the last reader is.
+typedef struct pipe {
+    pipe_slot_t slots[PIPE_SLOTS];
+    uint32_t head;                // Slots ever filled (writer)
+    uint32_t tail;                // Slots ever drained (reader)
+    uint32_t readers;
+    uint32_t writers;
+    uint8_t *spare;               // A drained page kept for the next fill
+    wait_queue_t read_wait;
+    wait_queue_t write_wait;
+    uint64_t bytes_copied;
+    uint64_t bytes_spliced;
+} pipe_t;
+
+// A pipe with one reader and one writer
+pipe_t* pipe_create(void);
+// Drop one end; the pipe is freed with the last of them
+void pipe_close_reader(pipe_t *pipe);
+void pipe_close_writer(pipe_t *pipe);
+
+// Blocks until something can be read; 0 once empty with no writers left
+int pipe_read(pipe_t *pipe, uint8_t *buffer, uint32_t size);
+// Blocks while the pipe is full; -1 once there are no readers
+int pipe_write(pipe_t *pipe, const uint8_t *buffer, uint32_t size);
+// Queue len bytes at `offset` in a pinned page cache page without copying
+// them; the pipe takes over the pin. -1 (pin untouched) with no readers.
+int pipe_splice_page(pipe_t *pipe, struct pcache_page *page, uint32_t offset, uint32_t len);
+
+// VFS node for one end, FILE_TYPE_PIPE; closing it closes that end
+vfs_node_t* pipe_open_end(pipe_t *pipe, int write_end);
+
+#endif // PIPE_H
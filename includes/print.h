@@ -50,21 +50,12 @@ typedef struct {
     size_t read_pos;
 } Buffer;
 
-typedef struct {
-    int fd;
-    int type;
-    void *buffer;
-    size_t pos;
-    size_t size;
-} FileDescriptor;
-
 extern Framebuffer fb;
 extern Cursor cursor;
 extern EFI_GRAPHICS_OUTPUT_PROTOCOL *gop;
 extern Buffer stdin_buf;
 extern Buffer stdout_buf;
 extern Buffer stderr_buf;
-extern FileDescriptor fd_table[256];
 
 extern int uefi_active;
 
@@ -96,7 +87,6 @@ void printk(uint32_t text_fg, uint32_t text_bg,
 void SetCursorPos(uint32_t x, uint32_t y) NO_THROW;
 void SetColors(uint32_t fg, uint32_t bg) NO_THROW;
 void ClearScreen(uint32_t color) NO_THROW OPT_O3;
-void init_fds() NO_THROW;
 void buf_write(Buffer *buf, const char *str) NO_THROW NON_NULL(1,2);
 
 #endif
\ No newline at end of file
@@ -2,10 +2,9 @@
 #define PROCESS_H
 
 #include <stdint.h>
+#include "list.h"
 
-#define MAX_PROCESSES 64
-#define MAX_THREADS_PER_PROCESS 16
-#define MAX_THREADS_GLOBAL 256
+#define THREAD_KSTACK_SIZE 16384
 
 // Thread states
 typedef enum {
@@ -48,6 +47,8 @@ typedef struct {
 } deadline_params_t;
 
 struct process_t;
+struct fd_table;
+struct pipe;
 
 // Thread structure
 typedef struct thread_t {
@@ -57,31 +58,48 @@ typedef struct thread_t {
     cpu_context_t context;
     void *stack_base;
     uint32_t stack_size;
+    void *kernel_stack;      // THREAD_KSTACK_SIZE bytes: SYSCALL and interrupts from ring 3
+    uint8_t user_mode;       // Runs at CPL 3; set by whatever drops it there
     uint64_t stack_pointer;  // Deprecated, use context.rsp
     deadline_params_t sched;
     uint64_t last_scheduled;
-    struct thread_t *next;   // For ready queue
+    list_head_t run_link;    // Ready queue / zombie list
+    list_head_t proc_link;   // Parent's thread list
+    list_head_t global_link; // thread_list
+    list_head_t jobs;        // Jobs tracking this thread (job_t.thread_link)
     int used;
     void *private_data;
     uint64_t entry_point;
     uint64_t sleep_until;
+    list_head_t wait_link;   // wait_queue_t.waiters, or the timed sleep list
+    struct pipe *pipe_in;    // Pipeline stage input, if any
+    struct pipe *pipe_out;   // When set, printk output goes here, not the screen
 } thread_t;
 
+// Threads blocked until someone calls wait_queue_wake()
+typedef struct wait_queue {
+    list_head_t waiters;
+} wait_queue_t;
+
 // Process structure
 typedef struct process_t {
     uint32_t pid;
+    uint32_t ppid;           // Creating process, 0 for those made at boot
     uint64_t memory_space;
     process_state_t state;
-    thread_t *threads[MAX_THREADS_PER_PROCESS];
+    list_head_t threads;     // thread_t.proc_link
     uint32_t thread_count;
+    list_head_t link;        // process_list
     uint8_t used;
     char name[64];
+    struct fd_table *files;  // Shared with the creating process
 } process_t;
 
 // Process management
 void process_init(void);
 int process_create(const char *name, uint64_t memory_space);
 process_t* get_process(uint32_t pid);
+void process_remove(process_t *proc);
 void print_process_table(void);
 
 // Thread management
@@ -93,6 +111,16 @@ void thread_exit(void);
 void thread_yield(void);
 void thread_block(uint32_t tid);
 void thread_unblock(uint32_t tid);
+// Block the calling thread until get_timer_ticks() reaches tick
+void thread_sleep_until(uint64_t tick);
+
+void wait_queue_init(wait_queue_t *wq);
+// Block the calling thread on wq. Call with interrupts saved off, after
+// rechecking the condition; they are back on when this returns. -1 (and
+// no sleep) when there is no thread to block.
+int wait_queue_sleep(wait_queue_t *wq);
+// Make every waiter runnable again
+void wait_queue_wake(wait_queue_t *wq);
 
 // Scheduler
 void scheduler_init(void);
@@ -104,8 +132,16 @@ void schedule(void);
 // Kernel threads
 void init_kernel_threads(void);
 
-// Global tables
-extern process_t process_table[MAX_PROCESSES];
-extern thread_t thread_table[MAX_THREADS_GLOBAL];
+// Global lists, IDR-indexed by PID/TID for lookup
+extern list_head_t process_list;
+extern list_head_t thread_list;
+
+#define for_each_process(p) list_for_each_entry(p, &process_list, process_t, link)
+#define for_each_thread(t)  list_for_each_entry(t, &thread_list, thread_t, global_link)
+#define for_each_process_thread(proc, t) \
+    list_for_each_entry(t, &(proc)->threads, thread_t, proc_link)
+
+uint32_t process_count(void);
+uint32_t thread_count_global(void);
 
 #endif // PROCESS_H
\ No newline at end of file
@@ -0,0 +1,114 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include <stdint.h>
+
+#define MAX_SYSCALLS 128
+
+// MSRs programmed by syscall_init
+#define MSR_EFER    0xC0000080
+#define MSR_STAR    0xC0000081
+#define MSR_LSTAR   0xC0000082
+#define MSR_SFMASK  0xC0000084
+
+#define EFER_SCE    (1 << 0)
+
+// Flags cleared on entry: IF, TF, DF, AC
+#define SYSCALL_RFLAGS_MASK 0x40700
+
+// Process and thread
+#define SYS_EXIT            0
+#define SYS_FORK            1
+#define SYS_GETPID          2
+#define SYS_GETPPID         3
+#define SYS_GETTID          4
+#define SYS_THREAD_CREATE   6
+#define SYS_THREAD_EXIT     7
+#define SYS_THREAD_YIELD    8
+#define SYS_SLEEP           10
+#define SYS_SLEEP_MS        11
+
+// Memory
+#define SYS_MALLOC          12
+#define SYS_FREE            13
+
+// Files
+#define SYS_OPEN            20
+#define SYS_CLOSE           21
+#define SYS_READ            22
+#define SYS_WRITE           23
+#define SYS_LSEEK           24
+#define SYS_STAT            25
+#define SYS_UNLINK          27
+#define SYS_PREAD           28
+#define SYS_PWRITE          29
+#define SYS_READV           30
+#define SYS_WRITEV          31
+#define SYS_PIPE            32
+#define SYS_MKDIR           40
+#define SYS_RMDIR           41
+#define SYS_CHDIR           42
+#define SYS_GETCWD          43
+
+// Time
+#define SYS_UPTIME          63
+#define SYS_GETTIME         64
+
+// Debug
+#define SYS_DEBUG_PRINT     100
+#define SYS_NULL            127
+
+typedef int64_t (*syscall_fn_t)(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+
+typedef struct {
+    uint8_t type;
+    uint32_t size;
+    uint32_t inode;
+    uint32_t permissions;
+} syscall_stat_t;
+
+void syscall_init(void);
+void syscall_register_all(void);
+int64_t syscall_handler(uint64_t num, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+
+// Issue SYSCALL from ring 0 (kernel threads, tests)
+int64_t syscall_invoke(uint64_t num, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+
+void test_syscall_interface(void);
+
+// Handlers
+int64_t sys_exit(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_getpid(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_getppid(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_gettid(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_thread_create(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_thread_exit(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_thread_yield(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_sleep(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_sleep_ms(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+
+int64_t sys_malloc(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_free(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+
+int64_t sys_open(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_close(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_read(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_write(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_lseek(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_stat(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_pread(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_pwrite(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_readv(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_writev(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_pipe(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_unlink(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_mkdir(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_rmdir(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_chdir(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_getcwd(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+
+int64_t sys_uptime(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_gettime(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+int64_t sys_debug_print(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+
+#endif // SYSCALL_H
@@ -3,21 +3,99 @@
 
 #include <stdint.h>
 #include "vfs.h"
+#include "list.h"
 
-#define TINYFS_MAGIC 0x54494E59
-#define TINYFS_BLOCK_SIZE 512
+#define TINYFS_MAGIC 0x54494E59     // v1: FAT block chains
+#define TINYFS2_MAGIC 0x32594E54    // v2: extents, fixed 512 KiB geometry
+#define TINYFS3_MAGIC 0x33594E54    // v3: extents, bitmap, sized to the device
+#define TINYFS_BLOCK_SIZE 4096      // Block size of newly formatted volumes
+#define TINYFS_SECTOR_SIZE 512
 #define TINYFS_MAX_FILENAME 32
-#define TINYFS_MAX_FILES 256
+#define TINYFS_MIN_FILES 256
+#define TINYFS_MAX_FILES 65536
+#define TINYFS_BLOCKS_PER_FILE 16   // Directory entries are sized one per this many blocks
+#define TINYFS_EXTENTS 7
 
+// Metadata journal of newly formatted volumes. Changes are grouped into
+// one transaction until it reaches the block threshold or the interval
+// passes, both tunable at run time.
+#define TINYFS_JOURNAL_MAGIC 0x4C4E524A     // "JRNL"
+#define TINYFS_JOURNAL_BLOCKS 64
+#define TINYFS_JOURNAL_DESC 1
+#define TINYFS_JOURNAL_COMMIT 2
+#define TINYFS_COMMIT_INTERVAL 500          // ms
+#define TINYFS_COMMIT_BLOCKS 32
+#define TINYFS_COMMIT_MAX (TINYFS_JOURNAL_BLOCKS / 2)   // Threshold cap: the rest is headroom
+
+// v1 and v2 volumes: 1024 blocks of 512 bytes, FAT/map at 1, directory at
+// 11, data at 101. They keep that geometry when upgraded to v3.
+#define TINYFS_LEGACY_BLOCKS 1024
+#define TINYFS_LEGACY_MAP_BLOCKS 10
+#define TINYFS_LEGACY_DIR_BLOCKS 90
+#define TINYFS_LEGACY_FILES 256
+
+// Region offsets and sizes are in blocks of block_size bytes
 typedef struct {
     uint32_t magic;
     uint32_t total_blocks;
-    uint32_t fat_start;
+    uint32_t map_start;      // v1 FAT, v2 uint32_t map, v3 free-space bitmap
     uint32_t dir_start;
     uint32_t data_start;
     uint32_t free_blocks;
+
+    // v3 only, zero on older volumes
+    uint32_t block_size;
+    uint32_t map_blocks;
+    uint32_t dir_blocks;
+    uint32_t max_files;
+
+    // Zero on volumes formatted without a journal
+    uint32_t journal_start;
+    uint32_t journal_blocks;
+    uint32_t journal_seq;    // Last transaction written back in place
 } tinyfs_superblock_t;
 
+// First block of a transaction (descriptor) and the block after its logged
+// copies (commit). The descriptor lists where each copy belongs; the commit
+// carries a checksum of the copies, so a torn transaction is never replayed.
+typedef struct {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t seq;
+    uint32_t count;
+    uint32_t checksum;
+    uint32_t blocks[];
+} tinyfs_journal_header_t;
+
+typedef struct {
+    uint64_t commits;
+    uint64_t ops;             // Metadata updates folded into those commits
+    uint64_t blocks_logged;
+    uint64_t direct;          // Writebacks too large for the journal
+    uint64_t overflows;       // Of those, ones on a mounted volume rather than at mount
+    uint64_t replays;
+    uint32_t interval_ms;
+    uint32_t max_blocks;
+} tinyfs_journal_stats_t;
+
+// A run of blocks: file blocks logical..logical+length-1 live at start..
+typedef struct {
+    uint32_t logical;
+    uint32_t start;
+    uint32_t length;
+} tinyfs_extent_t;
+
+typedef struct {
+    char name[TINYFS_MAX_FILENAME];
+    uint32_t size;
+    uint32_t parent_inode;
+    uint8_t is_directory;
+    uint8_t used;
+    uint16_t nextents;
+    tinyfs_extent_t extents[TINYFS_EXTENTS];   // Ascending, logically contiguous
+} tinyfs_dirent_t;
+
+// v1 directory entry, only read when upgrading a volume
 typedef struct {
     char name[TINYFS_MAX_FILENAME];
     uint32_t first_block;
@@ -26,16 +104,59 @@ typedef struct {
     uint8_t used;
     uint32_t parent_inode;
     uint8_t padding[2];
-} tinyfs_dirent_t;
+} tinyfs_dirent_v1_t;
+
+// In-memory directory index, rebuilt from the directory at mount
+typedef struct {
+    list_head_t hash_link;       // Bucket chain, keyed by parent and name
+    list_head_t sibling_link;    // Parent's children list
+    list_head_t children;        // Directories: their entries, in creation order
+    vfs_node_t *node;            // Cached node handed out by lookups
+    uint32_t opens;
+} tinyfs_inode_t;
 
 typedef struct {
     tinyfs_superblock_t sb;
-    uint32_t fat[1024];
-    tinyfs_dirent_t dirents[TINYFS_MAX_FILES];
+    uint32_t block_size;
+    uint32_t sectors_per_block;
+    uint32_t dirents_per_block;
+
+    // In-memory copies of the on-disk regions, laid out exactly as on disk
+    uint8_t *bitmap;             // Bit per block, set = in use
+    tinyfs_dirent_t *dirents;    // sb.max_files entries
+
+    tinyfs_inode_t *inodes;      // Parallel to dirents; inode 0 is the root
+    list_head_t *hash;
+    uint32_t hash_mask;
+
+    uint32_t alloc_cursor;       // Next-fit: free space searches start here
+    uint8_t *scratch;            // One block for partial block I/O
     char device[32];
+    uint32_t dev;                // blkdev id of device
+
+    // Metadata blocks changed in memory since the last writeback
+    int sb_dirty;
+    uint32_t *map_dirty;         // Bit per bitmap block
+    uint32_t *dir_dirty;         // Bit per directory block
+
+    // Open transaction: updates since the last commit
+    uint32_t txn_ops;
+    uint64_t txn_since;          // Timer tick of the first of them
+    list_head_t mount_link;      // Mounted instances, for the commit thread
+    int live;                    // On that list; mount-time rewrites are done
+    uint8_t *journal_buf;        // Descriptor or commit block being built
 } tinyfs_data_t;
 
 int tinyfs_format(const char *device);
+
+// 0 if `device` holds a tinyfs volume (any version) that can be mounted
+int tinyfs_probe(const char *device);
+
+// Commit thread for journaled volumes; until it runs, every update commits
+void tinyfs_start_journal(void);
+void tinyfs_set_commit(uint32_t interval_ms, uint32_t max_blocks);
+void tinyfs_get_journal_stats(tinyfs_journal_stats_t *stats);
+void tinyfs_print_journal_stats(void);
 filesystem_t* tinyfs_create(void);
 static int strcmp_safe(const char *s1, const char *s2);
-#endif
\ No newline at end of file
+#endif
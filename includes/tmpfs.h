@@ -0,0 +1,50 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include <stdint.h>
+#include "vfs.h"
+#include "list.h"
+
+#define TMPFS_PAGE_SIZE         4096
+#define TMPFS_MAX_PAGES         4096    // 16 MB per mount, less when memory is short
+#define TMPFS_HASH_MIN          64      // Buckets at mount; doubled as the tree grows
+#define TMPFS_MAX_FILENAME      64
+
+// A file or directory. The vfs_node is embedded, so nodes handed to the
+// VFS live exactly as long as the inode.
+typedef struct tmpfs_inode {
+    vfs_node_t node;
+    struct tmpfs_inode *parent;   // NULL for the root and for removed inodes
+    uint32_t hash;
+    uint32_t seq;                 // Position in the parent's listing
+    uint32_t opens;
+    list_head_t hash_link;        // Instance name hash: (parent, name)
+    list_head_t sibling_link;     // Parent's children, in seq order
+    list_head_t inode_link;       // Every inode of the instance
+
+    // Directories
+    list_head_t children;
+    uint32_t next_seq;
+    struct tmpfs_inode *cursor;   // Last child a readdir_next returned
+
+    // Regular files: page i holds bytes i*4096.., NULL pages read as zeros
+    uint8_t **pages;
+    uint32_t page_slots;
+} tmpfs_inode_t;
+
+// One mount. Every filesystem_t carries its own, so one type can be
+// mounted any number of times.
+typedef struct {
+    tmpfs_inode_t *root;
+    list_head_t inodes;
+    list_head_t *hash;
+    uint32_t hash_mask;
+    uint32_t entries;
+    uint32_t next_inode;
+    uint32_t max_pages;
+    uint32_t used_pages;
+} tmpfs_data_t;
+
+filesystem_t* tmpfs_create(void);
+
+#endif // TMPFS_H
@@ -4,7 +4,7 @@
 #include <stdint.h>
 
 #define MAX_FILENAME 256
-#define MAX_OPEN_FILES 256
+#define VFS_MAX_MOUNTS 16
 
 #define FILE_TYPE_REGULAR    0x01
 #define FILE_TYPE_DIRECTORY  0x02
@@ -26,12 +26,22 @@
 typedef struct vfs_node vfs_node_t;
 typedef struct filesystem filesystem_t;
 
+#define VFS_IOV_MAX 1024    // Segments accepted by one readv/writev
+
+// One segment of a scatter/gather list
+typedef struct vfs_iovec {
+    void *base;
+    uint64_t len;
+} vfs_iovec_t;
+
 typedef struct vfs_operations {
     int (*open)(vfs_node_t *node, uint32_t flags);
     int (*close)(vfs_node_t *node);
     int (*read)(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset);
     int (*write)(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset);
+    int64_t (*writev)(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, uint64_t offset);
     vfs_node_t* (*readdir)(vfs_node_t *node, uint32_t index);
+    vfs_node_t* (*readdir_next)(vfs_node_t *node, uint32_t *cookie);
     vfs_node_t* (*finddir)(vfs_node_t *node, const char *name);
     int (*create)(vfs_node_t *parent, const char *name, uint8_t type, uint32_t permissions);
     int (*unlink)(vfs_node_t *parent, const char *name);
@@ -48,6 +58,13 @@ struct vfs_node {
     void *private_data;
 };
 
+// Directory cursor. Nodes returned by readdir/finddir belong to the
+// filesystem and must not be freed.
+typedef struct vfs_dir {
+    vfs_node_t *node;
+    uint32_t cookie;          // Filesystem's resume position, 0 at the start
+} vfs_dir_t;
+
 typedef struct fs_stats {
     uint32_t total_blocks;
     uint32_t free_blocks;
@@ -59,17 +76,57 @@ typedef struct filesystem_operations {
     int (*unmount)(filesystem_t *fs);
     vfs_node_t* (*get_root)(filesystem_t *fs);
     int (*get_stats)(filesystem_t *fs, fs_stats_t *stats);
+    int (*sync)(filesystem_t *fs);      // Optional: push out metadata held back in memory
 } filesystem_operations_t;
 
+// filesystem_t flags
+#define FS_FLAG_RAM 0x01    // File data already lives in memory; reads skip the page cache
+#define FS_FLAG_RDONLY 0x02 // Mounted read-only; set by the VFS
+
+// vfs_mount_flags() flags
+#define MOUNT_READONLY 0x01
+
 struct filesystem {
     char name[32];
     filesystem_operations_t *ops;
+    uint32_t flags;
     void *private_data;
 };
 
+// Per open file: where a sequential reader is expected next, and how far
+// ahead of it the page cache reads
+typedef struct vfs_readahead {
+    uint32_t next;
+    uint32_t window;          // Pages; 0 until the access looks sequential
+} vfs_readahead_t;
+
+// vfs_mmap() protection
+#define VFS_PROT_READ  0x01
+#define VFS_PROT_WRITE 0x02
+
+// A file range mapped from the page cache. There are no per-process page
+// tables to fault through, so a mapping is walked with vfs_map_get(): a
+// page is brought in on first touch and stays pinned until vfs_munmap().
+// Everyone mapping a file shares the same cached pages, and writes made
+// through the VFS show up in them.
+typedef struct vfs_map {
+    vfs_node_t *node;
+    struct dentry *dentry;    // Pinned like an open file's
+    uint32_t offset;          // File offset of byte 0, page aligned
+    uint32_t length;
+    uint32_t prot;
+    uint32_t faults;          // Pages brought in so far
+    struct pcache_page **pages;
+    struct vfs_map *next;     // Live mappings
+} vfs_map_t;
+
+// An open file. Descriptor tables point at it; it goes away with the
+// last reference.
 typedef struct file_descriptor {
-    int used;
+    uint32_t refcount;
     vfs_node_t *node;
+    struct dentry *dentry;    // Pinned in the dentry cache while open
+    vfs_readahead_t ra;
     uint32_t position;
     uint32_t flags;
 } file_descriptor_t;
@@ -77,6 +134,10 @@ typedef struct file_descriptor {
 void vfs_init(void);
 int vfs_register_filesystem(filesystem_t *fs);
 int vfs_mount(const char *fs_type, const char *device, const char *mountpoint);
+int vfs_mount_flags(const char *fs_type, const char *device, const char *mountpoint, uint32_t flags);
+int vfs_unmount(const char *mountpoint);
+void vfs_list_mounts(void);
+int vfs_sync(void);
 
 int vfs_open(const char *path, uint32_t flags);
 int vfs_close(int fd);
@@ -84,7 +145,36 @@ int vfs_read(int fd, uint8_t *buffer, uint32_t size);
 int vfs_write(int fd, uint8_t *buffer, uint32_t size);
 int vfs_seek(int fd, int offset, int whence);
 
+void vfs_file_get(file_descriptor_t *file);
+void vfs_file_put(file_descriptor_t *file);
+
+// Scatter/gather and positional I/O. pread/pwrite leave the file position
+// alone; a filesystem with a writev op receives the whole list in one call.
+int64_t vfs_readv(int fd, const vfs_iovec_t *iov, int iovcnt);
+int64_t vfs_writev(int fd, const vfs_iovec_t *iov, int iovcnt);
+int64_t vfs_pread(int fd, void *buffer, uint64_t size, uint64_t offset);
+int64_t vfs_pwrite(int fd, const void *buffer, uint64_t size, uint64_t offset);
+
+// Map len bytes (0: to end of file) from a page-aligned offset. Read-only;
+// the mapping outlives fd.
+vfs_map_t* vfs_mmap(int fd, uint32_t offset, uint32_t len, uint32_t prot);
+// Byte `offset` of the mapping, faulting its page in; *avail gets how many
+// bytes follow it before the next page boundary or the end
+const uint8_t* vfs_map_get(vfs_map_t *map, uint32_t offset, uint32_t *avail);
+int vfs_munmap(vfs_map_t *map);
+
+struct pipe;
+
+// Two descriptors on a new pipe: fds[0] reads, fds[1] writes
+int vfs_pipe(int fds[2]);
+// Move up to len bytes from fd's position into pipe. Cached file pages
+// are handed to the pipe pinned instead of copied. Blocks while the pipe
+// is full; 0 at end of file, -1 once the pipe has no reader.
+int vfs_splice(int fd, struct pipe *pipe, uint32_t len);
+
 vfs_node_t* vfs_readdir(vfs_node_t *node, uint32_t index);
+int vfs_opendir(vfs_node_t *node, vfs_dir_t *dir);
+vfs_node_t* vfs_readdir_next(vfs_dir_t *dir);
 vfs_node_t* vfs_finddir(vfs_node_t *node, const char *name);
 void vfs_list_directory(const char *path);
 
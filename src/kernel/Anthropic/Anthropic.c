@@ -5,6 +5,7 @@
 #include "memory.h"
 #include "mouse.h"
 #include "IO.h"
+#include "irq.h"
 
 #define MAX_LINES 250
 #define MAX_LINE_LENGTH 80
@@ -942,14 +943,14 @@ void anthropic_editor(const char* filename) {
     for (volatile int i = 0; i < 100000; i++);
 
 
-    __asm__ volatile("cli");
+    irq_disable();
     scancode_read_pos = 0;
     scancode_write_pos = 0;
 
     for (int i = 0; i < 256; i++) {
         scancode_buffer[i] = 0;
     }
-    __asm__ volatile("sti");
+    irq_enable();
 
     mouse_initialized = 0;
     mouse_button_state = 0;
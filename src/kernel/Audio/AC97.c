@@ -5,6 +5,7 @@
 #include "string_helpers.h"
 #include "sleep.h"
 #include "process.h"
+#include "apic.h"
 
 #define PCI_CONFIG_ADDRESS  0xCF8
 #define PCI_CONFIG_DATA     0xCFC
@@ -1232,10 +1233,10 @@ int ac97_init(void) {
 
     g_ac97_device->initialized = 1;
 
-     if (g_ac97_device->irq > 0) {
-        extern void irq_install_handler(uint8_t irq, void (*handler)(void));
-        irq_install_handler(g_ac97_device->irq, ac97_interrupt_handler);
-        PRINT(MAGENTA, BLACK, "[AC97] IRQ %u handler registered\n", g_ac97_device->irq);
+    int vector = pci_irq_setup(g_ac97_device->bus, g_ac97_device->device,
+                               g_ac97_device->function, ac97_interrupt_handler);
+    if (vector >= 0) {
+        PRINT(MAGENTA, BLACK, "[AC97] IRQ %u handler on vector 0x%x\n", g_ac97_device->irq, vector);
     }
 
     PRINT(MAGENTA, BLACK, "[AC97] Initialization complete!\n");
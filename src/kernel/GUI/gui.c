@@ -4,6 +4,7 @@
 #include "string_helpers.h"
 #include "vfs.h"
 #include "process.h"
+#include "irq.h"
 #include "gui.h"
 #include "create_dialog.h"
 #include "taskbar.h"
@@ -67,7 +68,7 @@ static int get_internal_cursor_y(void) {
 void gui_thread_entry(void) {
     PRINT(GREEN, BLACK, "[GUI] Starting as thread\n");
     
-    __asm__ volatile("sti");
+    irq_enable();
     
     uint64_t flags;
     __asm__ volatile("pushfq; pop %0" : "=r"(flags));
@@ -75,13 +76,13 @@ void gui_thread_entry(void) {
     
     gui_owns_input = 1;
     
-    __asm__ volatile("cli");
+    irq_disable();
     scancode_read_pos = 0;
     scancode_write_pos = 0;
     for (int i = 0; i < 256; i++) {
         scancode_buffer[i] = 0;
     }
-    __asm__ volatile("sti");
+    irq_enable();
     
     PRINT(GREEN, BLACK, "[GUI] Input buffer claimed\n");
     
@@ -89,13 +90,13 @@ void gui_thread_entry(void) {
     
     gui_owns_input = 0;
     
-    __asm__ volatile("cli");
+    irq_disable();
     scancode_read_pos = 0;
     scancode_write_pos = 0;
     for (int i = 0; i < 256; i++) {
         scancode_buffer[i] = 0;
     }
-    __asm__ volatile("sti");
+    irq_enable();
     
     PRINT(GREEN, BLACK, "[GUI] Input buffer released\n");
     
@@ -506,10 +507,10 @@ void gui_main(void) {
     restore_cursor_area();
     disable_mouse();
 
-    __asm__ volatile("cli");
+    irq_disable();
     scancode_read_pos = scancode_write_pos = 0;
     for (int i = 0; i < 256; i++) scancode_buffer[i] = 0;
-    __asm__ volatile("sti");
+    irq_enable();
 
     mouse_initialized = 0;
     mouse_button_state = 0;
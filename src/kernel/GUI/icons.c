@@ -98,10 +98,11 @@ int desktop_load_directory(desktop_state_t *state, const char *path) {
     
     desktop_init(state);
     
-    uint32_t index = 0;
+    vfs_dir_t cursor;
     vfs_node_t *entry;
     
-    while ((entry = vfs_readdir(dir, index++)) != NULL && state->count < MAX_DESKTOP_ICONS) {
+    vfs_opendir(dir, &cursor);
+    while (state->count < MAX_DESKTOP_ICONS && (entry = vfs_readdir_next(&cursor)) != NULL) {
         desktop_icon_t *icon = &state->icons[state->count];
         
         // Copy name (truncate if needed)
@@ -132,7 +133,6 @@ int desktop_load_directory(desktop_state_t *state, const char *path) {
         icon->selected = 0;
         
         state->count++;
-        kfree(entry);
     }
     
     PRINT(MAGENTA, BLACK, "[DESKTOP] Loaded %d icons from %s\n", state->count, path);
@@ -357,20 +357,46 @@ void text_editor_save(text_editor_t* editor) {
         return;
     }
     
+    // Lines and the newlines between them go down as one write
+    static vfs_iovec_t iov[EDITOR_MAX_LINES * 2];
+    int iovcnt = 0;
+    
     for (int i = 0; i < editor->buffer.line_count; i++) {
-        int len = STRLEN(editor->buffer.lines[i]);
-        vfs_write(fd, (uint8_t*)editor->buffer.lines[i], len);
+        iov[iovcnt].base = editor->buffer.lines[i];
+        iov[iovcnt].len = STRLEN(editor->buffer.lines[i]);
+        iovcnt++;
         if (i < editor->buffer.line_count - 1) {
-            vfs_write(fd, (uint8_t*)"\n", 1);
+            iov[iovcnt].base = (void*)"\n";
+            iov[iovcnt].len = 1;
+            iovcnt++;
         }
     }
     
+    if (iovcnt > 0 && vfs_writev(fd, iov, iovcnt) < 0) {
+        PRINT(RED, BLACK, "[EDITOR] Failed to write %s\n", editor->buffer.filepath);
+        vfs_close(fd);
+        return;
+    }
+    
     vfs_close(fd);
     editor->buffer.modified = 0;
     
     PRINT(GREEN, BLACK, "[EDITOR] Saved to %s\n", editor->buffer.filepath);
 }
 
+// Split `len` bytes into lines, carrying a partial line over in *line_pos
+static void text_editor_parse(text_editor_t* editor, const char* data, uint32_t len, int* line_pos) {
+    for (uint32_t i = 0; i < len && editor->buffer.line_count < EDITOR_MAX_LINES; i++) {
+        if (data[i] == '\n') {
+            editor->buffer.lines[editor->buffer.line_count][*line_pos] = '\0';
+            editor->buffer.line_count++;
+            *line_pos = 0;
+        } else if (*line_pos < EDITOR_MAX_LINE_LENGTH - 1) {
+            editor->buffer.lines[editor->buffer.line_count][(*line_pos)++] = data[i];
+        }
+    }
+}
+
 void text_editor_load(text_editor_t* editor, const char* filepath) {
     int fd = vfs_open(filepath, FILE_READ);
     if (fd < 0) {
@@ -378,27 +404,32 @@ void text_editor_load(text_editor_t* editor, const char* filepath) {
         return;
     }
     
-    char buffer[4096];
-    uint32_t bytes_read = vfs_read(fd, (uint8_t*)buffer, sizeof(buffer) - 1);
-    buffer[bytes_read] = '\0';
-    
-    vfs_close(fd);
-    
-    // Parse into lines
     editor->buffer.line_count = 0;
     int line_pos = 0;
     
-    for (uint32_t i = 0; i < bytes_read && editor->buffer.line_count < EDITOR_MAX_LINES; i++) {
-        if (buffer[i] == '\n') {
-            editor->buffer.lines[editor->buffer.line_count][line_pos] = '\0';
-            editor->buffer.line_count++;
-            line_pos = 0;
-        } else if (line_pos < EDITOR_MAX_LINE_LENGTH - 1) {
-            editor->buffer.lines[editor->buffer.line_count][line_pos++] = buffer[i];
+    // Parse straight out of the page cache, a page at a time
+    vfs_map_t* map = vfs_mmap(fd, 0, 0, VFS_PROT_READ);
+    if (map) {
+        uint32_t pos = 0;
+        uint32_t avail;
+        const uint8_t* data;
+        while (editor->buffer.line_count < EDITOR_MAX_LINES &&
+               (data = vfs_map_get(map, pos, &avail)) != NULL) {
+            text_editor_parse(editor, (const char*)data, avail, &line_pos);
+            pos += avail;
         }
+        vfs_munmap(map);
+    } else {
+        // Empty, on a RAM filesystem, or no page cache to map from
+        char buffer[4096];
+        int bytes_read = vfs_read(fd, (uint8_t*)buffer, sizeof(buffer));
+        if (bytes_read > 0) text_editor_parse(editor, buffer, (uint32_t)bytes_read, &line_pos);
     }
     
-    if (line_pos > 0 || editor->buffer.line_count == 0) {
+    vfs_close(fd);
+    
+    if ((line_pos > 0 || editor->buffer.line_count == 0) &&
+        editor->buffer.line_count < EDITOR_MAX_LINES) {
         editor->buffer.lines[editor->buffer.line_count][line_pos] = '\0';
         editor->buffer.line_count++;
     }
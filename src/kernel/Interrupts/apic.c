@@ -0,0 +1,295 @@
+#include "apic.h"
+#include "acpi.h"
+#include "IO.h"
+#include "PICR.h"
+#include "print.h"
+#include "string_helpers.h"
+
+typedef struct {
+    uint8_t id;
+    volatile uint32_t *base;
+    uint32_t gsi_base;
+    uint32_t gsi_count;
+} ioapic_t;
+
+volatile uint32_t *lapic_eoi_reg = NULL;
+
+static volatile uint32_t *lapic_base = NULL;
+static ioapic_t ioapics[MAX_IOAPICS];
+static int ioapic_count = 0;
+static int apic_active = 0;
+static int cpu_count = 0;
+
+// ISA IRQ -> GSI and MPS flags, from MADT interrupt source overrides
+static uint32_t isa_gsi[16];
+static uint16_t isa_flags[16];
+
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_base[reg / 4] = value;
+}
+
+static uint32_t ioapic_read(ioapic_t *io, uint8_t reg) {
+    io->base[0] = reg;
+    return io->base[4];
+}
+
+static void ioapic_write(ioapic_t *io, uint8_t reg, uint32_t value) {
+    io->base[0] = reg;
+    io->base[4] = value;
+}
+
+static ioapic_t* ioapic_for_gsi(uint32_t gsi) {
+    for (int i = 0; i < ioapic_count; i++) {
+        if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].gsi_count) {
+            return &ioapics[i];
+        }
+    }
+    return NULL;
+}
+
+static uint64_t ioapic_get_entry(ioapic_t *io, uint32_t pin) {
+    uint32_t lo = ioapic_read(io, IOAPIC_REG_REDTBL + pin * 2);
+    uint32_t hi = ioapic_read(io, IOAPIC_REG_REDTBL + pin * 2 + 1);
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static void ioapic_set_entry(ioapic_t *io, uint32_t pin, uint64_t entry) {
+    // Keep the pin masked while the two halves disagree
+    ioapic_write(io, IOAPIC_REG_REDTBL + pin * 2, IOAPIC_MASKED);
+    ioapic_write(io, IOAPIC_REG_REDTBL + pin * 2 + 1, (uint32_t)(entry >> 32));
+    ioapic_write(io, IOAPIC_REG_REDTBL + pin * 2, (uint32_t)entry);
+}
+
+static uint32_t irq_to_gsi(uint8_t irq) {
+    return (irq < 16) ? isa_gsi[irq] : irq;
+}
+
+
+static void madt_parse(acpi_madt_t *madt) {
+    for (int i = 0; i < 16; i++) {
+        isa_gsi[i] = i;
+        isa_flags[i] = 0;
+    }
+
+    uint64_t lapic_phys = madt->lapic_address;
+    uint8_t *ptr = (uint8_t*)madt + sizeof(acpi_madt_t);
+    uint8_t *end = (uint8_t*)madt + madt->header.length;
+
+    while (ptr + sizeof(madt_entry_t) <= end) {
+        madt_entry_t *entry = (madt_entry_t*)ptr;
+        if (entry->length < sizeof(madt_entry_t)) break;
+
+        switch (entry->type) {
+            case MADT_ENTRY_LAPIC: {
+                madt_lapic_t *lapic = (madt_lapic_t*)entry;
+                if (lapic->flags & 1) cpu_count++;
+                break;
+            }
+            case MADT_ENTRY_IOAPIC: {
+                madt_ioapic_t *io = (madt_ioapic_t*)entry;
+                if (ioapic_count < MAX_IOAPICS) {
+                    ioapics[ioapic_count].id = io->ioapic_id;
+                    ioapics[ioapic_count].base = (volatile uint32_t*)(uintptr_t)io->address;
+                    ioapics[ioapic_count].gsi_base = io->gsi_base;
+                    ioapic_count++;
+                }
+                break;
+            }
+            case MADT_ENTRY_ISO: {
+                madt_iso_t *iso = (madt_iso_t*)entry;
+                if (iso->bus == 0 && iso->source < 16) {
+                    isa_gsi[iso->source] = iso->gsi;
+                    isa_flags[iso->source] = iso->flags;
+                }
+                break;
+            }
+            case MADT_ENTRY_LAPIC_OVERRIDE: {
+                madt_lapic_override_t *ovr = (madt_lapic_override_t*)entry;
+                lapic_phys = ovr->address;
+                break;
+            }
+        }
+
+        ptr += entry->length;
+    }
+
+    lapic_base = (volatile uint32_t*)(uintptr_t)lapic_phys;
+}
+
+
+int apic_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & (1 << 9))) {
+        PRINT(YELLOW, BLACK, "[APIC] CPU has no local APIC, using 8259 PIC\n");
+        return -1;
+    }
+
+    acpi_madt_t *madt = (acpi_madt_t*)acpi_find_table("APIC");
+    if (!madt) {
+        PRINT(YELLOW, BLACK, "[APIC] No MADT, using 8259 PIC\n");
+        return -1;
+    }
+
+    madt_parse(madt);
+    if (!lapic_base || ioapic_count == 0) {
+        PRINT(YELLOW, BLACK, "[APIC] No I/O APIC in MADT, using 8259 PIC\n");
+        return -1;
+    }
+
+
+    // The 8259 stays remapped but fully masked, so stray IRQ7/15s land on unused vectors
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+
+
+    uint64_t base_msr = rdmsr(IA32_APIC_BASE_MSR);
+    wrmsr(IA32_APIC_BASE_MSR, base_msr | IA32_APIC_BASE_EN);
+
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_REG_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+
+    for (int i = 0; i < ioapic_count; i++) {
+        ioapic_t *io = &ioapics[i];
+        io->gsi_count = ((ioapic_read(io, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+
+        for (uint32_t pin = 0; pin < io->gsi_count; pin++) {
+            ioapic_set_entry(io, pin, IOAPIC_MASKED);
+        }
+    }
+
+    apic_active = 1;
+    lapic_eoi_reg = &lapic_base[LAPIC_REG_EOI / 4];
+
+
+    // ISA IRQs keep their 32 + n vectors; IRQ2 is the 8259 cascade and has no device
+    for (uint8_t irq = 0; irq < 16; irq++) {
+        if (irq == 2) continue;
+        ioapic_route_irq(irq, IRQ_VECTOR_BASE + irq, 0);
+    }
+
+    lapic_eoi();
+
+    PRINT(MAGENTA, BLACK, "[APIC] LAPIC id %u at 0x%llx, %d CPU(s)\n",
+          lapic_id(), (uint64_t)lapic_base, cpu_count);
+    PRINT(MAGENTA, BLACK, "[APIC] %d I/O APIC(s), IRQ0 -> GSI %u\n", ioapic_count, isa_gsi[0]);
+    return 0;
+}
+
+int apic_enabled(void) {
+    return apic_active;
+}
+
+uint32_t lapic_id(void) {
+    if (!lapic_base) return 0;
+    return lapic_read(LAPIC_REG_ID) >> 24;
+}
+
+void lapic_eoi(void) {
+    if (lapic_base) {
+        lapic_write(LAPIC_REG_EOI, 0);
+    }
+}
+
+
+int ioapic_route_irq(uint8_t irq, uint8_t vector, int pci) {
+    uint32_t gsi = irq_to_gsi(irq);
+    ioapic_t *io = ioapic_for_gsi(gsi);
+    if (!io) return -1;
+
+    uint16_t flags = (irq < 16) ? isa_flags[irq] : 0;
+    uint32_t polarity = flags & 3;
+    uint32_t trigger = (flags >> 2) & 3;
+
+    // "Conforms to bus" defaults: ISA is edge/active-high, PCI is level/active-low
+    int active_low = (polarity == 3) || (polarity == 0 && pci);
+    int level = (trigger == 3) || (trigger == 0 && pci);
+
+    uint64_t entry = vector | IOAPIC_MASKED;
+    if (active_low) entry |= IOAPIC_ACTIVE_LOW;
+    if (level) entry |= IOAPIC_LEVEL;
+    entry |= (uint64_t)lapic_id() << 56;
+
+    uint64_t saved = irq_save();
+    ioapic_set_entry(io, gsi - io->gsi_base, entry);
+    irq_restore(saved);
+    return 0;
+}
+
+static void ioapic_set_masked(uint8_t irq, int masked) {
+    uint32_t gsi = irq_to_gsi(irq);
+    ioapic_t *io = ioapic_for_gsi(gsi);
+    if (!io) return;
+
+    uint32_t pin = gsi - io->gsi_base;
+    uint64_t saved = irq_save();
+    uint32_t lo = ioapic_read(io, IOAPIC_REG_REDTBL + pin * 2);
+    lo = masked ? (lo | IOAPIC_MASKED) : (lo & ~IOAPIC_MASKED);
+    ioapic_write(io, IOAPIC_REG_REDTBL + pin * 2, lo);
+    irq_restore(saved);
+}
+
+void ioapic_mask_irq(uint8_t irq) {
+    ioapic_set_masked(irq, 1);
+}
+
+void ioapic_unmask_irq(uint8_t irq) {
+    ioapic_set_masked(irq, 0);
+}
+
+int ioapic_irq_masked(uint8_t irq) {
+    uint32_t gsi = irq_to_gsi(irq);
+    ioapic_t *io = ioapic_for_gsi(gsi);
+    if (!io) return 1;
+
+    return (ioapic_get_entry(io, gsi - io->gsi_base) & IOAPIC_MASKED) ? 1 : 0;
+}
+
+int ioapic_irq_vector(uint8_t irq) {
+    uint32_t gsi = irq_to_gsi(irq);
+    ioapic_t *io = ioapic_for_gsi(gsi);
+    if (!io) return -1;
+
+    return (int)(ioapic_get_entry(io, gsi - io->gsi_base) & 0xFF);
+}
+
+
+void apic_print_info(void) {
+    PRINT(CYAN, BLACK, "\n=== Interrupt Controllers ===\n");
+
+    if (!apic_active) {
+        PRINT(WHITE, BLACK, "Mode: 8259 PIC (mask 0x%x/0x%x)\n", inb(PIC1_DATA), inb(PIC2_DATA));
+        return;
+    }
+
+    PRINT(WHITE, BLACK, "Mode: APIC, LAPIC id %u, version 0x%x\n",
+          lapic_id(), lapic_read(LAPIC_REG_VERSION) & 0xFF);
+
+    for (int i = 0; i < ioapic_count; i++) {
+        PRINT(WHITE, BLACK, "IOAPIC %u: GSI %u-%u at 0x%llx\n", ioapics[i].id,
+              ioapics[i].gsi_base, ioapics[i].gsi_base + ioapics[i].gsi_count - 1,
+              (uint64_t)ioapics[i].base);
+    }
+
+    for (uint8_t irq = 0; irq < 16; irq++) {
+        uint32_t gsi = isa_gsi[irq];
+        ioapic_t *io = ioapic_for_gsi(gsi);
+        if (!io || irq == 2) continue;
+
+        uint64_t entry = ioapic_get_entry(io, gsi - io->gsi_base);
+        if (entry & IOAPIC_MASKED) continue;
+
+        PRINT(WHITE, BLACK, "  IRQ%u -> GSI %u vector 0x%x %s %s\n", irq, gsi,
+              (uint32_t)(entry & 0xFF),
+              (entry & IOAPIC_LEVEL) ? "level" : "edge",
+              (entry & IOAPIC_ACTIVE_LOW) ? "low" : "high");
+    }
+}
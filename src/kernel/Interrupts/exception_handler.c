@@ -1,9 +1,12 @@
 #include "handler.h"
 #include "print.h"
 #include "string_helpers.h"
+#include "irqstat.h"
 
 
 void isr_handler(registers_t* r) {
+    irqstat_enter(r->int_no);
+
     switch(r->int_no) {
         case 0:
             PRINT(RED, BLACK, "Divide-by-zero exception!\n");
@@ -117,6 +120,8 @@ void isr_handler(registers_t* r) {
             break;
     }
 
+    // Every exception is fatal; charge the report, not the halt
+    irqstat_exit(r->int_no);
 
     for(;;) asm volatile("hlt");
 }
\ No newline at end of file
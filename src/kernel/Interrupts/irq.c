@@ -4,6 +4,8 @@
 #include "IO.h"
 #include "print.h"
 #include "irq.h"
+#include "apic.h"
+#include "irqstat.h"
 #include "process.h"
 #include "fg.h"
 #include "string_helpers.h"
@@ -24,7 +26,9 @@
 volatile uint64_t timer_ticks = 0;
 volatile uint64_t timer_seconds = 0;
 
-static irq_handler_t irq_handlers[16] = {NULL};
+static irq_handler_t vector_handlers[256][IRQ_SHARED_MAX];
+// Exceptions, legacy IRQ vectors and 0xF0-0xFF are never handed out
+static uint64_t vector_used[4] = { (1ULL << 48) - 1, 0, 0, 0xFFFFULL << 48 };
 
 
 void pic_send_eoi(int irq) {
@@ -82,26 +86,150 @@ uint8_t pic_get_mask(void) {
 }
 
 
+void irq_mask(uint8_t irq) {
+    if (irq >= 16) return;
+
+    if (apic_enabled()) {
+        ioapic_mask_irq(irq);
+    } else {
+        pic_set_mask(irq);
+    }
+}
+
+void irq_unmask(uint8_t irq) {
+    if (irq >= 16) return;
+
+    if (apic_enabled()) {
+        ioapic_unmask_irq(irq);
+    } else {
+        pic_clear_mask(irq);
+    }
+}
+
+int irq_is_masked(uint8_t irq) {
+    if (irq >= 16) return 1;
+
+    if (apic_enabled()) {
+        return ioapic_irq_masked(irq);
+    }
+
+    uint16_t port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
+    return (inb(port) >> (irq & 7)) & 1;
+}
+
+void irq_send_eoi(int irq) {
+    if (lapic_eoi_reg) {
+        *lapic_eoi_reg = 0;
+    } else {
+        pic_send_eoi(irq);
+    }
+}
+
+
+int irq_install_vector(int vector, irq_handler_t handler) {
+    if (vector < IRQ_VECTOR_BASE || vector > 0xFF || !handler) return -1;
+
+    uint64_t flags = irq_save();
+    for (int i = 0; i < IRQ_SHARED_MAX; i++) {
+        if (!vector_handlers[vector][i] || vector_handlers[vector][i] == handler) {
+            vector_handlers[vector][i] = handler;
+            irq_restore(flags);
+            return 0;
+        }
+    }
+    irq_restore(flags);
+
+    PRINT(YELLOW, BLACK, "[IRQ] Vector 0x%x has too many handlers\n", vector);
+    return -1;
+}
+
+void irq_uninstall_vector(int vector, irq_handler_t handler) {
+    if (vector < IRQ_VECTOR_BASE || vector > 0xFF) return;
+
+    uint64_t flags = irq_save();
+    int j = 0;
+    for (int i = 0; i < IRQ_SHARED_MAX; i++) {
+        irq_handler_t h = vector_handlers[vector][i];
+        vector_handlers[vector][i] = NULL;
+        if (h && h != handler) {
+            vector_handlers[vector][j++] = h;
+        }
+    }
+    irq_restore(flags);
+}
+
+int irq_alloc_vector(void) {
+    uint64_t flags = irq_save();
+
+    for (int vector = IRQ_VECTOR_DYN_FIRST; vector <= IRQ_VECTOR_DYN_LAST; vector++) {
+        uint64_t bit = 1ULL << (vector & 63);
+        if (!(vector_used[vector >> 6] & bit)) {
+            vector_used[vector >> 6] |= bit;
+            irq_restore(flags);
+            return vector;
+        }
+    }
+
+    irq_restore(flags);
+    PRINT(YELLOW, BLACK, "[IRQ] Out of interrupt vectors\n");
+    return -1;
+}
+
+void irq_free_vector(int vector) {
+    if (vector < IRQ_VECTOR_DYN_FIRST || vector > IRQ_VECTOR_DYN_LAST) return;
+
+    uint64_t flags = irq_save();
+    for (int i = 0; i < IRQ_SHARED_MAX; i++) {
+        vector_handlers[vector][i] = NULL;
+    }
+    vector_used[vector >> 6] &= ~(1ULL << (vector & 63));
+    irq_restore(flags);
+}
+
+
 void irq_install_handler(int irq, irq_handler_t handler) {
     if (irq >= 0 && irq < 16) {
-        irq_handlers[irq] = handler;
+        if (irq_install_vector(IRQ_VECTOR_BASE + irq, handler) == 0) {
+            irq_unmask(irq);
+        }
     }
 }
 
 void irq_uninstall_handler(int irq) {
     if (irq >= 0 && irq < 16) {
-        irq_handlers[irq] = NULL;
+        irq_mask(irq);
+        for (int i = 0; i < IRQ_SHARED_MAX; i++) {
+            vector_handlers[IRQ_VECTOR_BASE + irq][i] = NULL;
+        }
     }
 }
 
 
-void irq_common_handler(int irq_num) {
-    if (irq_handlers[irq_num] != NULL) {
-        irq_handler_t handler = irq_handlers[irq_num];
+void irq_dispatch(uint64_t vector) {
+    if (vector == APIC_SPURIOUS_VECTOR) return;
+
+    irqstat_enter(vector);
+
+    for (int i = 0; i < IRQ_SHARED_MAX; i++) {
+        irq_handler_t handler = vector_handlers[vector][i];
+        if (!handler) break;
         handler();
     }
 
-    pic_send_eoi(irq_num);
+    if (lapic_eoi_reg) {
+        *lapic_eoi_reg = 0;
+    } else if (vector >= IRQ_VECTOR_BASE && vector < IRQ_VECTOR_BASE + 16) {
+        pic_send_eoi((int)vector - IRQ_VECTOR_BASE);
+    } else {
+        outb(PIC1_COMMAND, PIC_EOI);
+    }
+
+    irqstat_exit(vector);
+}
+
+void irq_common_handler(int irq_num) {
+    if (irq_num < 0 || irq_num >= 16) return;
+    irq_dispatch(IRQ_VECTOR_BASE + irq_num);
 }
 
 
@@ -109,8 +237,12 @@ void irq_common_handler(int irq_num) {
 
 
 void timer_handler_c(void) {
+    irqstat_enter(IRQ_VECTOR_BASE);
     timer_ticks++;
 
+    // Acknowledge before scheduler_tick() can switch away from this frame
+    irq_send_eoi(0);
+
 
     extern int get_scheduler_enabled(void);
     if (get_scheduler_enabled()) {
@@ -122,7 +254,7 @@ void timer_handler_c(void) {
     extern void update_jobs_safe(void);
     update_jobs_safe();
 
-    outb(0x20, 0x20);
+    irqstat_exit(IRQ_VECTOR_BASE);
 }
 
 void pit_init(uint32_t frequency) {
@@ -140,30 +272,22 @@ void pit_init(uint32_t frequency) {
 void irq_init(void) {
     PRINT(WHITE, BLACK, "[IRQ] Initializing IRQ system...\n");
 
-    for (int i = 0; i < 16; i++) {
-        irq_handlers[i] = NULL;
-    }
-
     timer_ticks = 0;
     timer_seconds = 0;
 
     pit_init(TIMER_FREQ);
 
     PRINT(WHITE, BLACK, "[IRQ] Unmasking IRQ0 (timer)...\n");
-    pic_clear_mask(0);
-    for (volatile int i = 0; i < 10000; i++);
+    irq_unmask(0);
 
-    uint8_t mask = inb(0x21);
-    PRINT(WHITE, BLACK, "[IRQ] PIC1 mask after unmask: 0x%x\n", mask);
-
-    if (mask & 0x01) {
+    if (irq_is_masked(0)) {
         PRINT(YELLOW, BLACK, "[WARNING] IRQ0 still masked!\n");
     } else {
         PRINT(MAGENTA, BLACK, "[OK] IRQ0 is unmasked\n");
     }
 
     PRINT(WHITE, BLACK, "[IRQ] Enabling interrupts...\n");
-    __asm__ volatile("sti");
+    irq_enable();
 
     PRINT(MAGENTA, BLACK, "[IRQ] IRQ system ready\n");
 }
@@ -177,7 +301,11 @@ void show_timer_info(void) {
     PRINT(WHITE, BLACK, "Ticks: %llu\n", timer_ticks);
     PRINT(WHITE, BLACK, "Uptime: %llu seconds\n", timer_seconds);
     PRINT(WHITE, BLACK, "Milliseconds: %llu\n", (timer_ticks * 1000) / TIMER_FREQ);
-    PRINT(WHITE, BLACK, "PIC1 mask: 0x%x\n", pic_get_mask());
+    if (apic_enabled()) {
+        PRINT(WHITE, BLACK, "Controller: I/O APIC, timer %s\n", irq_is_masked(0) ? "masked" : "unmasked");
+    } else {
+        PRINT(WHITE, BLACK, "PIC1 mask: 0x%x\n", pic_get_mask());
+    }
 }
 
 
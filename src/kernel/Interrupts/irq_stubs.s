@@ -0,0 +1,74 @@
+; Hardware interrupt stubs for vectors 32-255
+; Each stub pushes its vector number and enters irq_dispatch
+
+section .text
+
+%assign vec 32
+%rep 224
+irq_stub_%+vec:
+    push qword vec         ; Push vector number
+    jmp irq_common_stub
+%assign vec vec+1
+%endrep
+
+extern irq_dispatch
+
+irq_common_stub:
+    ; Save all registers
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    ; Vector number sits above the 15 saved registers
+    mov rdi, [rsp + 15*8]
+
+    ; Align the stack for the C call; rbx is callee-saved
+    mov rbx, rsp
+    and rsp, -16
+    call irq_dispatch
+    mov rsp, rbx
+
+    ; Restore all registers
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+
+    ; Clean up vector number
+    add rsp, 8
+
+    iretq
+
+section .data
+
+; Stub address for vector 32 + i, used by idt_install
+global irq_stub_table
+irq_stub_table:
+%assign vec 32
+%rep 224
+    dq irq_stub_%+vec
+%assign vec vec+1
+%endrep
@@ -0,0 +1,284 @@
+#include "irqstat.h"
+#include "irq.h"
+#include "IO.h"
+#include "print.h"
+#include "string_helpers.h"
+
+static irqstat_vector_t vector_stats[256];
+static irqstat_off_t off_stats;
+
+// Handlers currently running, innermost last
+static struct {
+    uint8_t vector;
+    uint64_t start;
+} in_flight[IRQSTAT_MAX_NESTING];
+static int in_flight_depth = 0;
+
+// Open IRQ-off window from irq_save/irq_disable
+static uint64_t off_start = 0;
+static const char *off_func = NULL;
+static int off_line = 0;
+
+static uint64_t tsc_per_us = 0;
+
+
+static int hist_bucket(uint64_t cycles) {
+    if (cycles < (1ULL << IRQSTAT_HIST_SHIFT)) return 0;
+
+    int bit = 63 - __builtin_clzll(cycles);
+    int bucket = bit - IRQSTAT_HIST_SHIFT + 1;
+    return bucket >= IRQSTAT_HIST_BUCKETS ? IRQSTAT_HIST_BUCKETS - 1 : bucket;
+}
+
+static void off_record(uint64_t cycles, const char *func, int line) {
+    off_stats.count++;
+    off_stats.total_cycles += cycles;
+    off_stats.hist[hist_bucket(cycles)]++;
+
+    if (cycles > off_stats.max_cycles) {
+        off_stats.max_cycles = cycles;
+        off_stats.max_func = func;
+        off_stats.max_line = line;
+    }
+}
+
+static void vector_record(uint8_t vector, uint64_t cycles) {
+    irqstat_vector_t *v = &vector_stats[vector];
+    v->count++;
+    v->total_cycles += cycles;
+    v->hist[hist_bucket(cycles)]++;
+    if (cycles > v->max_cycles) v->max_cycles = cycles;
+
+    // The handler itself ran with IF clear
+    off_record(cycles, NULL, vector);
+}
+
+
+void irqoff_begin(const char *func, int line) {
+    if (off_start) return;
+    off_start = rdtsc();
+    off_func = func;
+    off_line = line;
+}
+
+void irqoff_end(void) {
+    if (!off_start) return;
+    off_record(rdtsc() - off_start, off_func, off_line);
+    off_start = 0;
+}
+
+
+void irqstat_enter(uint64_t vector) {
+    uint64_t now = rdtsc();
+
+    // A maskable interrupt proves IF was set, so any open window was
+    // closed by a path that does not report (iretq, popfq, sti; hlt)
+    if (vector >= IRQ_VECTOR_BASE) off_start = 0;
+
+    if (in_flight_depth < IRQSTAT_MAX_NESTING) {
+        in_flight[in_flight_depth].vector = (uint8_t)vector;
+        in_flight[in_flight_depth].start = now;
+    }
+    in_flight_depth++;
+}
+
+void irqstat_exit(uint64_t vector) {
+    // Already closed by irqstat_switch(), or entered before a reset
+    if (in_flight_depth == 0) return;
+
+    in_flight_depth--;
+    if (in_flight_depth >= IRQSTAT_MAX_NESTING) return;
+
+    vector_record(in_flight[in_flight_depth].vector, rdtsc() - in_flight[in_flight_depth].start);
+}
+
+void irqstat_switch(void) {
+    uint64_t now = rdtsc();
+    int depth = in_flight_depth < IRQSTAT_MAX_NESTING ? in_flight_depth : IRQSTAT_MAX_NESTING;
+
+    for (int i = 0; i < depth; i++) {
+        vector_record(in_flight[i].vector, now - in_flight[i].start);
+    }
+    in_flight_depth = 0;
+}
+
+void irqstat_reset(void) {
+    uint64_t flags = irq_save();
+
+    for (int i = 0; i < 256; i++) {
+        vector_stats[i].count = 0;
+        vector_stats[i].total_cycles = 0;
+        vector_stats[i].max_cycles = 0;
+        for (int b = 0; b < IRQSTAT_HIST_BUCKETS; b++) vector_stats[i].hist[b] = 0;
+    }
+
+    off_stats.count = 0;
+    off_stats.total_cycles = 0;
+    off_stats.max_cycles = 0;
+    off_stats.max_func = NULL;
+    off_stats.max_line = 0;
+    for (int b = 0; b < IRQSTAT_HIST_BUCKETS; b++) off_stats.hist[b] = 0;
+
+    // Drop our own window too; irq_restore() would record it otherwise
+    off_start = 0;
+    in_flight_depth = 0;
+
+    irq_restore(flags);
+}
+
+const irqstat_vector_t* irqstat_get(uint8_t vector) {
+    return &vector_stats[vector];
+}
+
+const irqstat_off_t* irqstat_get_off(void) {
+    return &off_stats;
+}
+
+
+// TSC rate from 20 ticks of the 1 kHz PIT; needs interrupts on
+uint64_t irqstat_tsc_per_us(void) {
+    if (tsc_per_us) return tsc_per_us;
+
+    uint64_t tick = get_timer_ticks();
+    while (get_timer_ticks() == tick) __asm__ volatile("hlt");
+
+    uint64_t start_tick = get_timer_ticks();
+    uint64_t start_tsc = rdtsc();
+    while (get_timer_ticks() < start_tick + 20) __asm__ volatile("hlt");
+    uint64_t cycles = rdtsc() - start_tsc;
+
+    tsc_per_us = cycles / 20000;
+    if (tsc_per_us == 0) tsc_per_us = 1;
+    return tsc_per_us;
+}
+
+
+static void print_hist_row(const uint32_t *hist) {
+    for (int b = 0; b < IRQSTAT_HIST_BUCKETS; b++) {
+        PRINT(WHITE, BLACK, " %u", hist[b]);
+    }
+    PRINT(WHITE, BLACK, "\n");
+}
+
+static void print_hist_bars(const uint32_t *hist) {
+    uint32_t peak = 0;
+    for (int b = 0; b < IRQSTAT_HIST_BUCKETS; b++) {
+        if (hist[b] > peak) peak = hist[b];
+    }
+    if (peak == 0) return;
+
+    for (int b = 0; b < IRQSTAT_HIST_BUCKETS; b++) {
+        if (!hist[b]) continue;
+
+        // printk has no field widths; label each bar by its bucket's lower bound
+        if (b == 0) {
+            PRINT(WHITE, BLACK, " <2^%d |", IRQSTAT_HIST_SHIFT);
+        } else {
+            PRINT(WHITE, BLACK, "  2^%d |", b + IRQSTAT_HIST_SHIFT - 1);
+        }
+
+        int width = (int)(((uint64_t)hist[b] * 40 + peak - 1) / peak);
+        for (int i = 0; i < width; i++) PRINT(GREEN, BLACK, "#");
+        PRINT(WHITE, BLACK, " %u\n", hist[b]);
+    }
+}
+
+static int parse_vector(const char *arg) {
+    int base = 10, value = 0, digits = 0;
+
+    if (arg[0] == '0' && (arg[1] == 'x' || arg[1] == 'X')) {
+        base = 16;
+        arg += 2;
+    }
+
+    for (; *arg && *arg != ' '; arg++) {
+        int d;
+        if (*arg >= '0' && *arg <= '9') d = *arg - '0';
+        else if (base == 16 && *arg >= 'a' && *arg <= 'f') d = *arg - 'a' + 10;
+        else if (base == 16 && *arg >= 'A' && *arg <= 'F') d = *arg - 'A' + 10;
+        else return -1;
+
+        value = value * base + d;
+        if (value > 255) return -1;
+        digits++;
+    }
+
+    return digits ? value : -1;
+}
+
+
+static void irqstat_print_vector(uint8_t vector) {
+    const irqstat_vector_t *v = &vector_stats[vector];
+    uint64_t per_us = irqstat_tsc_per_us();
+
+    PRINT(CYAN, BLACK, "\n=== Vector 0x%x handler latency (cycles) ===\n", vector);
+    if (!v->count) {
+        PRINT(WHITE, BLACK, "No interrupts recorded\n");
+        return;
+    }
+
+    PRINT(WHITE, BLACK, "Count %llu, avg %llu us, max %llu us\n", v->count,
+          v->total_cycles / v->count / per_us, v->max_cycles / per_us);
+    print_hist_bars(v->hist);
+}
+
+static void irqstat_print_summary(void) {
+    uint64_t per_us = irqstat_tsc_per_us();
+
+    PRINT(CYAN, BLACK, "\n=== Interrupt Statistics (TSC %llu MHz) ===\n", per_us);
+    PRINT(WHITE, BLACK, "vector: count, avg cycles, max cycles, max us\n");
+
+    for (int i = 0; i < 256; i++) {
+        const irqstat_vector_t *v = &vector_stats[i];
+        if (!v->count) continue;
+
+        PRINT(WHITE, BLACK, "0x%x: %llu, %llu, %llu, %llu\n", i, v->count,
+              v->total_cycles / v->count, v->max_cycles, v->max_cycles / per_us);
+    }
+
+    PRINT(CYAN, BLACK, "\nHistograms, log2 cycle buckets from <%u:\n", 1U << IRQSTAT_HIST_SHIFT);
+    for (int i = 0; i < 256; i++) {
+        if (!vector_stats[i].count) continue;
+        PRINT(WHITE, BLACK, "0x%x:", i);
+        print_hist_row(vector_stats[i].hist);
+    }
+
+    PRINT(CYAN, BLACK, "\n--- IRQ-disabled windows ---\n");
+    if (!off_stats.count) {
+        PRINT(WHITE, BLACK, "None recorded\n");
+        return;
+    }
+
+    PRINT(WHITE, BLACK, "Count %llu, avg %llu cycles, max %llu cycles (%llu us)\n", off_stats.count,
+          off_stats.total_cycles / off_stats.count, off_stats.max_cycles, off_stats.max_cycles / per_us);
+    if (off_stats.max_func) {
+        PRINT(WHITE, BLACK, "Longest opened in %s() line %d\n", off_stats.max_func, off_stats.max_line);
+    } else {
+        PRINT(WHITE, BLACK, "Longest was the handler for vector 0x%x\n", off_stats.max_line);
+    }
+    PRINT(WHITE, BLACK, "off:");
+    print_hist_row(off_stats.hist);
+}
+
+void irqstat_command(const char *arg) {
+    while (arg && *arg == ' ') arg++;
+
+    if (!arg || !*arg) {
+        irqstat_print_summary();
+        return;
+    }
+
+    if (STRNCMP(arg, "reset", 5) == 0) {
+        irqstat_reset();
+        PRINT(GREEN, BLACK, "[IRQSTAT] Counters cleared\n");
+        return;
+    }
+
+    int vector = parse_vector(arg);
+    if (vector < 0) {
+        PRINT(YELLOW, BLACK, "Usage: irqstat [reset | <vector>]\n");
+        return;
+    }
+
+    irqstat_print_vector((uint8_t)vector);
+}
@@ -0,0 +1,126 @@
+#include "apic.h"
+#include "PCI.h"
+#include "print.h"
+#include "string_helpers.h"
+
+static void pci_disable_intx(uint8_t bus, uint8_t dev, uint8_t func) {
+    uint16_t cmd = pci_read_word(bus, dev, func, PCI_COMMAND);
+    pci_write_word(bus, dev, func, PCI_COMMAND, cmd | PCI_COMMAND_INTX_DISABLE);
+}
+
+static uint32_t msi_address(void) {
+    return MSI_ADDRESS_BASE | (lapic_id() << 12);
+}
+
+int pci_enable_msi(uint8_t bus, uint8_t dev, uint8_t func, uint8_t vector) {
+    if (!apic_enabled()) return -1;
+
+    uint8_t cap = pci_find_capability(bus, dev, func, PCI_CAP_ID_MSI);
+    if (!cap) return -1;
+
+    uint16_t ctrl = pci_read_word(bus, dev, func, cap + 2);
+
+    pci_write_dword(bus, dev, func, cap + 4, msi_address());
+    if (ctrl & PCI_MSI_64BIT) {
+        pci_write_dword(bus, dev, func, cap + 8, 0);
+        pci_write_word(bus, dev, func, cap + 12, vector);
+    } else {
+        pci_write_word(bus, dev, func, cap + 8, vector);
+    }
+
+    // One message, edge-triggered fixed delivery
+    ctrl &= ~PCI_MSI_MME_MASK;
+    ctrl |= PCI_MSI_ENABLE;
+    pci_write_word(bus, dev, func, cap + 2, ctrl);
+
+    pci_disable_intx(bus, dev, func);
+    return 0;
+}
+
+int pci_enable_msix(uint8_t bus, uint8_t dev, uint8_t func, uint8_t vector) {
+    if (!apic_enabled()) return -1;
+
+    uint8_t cap = pci_find_capability(bus, dev, func, PCI_CAP_ID_MSIX);
+    if (!cap) return -1;
+
+    uint16_t ctrl = pci_read_word(bus, dev, func, cap + 2);
+    uint32_t table = pci_read_dword(bus, dev, func, cap + 4);
+    uint8_t bir = table & 7;
+    if (bir > 5) return -1;
+
+    uint8_t bar_off = PCI_BAR0 + bir * 4;
+    uint32_t bar = pci_read_dword(bus, dev, func, bar_off);
+    if (bar & 1) return -1;
+
+    uint64_t base = bar & ~0xFULL;
+    if ((bar & 0x6) == 0x4) {
+        base |= (uint64_t)pci_read_dword(bus, dev, func, bar_off + 4) << 32;
+    }
+    if (!base) return -1;
+
+    uint16_t cmd = pci_read_word(bus, dev, func, PCI_COMMAND);
+    pci_write_word(bus, dev, func, PCI_COMMAND, cmd | 0x02);
+
+
+    // Hold the whole function masked while entry 0 is rewritten
+    pci_write_word(bus, dev, func, cap + 2, ctrl | PCI_MSIX_ENABLE | PCI_MSIX_FUNC_MASK);
+
+    volatile uint32_t *entry = (volatile uint32_t*)(uintptr_t)(base + (table & ~7U));
+    entry[0] = msi_address();
+    entry[1] = 0;
+    entry[2] = vector;
+    entry[3] = 0;
+
+    pci_write_word(bus, dev, func, cap + 2, (ctrl | PCI_MSIX_ENABLE) & ~PCI_MSIX_FUNC_MASK);
+
+    pci_disable_intx(bus, dev, func);
+    return 0;
+}
+
+
+int pci_irq_setup(uint8_t bus, uint8_t dev, uint8_t func, irq_handler_t handler) {
+    uint8_t line = pci_read_byte(bus, dev, func, PCI_INTERRUPT_LINE);
+
+    if (!apic_enabled()) {
+        if (line == 0 || line >= 16) return -1;
+        irq_install_handler(line, handler);
+        return IRQ_VECTOR_BASE + line;
+    }
+
+    int vector = irq_alloc_vector();
+    if (vector < 0) return -1;
+
+    irq_install_vector(vector, handler);
+
+    if (pci_enable_msix(bus, dev, func, vector) == 0) {
+        PRINT(MAGENTA, BLACK, "[MSI] %02x:%02x.%x using MSI-X vector 0x%x\n", bus, dev, func, vector);
+        return vector;
+    }
+
+    if (pci_enable_msi(bus, dev, func, vector) == 0) {
+        PRINT(MAGENTA, BLACK, "[MSI] %02x:%02x.%x using MSI vector 0x%x\n", bus, dev, func, vector);
+        return vector;
+    }
+
+
+    // No MSI: give the INTx line its own vector, shared only by devices on the same pin
+    if (line == 0 || line == 0xFF) {
+        irq_free_vector(vector);
+        return -1;
+    }
+
+    int routed = ioapic_irq_vector(line);
+    if (routed >= IRQ_VECTOR_DYN_FIRST && routed <= IRQ_VECTOR_DYN_LAST) {
+        irq_free_vector(vector);
+        vector = routed;
+        irq_install_vector(vector, handler);
+    } else if (ioapic_route_irq(line, vector, 1) != 0) {
+        irq_free_vector(vector);
+        return -1;
+    }
+
+    ioapic_unmask_irq(line);
+
+    PRINT(MAGENTA, BLACK, "[APIC] %02x:%02x.%x INTx line %u -> vector 0x%x\n", bus, dev, func, line, vector);
+    return vector;
+}
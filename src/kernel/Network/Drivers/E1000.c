@@ -4,14 +4,25 @@
 #include "string_helpers.h"
 #include "PCI.h"
 #include "net.h"
+#include "apic.h"
+#include "irq.h"
+#include "process.h"
 
 static e1000_device_t e1000_dev;
 
+static e1000_stats_t rx_stats;
+static volatile int rx_pending = 0;
+static volatile int rx_busy = 0;
+static int rx_tid = -1;
+static wait_queue_t rx_wait = { LIST_HEAD_INIT(rx_wait.waiters) };
+
 #define REG_CTRL     0x0000
 #define REG_STATUS   0x0008
 #define REG_EERD     0x0014
 #define REG_ICR      0x00C0
 #define REG_IMS      0x00D0
+#define REG_IMC      0x00D8
+#define REG_ITR      0x00C4
 #define REG_RCTL     0x0100
 #define REG_TCTL     0x0400
 #define REG_RDBAL    0x2800
@@ -19,6 +30,8 @@ static e1000_device_t e1000_dev;
 #define REG_RDLEN    0x2808
 #define REG_RDH      0x2810
 #define REG_RDT      0x2818
+#define REG_RDTR     0x2820
+#define REG_RADV     0x282C
 #define REG_TDBAL    0x3800
 #define REG_TDBAH    0x3804
 #define REG_TDLEN    0x3808
@@ -27,6 +40,8 @@ static e1000_device_t e1000_dev;
 #define REG_RAL      0x5400
 #define REG_RAH      0x5404
 
+static void e1000_start_rx_thread(void);
+
 uint32_t e1000_read_reg(uint16_t reg) {
     return *(volatile uint32_t*)(e1000_dev.mmio_base + reg);
 }
@@ -47,6 +62,7 @@ int e1000_init(void) {
 
 
     int found = 0;
+    uint8_t pci_bus = 0, pci_dev = 0;
     for (int bus = 0; bus < 256; bus++) {
         for (int dev = 0; dev < 32; dev++) {
             uint16_t vendor = pci_read_word(bus, dev, 0, 0);
@@ -62,6 +78,8 @@ int e1000_init(void) {
                 uint16_t cmd = pci_read_word(bus, dev, 0, 4);
                 pci_write_word(bus, dev, 0, 4, cmd | 0x07);
 
+                pci_bus = bus;
+                pci_dev = dev;
                 found = 1;
                 break;
             }
@@ -130,6 +148,12 @@ int e1000_init(void) {
     e1000_dev.rx_cur = 0;
 
 
+    e1000_write_reg(REG_RDTR, E1000_RDTR_DEFAULT);
+    e1000_write_reg(REG_RADV, E1000_RADV_DEFAULT);
+    e1000_write_reg(REG_ITR, E1000_ITR_LOW_LATENCY);
+    rx_stats.itr = E1000_ITR_LOW_LATENCY;
+
+
     e1000_write_reg(REG_RCTL, (1 << 1) | (1 << 15) | (1 << 25) | (1 << 26));
 
     PRINT(GREEN, BLACK, "[E1000] RX enabled\n");
@@ -175,11 +199,18 @@ int e1000_init(void) {
     e1000_write_reg(REG_RAH, rah);
 
 
-    e1000_write_reg(REG_IMS, 0xFF);
+    e1000_read_reg(REG_ICR);
+    e1000_dev.irq = pci_irq_setup(pci_bus, pci_dev, 0, e1000_interrupt_handler);
+    if (e1000_dev.irq >= 0) {
+        PRINT(GREEN, BLACK, "[E1000] Interrupts on vector 0x%x\n", e1000_dev.irq);
+    }
 
     e1000_dev.initialized = 1;
     net_register_device(e1000_dev.mac_addr);
 
+    e1000_start_rx_thread();
+    e1000_write_reg(REG_IMS, E1000_RX_IRQ_MASK | E1000_ICR_LSC);
+
     PRINT(GREEN, BLACK, "[E1000] Ready\n");
     return 0;
 }
@@ -207,16 +238,20 @@ int e1000_send_packet(const void *data, uint16_t len) {
     return 0;
 }
 
-void e1000_interrupt_handler(void) {
-    if (!e1000_dev.initialized) return;
-
-    uint32_t cause = e1000_read_reg(REG_ICR);
+static int e1000_rx_drain(int budget) {
+    uint64_t flags = irq_save();
+    if (rx_busy) {
+        irq_restore(flags);
+        return 0;
+    }
+    rx_busy = 1;
+    irq_restore(flags);
 
 
     uint32_t idx = e1000_dev.rx_cur;
     int got_packets = 0;
 
-    while (e1000_dev.rx_descs[idx].status & 1) {
+    while (got_packets < budget && (e1000_dev.rx_descs[idx].status & 1)) {
         e1000_rx_desc_t *desc = &e1000_dev.rx_descs[idx];
         uint16_t len = desc->length;
         uint8_t *data = (uint8_t*)desc->buffer_addr;
@@ -230,6 +265,116 @@ void e1000_interrupt_handler(void) {
 
     e1000_dev.rx_cur = idx;
     e1000_write_reg(REG_RDT, (idx == 0) ? 31 : idx - 1);
+
+    rx_stats.polls++;
+    rx_stats.packets += got_packets;
+    if ((uint32_t)got_packets > rx_stats.max_per_poll) {
+        rx_stats.max_per_poll = got_packets;
+    }
+    if (got_packets >= budget) {
+        rx_stats.budget_exhausted++;
+    }
+
+    rx_busy = 0;
+    return got_packets;
+}
+
+// Pick the throttle rate from how full the last poll was: sparse traffic
+// gets prompt interrupts, a saturated ring gets few interrupts and more polling.
+static void e1000_update_itr(int packets) {
+    uint32_t itr;
+
+    if (packets >= E1000_NAPI_BUDGET) {
+        itr = E1000_ITR_BULK;
+    } else if (packets > 4) {
+        itr = E1000_ITR_LOW_LATENCY;
+    } else {
+        itr = E1000_ITR_LOWEST_LATENCY;
+    }
+
+    if (itr != rx_stats.itr) {
+        rx_stats.itr = itr;
+        e1000_write_reg(REG_ITR, itr);
+    }
+}
+
+
+// Runs in interrupt context: acknowledge, mask RX and hand off to the RX thread
+void e1000_interrupt_handler(void) {
+    if (!e1000_dev.initialized) return;
+
+    uint32_t cause = e1000_read_reg(REG_ICR);
+
+    if (cause & E1000_RX_IRQ_MASK) {
+        rx_stats.interrupts++;
+        if (cause & E1000_ICR_RXO) rx_stats.rx_overruns++;
+
+        e1000_write_reg(REG_IMC, E1000_RX_IRQ_MASK);
+        rx_pending = 1;
+        wait_queue_wake(&rx_wait);
+    }
+}
+
+static void e1000_rx_thread(void) {
+    while (1) {
+        rx_pending = 0;
+        int packets = e1000_rx_drain(E1000_NAPI_BUDGET);
+        e1000_update_itr(packets);
+
+        // Ring still busy: keep RX masked and poll again after others ran
+        if (packets >= E1000_NAPI_BUDGET) {
+            thread_yield();
+            continue;
+        }
+
+        // Re-arm and sleep unless another interrupt arrived while draining
+        uint64_t flags = irq_save();
+        if (!rx_pending) {
+            e1000_write_reg(REG_IMS, E1000_RX_IRQ_MASK);
+            // Woken with interrupts back on
+            if (wait_queue_sleep(&rx_wait) == 0) continue;
+        }
+        irq_restore(flags);
+    }
+}
+
+static void e1000_start_rx_thread(void) {
+    extern int get_scheduler_enabled(void);
+    if (rx_tid > 0 || e1000_dev.irq < 0 || !get_scheduler_enabled()) return;
+
+    rx_tid = thread_create(1, e1000_rx_thread, 16384, 10000000, 1000000000, 1000000000);
+    if (rx_tid < 0) {
+        PRINT(YELLOW, BLACK, "[E1000] RX thread creation failed, polling only\n");
+        return;
+    }
+
+    PRINT(GREEN, BLACK, "[E1000] RX thread TID=%d\n", rx_tid);
+}
+
+void e1000_poll(void) {
+    if (!e1000_dev.initialized) return;
+
+    if (rx_tid > 0) {
+        thread_yield();
+        return;
+    }
+
+    e1000_rx_drain(E1000_NAPI_BUDGET);
+}
+
+const e1000_stats_t* e1000_get_stats(void) {
+    return &rx_stats;
+}
+
+void e1000_print_stats(void) {
+    uint64_t avg = rx_stats.polls ? rx_stats.packets / rx_stats.polls : 0;
+
+    PRINT(WHITE, BLACK, "RX interrupts: %llu  polls: %llu  packets: %llu\n",
+          rx_stats.interrupts, rx_stats.polls, rx_stats.packets);
+    PRINT(WHITE, BLACK, "Packets/poll: avg %llu max %u  budget hit: %llu\n",
+          avg, rx_stats.max_per_poll, rx_stats.budget_exhausted);
+    PRINT(WHITE, BLACK, "RX overruns: %llu  ITR: %u (%s)\n", rx_stats.rx_overruns, rx_stats.itr,
+          rx_tid > 0 ? "interrupt+poll" : "polling only");
 }
 
 void e1000_get_mac_address(uint8_t *mac) {
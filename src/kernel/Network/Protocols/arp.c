@@ -155,7 +155,7 @@ int arp_resolve(uint32_t ip, uint8_t *mac) {
         for (int i = 0; i < 500; i++) {
 
             for (int p = 0; p < 20; p++) {
-                e1000_interrupt_handler();
+                e1000_poll();
             }
 
             if (arp_cache_lookup(ip, mac) == 0) {
@@ -118,7 +118,7 @@ int dhcp_get_ip(void) {
         udp_send(0xFFFFFFFF, 68, 67, buf, 548);
 
         for (int i = 0; i < 2000; i++) {
-            for (int p = 0; p < 50; p++) e1000_interrupt_handler();
+            for (int p = 0; p < 50; p++) e1000_poll();
             if (got_offer) goto send_request;
             for (volatile int j = 0; j < 5000; j++);
         }
@@ -135,7 +135,7 @@ send_request:
 
 
     for (int i = 0; i < 100; i++) {
-        e1000_interrupt_handler();
+        e1000_poll();
         for (volatile int j = 0; j < 10000; j++);
     }
 
@@ -180,7 +180,7 @@ send_request:
         udp_send(0xFFFFFFFF, 68, 67, buf, 548);
 
         for (int i = 0; i < 2000; i++) {
-            for (int p = 0; p < 50; p++) e1000_interrupt_handler();
+            for (int p = 0; p < 50; p++) e1000_poll();
             if (got_ack) goto done;
             for (volatile int j = 0; j < 5000; j++);
         }
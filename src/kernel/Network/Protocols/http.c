@@ -437,7 +437,7 @@ int http_get(const char *url, char *output, int max_len) {
     
     for (int i = 0; i < timeout; i++) {
         for (int p = 0; p < 50; p++) {
-            e1000_interrupt_handler();
+            e1000_poll();
         }
         
         if (http_response_len > last_len) {
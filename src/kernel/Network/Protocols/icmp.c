@@ -144,7 +144,7 @@ int icmp_wait_reply(uint16_t id, uint16_t seq, int timeout_ms) {
     for (int i = 0; i < iterations; i++) {
 
         for (int j = 0; j < 100; j++) {
-            e1000_interrupt_handler();
+            e1000_poll();
 
 
             if (reply_received || check_reply_in_array(id, seq)) {
@@ -228,7 +228,7 @@ void cmd_ping(const char *target) {
             for (int delay = 0; delay < 1000; delay++) {
 
                 for (int p = 0; p < 10; p++) {
-                    e1000_interrupt_handler();
+                    e1000_poll();
                 }
 
 
@@ -284,7 +284,7 @@ void cmd_ping_fast(const char *target) {
 
         for (int d = 0; d < 100; d++) {
             for (int p = 0; p < 10; p++) {
-                e1000_interrupt_handler();
+                e1000_poll();
             }
             for (volatile int j = 0; j < 1000; j++);
         }
@@ -141,7 +141,7 @@ int tcp_connect(tcp_socket_t *sock, uint32_t dest_ip, uint16_t dest_port) {
 
     for (int i = 0; i < timeout; i++) {
         for (int j = 0; j < 100; j++) {
-            e1000_interrupt_handler();
+            e1000_poll();
 
             if (sock->state == TCP_STATE_ESTABLISHED) {
                 PRINT(WHITE, BLACK, "\n");
@@ -203,7 +203,7 @@ int tcp_close(tcp_socket_t *sock) {
 
     for (int i = 0; i < 1000; i++) {
         for (int p = 0; p < 10; p++) {
-            e1000_interrupt_handler();
+            e1000_poll();
         }
         if (sock->state == TCP_STATE_CLOSED) break;
         for (volatile int j = 0; j < 1000; j++);
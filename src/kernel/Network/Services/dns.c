@@ -309,7 +309,7 @@ int dns_resolve(const char *hostname, uint32_t *ip_out) {
         for (int i = 0; i < timeout && dns_waiting; i++) {
 
             for (int p = 0; p < 100; p++) {
-                e1000_interrupt_handler();
+                e1000_poll();
                 if (!dns_waiting) {
                     PRINT(WHITE, BLACK, "\n");
                     goto done;
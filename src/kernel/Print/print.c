@@ -2,6 +2,8 @@
 #include "FONT.h"
 #include "string_helpers.h"
 #include "auto_scroll.h"
+#include "irq.h"
+#include "pipe.h"
 #include <stdarg.h>
 
 Framebuffer fb;
@@ -12,17 +14,8 @@ Buffer stdin_buf;
 Buffer stdout_buf;
 Buffer stderr_buf;
 
-FileDescriptor fd_table[256];
 extern char font8x8_basic[128][8];
 extern int isgui;
-void init_fds() {
-    fd_table[STDIN].type = 0;
-    fd_table[STDIN].buffer = &stdin_buf;
-    fd_table[STDOUT].type = 1;
-    fd_table[STDOUT].buffer = &stdout_buf;
-    fd_table[STDERR].type = 2;
-    fd_table[STDERR].buffer = &stderr_buf;
-}
 
 void init_graphics(EFI_SYSTEM_TABLE *ST) {
     EFI_GUID gop_guid = EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID;
@@ -160,12 +153,36 @@ static void debug_print_hex(unsigned char val) {
     printc(hex[val >> 4]);
     printc(hex[val & 0x0F]);
 }
-void print_unsigned(unsigned long long num, int base) {
+
+
+// Where printk's characters go: the screen, or a pipe that gets each
+// message in one write
+typedef struct {
+    pipe_t *pipe;             // NULL: the screen
+    uint32_t len;
+    char buf[512];            // As long as a format string can be
+} print_out_t;
+
+static void out_flush(print_out_t *out) {
+    if (out->pipe && out->len) pipe_write(out->pipe, (const uint8_t*)out->buf, out->len);
+    out->len = 0;
+}
+
+static void out_char(print_out_t *out, char c) {
+    if (!out->pipe) {
+        printc(c);
+        return;
+    }
+    if (out->len == sizeof(out->buf)) out_flush(out);
+    out->buf[out->len++] = c;
+}
+
+static void out_unsigned(print_out_t *out, unsigned long long num, int base) {
     char buf[32];
     int i = 0;
 
     if (num == 0) {
-        printc('0');
+        out_char(out, '0');
         return;
     }
 
@@ -176,26 +193,36 @@ void print_unsigned(unsigned long long num, int base) {
     }
 
     while (i > 0) {
-        printc(buf[--i]);
+        out_char(out, buf[--i]);
     }
 }
 
-void print_signed(long long num) {
+static void out_signed(print_out_t *out, long long num) {
     if (num < 0) {
-        printc('-');
+        out_char(out, '-');
         num = -num;
     }
-    print_unsigned((unsigned long long)num, 10);
+    out_unsigned(out, (unsigned long long)num, 10);
+}
+
+void print_unsigned(unsigned long long num, int base) {
+    print_out_t screen = { .pipe = NULL, .len = 0 };
+    out_unsigned(&screen, num, base);
 }
 
-static void safe_print_str(const char* str) {
+void print_signed(long long num) {
+    print_out_t screen = { .pipe = NULL, .len = 0 };
+    out_signed(&screen, num);
+}
+
+static void safe_print_str(print_out_t *out, const char* str) {
     if (!str) {
-        printc('(');
-        printc('n');
-        printc('u');
-        printc('l');
-        printc('l');
-        printc(')');
+        out_char(out, '(');
+        out_char(out, 'n');
+        out_char(out, 'u');
+        out_char(out, 'l');
+        out_char(out, 'l');
+        out_char(out, ')');
         return;
     }
 
@@ -209,7 +236,7 @@ static void safe_print_str(const char* str) {
     buf[i] = '\0';
 
     for (int j = 0; j < i; j++) {
-        printc(buf[j]);
+        out_char(out, buf[j]);
     }
 }
 
@@ -221,6 +248,12 @@ void printk(uint32_t text_fg, uint32_t text_bg, const char *format, ...) {
     cursor.fg_color = text_fg;
     cursor.bg_color = text_bg;
 
+    // A pipeline stage's output feeds the next stage. Writing may sleep,
+    // so anything printed with interrupts off still goes to the screen.
+    print_out_t out = { .pipe = NULL, .len = 0 };
+    thread_t *thread = get_current_thread();
+    if (thread && thread->pipe_out && irq_enabled()) out.pipe = thread->pipe_out;
+
     char fmt[512];
     int fmt_len = 0;
     while (format[fmt_len] && fmt_len < 511) {
@@ -235,7 +268,7 @@ void printk(uint32_t text_fg, uint32_t text_bg, const char *format, ...) {
     int i = 0;
     while (i < fmt_len) {
         if (fmt[i] != '%') {
-            printc(fmt[i]);
+            out_char(&out, fmt[i]);
             i++;
             continue;
         }
@@ -259,7 +292,7 @@ void printk(uint32_t text_fg, uint32_t text_bg, const char *format, ...) {
         switch (fmt[i]) {
             case 's': {
                 const char *str = va_arg(args, const char*);
-                safe_print_str(str);
+                safe_print_str(&out, str);
                 break;
             }
 
@@ -267,7 +300,7 @@ void printk(uint32_t text_fg, uint32_t text_bg, const char *format, ...) {
                 long long val = is_longlong ?
                     va_arg(args, long long) :
                     (long long)va_arg(args, int);
-                print_signed(val);
+                out_signed(&out, val);
                 break;
             }
 
@@ -275,7 +308,7 @@ void printk(uint32_t text_fg, uint32_t text_bg, const char *format, ...) {
                 unsigned long long val = is_longlong ?
                     va_arg(args, unsigned long long) :
                     (unsigned long long)va_arg(args, unsigned int);
-                print_unsigned(val, 10);
+                out_unsigned(&out, val, 10);
                 break;
             }
 
@@ -283,7 +316,7 @@ void printk(uint32_t text_fg, uint32_t text_bg, const char *format, ...) {
                 unsigned long long val = is_longlong ?
                     va_arg(args, unsigned long long) :
                     (unsigned long long)va_arg(args, unsigned int);
-                print_unsigned(val, 16);
+                out_unsigned(&out, val, 16);
                 break;
             }
 
@@ -291,32 +324,32 @@ void printk(uint32_t text_fg, uint32_t text_bg, const char *format, ...) {
                 unsigned long long val = is_longlong ?
                     va_arg(args, unsigned long long) :
                     (unsigned long long)va_arg(args, unsigned int);
-                print_unsigned(val, 16);
+                out_unsigned(&out, val, 16);
                 break;
             }
 
             case 'p': {
                 void *ptr = va_arg(args, void*);
-                printc('0');
-                printc('x');
-                print_unsigned((unsigned long long)ptr, 16);
+                out_char(&out, '0');
+                out_char(&out, 'x');
+                out_unsigned(&out, (unsigned long long)ptr, 16);
                 break;
             }
 
             case 'c': {
                 char ch = (char)va_arg(args, int);
-                printc(ch);
+                out_char(&out, ch);
                 break;
             }
 
             case '%': {
-                printc('%');
+                out_char(&out, '%');
                 break;
             }
 
             default: {
-                printc('%');
-                printc(fmt[i]);
+                out_char(&out, '%');
+                out_char(&out, fmt[i]);
                 break;
             }
         }
@@ -324,6 +357,7 @@ void printk(uint32_t text_fg, uint32_t text_bg, const char *format, ...) {
     }
 
     va_end(args);
+    out_flush(&out);
 
     cursor.fg_color = old_fg;
     cursor.bg_color = old_bg;
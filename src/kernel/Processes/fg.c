@@ -4,22 +4,17 @@
 #include "sleep.h"
 #include "string_helpers.h"
 #include "vfs.h"
+#include "idr.h"
+#include "irq.h"
+#include "memory.h"
 
-job_t job_table[MAX_JOBS];
-static int next_job_id = 1;
+static idr_t job_idr;
+static list_head_t job_list = LIST_HEAD_INIT(job_list);
 static int jobs_enabled = 0;
 
 void jobs_init(void) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        job_table[i].used = 0;
-        job_table[i].job_id = 0;
-        job_table[i].pid = 0;
-        job_table[i].tid = 0;
-        job_table[i].state = JOB_DONE;
-        job_table[i].is_background = 0;
-        job_table[i].sleep_until = 0;
-        job_table[i].command[0] = '\0';
-    }
+    idr_init(&job_idr, 1);
+    list_init(&job_list);
 
     jobs_enabled = 0;
     PRINT(MAGENTA, BLACK, "[JOBS] Job system initialized\n");
@@ -34,30 +29,41 @@ void jobs_set_active(int active) {
     }
 }
 
-static int find_free_job_slot(void) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (!job_table[i].used) {
-            return i;
-        }
+
+// Jobs found dead from IRQ context are only marked unused there;
+// unlinking and freeing happens here, outside interrupt handlers.
+static void reap_jobs(void) {
+    job_t *job, *tmp;
+    uint64_t flags = irq_save();
+
+    list_for_each_entry_safe(job, tmp, &job_list, job_t, link) {
+        if (job->used) continue;
+
+        idr_remove(&job_idr, job->job_id);
+        list_del(&job->link);
+        list_del(&job->thread_link);
+        kfree(job);
     }
-    return -1;
+
+    irq_restore(flags);
 }
 
-int add_fg_job(const char *command, uint32_t pid, uint32_t tid) {
-    int slot = find_free_job_slot();
-    if (slot < 0) {
-        PRINT(YELLOW, BLACK, "[JOBS] No free job slots\n");
-        return -1;
+static job_t* job_create(const char *command, uint32_t pid, uint32_t tid, int is_background) {
+    reap_jobs();
+
+    job_t *job = (job_t*)kcalloc(1, sizeof(job_t));
+    if (!job) {
+        PRINT(YELLOW, BLACK, "[JOBS] Out of memory for job\n");
+        return NULL;
     }
 
-    job_t *job = &job_table[slot];
-    job->job_id = next_job_id++;
     job->pid = pid;
     job->tid = tid;
     job->state = JOB_RUNNING;
-    job->is_background = 0;
-    job->used = 1;
+    job->is_background = is_background;
     job->sleep_until = 0;
+    list_init(&job->link);
+    list_init(&job->thread_link);
 
 
     int i = 0;
@@ -67,40 +73,42 @@ int add_fg_job(const char *command, uint32_t pid, uint32_t tid) {
     }
     job->command[i] = '\0';
 
-    PRINT(GREEN, BLACK, "[JOBS] Created foreground job %d (TID=%u)\n",
-          job->job_id, tid);
-
-    return job->job_id;
-}
-
-int add_bg_job(const char *command, uint32_t pid, uint32_t tid) {
 
+    uint64_t flags = irq_save();
+    int id = idr_alloc(&job_idr, job);
+    if (id < 0) {
+        irq_restore(flags);
+        PRINT(YELLOW, BLACK, "[JOBS] No free job IDs\n");
+        kfree(job);
+        return NULL;
+    }
 
+    job->job_id = id;
+    job->used = 1;
+    list_add_tail(&job->link, &job_list);
 
+    thread_t *thread = get_thread(tid);
+    if (thread) {
+        list_add_tail(&job->thread_link, &thread->jobs);
+    }
+    irq_restore(flags);
 
+    return job;
+}
 
-    int slot = find_free_job_slot();
-    if (slot < 0) {
-        PRINT(YELLOW, BLACK, "[JOBS] No free job slots\n");
-        return -1;
-    }
+int add_fg_job(const char *command, uint32_t pid, uint32_t tid) {
+    job_t *job = job_create(command, pid, tid, 0);
+    if (!job) return -1;
 
-    job_t *job = &job_table[slot];
-    job->job_id = next_job_id++;
-    job->pid = pid;
-    job->tid = tid;
-    job->state = JOB_RUNNING;
-    job->is_background = 1;
-    job->used = 1;
-    job->sleep_until = 0;
+    PRINT(GREEN, BLACK, "[JOBS] Created foreground job %d (TID=%u)\n",
+          job->job_id, tid);
 
+    return job->job_id;
+}
 
-    int i = 0;
-    while (command[i] && i < 255) {
-        job->command[i] = command[i];
-        i++;
-    }
-    job->command[i] = '\0';
+int add_bg_job(const char *command, uint32_t pid, uint32_t tid) {
+    job_t *job = job_create(command, pid, tid, 1);
+    if (!job) return -1;
 
     PRINT(WHITE, BLACK, "[%d] %d (TID %u)\n", job->job_id, pid, tid);
 
@@ -108,34 +116,55 @@ int add_bg_job(const char *command, uint32_t pid, uint32_t tid) {
 }
 
 void remove_job(int job_id) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (job_table[i].used && job_table[i].job_id == job_id) {
-            PRINT(MAGENTA, BLACK, "[%d]+ Done                    %s\n",
-                  job_id, job_table[i].command);
-
-            job_table[i].used = 0;
-            job_table[i].state = JOB_DONE;
-            return;
-        }
-    }
+    job_t *job = get_job(job_id);
+    if (!job) return;
+
+    PRINT(MAGENTA, BLACK, "[%d]+ Done                    %s\n",
+          job_id, job->command);
+
+    job->used = 0;
+    job->state = JOB_DONE;
+    reap_jobs();
 }
 
 job_t* get_job(int job_id) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (job_table[i].used && job_table[i].job_id == job_id) {
-            return &job_table[i];
-        }
+    if (job_id <= 0) return NULL;
+
+    job_t *job = (job_t*)idr_find(&job_idr, (uint32_t)job_id);
+    if (!job || !job->used) return NULL;
+    return job;
+}
+
+job_t* get_job_by_tid(uint32_t tid) {
+    thread_t *thread = get_thread(tid);
+    if (!thread) return NULL;
+
+    job_t *job;
+    list_for_each_entry(job, &thread->jobs, job_t, thread_link) {
+        if (job->used) return job;
     }
     return NULL;
 }
 
+int count_active_jobs(void) {
+    int count = 0;
+    job_t *job;
+
+    list_for_each_entry(job, &job_list, job_t, link) {
+        if (job->used) count++;
+    }
+    return count;
+}
+
 void list_jobs(void) {
     PRINT(WHITE, BLACK, "\n=== Jobs ===\n");
 
+    reap_jobs();
+
     int count = 0;
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (job_table[i].used) {
-            job_t *job = &job_table[i];
+    job_t *job;
+    list_for_each_entry(job, &job_list, job_t, link) {
+        if (job->used) {
             thread_t *thread = get_thread(job->tid);
 
             const char *state_str;
@@ -213,10 +242,10 @@ void update_jobs_safe(void) {
 
     uint64_t current_time_ms = get_uptime_ms();
 
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (!job_table[i].used) continue;
+    job_t *job;
+    list_for_each_entry(job, &job_list, job_t, link) {
+        if (!job->used) continue;
 
-        job_t *job = &job_table[i];
         thread_t *thread = get_thread(job->tid);
 
 
@@ -276,10 +305,10 @@ void update_jobs(void) {
         last_check_ms = current_time_ms;
     }
 
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (!job_table[i].used) continue;
+    job_t *job;
+    list_for_each_entry(job, &job_list, job_t, link) {
+        if (!job->used) continue;
 
-        job_t *job = &job_table[i];
         thread_t *thread = get_thread(job->tid);
 
 
@@ -341,4 +370,6 @@ void update_jobs(void) {
                 break;
         }
     }
+
+    reap_jobs();
 }
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "idr.h"
+#include "memory.h"
+
+#define IDR_FULL_MASK (~0ULL)
+
+static uint64_t idr_capacity(int layers) {
+    return 1ULL << (IDR_BITS * layers);
+}
+
+static idr_layer_t* idr_layer_alloc(void) {
+    return (idr_layer_t*)kcalloc(1, sizeof(idr_layer_t));
+}
+
+void idr_init(idr_t *idr, uint32_t base) {
+    idr->top = NULL;
+    idr->layers = 0;
+    idr->base = base;
+    idr->cursor = base;
+    idr->count = 0;
+}
+
+static int idr_grow(idr_t *idr, int layers) {
+    while (idr->layers < layers) {
+        idr_layer_t *layer = idr_layer_alloc();
+        if (!layer) return -1;
+
+        if (idr->top) {
+            layer->slots[0] = idr->top;
+            layer->present = 1;
+            if (idr->top->full == IDR_FULL_MASK) {
+                layer->full = 1;
+            }
+        }
+
+        idr->top = layer;
+        idr->layers++;
+    }
+    return 0;
+}
+
+
+static int64_t idr_find_free(idr_layer_t *layer, int shift, uint64_t first, uint64_t start) {
+    uint32_t idx = (start > first) ? (uint32_t)((start - first) >> shift) : 0;
+    if (idx >= IDR_SIZE) return -1;
+
+    uint64_t avail = ~layer->full & (IDR_FULL_MASK << idx);
+
+    while (avail) {
+        idx = __builtin_ctzll(avail);
+        uint64_t child_first = first + ((uint64_t)idx << shift);
+        uint64_t from = (start > child_first) ? start : child_first;
+
+        if (shift == 0) return (int64_t)child_first;
+
+        idr_layer_t *child = (idr_layer_t*)layer->slots[idx];
+        if (!child) return (int64_t)from;
+
+        int64_t id = idr_find_free(child, shift - IDR_BITS, child_first, from);
+        if (id >= 0) return id;
+
+        avail &= avail - 1;
+    }
+
+    return -1;
+}
+
+static int64_t idr_get_free(idr_t *idr, uint64_t start) {
+    while (start <= IDR_ID_MAX) {
+        int needed = idr->layers ? idr->layers : 1;
+        while (start >= idr_capacity(needed)) needed++;
+        if (needed > IDR_MAX_LAYERS || idr_grow(idr, needed) != 0) return -1;
+
+        int64_t id = idr_find_free(idr->top, (idr->layers - 1) * IDR_BITS, 0, start);
+        if (id >= 0) return (id <= IDR_ID_MAX) ? id : -1;
+
+        start = idr_capacity(idr->layers);
+    }
+    return -1;
+}
+
+static int idr_insert(idr_t *idr, uint32_t id, void *ptr) {
+    idr_layer_t *path[IDR_MAX_LAYERS];
+    uint32_t slot[IDR_MAX_LAYERS];
+    idr_layer_t *layer = idr->top;
+    int depth = 0;
+
+    for (int shift = (idr->layers - 1) * IDR_BITS; shift >= 0; shift -= IDR_BITS) {
+        uint32_t idx = (id >> shift) & IDR_MASK;
+        path[depth] = layer;
+        slot[depth] = idx;
+        depth++;
+
+        if (shift == 0) break;
+
+        if (!layer->slots[idx]) {
+            idr_layer_t *child = idr_layer_alloc();
+            if (!child) return -1;
+            layer->slots[idx] = child;
+            layer->present |= 1ULL << idx;
+        }
+        layer = (idr_layer_t*)layer->slots[idx];
+    }
+
+    layer->slots[slot[depth - 1]] = ptr;
+    layer->present |= 1ULL << slot[depth - 1];
+    layer->full |= 1ULL << slot[depth - 1];
+
+    for (int i = depth - 1; i > 0 && path[i]->full == IDR_FULL_MASK; i--) {
+        path[i - 1]->full |= 1ULL << slot[i - 1];
+    }
+
+    idr->count++;
+    return 0;
+}
+
+int idr_alloc(idr_t *idr, void *ptr) {
+    if (!ptr) return -1;
+
+    int64_t id = idr_get_free(idr, idr->cursor);
+    if (id < 0 && idr->cursor != idr->base) {
+        id = idr_get_free(idr, idr->base);
+    }
+    if (id < 0) return -1;
+
+    if (idr_insert(idr, (uint32_t)id, ptr) != 0) return -1;
+
+    idr->cursor = (id < IDR_ID_MAX) ? (uint32_t)id + 1 : idr->base;
+    return (int)id;
+}
+
+void* idr_find(idr_t *idr, uint32_t id) {
+    if (!idr->top || id >= idr_capacity(idr->layers)) return NULL;
+
+    idr_layer_t *layer = idr->top;
+    for (int shift = (idr->layers - 1) * IDR_BITS; shift > 0; shift -= IDR_BITS) {
+        layer = (idr_layer_t*)layer->slots[(id >> shift) & IDR_MASK];
+        if (!layer) return NULL;
+    }
+
+    return layer->slots[id & IDR_MASK];
+}
+
+void* idr_remove(idr_t *idr, uint32_t id) {
+    if (!idr->top || id >= idr_capacity(idr->layers)) return NULL;
+
+    idr_layer_t *path[IDR_MAX_LAYERS];
+    uint32_t slot[IDR_MAX_LAYERS];
+    idr_layer_t *layer = idr->top;
+    int depth = 0;
+
+    for (int shift = (idr->layers - 1) * IDR_BITS; shift >= 0; shift -= IDR_BITS) {
+        uint32_t idx = (id >> shift) & IDR_MASK;
+        path[depth] = layer;
+        slot[depth] = idx;
+        depth++;
+
+        if (shift == 0) break;
+
+        layer = (idr_layer_t*)layer->slots[idx];
+        if (!layer) return NULL;
+    }
+
+    void *ptr = layer->slots[slot[depth - 1]];
+    if (!ptr) return NULL;
+
+    layer->slots[slot[depth - 1]] = NULL;
+    layer->present &= ~(1ULL << slot[depth - 1]);
+    layer->full &= ~(1ULL << slot[depth - 1]);
+
+    for (int i = depth - 1; i > 0; i--) {
+        idr_layer_t *parent = path[i - 1];
+        parent->full &= ~(1ULL << slot[i - 1]);
+
+        if (path[i]->present == 0) {
+            parent->slots[slot[i - 1]] = NULL;
+            parent->present &= ~(1ULL << slot[i - 1]);
+            kfree(path[i]);
+        }
+    }
+
+    idr->count--;
+    return ptr;
+}
+
+
+static void* idr_find_next(idr_layer_t *layer, int shift, uint64_t first,
+                           uint64_t start, uint64_t *out) {
+    uint32_t idx = (start > first) ? (uint32_t)((start - first) >> shift) : 0;
+    if (idx >= IDR_SIZE) return NULL;
+
+    uint64_t avail = layer->present & (IDR_FULL_MASK << idx);
+
+    while (avail) {
+        idx = __builtin_ctzll(avail);
+        uint64_t child_first = first + ((uint64_t)idx << shift);
+
+        if (shift == 0) {
+            *out = child_first;
+            return layer->slots[idx];
+        }
+
+        void *ptr = idr_find_next((idr_layer_t*)layer->slots[idx], shift - IDR_BITS,
+                                  child_first, (start > child_first) ? start : child_first, out);
+        if (ptr) return ptr;
+
+        avail &= avail - 1;
+    }
+
+    return NULL;
+}
+
+void* idr_get_next(idr_t *idr, uint32_t *id) {
+    if (!idr->top || *id >= idr_capacity(idr->layers)) return NULL;
+
+    uint64_t found = 0;
+    void *ptr = idr_find_next(idr->top, (idr->layers - 1) * IDR_BITS, 0, *id, &found);
+    if (ptr) *id = (uint32_t)found;
+    return ptr;
+}
+
+uint32_t idr_count(idr_t *idr) {
+    return idr->count;
+}
@@ -2,32 +2,22 @@
 #include "memory.h"
 #include "print.h"
 #include "string_helpers.h"
+#include "idr.h"
+#include "irq.h"
+#include "fdtable.h"
 
 
-process_t process_table[MAX_PROCESSES];
+list_head_t process_list = LIST_HEAD_INIT(process_list);
 
-static uint32_t next_pid = 1;
+static idr_t pid_idr;
 
 
 
 
 
 void process_init(void) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        process_table[i].used = 0;
-        process_table[i].pid = 0;
-        process_table[i].thread_count = 0;
-        process_table[i].state = PROCESS_STATE_TERMINATED;
-        process_table[i].memory_space = 0;
-
-        for (int j = 0; j < MAX_THREADS_PER_PROCESS; j++) {
-            process_table[i].threads[j] = NULL;
-        }
-
-        for (int j = 0; j < 64; j++) {
-            process_table[i].name[j] = 0;
-        }
-    }
+    idr_init(&pid_idr, 1);
+    list_init(&process_list);
 
     PRINT(MAGENTA, BLACK, "[PROCESS] Process management initialized\n");
 }
@@ -36,28 +26,38 @@ void process_init(void) {
 
 
 
-static int find_free_process(void) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (!process_table[i].used) {
-            return i;
-        }
+int process_create(const char *name, uint64_t memory_space) {
+    process_t *proc = (process_t*)kcalloc(1, sizeof(process_t));
+    if (!proc) {
+        PRINT(YELLOW, BLACK, "[PROCESS] Out of memory for process\n");
+        return -1;
     }
-    return -1;
-}
 
-int process_create(const char *name, uint64_t memory_space) {
-    int idx = find_free_process();
-    if (idx < 0) {
-        PRINT(YELLOW, BLACK, "[PROCESS] No free process slots\n");
+    thread_t *creator = get_current_thread();
+    proc->ppid = creator && creator->parent ? creator->parent->pid : 0;
+
+    // Inherit the creator's descriptors (the kernel's at boot)
+    proc->files = fdt_current();
+    if (proc->files) fdt_get(proc->files);
+
+    uint64_t flags = irq_save();
+    int pid = idr_alloc(&pid_idr, proc);
+    if (pid < 0) {
+        irq_restore(flags);
+        PRINT(YELLOW, BLACK, "[PROCESS] No free PIDs\n");
+        fdt_put(proc->files);
+        kfree(proc);
         return -1;
     }
 
-    process_t *proc = &process_table[idx];
-    proc->pid = next_pid++;
+    proc->pid = (uint32_t)pid;
     proc->memory_space = memory_space;
     proc->state = PROCESS_STATE_READY;
     proc->thread_count = 0;
     proc->used = 1;
+    list_init(&proc->threads);
+    list_add_tail(&proc->link, &process_list);
+    irq_restore(flags);
 
     int i = 0;
     while (name[i] && i < 63) {
@@ -73,12 +73,19 @@ int process_create(const char *name, uint64_t memory_space) {
 }
 
 process_t* get_process(uint32_t pid) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i].used && process_table[i].pid == pid) {
-            return &process_table[i];
-        }
-    }
-    return NULL;
+    return (process_t*)idr_find(&pid_idr, pid);
+}
+
+uint32_t process_count(void) {
+    return idr_count(&pid_idr);
+}
+
+// Called with interrupts off once the last thread has gone; the PID is
+// free for reuse afterwards
+void process_remove(process_t *proc) {
+    idr_remove(&pid_idr, proc->pid);
+    list_del(&proc->link);
+    kfree(proc);
 }
 
 
@@ -89,38 +96,33 @@ void print_process_table(void) {
     PRINT(WHITE, BLACK, "\n=== Process Table ===\n");
 
     int count = 0;
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i].used) {
-            process_t *p = &process_table[i];
-
-            const char *state_str;
-            switch (p->state) {
-                case PROCESS_STATE_RUNNING: state_str = "RUNNING"; break;
-                case PROCESS_STATE_READY: state_str = "READY"; break;
-                case PROCESS_STATE_BLOCKED: state_str = "BLOCKED"; break;
-                default: state_str = "TERMINATED"; break;
-            }
+    process_t *p;
+    for_each_process(p) {
+        const char *state_str;
+        switch (p->state) {
+            case PROCESS_STATE_RUNNING: state_str = "RUNNING"; break;
+            case PROCESS_STATE_READY: state_str = "READY"; break;
+            case PROCESS_STATE_BLOCKED: state_str = "BLOCKED"; break;
+            default: state_str = "TERMINATED"; break;
+        }
 
-            PRINT(MAGENTA, BLACK, "PID=%u | '%s' | Memory=0x%llX | State=%s | Threads=%u\n",
-                  p->pid, p->name, p->memory_space, state_str, p->thread_count);
-
-            for (uint32_t j = 0; j < p->thread_count; j++) {
-                thread_t *t = p->threads[j];
-                if (t) {
-                    const char *tstate_str;
-                    switch (t->state) {
-                        case THREAD_STATE_RUNNING: tstate_str = "RUNNING"; break;
-                        case THREAD_STATE_READY: tstate_str = "READY"; break;
-                        case THREAD_STATE_BLOCKED: tstate_str = "BLOCKED"; break;
-                        default: tstate_str = "TERMINATED"; break;
-                    }
-
-                    PRINT(WHITE, BLACK, "  TID=%u | %s | Entry=0x%llx\n",
-                          t->tid, tstate_str, t->entry_point);
-                }
+        PRINT(MAGENTA, BLACK, "PID=%u | '%s' | Memory=0x%llX | State=%s | Threads=%u\n",
+              p->pid, p->name, p->memory_space, state_str, p->thread_count);
+
+        thread_t *t;
+        for_each_process_thread(p, t) {
+            const char *tstate_str;
+            switch (t->state) {
+                case THREAD_STATE_RUNNING: tstate_str = "RUNNING"; break;
+                case THREAD_STATE_READY: tstate_str = "READY"; break;
+                case THREAD_STATE_BLOCKED: tstate_str = "BLOCKED"; break;
+                default: tstate_str = "TERMINATED"; break;
             }
-            count++;
+
+            PRINT(WHITE, BLACK, "  TID=%u | %s | Entry=0x%llx\n",
+                  t->tid, tstate_str, t->entry_point);
         }
+        count++;
     }
 
     if (count == 0) {
@@ -4,20 +4,31 @@
 #include "print.h"
 #include "string_helpers.h"
 #include "TSS.h"
+#include "idr.h"
+#include "irq.h"
+#include "percpu.h"
+#include "irqstat.h"
+#include "fdtable.h"
 
 
-thread_t thread_table[MAX_THREADS_GLOBAL];
-
+list_head_t thread_list = LIST_HEAD_INIT(thread_list);
 
+static idr_t tid_idr;
 static thread_t *current_thread = NULL;
 static thread_t *idle_thread = NULL;
-static uint32_t next_tid = 1;
 static volatile int scheduler_enabled = 0;
 static volatile int in_scheduler = 0;
 
 
-static thread_t *ready_queue_head = NULL;
-static thread_t *ready_queue_tail = NULL;
+static list_head_t ready_queue = LIST_HEAD_INIT(ready_queue);
+static list_head_t zombie_list = LIST_HEAD_INIT(zombie_list);
+// Threads in thread_sleep_until(), soonest wakeup first (thread_t.wait_link)
+static list_head_t sleep_list = LIST_HEAD_INIT(sleep_list);
+
+static thread_t* ready_queue_peek(void) {
+    if (list_empty(&ready_queue)) return NULL;
+    return list_first_entry(&ready_queue, thread_t, run_link);
+}
 
 
 int get_scheduler_enabled(void) {
@@ -52,8 +63,8 @@ void debug_context_switch(void) {
     }
 
 
-    if (ready_queue_head) {
-        thread_t *next = ready_queue_head;
+    thread_t *next = ready_queue_peek();
+    if (next) {
         PRINT(WHITE, BLACK, "\nNext thread: TID=%u\n", next->tid);
         PRINT(WHITE, BLACK, "  RSP: 0x%llx\n", next->context.rsp);
         PRINT(WHITE, BLACK, "  RIP: 0x%llx\n", next->context.rip);
@@ -78,21 +89,10 @@ void debug_context_switch(void) {
 
 void scheduler_init(void) {
 
-    for (int i = 0; i < MAX_THREADS_GLOBAL; i++) {
-        thread_table[i].used = 0;
-        thread_table[i].tid = 0;
-        thread_table[i].parent = NULL;
-        thread_table[i].state = THREAD_STATE_TERMINATED;
-        thread_table[i].next = NULL;
-        thread_table[i].stack_base = NULL;
-        thread_table[i].stack_pointer = 0;
-        thread_table[i].stack_size = 0;
-        thread_table[i].private_data = NULL;
-        thread_table[i].entry_point = 0;
-    }
-
-    ready_queue_head = NULL;
-    ready_queue_tail = NULL;
+    idr_init(&tid_idr, 1);
+    list_init(&thread_list);
+    list_init(&ready_queue);
+    list_init(&zombie_list);
     current_thread = NULL;
     idle_thread = NULL;
     scheduler_enabled = 0;
@@ -106,7 +106,7 @@ void scheduler_enable(void) {
     PRINT(MAGENTA, BLACK, "[SCHED] Scheduler ENABLED\n");
 
 
-    if (!current_thread && ready_queue_head) {
+    if (!current_thread && !list_empty(&ready_queue)) {
         PRINT(YELLOW, BLACK, "[SCHED] No current thread, forcing initial schedule...\n");
         schedule();
     }
@@ -117,53 +117,46 @@ void scheduler_disable(void) {
     PRINT(MAGENTA, BLACK, "[SCHED] Scheduler DISABLED\n");
 }
 
-static int find_free_thread_slot(void) {
-    for (int i = 0; i < MAX_THREADS_GLOBAL; i++) {
-        if (!thread_table[i].used) {
-            return i;
-        }
-    }
-    return -1;
-}
-
 void ready_queue_add(thread_t *thread) {
     if (!thread) return;
 
-    thread->next = NULL;
-
-    if (!ready_queue_head) {
-        ready_queue_head = thread;
-        ready_queue_tail = thread;
-    } else {
-        ready_queue_tail->next = thread;
-        ready_queue_tail = thread;
+    uint64_t flags = irq_save();
+    if (list_empty(&thread->run_link)) {
+        list_add_tail(&thread->run_link, &ready_queue);
     }
+    irq_restore(flags);
 }
 
 void ready_queue_remove(thread_t *thread) {
-    if (!thread || !ready_queue_head) return;
+    if (!thread) return;
 
-    if (ready_queue_head == thread) {
-        ready_queue_head = thread->next;
-        if (ready_queue_tail == thread) {
-            ready_queue_tail = NULL;
+    uint64_t flags = irq_save();
+    list_del(&thread->run_link);
+    irq_restore(flags);
+}
+
+
+static void reap_zombies(void) {
+    uint64_t flags = irq_save();
+
+    while (!list_empty(&zombie_list)) {
+        thread_t *thread = list_first_entry(&zombie_list, thread_t, run_link);
+        list_del(&thread->run_link);
+
+        while (!list_empty(&thread->jobs)) {
+            list_del(thread->jobs.next);
         }
-        thread->next = NULL;
-        return;
-    }
 
-    thread_t *current = ready_queue_head;
-    while (current->next) {
-        if (current->next == thread) {
-            current->next = thread->next;
-            if (ready_queue_tail == thread) {
-                ready_queue_tail = current;
-            }
-            thread->next = NULL;
-            return;
+        if (thread->stack_base) {
+            kfree(thread->stack_base);
+        }
+        if (thread->kernel_stack) {
+            kfree(thread->kernel_stack);
         }
-        current = current->next;
+        kfree(thread);
     }
+
+    irq_restore(flags);
 }
 
 static void thread_wrapper(void) {
@@ -186,7 +179,7 @@ static void thread_wrapper(void) {
     PRINT(GREEN, BLACK, "[THREAD] TID=%u started execution\n", current->tid);
 
 
-    __asm__ volatile("sti");
+    irq_enable();
 
 
 
@@ -273,24 +266,28 @@ int thread_create(uint32_t pid, void (*entry_point)(void), uint32_t stack_size,
         return -1;
     }
 
-    if (proc->thread_count >= MAX_THREADS_PER_PROCESS) {
-        PRINT(YELLOW, BLACK, "[THREAD] Max threads for process %u\n", pid);
-        return -1;
-    }
+    reap_zombies();
 
-    int slot = find_free_thread_slot();
-    if (slot < 0) {
-        PRINT(YELLOW, BLACK, "[THREAD] No free thread slots\n");
+    thread_t *thread = (thread_t*)kcalloc(1, sizeof(thread_t));
+    if (!thread) {
+        PRINT(YELLOW, BLACK, "[THREAD] Out of memory for thread\n");
         return -1;
     }
 
-    thread_t *thread = &thread_table[slot];
-
 
     thread->stack_size = stack_size;
     thread->stack_base = kmalloc(stack_size);
     if (!thread->stack_base) {
         PRINT(YELLOW, BLACK, "[THREAD] Stack allocation failed\n");
+        kfree(thread);
+        return -1;
+    }
+
+    thread->kernel_stack = kmalloc(THREAD_KSTACK_SIZE);
+    if (!thread->kernel_stack) {
+        PRINT(YELLOW, BLACK, "[THREAD] Kernel stack allocation failed\n");
+        kfree(thread->stack_base);
+        kfree(thread);
         return -1;
     }
 
@@ -300,11 +297,14 @@ int thread_create(uint32_t pid, void (*entry_point)(void), uint32_t stack_size,
     }
 
 
-    thread->tid = next_tid++;
     thread->parent = proc;
     thread->state = THREAD_STATE_READY;
     thread->used = 1;
-    thread->next = NULL;
+    list_init(&thread->run_link);
+    list_init(&thread->proc_link);
+    list_init(&thread->global_link);
+    list_init(&thread->jobs);
+    list_init(&thread->wait_link);
     thread->private_data = NULL;
     thread->entry_point = (uint64_t)entry_point;
 
@@ -320,15 +320,42 @@ int thread_create(uint32_t pid, void (*entry_point)(void), uint32_t stack_size,
     thread->last_scheduled = 0;
 
 
-    proc->threads[proc->thread_count++] = thread;
+    uint64_t flags = irq_save();
+
+    // Its last thread may have exited since the lookup, taking the PID along
+    if (get_process(pid) != proc) {
+        irq_restore(flags);
+        PRINT(YELLOW, BLACK, "[THREAD] Process %u exited\n", pid);
+        kfree(thread->kernel_stack);
+        kfree(thread->stack_base);
+        kfree(thread);
+        return -1;
+    }
+
+    int tid = idr_alloc(&tid_idr, thread);
+    if (tid < 0) {
+        irq_restore(flags);
+        PRINT(YELLOW, BLACK, "[THREAD] No free thread IDs\n");
+        kfree(thread->kernel_stack);
+        kfree(thread->stack_base);
+        kfree(thread);
+        return -1;
+    }
+
+    thread->tid = (uint32_t)tid;
+    list_add_tail(&thread->proc_link, &proc->threads);
+    proc->thread_count++;
+    list_add_tail(&thread->global_link, &thread_list);
+    irq_restore(flags);
 
 
     ready_queue_add(thread);
 
+    thread_t *head = ready_queue_peek();
     PRINT(MAGENTA, BLACK, "[THREAD] Created TID=%u for PID=%u (entry=0x%llx)\n",
           thread->tid, proc->pid, thread->entry_point);
     PRINT(CYAN, BLACK, "[THREAD] TID=%u added, ready_head=%u\n",
-      thread->tid, ready_queue_head ? ready_queue_head->tid : 0);
+      thread->tid, head ? head->tid : 0);
 
     if (scheduler_enabled && !current_thread) {
         PRINT(YELLOW, BLACK, "[THREAD] Scheduler enabled, auto-starting first thread\n");
@@ -339,12 +366,11 @@ int thread_create(uint32_t pid, void (*entry_point)(void), uint32_t stack_size,
 }
 
 thread_t* get_thread(uint32_t tid) {
-    for (int i = 0; i < MAX_THREADS_GLOBAL; i++) {
-        if (thread_table[i].used && thread_table[i].tid == tid) {
-            return &thread_table[i];
-        }
-    }
-    return NULL;
+    return (thread_t*)idr_find(&tid_idr, tid);
+}
+
+uint32_t thread_count_global(void) {
+    return idr_count(&tid_idr);
 }
 
 thread_t* get_current_thread(void) {
@@ -390,6 +416,78 @@ void thread_unblock(uint32_t tid) {
     PRINT(WHITE, BLACK, "[THREAD] Unblocked TID=%u\n", tid);
 }
 
+void thread_sleep_until(uint64_t tick) {
+    thread_t *thread = current_thread;
+    if (!scheduler_enabled || !thread) {
+        while (get_timer_ticks() < tick) thread_yield();
+        return;
+    }
+
+    irq_disable();
+    if (get_timer_ticks() >= tick) {
+        irq_enable();
+        return;
+    }
+
+    list_head_t *pos = sleep_list.next;
+    while (pos != &sleep_list && list_entry(pos, thread_t, wait_link)->sleep_until <= tick) {
+        pos = pos->next;
+    }
+    thread->sleep_until = tick;
+    list_add_tail(&thread->wait_link, pos);
+
+    thread->state = THREAD_STATE_BLOCKED;
+    ready_queue_remove(thread);
+    schedule();
+}
+
+// Timer interrupt: make sleepers whose time has come runnable
+static void wake_sleepers(void) {
+    uint64_t now = get_timer_ticks();
+
+    while (!list_empty(&sleep_list)) {
+        thread_t *thread = list_first_entry(&sleep_list, thread_t, wait_link);
+        if (thread->sleep_until > now) break;
+
+        list_del(&thread->wait_link);
+        thread->sleep_until = 0;
+        thread->state = THREAD_STATE_READY;
+        ready_queue_add(thread);
+    }
+}
+
+void wait_queue_init(wait_queue_t *wq) {
+    list_init(&wq->waiters);
+}
+
+int wait_queue_sleep(wait_queue_t *wq) {
+    thread_t *thread = current_thread;
+    if (!scheduler_enabled || !thread) return -1;
+
+    list_add_tail(&thread->wait_link, &wq->waiters);
+    thread->state = THREAD_STATE_BLOCKED;
+    ready_queue_remove(thread);
+
+    schedule();
+    return 0;
+}
+
+void wait_queue_wake(wait_queue_t *wq) {
+    uint64_t flags = irq_save();
+
+    while (!list_empty(&wq->waiters)) {
+        thread_t *thread = list_first_entry(&wq->waiters, thread_t, wait_link);
+        list_del(&thread->wait_link);
+
+        if (thread->state == THREAD_STATE_BLOCKED) {
+            thread->state = THREAD_STATE_READY;
+            ready_queue_add(thread);
+        }
+    }
+
+    irq_restore(flags);
+}
+
 void thread_exit(void) {
     if (!current_thread) {
         PRINT(YELLOW, BLACK, "[THREAD] Exit: no current thread\n");
@@ -399,35 +497,37 @@ void thread_exit(void) {
     uint32_t tid = current_thread->tid;
     PRINT(WHITE, BLACK, "[THREAD] Exiting TID=%u\n", tid);
 
+    irq_disable();
+
     current_thread->state = THREAD_STATE_TERMINATED;
     current_thread->used = 0;
 
+    idr_remove(&tid_idr, tid);
+    list_del(&current_thread->global_link);
+    list_del(&current_thread->run_link);
 
-    if (current_thread->stack_base) {
-        kfree(current_thread->stack_base);
-        current_thread->stack_base = NULL;
-    }
+
+    // Still running on this stack: freed by reap_zombies() later
+    list_add_tail(&current_thread->run_link, &zombie_list);
 
 
     process_t *proc = current_thread->parent;
     if (proc) {
-        for (int i = 0; i < proc->thread_count; i++) {
-            if (proc->threads[i] == current_thread) {
-
-                for (int j = i; j < proc->thread_count - 1; j++) {
-                    proc->threads[j] = proc->threads[j + 1];
-                }
-                proc->thread_count--;
-                proc->threads[proc->thread_count] = NULL;
-                break;
-            }
-        }
+        list_del(&current_thread->proc_link);
+        proc->thread_count--;
 
 
         if (proc->thread_count == 0) {
             proc->state = PROCESS_STATE_TERMINATED;
             PRINT(WHITE, BLACK, "[THREAD] Process %u terminated (no threads)\n", proc->pid);
+
+            fd_table_t *files = proc->files;
+            proc->files = NULL;
+            fdt_put(files);
+
+            process_remove(proc);
         }
+        current_thread->parent = NULL;
     }
 
     current_thread = NULL;
@@ -444,7 +544,7 @@ void thread_yield(void) {
     if (!scheduler_enabled) return;
     if (!current_thread) {
 
-        if (ready_queue_head) {
+        if (!list_empty(&ready_queue)) {
             schedule();
         }
         return;
@@ -472,7 +572,7 @@ void schedule(void) {
     }
 
 
-    thread_t *next = ready_queue_head;
+    thread_t *next = ready_queue_peek();
 
 
     if (!next) {
@@ -488,6 +588,7 @@ void schedule(void) {
             current_thread = NULL;
 
 
+            irqoff_end();
             __asm__ volatile("sti; hlt");
 
 
@@ -498,13 +599,14 @@ void schedule(void) {
     }
 
 
-    ready_queue_head = next->next;
-    if (ready_queue_tail == next) {
-        ready_queue_tail = NULL;
-    }
-    next->next = NULL;
+    ready_queue_remove(next);
     next->state = THREAD_STATE_RUNNING;
 
+    // Ring 3 entries (SYSCALL, interrupts) land on the thread's own kernel stack
+    set_kernel_stack(((uint64_t)next->kernel_stack + THREAD_KSTACK_SIZE) & ~0xFULL);
+    get_percpu_data()->user_mode = next->user_mode;
+    get_percpu_data()->current_tid = next->tid;
+
 
     if (!prev) {
         current_thread = next;
@@ -513,6 +615,8 @@ void schedule(void) {
         PRINT(MAGENTA, BLACK, "[SCHED] Starting first thread TID=%u\n", next->tid);
 
         uint64_t new_rsp = next->context.rsp;
+        irqstat_switch();
+        irqoff_end();
 
         __asm__ volatile(
             "mov %0, %%rsp\n"
@@ -544,9 +648,9 @@ void schedule(void) {
     current_thread = next;
     in_scheduler = 0;
 
-
+    irqstat_switch();
     switch_to_thread(&prev->context, &next->context);
-    __asm__ volatile("sti");
+    irq_enable();
 }
 void scheduler_tick(void) {
     if (!scheduler_enabled) return;
@@ -554,9 +658,9 @@ void scheduler_tick(void) {
 
     if (in_scheduler) return;
 
+    wake_sleepers();
 
-
-    if (ready_queue_head) {
+    if (!list_empty(&ready_queue)) {
         schedule();
     }
 }
@@ -8,9 +8,6 @@
 #define TIMER_FREQ 1000
 
 
-extern job_t job_table[];
-
-
 
 void sleep_ticks(uint64_t ticks) {
     if (ticks == 0) return;
@@ -37,23 +34,14 @@ void sleep_ticks(uint64_t ticks) {
           current->tid, sleep_duration_ms, current_time_ms, wake_time_ms);
 
 
-    extern job_t job_table[];
-    int found_job = 0;
-    for (int i = 0; i < MAX_JOBS; i++) {
-        job_t *job = &job_table[i];
-
-        if (job->used && job->tid == current->tid) {
-            job->state = JOB_SLEEPING;
-            job->sleep_until = wake_time_ms;
-            found_job = 1;
-
-            PRINT(WHITE, BLACK, "[SLEEP] Job %d will wake at %llu ms\n",
-                  job->job_id, wake_time_ms);
-            break;
-        }
-    }
+    job_t *job = get_job_by_tid(current->tid);
+    if (job) {
+        job->state = JOB_SLEEPING;
+        job->sleep_until = wake_time_ms;
 
-    if (!found_job) {
+        PRINT(WHITE, BLACK, "[SLEEP] Job %d will wake at %llu ms\n",
+              job->job_id, wake_time_ms);
+    } else {
         PRINT(YELLOW, BLACK, "[SLEEP] WARNING: No job found for TID=%u\n", current->tid);
     }
 
@@ -32,6 +32,17 @@
 #include "command_history.h"
 #include "keyboard.h"
 #include "IO.h"
+#include "irq.h"
+#include "apic.h"
+#include "irqstat.h"
+#include "bcache.h"
+#include "dcache.h"
+#include "pagecache.h"
+#include "ide_dma.h"
+#include "blkdev.h"
+#include "ahci.h"
+#include "fdtable.h"
+#include "pipe.h"
 
 #define CURSOR_BLINK_RATE 50000
 
@@ -135,7 +146,7 @@ void shell_thread_entry(void) {
     PRINT(GREEN, BLACK, "[SHELL] Starting as thread\n");
 
 
-    __asm__ volatile("sti");
+    irq_enable();
 
 
     uint64_t flags;
@@ -253,7 +264,6 @@ static void u64_to_hex(uint64_t val, char *out) {
 
 void cmd_schedinfo(void) {
     extern int get_scheduler_enabled(void);
-    extern thread_t thread_table[];
 
     PRINT(CYAN, BLACK, "\n=== Scheduler Information ===\n");
     PRINT(WHITE, BLACK, "Scheduler enabled: %s\n",
@@ -268,9 +278,10 @@ void cmd_schedinfo(void) {
 
 
     int running = 0, ready = 0, blocked = 0, terminated = 0;
-    for (int i = 0; i < MAX_THREADS_GLOBAL; i++) {
-        if (thread_table[i].used) {
-            switch (thread_table[i].state) {
+    thread_t *t;
+    for_each_thread(t) {
+        if (t->used) {
+            switch (t->state) {
                 case THREAD_STATE_RUNNING: running++; break;
                 case THREAD_STATE_READY: ready++; break;
                 case THREAD_STATE_BLOCKED: blocked++; break;
@@ -314,11 +325,11 @@ static uint32_t resolve_special_target(const char *target) {
  void cmd_schedstart(void) {
     PRINT(WHITE, BLACK, "Forcing scheduler to start threads...\n");
 
-    extern thread_t thread_table[];
     int ready_count = 0;
+    thread_t *t;
 
-    for (int i = 0; i < MAX_THREADS_GLOBAL; i++) {
-        if (thread_table[i].used && thread_table[i].state == THREAD_STATE_READY) {
+    for_each_thread(t) {
+        if (t->used && t->state == THREAD_STATE_READY) {
             ready_count++;
         }
     }
@@ -365,11 +376,11 @@ static uint32_t resolve_special_target(const char *target) {
 
 
     PRINT(WHITE, BLACK, "[3/5] Checking threads... ");
-    extern thread_t thread_table[];
     int running = 0, ready = 0, blocked = 0;
-    for (int i = 0; i < MAX_THREADS_GLOBAL; i++) {
-        if (thread_table[i].used) {
-            switch (thread_table[i].state) {
+    thread_t *t;
+    for_each_thread(t) {
+        if (t->used) {
+            switch (t->state) {
                 case THREAD_STATE_RUNNING: running++; break;
                 case THREAD_STATE_READY: ready++; break;
                 case THREAD_STATE_BLOCKED: blocked++; break;
@@ -392,22 +403,18 @@ static uint32_t resolve_special_target(const char *target) {
 
 
     PRINT(WHITE, BLACK, "[4/5] Checking job system... ");
-    extern job_t job_table[];
-    int active_jobs = 0;
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (job_table[i].used) active_jobs++;
-    }
+    int active_jobs = count_active_jobs();
     PRINT(GREEN, BLACK, " %d active jobs\n", active_jobs);
 
 
     PRINT(WHITE, BLACK, "[5/5] Checking interrupts... ");
-    uint8_t pic_mask = inb(0x21);
-    if (pic_mask & 0x01) {
+    int timer_masked = irq_is_masked(0);
+    if (timer_masked) {
         PRINT(RED, BLACK, "âœ— IRQ0 (timer) is MASKED!\n");
-        PRINT(YELLOW, BLACK, "   PIC mask: 0x%02x\n", pic_mask);
+        PRINT(YELLOW, BLACK, "   Controller: %s\n", apic_enabled() ? "I/O APIC" : "8259 PIC");
         issues++;
     } else {
-        PRINT(GREEN, BLACK, " IRQ0 unmasked (mask: 0x%02x)\n", pic_mask);
+        PRINT(GREEN, BLACK, " IRQ0 unmasked (%s)\n", apic_enabled() ? "I/O APIC" : "8259 PIC");
     }
 
     if (issues == 0) {
@@ -420,7 +427,7 @@ static uint32_t resolve_special_target(const char *target) {
         if (get_scheduler_enabled() == 0) {
             PRINT(WHITE, BLACK, "   Scheduler disabled");
         }
-        if (pic_mask & 0x01) {
+        if (timer_masked) {
             PRINT(WHITE, BLACK, "   Timer IRQ masked - interrupts won't fire\n");
         }
         if (running == 0 && ready > 0) {
@@ -876,6 +883,8 @@ void cmd_ifconfig(void) {
     } else {
         PRINT(YELLOW, BLACK, "Link: DOWN\n");
     }
+
+    e1000_print_stats();
 }
 
 void cmd_netconfig(const char *args) {
@@ -1670,7 +1679,7 @@ void bg_command_thread(void) {
     bg_exec_context_t *ctx = (bg_exec_context_t*)current->private_data;
 
 
-    __asm__ volatile("sti");
+    irq_enable();
 
     PRINT(GREEN, BLACK, "\n[BG %d] Starting: %s\n", ctx->job_id, ctx->command);
 
@@ -1841,6 +1850,330 @@ void send_to_background(int job_id) {
     PRINT(GREEN, BLACK, "bg: job %d (%s) sent to background\n", job_id, job->command);
 }
 
+static void fsbench_path(char *path, const char *dir, uint32_t i) {
+    int len = 0;
+    for (int j = 0; dir[j]; j++) path[len++] = dir[j];
+    path[len++] = '/';
+    path[len++] = 'f';
+
+    char digits[10];
+    int nd = 0;
+    do {
+        digits[nd++] = (char)('0' + i % 10);
+        i /= 10;
+    } while (i);
+    while (nd) path[len++] = digits[--nd];
+    path[len] = '\0';
+}
+
+// Create, write and remove n small files under /fsbench: nearly all of it
+// is metadata, so the rate shows what the journal's batching buys
+static void cmd_fsbench(const char *arg) {
+    while (*arg == ' ') arg++;
+    uint32_t count = parse_number(arg);
+    if (count == 0) count = 100;
+
+    char dir[] = "/fsbench";
+    if (!vfs_resolve_path(dir) && vfs_mkdir(dir, FILE_READ | FILE_WRITE) != 0) {
+        PRINT(YELLOW, BLACK, "fsbench: cannot create %s\n", dir);
+        return;
+    }
+
+    char path[32];
+    uint8_t payload[64];
+    for (int i = 0; i < 64; i++) {
+        payload[i] = (uint8_t)('a' + i % 26);
+    }
+
+    tinyfs_journal_stats_t before, after;
+    tinyfs_get_journal_stats(&before);
+
+    uint64_t start = get_timer_ticks();
+    uint32_t created = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        fsbench_path(path, dir, i);
+        if (vfs_create(path, FILE_READ | FILE_WRITE) != 0) break;
+        int fd = vfs_open(path, FILE_WRITE);
+        if (fd >= 0) {
+            vfs_write(fd, payload, sizeof(payload));
+            vfs_close(fd);
+        }
+        created++;
+    }
+    uint64_t elapsed = get_timer_ticks() - start;
+
+    tinyfs_get_journal_stats(&after);
+
+    uint64_t rate = elapsed ? (created * 1000ULL) / elapsed : created;
+    PRINT(CYAN, BLACK, "fsbench: %u files in %llu ms (%llu files/sec)\n", created, elapsed, rate);
+    PRINT(WHITE, BLACK, "fsbench: %llu commits, %llu blocks logged\n",
+          after.commits - before.commits, after.blocks_logged - before.blocks_logged);
+
+    for (uint32_t i = 0; i < created; i++) {
+        fsbench_path(path, dir, i);
+        vfs_unlink(path);
+    }
+    vfs_unlink(dir);
+}
+
+#define PIPELINE_MAX_STAGES 8
+
+struct pipeline;
+
+typedef struct pipeline_stage {
+    char *command;            // Points into the pipeline's copy of the line
+    pipe_t *in;               // NULL for the first stage
+    pipe_t *out;              // NULL for the last, which prints to the screen
+    struct pipeline *pipeline;
+} pipeline_stage_t;
+
+typedef struct pipeline {
+    char line[256];
+    pipeline_stage_t stages[PIPELINE_MAX_STAGES];
+    int count;
+    uint32_t running;         // Stages not finished yet
+    wait_queue_t done;
+} pipeline_t;
+
+static void run_command(char *cmd);
+
+// Resolve name against the working directory
+static void shell_full_path(char *out, const char *name) {
+    if (name[0] == '/') {
+        strcpy_safe_local(out, name, 256);
+        return;
+    }
+
+    strcpy_local(out, vfs_get_cwd_path());
+    int i = strlen_local(out);
+    if (i > 0 && out[i-1] != '/') out[i++] = '/';
+    int j = 0;
+    while (name[j] && i < 255) {
+        out[i++] = name[j++];
+    }
+    out[i] = '\0';
+}
+
+// Next chunk of a command's input: the named file when there is one,
+// else whatever the previous pipeline stage writes
+static int stage_read(int fd, uint8_t *buffer, uint32_t size) {
+    if (fd >= 0) return vfs_read(fd, buffer, size);
+
+    thread_t *self = get_current_thread();
+    if (!self || !self->pipe_in) return -1;
+    return pipe_read(self->pipe_in, buffer, size);
+}
+
+// Open the file named by arg, or -1 to read the pipeline; -2 on error
+static int stage_open(const char *cmd, const char *arg) {
+    if (*arg) {
+        char path[256];
+        shell_full_path(path, arg);
+        int fd = vfs_open(path, FILE_READ);
+        if (fd < 0) {
+            PRINT(YELLOW, BLACK, "%s: cannot open %s\n", cmd, path);
+            return -2;
+        }
+        return fd;
+    }
+
+    thread_t *self = get_current_thread();
+    if (!self || !self->pipe_in) {
+        PRINT(YELLOW, BLACK, "%s: no input (give a file or pipe into it)\n", cmd);
+        return -2;
+    }
+    return -1;
+}
+
+static int line_matches(const char *line, const char *pattern) {
+    for (int i = 0; line[i]; i++) {
+        int j = 0;
+        while (pattern[j] && line[i + j] == pattern[j]) j++;
+        if (!pattern[j]) return 1;
+    }
+    return 0;
+}
+
+// Print the lines holding pattern, one input chunk at a time; a line
+// longer than the line buffer is matched in pieces
+static void cmd_grep(char *args) {
+    while (*args == ' ') args++;
+    char *pattern = args;
+    while (*args && *args != ' ') args++;
+    if (*args) {
+        *args++ = '\0';
+        while (*args == ' ') args++;
+    }
+    if (!*pattern) {
+        PRINT(WHITE, BLACK, "Usage: grep <pattern> [file]\n");
+        return;
+    }
+
+    int fd = stage_open("grep", args);
+    if (fd == -2) return;
+
+    uint8_t chunk[512];
+    char line[256];
+    int len = 0;
+    int got;
+
+    while ((got = stage_read(fd, chunk, sizeof(chunk))) > 0) {
+        for (int i = 0; i < got; i++) {
+            if (chunk[i] != '\n' && len < 255) {
+                line[len++] = (char)chunk[i];
+                if (len < 255) continue;
+            }
+            line[len] = '\0';
+            if (line_matches(line, pattern)) PRINT(WHITE, BLACK, "%s\n", line);
+            len = 0;
+        }
+    }
+    if (len > 0) {
+        line[len] = '\0';
+        if (line_matches(line, pattern)) PRINT(WHITE, BLACK, "%s\n", line);
+    }
+
+    if (fd >= 0) vfs_close(fd);
+}
+
+static void cmd_wc(char *args) {
+    while (*args == ' ') args++;
+
+    int fd = stage_open("wc", args);
+    if (fd == -2) return;
+
+    uint8_t chunk[512];
+    uint64_t lines = 0, words = 0, bytes = 0;
+    int in_word = 0;
+    int got;
+
+    while ((got = stage_read(fd, chunk, sizeof(chunk))) > 0) {
+        for (int i = 0; i < got; i++) {
+            uint8_t c = chunk[i];
+            if (c == '\n') lines++;
+            if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+                in_word = 0;
+            } else if (!in_word) {
+                in_word = 1;
+                words++;
+            }
+        }
+        bytes += got;
+    }
+
+    PRINT(WHITE, BLACK, "%llu lines, %llu words, %llu bytes\n", lines, words, bytes);
+    if (fd >= 0) vfs_close(fd);
+}
+
+// Close a stage's pipe ends: the next stage sees end of file, the one
+// before it a broken pipe
+static void pipeline_stage_done(pipeline_stage_t *stage) {
+    if (stage->out) pipe_close_writer(stage->out);
+    if (stage->in) pipe_close_reader(stage->in);
+
+    // The shell may free the pipeline as soon as it sees zero, so the
+    // wakeup has to go out before it can look
+    pipeline_t *pipeline = stage->pipeline;
+    uint64_t flags = irq_save();
+    pipeline->running--;
+    wait_queue_wake(&pipeline->done);
+    irq_restore(flags);
+}
+
+static void pipeline_stage_thread(void) {
+    thread_t *self = get_current_thread();
+    pipeline_stage_t *stage = (pipeline_stage_t*)self->private_data;
+
+    self->pipe_in = stage->in;
+    self->pipe_out = stage->out;
+    run_command(stage->command);
+    self->pipe_in = NULL;
+    self->pipe_out = NULL;
+
+    pipeline_stage_done(stage);
+}
+
+// Run `a | b | ...` with each stage in its own thread, connected by
+// pipes, and wait for all of them. Data moves through at most a pipe's
+// worth of pages per stage, however much the first stage produces.
+static void run_pipeline(const char *cmd) {
+    pipeline_t *pipeline = (pipeline_t*)kcalloc(1, sizeof(pipeline_t));
+    if (!pipeline) {
+        PRINT(YELLOW, BLACK, "[ERROR] Out of memory\n");
+        return;
+    }
+    strcpy_safe_local(pipeline->line, cmd, 256);
+    wait_queue_init(&pipeline->done);
+
+    char *p = pipeline->line;
+    while (1) {
+        while (*p == ' ') p++;
+        char *start = p;
+        while (*p && *p != '|') p++;
+        char *end = p;
+        while (end > start && end[-1] == ' ') end--;
+
+        if (end == start || pipeline->count == PIPELINE_MAX_STAGES) {
+            PRINT(YELLOW, BLACK, "Invalid pipeline (empty stage or more than %d)\n", PIPELINE_MAX_STAGES);
+            kfree(pipeline);
+            return;
+        }
+        pipeline->stages[pipeline->count++].command = start;
+
+        int last = *p == '\0';
+        *end = '\0';
+        if (last) break;
+        p++;
+    }
+
+    for (int i = 0; i < pipeline->count; i++) {
+        pipeline->stages[i].pipeline = pipeline;
+    }
+    for (int i = 0; i + 1 < pipeline->count; i++) {
+        pipe_t *pipe = pipe_create();
+        if (!pipe) {
+            PRINT(YELLOW, BLACK, "[ERROR] Out of memory\n");
+            for (int j = 0; j < i; j++) {
+                pipe_close_reader(pipeline->stages[j].out);
+                pipe_close_writer(pipeline->stages[j].out);
+            }
+            kfree(pipeline);
+            return;
+        }
+        pipeline->stages[i].out = pipe;
+        pipeline->stages[i + 1].in = pipe;
+    }
+
+    pipeline->running = pipeline->count;
+    for (int i = 0; i < pipeline->count; i++) {
+        pipeline_stage_t *stage = &pipeline->stages[i];
+
+        // The stage must not run before it can find its description
+        uint64_t flags = irq_save();
+        int tid = thread_create(1, pipeline_stage_thread, 65536, 50000000, 500000000, 500000000);
+        thread_t *thread = tid >= 0 ? get_thread(tid) : NULL;
+        if (thread) thread->private_data = stage;
+        irq_restore(flags);
+
+        if (!thread) {
+            PRINT(YELLOW, BLACK, "[ERROR] Failed to start pipeline stage: %s\n", stage->command);
+            pipeline_stage_done(stage);
+        }
+    }
+
+    uint64_t flags = irq_save();
+    while (pipeline->running) {
+        if (wait_queue_sleep(&pipeline->done) != 0) {
+            irq_restore(flags);
+            thread_yield();
+        }
+        flags = irq_save();
+    }
+    irq_restore(flags);
+
+    kfree(pipeline);
+}
+
 void process_command(char* cmd) {
    if (cmd[0] == '\0') return;
 
@@ -1915,6 +2248,18 @@ void process_command(char* cmd) {
         return;
     }
 
+    for (int i = 0; cmd[i]; i++) {
+        if (cmd[i] == '|') {
+            run_pipeline(cmd);
+            return;
+        }
+    }
+
+    run_command(cmd);
+}
+
+// One command, run by the shell itself or as a pipeline stage
+static void run_command(char *cmd) {
     if (STRNCMP(cmd, "hello", 5) == 0) {
         PRINT(GREEN, BLACK, "hello :D\n");
     }
@@ -2007,6 +2352,23 @@ PRINT(WHITE, BLACK, "  schedinfo    - Show scheduler state\n");
 PRINT(WHITE, BLACK, "  threaddebug  - Detailed thread information\n");
 PRINT(WHITE, BLACK, "  schedtest    - Test scheduler with demo thread\n");
 PRINT(WHITE, BLACK, "  jobdebug     - Debug job system state\n");
+PRINT(WHITE, BLACK, "  apic         - Show interrupt controller routing\n");
+PRINT(WHITE, BLACK, "  irqstat [v]  - IRQ latency histograms (reset, or vector)\n");
+PRINT(WHITE, BLACK, "  bcstat       - Buffer cache hit ratio and write-back stats\n");
+PRINT(WHITE, BLACK, "  dcstat       - Dentry cache hit ratio\n");
+PRINT(WHITE, BLACK, "  pcstat       - Page cache hit ratio and readahead\n");
+PRINT(WHITE, BLACK, "  sync         - Write all dirty cached sectors to disk\n");
+PRINT(WHITE, BLACK, "  dmabench [n] - Sequential read of n sectors, PIO vs DMA\n");
+PRINT(WHITE, BLACK, "  lsblk        - List block devices and AHCI queue stats\n");
+PRINT(WHITE, BLACK, "  mount [t d p]- List mounts, or mount type t from device d on p\n");
+PRINT(WHITE, BLACK, "  umount <p>   - Unmount the filesystem mounted on p\n");
+PRINT(WHITE, BLACK, "  jstat        - TinyFS journal commit stats\n");
+PRINT(WHITE, BLACK, "  jtune <ms> [b] - Set journal commit interval and block threshold\n");
+PRINT(WHITE, BLACK, "  fsbench [n]  - Create, write and delete n small files\n");
+PRINT(WHITE, BLACK, "  fds          - List this process's open file descriptors\n");
+PRINT(WHITE, BLACK, "  grep <pat> [file] - Print lines containing pat\n");
+PRINT(WHITE, BLACK, "  wc [file]    - Count lines, words and bytes\n");
+PRINT(WHITE, BLACK, "  a | b | ...  - Pipeline: each command's output feeds the next\n");
         PRINT(GREEN, BLACK, "Shutdown commands: \n");
         PRINT(WHITE, BLACK, "  shutdown - Power off the system\n");
         PRINT(WHITE, BLACK, "  reboot   - Reboot the system\n");
@@ -2017,10 +2379,14 @@ PRINT(WHITE, BLACK, "  jobdebug     - Debug job system state\n");
     }
     else if (STRNCMP(cmd, "shutdown", 8) == 0) {
         PRINT(WHITE, BLACK, "Shutting down...\n");
+        vfs_sync();
+        bcache_sync();
         system_shutdown();
     }
     else if (STRNCMP(cmd, "reboot", 6) == 0) {
         PRINT(WHITE, BLACK, "Rebooting...\n");
+        vfs_sync();
+        bcache_sync();
         system_reboot();
     }
     else if (STRNCMP(cmd, "echo ", 5) == 0) {
@@ -2042,11 +2408,12 @@ PRINT(WHITE, BLACK, "  jobdebug     - Debug job system state\n");
         }
 
         int ready = 0, running = 0, blocked = 0;
-        for (int i = 0; i < MAX_THREADS_GLOBAL; i++) {
-            if (thread_table[i].used) {
-                if (thread_table[i].state == THREAD_STATE_READY) ready++;
-                else if (thread_table[i].state == THREAD_STATE_RUNNING) running++;
-                else if (thread_table[i].state == THREAD_STATE_BLOCKED) blocked++;
+        thread_t *t;
+        for_each_thread(t) {
+            if (t->used) {
+                if (t->state == THREAD_STATE_READY) ready++;
+                else if (t->state == THREAD_STATE_RUNNING) running++;
+                else if (t->state == THREAD_STATE_BLOCKED) blocked++;
             }
         }
 
@@ -2203,12 +2570,22 @@ PRINT(WHITE, BLACK, "  jobdebug     - Debug job system state\n");
             fullpath[i] = '\0';
         }
         int fd = vfs_open(fullpath, FILE_READ);
-        if (fd >= 0) {
-            uint8_t buffer[513];
-            int bytes = vfs_read(fd, buffer, 512);
-            if (bytes > 0) {
+        thread_t *self = get_current_thread();
+        if (fd >= 0 && self && self->pipe_out) {
+            // Feeding a pipeline: hand the next stage the cached pages
+            while (vfs_splice(fd, self->pipe_out, PIPE_SLOTS * PIPE_PAGE_SIZE) > 0);
+            vfs_close(fd);
+        } else if (fd >= 0) {
+            uint8_t buffer[256];
+            uint32_t total = 0;
+            int bytes;
+            while ((bytes = vfs_read(fd, buffer, 255)) > 0) {
                 buffer[bytes] = '\0';
-                PRINT(WHITE, BLACK, "%s\n\n", buffer);
+                PRINT(WHITE, BLACK, "%s", buffer);
+                total += bytes;
+            }
+            if (total > 0) {
+                PRINT(WHITE, BLACK, "\n\n");
             } else {
                 PRINT(YELLOW, BLACK, "File is empty or read error\n");
             }
@@ -2359,8 +2736,8 @@ PRINT(WHITE, BLACK, "  jobdebug     - Debug job system state\n");
             PRINT(WHITE, BLACK, "  Free blocks: %u\n", stats.free_blocks);
             PRINT(WHITE, BLACK, "  Used blocks: %u\n", stats.total_blocks - stats.free_blocks);
             PRINT(WHITE, BLACK, "  Block size: %u bytes\n", stats.block_size);
-            uint32_t total_kb = (stats.total_blocks * stats.block_size) / 1024;
-            uint32_t free_kb = (stats.free_blocks * stats.block_size) / 1024;
+            uint32_t total_kb = (uint32_t)(((uint64_t)stats.total_blocks * stats.block_size) / 1024);
+            uint32_t free_kb = (uint32_t)(((uint64_t)stats.free_blocks * stats.block_size) / 1024);
             uint32_t used_kb = total_kb - free_kb;
             PRINT(WHITE, BLACK, "  Total size: %u KB\n", total_kb);
             PRINT(WHITE, BLACK, "  Used size: %u KB\n", used_kb);
@@ -2729,6 +3106,82 @@ else if (STRNCMP(cmd, "jobupdate", 9) == 0) {
     cmd_jobupdate();
 } else if (STRNCMP(cmd, "syscheck", 8) == 0) {
     cmd_syscheck();
+} else if (STRNCMP(cmd, "apic", 4) == 0) {
+    apic_print_info();
+} else if (STRNCMP(cmd, "irqstat", 7) == 0) {
+    irqstat_command(cmd + 7);
+} else if (STRNCMP(cmd, "bcstat", 6) == 0) {
+    bcache_print_stats();
+} else if (STRNCMP(cmd, "dcstat", 6) == 0) {
+    dcache_print_stats();
+} else if (STRNCMP(cmd, "pcstat", 6) == 0) {
+    pcache_print_stats();
+} else if (STRNCMP(cmd, "sync", 5) == 0) {
+    if (vfs_sync() == 0 && bcache_sync() == 0) {
+        PRINT(GREEN, BLACK, "Buffer cache flushed\n");
+    } else {
+        PRINT(YELLOW, BLACK, "Buffer cache flush failed\n");
+    }
+} else if (STRNCMP(cmd, "dmabench", 8) == 0) {
+    const char *arg = cmd + 8;
+    while (*arg == ' ') arg++;
+    uint32_t sectors = parse_number(arg);
+
+    // The benchmark stops the ata0 queue around its PIO pass; holding the
+    // buffer cache keeps the flusher from queueing writes behind it
+    bcache_quiesce();
+    ide_dma_benchmark(sectors ? sectors : 8192);
+    bcache_resume();
+} else if (STRNCMP(cmd, "lsblk", 6) == 0) {
+    blkdev_print_list();
+    ahci_print_info();
+} else if (STRNCMP(cmd, "mount", 5) == 0) {
+    // mount [type device path]
+    char args[3][64];
+    int argc = 0;
+    const char *p = cmd + 5;
+    while (argc < 3) {
+        while (*p == ' ') p++;
+        if (!*p) break;
+        int len = 0;
+        while (*p && *p != ' ' && len < 63) args[argc][len++] = *p++;
+        args[argc][len] = '\0';
+        while (*p && *p != ' ') p++;
+        argc++;
+    }
+
+    if (argc == 0) {
+        vfs_list_mounts();
+    } else if (argc == 3) {
+        vfs_mount(args[0], args[1], args[2]);
+    } else {
+        PRINT(YELLOW, BLACK, "Usage: mount [type device path]\n");
+    }
+} else if (STRNCMP(cmd, "umount ", 7) == 0) {
+    vfs_unmount(cmd + 7);
+} else if (STRNCMP(cmd, "jstat", 6) == 0) {
+    tinyfs_print_journal_stats();
+} else if (STRNCMP(cmd, "jtune", 5) == 0) {
+    const char *p = cmd + 5;
+    while (*p == ' ') p++;
+    if (*p < '0' || *p > '9') {
+        PRINT(YELLOW, BLACK, "Usage: jtune <ms> [blocks]\n");
+    } else {
+        uint32_t interval = parse_number(p);
+        while (*p >= '0' && *p <= '9') p++;
+        while (*p == ' ') p++;
+        uint32_t blocks = *p ? parse_number(p) : TINYFS_COMMIT_BLOCKS;
+        tinyfs_set_commit(interval, blocks);
+        tinyfs_print_journal_stats();
+    }
+} else if (STRNCMP(cmd, "fsbench", 7) == 0) {
+    cmd_fsbench(cmd + 7);
+} else if (STRNCMP(cmd, "fds", 4) == 0) {
+    fdt_print(fdt_current());
+} else if (STRNCMP(cmd, "grep ", 5) == 0) {
+    cmd_grep(cmd + 5);
+} else if (STRNCMP(cmd, "wc", 2) == 0) {
+    cmd_wc(cmd + 2);
 }
     else {
         PRINT(YELLOW, BLACK, "Unknown command: %s\n", cmd);
@@ -2765,7 +3218,7 @@ void run_text_demo(void) {
         }
 
         cursor_timer++;
-        e1000_interrupt_handler();
+        e1000_poll();
         
         // Only process keyboard if GUI doesn't own input
         if (!gui_owns_input) {
@@ -11,6 +11,7 @@
 #include "IO.h"
 #include "vfs.h"
 #include "tinyfs.h"
+#include "tmpfs.h"
 #include "ata.h"
 #include "definitions.h"
 #include "process.h"
@@ -19,8 +20,13 @@
 #include "string_helpers.h"
 #include "mouse.h"
 #include "gdt.h"
+#include "apic.h"
+#include "syscall.h"
+#include "bcache.h"
+#include "ide_dma.h"
+#include "ahci.h"
+#include "blkdev.h"
 
-extern void syscall_register_all(void);
 extern void pmm_init(EFI_MEMORY_DESCRIPTOR* map, UINTN desc_count, UINTN desc_size);
 extern void init_kernel_heap(void);
 extern vfs_node_t* vfs_get_root(void);
@@ -105,6 +111,18 @@ EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable
     PRINT(GREEN, BLACK, "[OK] IDT installed\n");
 
 
+    if (apic_init() == 0) {
+        PRINT(GREEN, BLACK, "[OK] LAPIC/IOAPIC enabled\n");
+    } else {
+        PRINT(WHITE, BLACK, "[INIT] Using legacy 8259 PIC\n");
+    }
+
+
+    syscall_init();
+    syscall_register_all();
+    PRINT(GREEN, BLACK, "[OK] SYSCALL/SYSRET enabled\n");
+
+
     serial_init(COM1);
     PRINT(GREEN, BLACK, "[OK] Serial initialized\n");
 
@@ -134,15 +152,25 @@ EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable
 
     PRINT(GREEN, BLACK, "[OK] Timer is working correctly!\n");
 
-    uint8_t mask = inb(0x21);
-    mask &= ~0x02;
-    outb(0x21, mask);
+    irq_unmask(1);
     PRINT(GREEN, BLACK, "[OK] Keyboard enabled\n");
 
     PRINT(WHITE, BLACK, "\n[INIT] Initializing storage...\n");
     ata_init();
     PRINT(GREEN, BLACK, "[OK] ATA initialized\n");
 
+    if (ide_dma_init() == 0) {
+        PRINT(GREEN, BLACK, "[OK] Bus-master DMA enabled\n");
+    }
+
+    if (ahci_init() == 0) {
+        PRINT(GREEN, BLACK, "[OK] AHCI initialized\n");
+    }
+
+    if (bcache_init() == 0) {
+        PRINT(GREEN, BLACK, "[OK] Buffer cache initialized\n");
+    }
+
     PRINT(WHITE, BLACK, "\n[INIT] Initializing filesystem...\n");
     vfs_init();
 
@@ -157,31 +185,51 @@ EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable
         goto boot_failed;
     }
 
-    PRINT(WHITE, BLACK, "[INIT] Formatting disk...\n");
-
-    char device_name[] = "ata0";
-    if (tinyfs_format(device_name) != 0) {
-        PRINT(YELLOW, BLACK, "[ERROR] Format failed\n");
-        goto boot_failed;
+    filesystem_t *tmpfs = tmpfs_create();
+    if (!tmpfs || vfs_register_filesystem(tmpfs) != 0) {
+        PRINT(YELLOW, BLACK, "[WARN] tmpfs unavailable\n");
     }
 
-    PRINT(GREEN, BLACK, "[OK] Disk formatted\n");
+    // Legacy IDE disk, else the data disk compile.sh puts on SATA port 1
+    char ata_disk[] = "ata0";
+    char sata_disk[] = "sata1";
+    char *device_name = blkdev_lookup(ata_disk) >= 0 ? ata_disk : sata_disk;
+
+    // Keep what is on the disk; only a disk without a volume is formatted
+    if (tinyfs_probe(device_name) != 0) {
+        PRINT(WHITE, BLACK, "[INIT] No filesystem on %s, formatting...\n", device_name);
+
+        if (tinyfs_format(device_name) != 0) {
+            PRINT(YELLOW, BLACK, "[ERROR] Format failed\n");
+            goto boot_failed;
+        }
 
-    for (volatile int i = 0; i < 10000000; i++);
+        PRINT(GREEN, BLACK, "[OK] Disk formatted\n");
+    }
 
     PRINT(WHITE, BLACK, "[INIT] Mounting filesystem...\n");
 
     char fs_type[] = "tinyfs";
-    char device[] = "ata0";
     char mountpoint[] = "/";
 
-    if (vfs_mount(fs_type, device, mountpoint) != 0) {
+    if (vfs_mount(fs_type, device_name, mountpoint) != 0) {
         PRINT(YELLOW, BLACK, "[ERROR] Mount failed\n");
         goto boot_failed;
     }
 
     PRINT(GREEN, BLACK, "[OK] Filesystem mounted\n");
 
+    // Scratch space that never touches the disk
+    char tmp_type[] = "tmpfs";
+    char tmp_device[] = "none";
+    char tmp_path[] = "/tmp";
+    if (!vfs_resolve_path(tmp_path)) {
+        vfs_mkdir(tmp_path, 0755);
+    }
+    if (vfs_mount(tmp_type, tmp_device, tmp_path) == 0) {
+        PRINT(GREEN, BLACK, "[OK] tmpfs mounted on /tmp\n");
+    }
+
     PRINT(WHITE, BLACK, "\n[INIT] Initializing processes...\n");
     process_init();
     PRINT(GREEN, BLACK, "[OK] Process table initialized\n");
@@ -198,6 +246,8 @@ EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable
 
     PRINT(WHITE, BLACK, "\n[INIT] Creating kernel threads...\n");
     init_kernel_threads();
+    bcache_start_flusher();
+    tinyfs_start_journal();
     PRINT(GREEN, BLACK, "[OK] Kernel threads created\n");
 
 
@@ -0,0 +1,37 @@
+#include "percpu.h"
+#include "memory.h"
+#include "IO.h"
+#include "TSS.h"
+#include "print.h"
+#include "string_helpers.h"
+
+static percpu_t boot_cpu_data;
+
+
+void percpu_init(void) {
+    boot_cpu_data.kernel_stack = kernel_stack_top & ~0xFULL;
+    boot_cpu_data.user_stack = 0;
+    boot_cpu_data.cpu_id = 0;
+    boot_cpu_data.current_tid = 0;
+    boot_cpu_data.scratch = NULL;
+    boot_cpu_data.user_mode = 0;
+
+    // Kernel runs with GS base 0; swapgs in syscall_entry brings in the per-CPU block
+    wrmsr(MSR_GS_BASE, 0);
+    wrmsr(MSR_KERNEL_GS_BASE, (uint64_t)&boot_cpu_data);
+
+    tss_set_rsp0(boot_cpu_data.kernel_stack);
+
+    PRINT(MAGENTA, BLACK, "[PERCPU] CPU0 data at 0x%llx, kernel stack 0x%llx\n",
+          (uint64_t)&boot_cpu_data, boot_cpu_data.kernel_stack);
+}
+
+percpu_t* get_percpu_data(void) {
+    return &boot_cpu_data;
+}
+
+void set_kernel_stack(uint64_t stack) {
+    stack &= ~0xFULL;
+    boot_cpu_data.kernel_stack = stack;
+    tss_set_rsp0(stack);
+}
@@ -0,0 +1,163 @@
+#include "syscall.h"
+#include "vfs.h"
+#include "irq.h"
+#include "print.h"
+#include "process.h"
+#include "string_helpers.h"
+
+#define USER_ADDR_LIMIT 0x0000800000000000ULL   // End of the lower canonical half
+
+extern char ImageBase[], _ebss[];
+
+// Kernel and callers share one address space, so a range only has to miss
+// the zero page, not wrap, and stay in the lower canonical half. Ring 3
+// callers may not name the kernel image either.
+static int validate_user_range(uint64_t ptr, uint64_t len) {
+    if (ptr < 0x1000 || ptr + len < ptr || ptr + len > USER_ADDR_LIMIT) return 0;
+
+    thread_t *t = get_current_thread();
+    if (t && t->user_mode && ptr < (uint64_t)_ebss && ptr + len > (uint64_t)ImageBase) {
+        return 0;
+    }
+    return 1;
+}
+
+// Strings and other objects whose length the callee finds out itself
+static int validate_user_pointer(uint64_t ptr) {
+    return validate_user_range(ptr, 1);
+}
+
+
+int64_t sys_open(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_pointer(a1)) return -1;
+    return vfs_open((const char*)a1, (uint32_t)a2);
+}
+
+int64_t sys_close(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    return vfs_close((int)a1);
+}
+
+int64_t sys_read(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_range(a2, (uint32_t)a3)) return -1;
+    return vfs_read((int)a1, (uint8_t*)a2, (uint32_t)a3);
+}
+
+int64_t sys_write(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_range(a2, (uint32_t)a3)) return -1;
+    return vfs_write((int)a1, (uint8_t*)a2, (uint32_t)a3);
+}
+
+int64_t sys_lseek(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    return vfs_seek((int)a1, (int)a2, (int)a3);
+}
+
+// a1 = fd, a2 = buffer, a3 = size, a4 = offset
+int64_t sys_pread(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_range(a2, a3)) return -1;
+    return vfs_pread((int)a1, (void*)a2, a3, a4);
+}
+
+int64_t sys_pwrite(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_range(a2, a3)) return -1;
+    return vfs_pwrite((int)a1, (const void*)a2, a3, a4);
+}
+
+// a1 = fd, a2 = vfs_iovec_t array, a3 = count
+int64_t sys_readv(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (a3 == 0 || a3 > VFS_IOV_MAX) return -1;
+    if (!validate_user_range(a2, a3 * sizeof(vfs_iovec_t))) return -1;
+
+    const vfs_iovec_t *iov = (const vfs_iovec_t*)a2;
+    for (uint64_t i = 0; i < a3; i++) {
+        if (iov[i].len && !validate_user_range((uint64_t)iov[i].base, iov[i].len)) return -1;
+    }
+    return vfs_readv((int)a1, iov, (int)a3);
+}
+
+int64_t sys_writev(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (a3 == 0 || a3 > VFS_IOV_MAX) return -1;
+    if (!validate_user_range(a2, a3 * sizeof(vfs_iovec_t))) return -1;
+
+    const vfs_iovec_t *iov = (const vfs_iovec_t*)a2;
+    for (uint64_t i = 0; i < a3; i++) {
+        if (iov[i].len && !validate_user_range((uint64_t)iov[i].base, iov[i].len)) return -1;
+    }
+    return vfs_writev((int)a1, iov, (int)a3);
+}
+
+// a1 = int[2] receiving the read and write descriptors
+int64_t sys_pipe(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_range(a1, 2 * sizeof(int))) return -1;
+    return vfs_pipe((int*)a1);
+}
+
+int64_t sys_stat(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_pointer(a1) || !validate_user_range(a2, sizeof(syscall_stat_t))) return -1;
+
+    vfs_node_t *node = vfs_resolve_path((const char*)a1);
+    if (!node) return -1;
+
+    syscall_stat_t *st = (syscall_stat_t*)a2;
+    st->type = node->type;
+    st->size = node->size;
+    st->inode = node->inode;
+    st->permissions = node->permissions;
+    return 0;
+}
+
+int64_t sys_unlink(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_pointer(a1)) return -1;
+    return vfs_unlink((const char*)a1);
+}
+
+int64_t sys_mkdir(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_pointer(a1)) return -1;
+    return vfs_mkdir((const char*)a1, a2 ? (uint32_t)a2 : 0755);
+}
+
+int64_t sys_rmdir(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_pointer(a1)) return -1;
+
+    vfs_node_t *node = vfs_resolve_path((const char*)a1);
+    if (!node || node->type != FILE_TYPE_DIRECTORY) return -1;
+
+    return vfs_unlink((const char*)a1);
+}
+
+int64_t sys_chdir(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_pointer(a1)) return -1;
+    return vfs_chdir((const char*)a1);
+}
+
+// a1 = buffer, a2 = size; returns the path length
+int64_t sys_getcwd(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (a2 == 0 || !validate_user_range(a1, a2)) return -1;
+
+    const char *cwd = vfs_get_cwd_path();
+    char *buf = (char*)a1;
+    uint64_t i = 0;
+
+    while (cwd[i] && i < a2 - 1) {
+        buf[i] = cwd[i];
+        i++;
+    }
+    buf[i] = '\0';
+
+    if (cwd[i]) return -1;
+    return (int64_t)i;
+}
+
+
+int64_t sys_uptime(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    return (int64_t)get_uptime_seconds();
+}
+
+int64_t sys_gettime(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    return (int64_t)get_timer_ticks();
+}
+
+int64_t sys_debug_print(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (!validate_user_pointer(a1)) return -1;
+    PRINT(WHITE, BLACK, "[USER] %s", (const char*)a1);
+    return 0;
+}
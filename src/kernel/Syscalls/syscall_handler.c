@@ -0,0 +1,78 @@
+#include "syscall.h"
+#include "print.h"
+#include "string_helpers.h"
+
+static syscall_fn_t syscall_table[MAX_SYSCALLS];
+static int syscall_count = 0;
+
+
+static int64_t syscall_not_implemented(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    PRINT(YELLOW, BLACK, "[SYSCALL] Not implemented\n");
+    return -1;
+}
+
+static int64_t sys_null(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    return 0;
+}
+
+static void register_syscall(uint64_t num, syscall_fn_t fn) {
+    if (num >= MAX_SYSCALLS) return;
+    if (syscall_table[num] == syscall_not_implemented) syscall_count++;
+    syscall_table[num] = fn;
+}
+
+
+int64_t syscall_handler(uint64_t num, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (num >= MAX_SYSCALLS) {
+        PRINT(YELLOW, BLACK, "[SYSCALL] Invalid syscall number: %llu\n", num);
+        return -1;
+    }
+
+    return syscall_table[num](a1, a2, a3, a4, a5);
+}
+
+
+void syscall_register_all(void) {
+    for (int i = 0; i < MAX_SYSCALLS; i++) {
+        syscall_table[i] = syscall_not_implemented;
+    }
+    syscall_count = 0;
+
+    register_syscall(SYS_EXIT, sys_exit);
+    register_syscall(SYS_GETPID, sys_getpid);
+    register_syscall(SYS_GETPPID, sys_getppid);
+    register_syscall(SYS_GETTID, sys_gettid);
+    register_syscall(SYS_THREAD_CREATE, sys_thread_create);
+    register_syscall(SYS_THREAD_EXIT, sys_thread_exit);
+    register_syscall(SYS_THREAD_YIELD, sys_thread_yield);
+    register_syscall(SYS_SLEEP, sys_sleep);
+    register_syscall(SYS_SLEEP_MS, sys_sleep_ms);
+
+    register_syscall(SYS_MALLOC, sys_malloc);
+    register_syscall(SYS_FREE, sys_free);
+
+    register_syscall(SYS_OPEN, sys_open);
+    register_syscall(SYS_CLOSE, sys_close);
+    register_syscall(SYS_READ, sys_read);
+    register_syscall(SYS_WRITE, sys_write);
+    register_syscall(SYS_LSEEK, sys_lseek);
+    register_syscall(SYS_STAT, sys_stat);
+    register_syscall(SYS_UNLINK, sys_unlink);
+    register_syscall(SYS_PREAD, sys_pread);
+    register_syscall(SYS_PWRITE, sys_pwrite);
+    register_syscall(SYS_READV, sys_readv);
+    register_syscall(SYS_WRITEV, sys_writev);
+    register_syscall(SYS_PIPE, sys_pipe);
+    register_syscall(SYS_MKDIR, sys_mkdir);
+    register_syscall(SYS_RMDIR, sys_rmdir);
+    register_syscall(SYS_CHDIR, sys_chdir);
+    register_syscall(SYS_GETCWD, sys_getcwd);
+
+    register_syscall(SYS_UPTIME, sys_uptime);
+    register_syscall(SYS_GETTIME, sys_gettime);
+
+    register_syscall(SYS_DEBUG_PRINT, sys_debug_print);
+    register_syscall(SYS_NULL, sys_null);
+
+    PRINT(MAGENTA, BLACK, "[SYSCALL] Registered %d syscalls\n", syscall_count);
+}
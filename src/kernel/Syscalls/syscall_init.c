@@ -0,0 +1,114 @@
+#include "syscall.h"
+#include "percpu.h"
+#include "gdt.h"
+#include "IO.h"
+#include "print.h"
+#include "string_helpers.h"
+
+extern void syscall_entry(void);
+
+
+// SYSCALL entry: RCX = return RIP, R11 = caller RFLAGS, RAX = number,
+// arguments in RDI, RSI, RDX, R10, R8. SYSCALL does not record the
+// caller's CPL, so percpu.user_mode (the running thread's thread_t
+// user_mode, loaded on every switch) says where it came from. Ring 3
+// callers move onto the thread's own kernel stack (percpu.kernel_stack)
+// and leave through SYSRET. Ring 0 callers keep their stack and return
+// with a plain jump, since SYSRET always lands in CPL 3. The caller RSP
+// and path flag live on the stack so the handler may block.
+__asm__(
+".global syscall_entry\n"
+"syscall_entry:\n"
+"    swapgs\n"
+"    mov %rsp, %gs:8\n"
+"    cmpq $0, %gs:32\n"
+"    je 1f\n"
+"    mov %gs:0, %rsp\n"
+"1:\n"
+"    pushq %gs:8\n"
+"    pushq %gs:32\n"
+"    push %r11\n"
+"    push %rcx\n"
+"    push %rbp\n"
+"    push %rbx\n"
+"    push %r15\n"
+"    push %r14\n"
+"    push %r13\n"
+"    push %r12\n"
+"    swapgs\n"
+"\n"
+"    # syscall_handler(num, a1, a2, a3, a4, a5)\n"
+"    mov %r8, %r9\n"
+"    mov %r10, %r8\n"
+"    mov %rdx, %rcx\n"
+"    mov %rsi, %rdx\n"
+"    mov %rdi, %rsi\n"
+"    mov %rax, %rdi\n"
+"\n"
+"    mov %rsp, %rbp\n"
+"    and $-16, %rsp\n"
+"    sti\n"
+"    call syscall_handler\n"
+"    cli\n"
+"    mov %rbp, %rsp\n"
+"\n"
+"    pop %r12\n"
+"    pop %r13\n"
+"    pop %r14\n"
+"    pop %r15\n"
+"    pop %rbx\n"
+"    pop %rbp\n"
+"    pop %rcx\n"
+"    pop %r11\n"
+"    cmpq $0, (%rsp)\n"
+"    je 2f\n"
+"    mov 8(%rsp), %rsp\n"
+"    sysretq\n"
+"2:\n"
+"    mov 8(%rsp), %rsp\n"
+"    push %r11\n"
+"    popfq\n"
+"    jmp *%rcx\n"
+);
+
+
+void syscall_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+    if (!(edx & (1 << 11))) {
+        PRINT(YELLOW, BLACK, "[SYSCALL] CPU does not support SYSCALL/SYSRET\n");
+        return;
+    }
+
+    percpu_init();
+
+    uint64_t efer = rdmsr(MSR_EFER);
+    wrmsr(MSR_EFER, efer | EFER_SCE);
+
+    // SYSCALL: CS = STAR[47:32], SS = +8
+    // SYSRET:  SS = STAR[63:48] + 8, CS = STAR[63:48] + 16 (RPL 3)
+    uint64_t star = ((uint64_t)KERNEL_CS << 32) | ((uint64_t)(USER_DS - 8) << 48);
+    wrmsr(MSR_STAR, star);
+    wrmsr(MSR_LSTAR, (uint64_t)syscall_entry);
+    wrmsr(MSR_SFMASK, SYSCALL_RFLAGS_MASK);
+
+    PRINT(MAGENTA, BLACK, "[SYSCALL] STAR=0x%llx LSTAR=0x%llx\n", star, (uint64_t)syscall_entry);
+}
+
+
+int64_t syscall_invoke(uint64_t num, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    register uint64_t r10 __asm__("r10") = a4;
+    register uint64_t r8 __asm__("r8") = a5;
+    int64_t ret;
+
+    // The calling thread is not in user mode, so syscall_entry stays on
+    // this stack and jumps back
+    __asm__ volatile(
+        "syscall"
+        : "=a"(ret), "+D"(a1), "+S"(a2), "+d"(a3), "+r"(r10), "+r"(r8)
+        : "0"(num)
+        : "rcx", "r9", "r11", "memory"
+    );
+
+    return ret;
+}
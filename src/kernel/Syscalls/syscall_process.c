@@ -0,0 +1,70 @@
+#include "syscall.h"
+#include "process.h"
+#include "sleep.h"
+#include "memory.h"
+
+
+int64_t sys_exit(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    thread_exit();
+    return 0;
+}
+
+int64_t sys_getpid(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    thread_t *current = get_current_thread();
+    if (!current || !current->parent) return -1;
+    return current->parent->pid;
+}
+
+int64_t sys_getppid(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    thread_t *current = get_current_thread();
+    if (!current || !current->parent) return -1;
+    return current->parent->ppid;
+}
+
+int64_t sys_gettid(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    thread_t *current = get_current_thread();
+    if (!current) return -1;
+    return current->tid;
+}
+
+
+// a1 = entry point, a2 = stack size (0 for the default)
+int64_t sys_thread_create(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    thread_t *current = get_current_thread();
+    if (!current || !current->parent || !a1) return -1;
+
+    uint32_t stack_size = a2 ? (uint32_t)a2 : 16384;
+    return thread_create(current->parent->pid, (void (*)(void))a1, stack_size,
+                         50000000, 1000000000, 1000000000);
+}
+
+int64_t sys_thread_exit(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    thread_exit();
+    return 0;
+}
+
+int64_t sys_thread_yield(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    thread_yield();
+    return 0;
+}
+
+int64_t sys_sleep(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    sleep_seconds((uint32_t)a1);
+    return 0;
+}
+
+int64_t sys_sleep_ms(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    sleep_ms(a1);
+    return 0;
+}
+
+
+int64_t sys_malloc(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (a1 == 0) return 0;
+    return (int64_t)(uint64_t)kmalloc(a1);
+}
+
+int64_t sys_free(uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    if (a1) kfree((void*)a1);
+    return 0;
+}
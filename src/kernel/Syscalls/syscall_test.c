@@ -0,0 +1,94 @@
+#include "syscall.h"
+#include "vfs.h"
+#include "IO.h"
+#include "print.h"
+#include "string_helpers.h"
+
+#define SYSCALL_BENCH_ITERATIONS 10000
+
+
+static int64_t syscall0(uint64_t num) {
+    return syscall_invoke(num, 0, 0, 0, 0, 0);
+}
+
+static int64_t syscall1(uint64_t num, uint64_t a1) {
+    return syscall_invoke(num, a1, 0, 0, 0, 0);
+}
+
+static int64_t syscall2(uint64_t num, uint64_t a1, uint64_t a2) {
+    return syscall_invoke(num, a1, a2, 0, 0, 0);
+}
+
+static void report(const char *name, int ok) {
+    if (ok) {
+        PRINT(GREEN, BLACK, "  [PASS] %s\n", name);
+    } else {
+        PRINT(YELLOW, BLACK, "  [FAIL] %s\n", name);
+    }
+}
+
+
+// Null syscall round trip through SYSCALL versus a direct call into the
+// dispatcher, so the entry/exit cost can be read off as the difference.
+static void syscall_benchmark(void) {
+    uint64_t best_sys = ~0ULL, best_direct = ~0ULL;
+    uint64_t total_sys = 0, total_direct = 0;
+
+    for (int i = 0; i < SYSCALL_BENCH_ITERATIONS; i++) {
+        uint64_t t0 = rdtsc();
+        syscall0(SYS_NULL);
+        uint64_t t1 = rdtsc();
+        syscall_handler(SYS_NULL, 0, 0, 0, 0, 0);
+        uint64_t t2 = rdtsc();
+
+        uint64_t sys = t1 - t0;
+        uint64_t direct = t2 - t1;
+        total_sys += sys;
+        total_direct += direct;
+        if (sys < best_sys) best_sys = sys;
+        if (direct < best_direct) best_direct = direct;
+    }
+
+    PRINT(CYAN, BLACK, "\n--- Null syscall latency (%d iterations) ---\n", SYSCALL_BENCH_ITERATIONS);
+    PRINT(WHITE, BLACK, "  SYSCALL:  avg %llu cycles, min %llu\n",
+          total_sys / SYSCALL_BENCH_ITERATIONS, best_sys);
+    PRINT(WHITE, BLACK, "  Direct:   avg %llu cycles, min %llu\n",
+          total_direct / SYSCALL_BENCH_ITERATIONS, best_direct);
+}
+
+
+void test_syscall_interface(void) {
+    PRINT(CYAN, BLACK, "\n=== Syscall Interface Test ===\n");
+
+    int64_t tid = syscall0(SYS_GETTID);
+    report("gettid", tid > 0);
+
+    int64_t pid = syscall0(SYS_GETPID);
+    report("getpid", pid > 0);
+
+    int64_t t0 = syscall0(SYS_GETTIME);
+    int64_t t1 = syscall0(SYS_GETTIME);
+    report("gettime", t0 >= 0 && t1 >= t0);
+    report("uptime", syscall0(SYS_UPTIME) >= 0);
+
+    char cwd[256];
+    int64_t len = syscall2(SYS_GETCWD, (uint64_t)cwd, sizeof(cwd));
+    report("getcwd", len > 0 && cwd[0] == '/');
+
+    syscall_stat_t st;
+    int64_t rc = syscall2(SYS_STAT, (uint64_t)"/", (uint64_t)&st);
+    report("stat /", rc == 0 && st.type == FILE_TYPE_DIRECTORY);
+
+    uint8_t *mem = (uint8_t*)syscall1(SYS_MALLOC, 64);
+    if (mem) {
+        for (int i = 0; i < 64; i++) mem[i] = (uint8_t)i;
+    }
+    report("malloc", mem != NULL && mem[63] == 63);
+    report("free", syscall1(SYS_FREE, (uint64_t)mem) == 0);
+
+    report("null", syscall0(SYS_NULL) == 0);
+    report("invalid number", syscall0(MAX_SYSCALLS + 1) == -1);
+    report("debug_print", syscall1(SYS_DEBUG_PRINT, (uint64_t)"hello from SYSCALL\n") == 0);
+
+    syscall_benchmark();
+}
@@ -0,0 +1,92 @@
+#include <efi.h>
+#include <efilib.h>
+#include "acpi.h"
+#include "print.h"
+#include "string_helpers.h"
+
+static acpi_rsdp_t *rsdp = NULL;
+
+static EFI_GUID acpi20_guid = {0x8868e871, 0xe4f1, 0x11d3, {0xbc, 0x22, 0x00, 0x80, 0xc7, 0x3c, 0x88, 0x81}};
+static EFI_GUID acpi10_guid = {0xeb9d2d30, 0x2d88, 0x11d3, {0x9a, 0x16, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d}};
+
+static int guid_equal(EFI_GUID *a, EFI_GUID *b) {
+    uint8_t *x = (uint8_t*)a;
+    uint8_t *y = (uint8_t*)b;
+    for (int i = 0; i < (int)sizeof(EFI_GUID); i++) {
+        if (x[i] != y[i]) return 0;
+    }
+    return 1;
+}
+
+static int acpi_checksum_ok(void *table, uint32_t length) {
+    uint8_t sum = 0;
+    uint8_t *bytes = (uint8_t*)table;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+int acpi_init(void) {
+    if (rsdp) return 0;
+
+    acpi_rsdp_t *v1 = NULL;
+
+    for (UINTN i = 0; i < ST->NumberOfTableEntries; i++) {
+        EFI_CONFIGURATION_TABLE *entry = &ST->ConfigurationTable[i];
+
+        if (guid_equal(&entry->VendorGuid, &acpi20_guid)) {
+            rsdp = (acpi_rsdp_t*)entry->VendorTable;
+            break;
+        }
+        if (guid_equal(&entry->VendorGuid, &acpi10_guid)) {
+            v1 = (acpi_rsdp_t*)entry->VendorTable;
+        }
+    }
+
+    if (!rsdp) rsdp = v1;
+
+    if (!rsdp || !acpi_checksum_ok(rsdp, 20)) {
+        rsdp = NULL;
+        PRINT(YELLOW, BLACK, "[ACPI] RSDP not found\n");
+        return -1;
+    }
+
+    PRINT(MAGENTA, BLACK, "[ACPI] RSDP rev %u at 0x%llx\n", rsdp->revision, (uint64_t)rsdp);
+    return 0;
+}
+
+acpi_sdt_header_t* acpi_find_table(const char *signature) {
+    if (!rsdp && acpi_init() != 0) return NULL;
+
+    int use_xsdt = rsdp->revision >= 2 && rsdp->xsdt_address;
+    acpi_sdt_header_t *root = use_xsdt
+        ? (acpi_sdt_header_t*)(uintptr_t)rsdp->xsdt_address
+        : (acpi_sdt_header_t*)(uintptr_t)rsdp->rsdt_address;
+
+    if (!root || !acpi_checksum_ok(root, root->length)) {
+        PRINT(YELLOW, BLACK, "[ACPI] Bad root table\n");
+        return NULL;
+    }
+
+    uint32_t entry_size = use_xsdt ? 8 : 4;
+    uint32_t count = (root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    uint8_t *entries = (uint8_t*)root + sizeof(acpi_sdt_header_t);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t addr = use_xsdt
+            ? *(uint64_t*)(entries + i * 8)
+            : *(uint32_t*)(entries + i * 4);
+
+        acpi_sdt_header_t *table = (acpi_sdt_header_t*)(uintptr_t)addr;
+        if (!table) continue;
+
+        if (table->signature[0] == signature[0] && table->signature[1] == signature[1] &&
+            table->signature[2] == signature[2] && table->signature[3] == signature[3] &&
+            acpi_checksum_ok(table, table->length)) {
+            return table;
+        }
+    }
+
+    return NULL;
+}
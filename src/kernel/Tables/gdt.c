@@ -64,11 +64,11 @@ void gdt_init(void) {
 
 
 
-    gdt_set_gate(3, 0, 0, 0xFA, 0x20);
+    gdt_set_gate(3, 0, 0, 0xF2, 0x00);
 
 
 
-    gdt_set_gate(4, 0, 0, 0xF2, 0x00);
+    gdt_set_gate(4, 0, 0, 0xFA, 0x20);
 
 
 
@@ -28,15 +28,7 @@ struct idt_ptr {
 struct idt_entry idt[IDT_ENTRIES];
 struct idt_ptr idtp;
 
-void generic_handler(void) {
-    __asm__ volatile(
-        "push %rax\n"
-        "movb $0x20, %al\n"
-        "outb %al, $0x20\n"
-        "pop %rax\n"
-        "iretq"
-    );
-}
+extern uint64_t irq_stub_table[];
 
 void generic_handler_tracked(void);
 void keyboard_handler(void);
@@ -102,7 +94,7 @@ void idt_install() {
 
 
     for(int i = 32; i < 256; i++) {
-        idt_set_gate(i, (uint64_t)generic_handler, KERNEL_CS, 0x8E);
+        idt_set_gate(i, irq_stub_table[i - 32], KERNEL_CS, 0x8E);
     }
 
 
@@ -139,8 +131,15 @@ void generic_handler_tracked(void) {
         "push %rbx\n"
         "lea interrupt_vector(%rip), %rbx\n"
         "incl (%rbx)\n"
+        "mov lapic_eoi_reg(%rip), %rbx\n"
+        "test %rbx, %rbx\n"
+        "jz 1f\n"
+        "movl $0, (%rbx)\n"
+        "jmp 2f\n"
+        "1:\n"
         "movb $0x20, %al\n"
         "outb %al, $0x20\n"
+        "2:\n"
         "pop %rbx\n"
         "pop %rax\n"
         "iretq"
@@ -153,6 +152,18 @@ void keyboard_handler(void) {
         "push %rax\n"
         "push %rbx\n"
         "push %rcx\n"
+        "push %rdx\n"
+        "push %rsi\n"
+        "push %rdi\n"
+        "push %rbp\n"
+        "push %r8\n"
+        "push %r9\n"
+        "push %r10\n"
+        "push %r11\n"
+
+        // 11 pushes on the 5-word frame leave RSP 16-byte aligned for the calls
+        "mov $33, %edi\n"
+        "call irqstat_enter\n"
 
         "lea interrupt_counter(%rip), %rbx\n"
         "incl (%rbx)\n"
@@ -170,9 +181,27 @@ void keyboard_handler(void) {
         "lea scancode_write_pos(%rip), %rbx\n"
         "incb (%rbx)\n"
 
+        "mov lapic_eoi_reg(%rip), %rbx\n"
+        "test %rbx, %rbx\n"
+        "jz 1f\n"
+        "movl $0, (%rbx)\n"
+        "jmp 2f\n"
+        "1:\n"
         "movb $0x20, %al\n"
         "outb %al, $0x20\n"
-
+        "2:\n"
+
+        "mov $33, %edi\n"
+        "call irqstat_exit\n"
+
+        "pop %r11\n"
+        "pop %r10\n"
+        "pop %r9\n"
+        "pop %r8\n"
+        "pop %rbp\n"
+        "pop %rdi\n"
+        "pop %rsi\n"
+        "pop %rdx\n"
         "pop %rcx\n"
         "pop %rbx\n"
         "pop %rax\n"
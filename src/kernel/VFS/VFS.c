@@ -3,15 +3,35 @@
 #include "memory.h"
 #include "print.h"
 #include "tinyfs.h"
+#include "dcache.h"
+#include "fdtable.h"
+#include "pagecache.h"
+#include "pipe.h"
 #include "string_helpers.h"
 
 static vfs_node_t *root_node = NULL;
 static vfs_node_t *current_dir = NULL;
 static char current_path[256] = "/";
-static file_descriptor_t vfs_fd_table[MAX_OPEN_FILES];
 static filesystem_t *registered_filesystems[16];
 static int num_filesystems = 0;
 
+// One mounted filesystem. `covered` is the directory it hides, named by
+// (fs, inode) so the check survives the covering node being re-created.
+typedef struct vfs_mount {
+    int used;
+    int cloned;               // fs was allocated for this mount
+    char path[256];
+    filesystem_t *fs;
+    vfs_node_t *root;
+    filesystem_t *covered_fs; // NULL for the root mount
+    uint32_t covered_inode;
+} vfs_mount_t;
+
+static vfs_mount_t mount_table[VFS_MAX_MOUNTS];
+static int num_mounts = 0;
+
+static vfs_map_t *live_maps = NULL;
+
 
 int str_len(const char *str) {
     int len = 0;
@@ -40,17 +60,18 @@ void vfs_init(void) {
     root_node = NULL;
     num_filesystems = 0;
 
-    for (int i = 0; i < MAX_OPEN_FILES; i++) {
-        vfs_fd_table[i].used = 0;
-        vfs_fd_table[i].node = NULL;
-        vfs_fd_table[i].position = 0;
-        vfs_fd_table[i].flags = 0;
-    }
+    dcache_init();
+    pcache_init();
 
     for (int i = 0; i < 16; i++) {
         registered_filesystems[i] = NULL;
     }
 
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        mount_table[i].used = 0;
+    }
+    num_mounts = 0;
+
     PRINT(MAGENTA, BLACK, "[VFS] Initialized\n");
 }
 
@@ -87,194 +108,362 @@ void vfs_debug_root(void) {
     }
 }
 
-int vfs_mount(const char *fs_type, const char *device, const char *mountpoint) {
-    PRINT(WHITE, BLACK, "[VFS] === vfs_mount START ===\n");
-    PRINT(WHITE, BLACK, "[VFS] fs_type='%s', device='%s', mountpoint='%s'\n", fs_type, device, mountpoint);
-    PRINT(WHITE, BLACK, "[VFS] root_node BEFORE mount: %p\n", root_node);
-    PRINT(WHITE, BLACK, "[VFS] DEBUG: num_filesystems = %d\n", num_filesystems);
-
-    PRINT(WHITE, BLACK, "[VFS MOUNT START] Verifying registered filesystems:\n");
+static filesystem_t* find_fs_type(const char *fs_type) {
     for (int i = 0; i < num_filesystems; i++) {
-        PRINT(WHITE, BLACK, "[VFSX_DEBUG]   fs[%d] at %p, name at %p: '%s'\n", i,
-               registered_filesystems[i],
-               registered_filesystems[i]->name,
-               registered_filesystems[i]->name);
+        if (registered_filesystems[i] && str_cmp(fs_type, registered_filesystems[i]->name) == 0) {
+            return registered_filesystems[i];
+        }
     }
+    return NULL;
+}
 
-    PRINT(WHITE, BLACK, "[VFS] Registered filesystems:\n");
-    for (int i = 0; i < num_filesystems; i++) {
-        if (registered_filesystems[i]) {
-            PRINT(WHITE, BLACK, "[VFS]  [%d] '%s' at %p\n", i,
-                   registered_filesystems[i]->name,
-                   registered_filesystems[i]);
+// A filesystem_t carries one mounted instance, so the registered one is
+// used for the first mount of a type and copied for every further one
+static filesystem_t* fs_instance(filesystem_t *type, int *cloned) {
+    *cloned = 0;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (mount_table[i].used && mount_table[i].fs == type && type->private_data) {
+            filesystem_t *fs = (filesystem_t*)kmalloc(sizeof(filesystem_t));
+            if (!fs) return NULL;
+
+            str_cpy(fs->name, type->name, 32);
+            fs->ops = type->ops;
+            fs->flags = type->flags & ~FS_FLAG_RDONLY;
+            fs->private_data = NULL;
+            *cloned = 1;
+            return fs;
         }
     }
+    type->flags &= ~FS_FLAG_RDONLY;
+    return type;
+}
 
-    filesystem_t *fs = NULL;
-    for (int i = 0; i < num_filesystems; i++) {
-        PRINT(WHITE, BLACK, "[VFS] Checking index %d: %p\n", i, registered_filesystems[i]);
-        PRINT(WHITE, BLACK, "[VFS-DEBUG] fs_type[0]='%c' fs_type addr=%p\n", fs_type[0], fs_type);
+static vfs_mount_t* mount_covering(vfs_node_t *dir) {
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t *m = &mount_table[i];
+        if (m->used && m->covered_fs == dir->fs && m->covered_inode == dir->inode &&
+            m->fs->private_data) {
+            return m;
+        }
+    }
+    return NULL;
+}
 
-        PRINT(WHITE, BLACK, "[VFS-DEBUG] name[0]='%c' name addr=%p\n", registered_filesystems[i]->name[0],
-           registered_filesystems[i]->name);
+// A directory something is mounted on resolves to the mounted root
+static vfs_node_t* cross_mounts(vfs_node_t *node) {
+    if (num_mounts < 2) return node;
 
-        if (registered_filesystems[i] != NULL && registered_filesystems[i]->name != NULL) {
-            PRINT(WHITE, BLACK, "[VFS] Comparing '%s' with '%s'\n", fs_type, registered_filesystems[i]->name);
+    for (int depth = 0; depth < VFS_MAX_MOUNTS && node->type == FILE_TYPE_DIRECTORY; depth++) {
+        vfs_mount_t *m = mount_covering(node);
+        if (!m) break;
+        node = m->root;
+    }
+    return node;
+}
 
-            if (str_cmp(fs_type, registered_filesystems[i]->name) == 0) {
-                fs = registered_filesystems[i];
-                PRINT(MAGENTA, BLACK, "[VFS] Found filesystem type: %s\n", fs_type);
-                break;
-            }
+static vfs_mount_t* find_mount(const char *path) {
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (mount_table[i].used && str_cmp(mount_table[i].path, path) == 0) {
+            return &mount_table[i];
         }
     }
+    return NULL;
+}
+
+// Mount points are kept without a trailing slash, except "/" itself
+static void normalize_mountpoint(const char *path, char *out) {
+    str_cpy(out, path, 256);
+    int len = str_len(out);
+    while (len > 1 && out[len - 1] == '/') {
+        out[--len] = '\0';
+    }
+}
+
+static vfs_node_t* walk_path(const char *path, dentry_t **dentry);
+
+int vfs_mount(const char *fs_type, const char *device, const char *mountpoint) {
+    return vfs_mount_flags(fs_type, device, mountpoint, 0);
+}
+
+int vfs_mount_flags(const char *fs_type, const char *device, const char *mountpoint, uint32_t flags) {
+    if (!fs_type || !mountpoint || mountpoint[0] != '/') return -1;
 
-    if (!fs) {
+    PRINT(WHITE, BLACK, "[VFS] Mounting %s (%s) at %s\n", fs_type, device ? device : "none", mountpoint);
+
+    char path[256];
+    normalize_mountpoint(mountpoint, path);
+    int is_root = path[1] == '\0';
+
+    filesystem_t *type = find_fs_type(fs_type);
+    if (!type) {
         PRINT(YELLOW, BLACK, "[VFS] Filesystem type not found: %s\n", fs_type);
         return -1;
     }
 
-    PRINT(WHITE, BLACK,"[VFS] Calling fs->ops->mount()...\n");
+    // An entry whose filesystem was unmounted underneath it is stale
+    vfs_mount_t *m = find_mount(path);
+    if (m && m->fs->private_data) {
+        PRINT(YELLOW, BLACK, "[VFS] %s is already a mount point\n", path);
+        return -1;
+    }
+
+    vfs_node_t *covered = NULL;
+    if (!is_root) {
+        covered = walk_path(path, NULL);
+        if (!covered || covered->type != FILE_TYPE_DIRECTORY) {
+            PRINT(YELLOW, BLACK, "[VFS] Mount point %s is not a directory\n", path);
+            return -1;
+        }
+    }
+
+    if (!m) {
+        for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+            if (!mount_table[i].used) {
+                m = &mount_table[i];
+                break;
+            }
+        }
+        if (!m) {
+            PRINT(YELLOW, BLACK, "[VFS] Mount table full\n");
+            return -1;
+        }
+    } else {
+        if (m->cloned) kfree(m->fs);
+        m->used = 0;
+        num_mounts--;
+    }
+
+    int cloned;
+    filesystem_t *fs = fs_instance(type, &cloned);
+    if (!fs) return -1;
 
     if (fs->ops->mount(fs, device) != 0) {
         PRINT(YELLOW, BLACK, "[VFS] Failed to mount %s on device %s\n", fs_type, device);
+        if (cloned) kfree(fs);
         return -1;
     }
 
-    PRINT(MAGENTA, BLACK, "[VFS] Mount operation successful\n");
+    vfs_node_t *root = fs->ops->get_root(fs);
+    if (!root) {
+        PRINT(YELLOW, BLACK, "[VFS] CRITICAL: get_root returned NULL!\n");
+        fs->ops->unmount(fs);
+        if (cloned) kfree(fs);
+        return -1;
+    }
+    root->fs = fs;
 
-    if (mountpoint[0] == '/' && mountpoint[1] == '\0') {
-        PRINT(WHITE, BLACK, "[VFS] Getting root node from filesystem...\n");
-        root_node = fs->ops->get_root(fs);
-        PRINT(WHITE, BLACK, "[VFS] root_node AFTER get_root: %p\n", root_node);
+    if (flags & MOUNT_READONLY) fs->flags |= FS_FLAG_RDONLY;
 
-        if (!root_node) {
-            PRINT(YELLOW, BLACK, "[VFS] CRITICAL: get_root returned NULL!\n");
-            return -1;
-        }
+    // Anything cached under a previous mount of this instance is gone
+    dcache_invalidate_fs(fs);
+    pcache_invalidate_fs(fs);
+
+    m->used = 1;
+    m->cloned = cloned;
+    str_cpy(m->path, path, 256);
+    m->fs = fs;
+    m->root = root;
+    m->covered_fs = covered ? covered->fs : NULL;
+    m->covered_inode = covered ? covered->inode : 0;
+    num_mounts++;
 
-        root_node->fs = fs;
+    if (is_root) {
+        root_node = root;
         current_dir = root_node;
-        PRINT(MAGENTA, BLACK, "[VFS] Root node set successfully:\n");
-        PRINT(MAGENTA, BLACK, "[VFS]   root_node = %p\n", root_node);
-        PRINT(MAGENTA, BLACK, "[VFS]   root_node->fs = %p\n", root_node->fs);
-        PRINT(MAGENTA, BLACK, "[VFS]   root_node->ops = %p\n", root_node->ops);
-        PRINT(MAGENTA, BLACK, "[VFS]   root_node->name = '%s'\n", root_node->name);
-        PRINT(MAGENTA, BLACK, "[VFS]   root_node->type = %d\n", root_node->type);
     }
 
-    PRINT(MAGENTA, BLACK, "[VFS] Mounted %s at %s\n", fs_type, mountpoint);
-
+    PRINT(MAGENTA, BLACK, "[VFS] Mounted %s at %s%s\n", fs_type, path,
+          (flags & MOUNT_READONLY) ? " (read-only)" : "");
     return 0;
 }
 
-static int allocate_fd(void) {
-    for (int i = 3; i < MAX_OPEN_FILES; i++) {
-        if (!vfs_fd_table[i].used) {
-            vfs_fd_table[i].used = 1;
-            return i;
-        }
+// Refuses while files are open on the mount, the cwd is inside it, or
+// something else is mounted inside it
+int vfs_unmount(const char *mountpoint) {
+    if (!mountpoint) return -1;
+
+    char path[256];
+    normalize_mountpoint(mountpoint, path);
+
+    vfs_mount_t *m = find_mount(path);
+    if (!m) {
+        PRINT(YELLOW, BLACK, "[VFS] %s is not a mount point\n", path);
+        return -1;
     }
-    return -1;
-}
 
-static void tokenize_path(const char *path, char tokens[][MAX_FILENAME], int *token_count) {
-    *token_count = 0;
-    int token_idx = 0;
-    int char_idx = 0;
+    filesystem_t *fs = m->fs;
+    int busy = current_dir && current_dir->fs == fs && m->root != root_node;
 
-    int start = (path[0] == '/') ? 1 : 0;
+    if (!busy) busy = fdt_uses_fs(fs);
+    for (int i = 0; i < VFS_MAX_MOUNTS && !busy; i++) {
+        if (mount_table[i].used && mount_table[i].covered_fs == fs) busy = 1;
+    }
+    for (vfs_map_t *map = live_maps; map && !busy; map = map->next) {
+        if (map->node->fs == fs) busy = 1;
+    }
 
-    for (int i = start; path[i]; i++) {
-        if (path[i] == '/') {
-            if (char_idx > 0) {
-                tokens[token_idx][char_idx] = '\0';
-                token_idx++;
-                char_idx = 0;
-            }
-        } else {
-            if (char_idx < MAX_FILENAME - 1) {
-                tokens[token_idx][char_idx++] = path[i];
-            }
-        }
+    if (busy) {
+        PRINT(YELLOW, BLACK, "[VFS] %s is busy\n", path);
+        return -1;
     }
 
-    if (char_idx > 0) {
-        tokens[token_idx][char_idx] = '\0';
-        token_idx++;
+    dcache_invalidate_fs(fs);
+    pcache_invalidate_fs(fs);
+
+    if (fs->ops && fs->ops->unmount && fs->ops->unmount(fs) != 0) return -1;
+
+    if (m->root == root_node) {
+        root_node = NULL;
+        current_dir = NULL;
     }
 
-    *token_count = token_idx;
+    if (m->cloned) kfree(fs);
+    m->used = 0;
+    num_mounts--;
+
+    PRINT(MAGENTA, BLACK, "[VFS] Unmounted %s\n", path);
+    return 0;
 }
 
-vfs_node_t* vfs_resolve_path(const char *path) {
-    PRINT(WHITE, BLACK, "[VFS] resolve_path: '%s'\n", path);
+void vfs_list_mounts(void) {
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t *m = &mount_table[i];
+        if (!m->used || !m->fs->private_data) continue;
 
-    if (!root_node) {
-        PRINT(YELLOW, BLACK, "[VFS] resolve_path: root_node is NULL!\n");
-        return NULL;
+        PRINT(WHITE, BLACK, "%s on %s%s\n", m->fs->name, m->path,
+              (m->fs->flags & FS_FLAG_RDONLY) ? " (ro)" : "");
     }
+}
 
-    PRINT(MAGENTA, BLACK, "[VFS] resolve_path: root_node = %p\n", root_node);
+int vfs_sync(void) {
+    int result = 0;
 
-    if (!path) {
-        PRINT(YELLOW, BLACK, "[VFS] resolve_path: path is NULL\n");
-        return NULL;
-    }
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t *m = &mount_table[i];
+        if (!m->used || !m->fs->private_data || !m->fs->ops->sync) continue;
 
-    if (path[0] == '/' && path[1] == '\0') {
-        PRINT(MAGENTA, BLACK, "[VFS] resolve_path: returning root\n");
-        return root_node;
+        if (m->fs->ops->sync(m->fs) != 0) result = -1;
     }
+    return result;
+}
 
-    if (path[0] != '/') {
-        PRINT(YELLOW, BLACK, "[VFS] resolve_path: path must be absolute: %s\n", path);
-        return NULL;
+// The open file behind fd in the calling process's table, pinned so a
+// concurrent close cannot free it; callers vfs_file_put() it when done
+static file_descriptor_t* fd_file(int fd) {
+    return fdt_lookup(fdt_current(), fd);
+}
+
+// One component through the dentry cache; the filesystem is only asked on
+// a miss, and its answer (including "no such name") is cached. `dentry`,
+// if given, receives the entry still pinned.
+static vfs_node_t* lookup_component(vfs_node_t *dir, const char *name, uint32_t len,
+                                    dentry_t **dentry) {
+    dentry_t *d = dcache_lookup(dir, name, len);
+    if (!d) {
+        char component[MAX_FILENAME];
+        if (len >= MAX_FILENAME) return NULL;
+
+        for (uint32_t i = 0; i < len; i++) {
+            component[i] = name[i];
+        }
+        component[len] = '\0';
+
+        vfs_node_t *node = vfs_finddir(dir, component);
+        d = dcache_add(dir, name, len, node);
+        if (!d) {
+            if (dentry) *dentry = NULL;
+            return node;
+        }
     }
 
-    char tokens[32][MAX_FILENAME];
-    int token_count = 0;
-    tokenize_path(path, tokens, &token_count);
+    vfs_node_t *node = d->node;
+    if (dentry) {
+        *dentry = d;
+    } else {
+        dcache_put(d);
+    }
+    return node;
+}
 
-    PRINT(WHITE, BLACK, "[VFS] resolve_path: %d path components\n", token_count);
+// Walk an absolute path in place, without copying components out.
+// `dentry` receives the last component's entry, pinned (NULL for the root).
+static vfs_node_t* walk_path(const char *path, dentry_t **dentry) {
+    if (dentry) *dentry = NULL;
+    if (!root_node || !path || path[0] != '/') return NULL;
 
     vfs_node_t *current = root_node;
+    const char *p = path;
 
-    for (int i = 0; i < token_count; i++) {
-        PRINT(WHITE, BLACK, "[VFS] resolve_path: looking for '%s'\n", tokens[i]);
+    while (*p) {
+        while (*p == '/') p++;
+        if (!*p) break;
 
-        if (!current) {
-            PRINT(YELLOW, BLACK, "[VFS] resolve_path: current node is NULL at component '%s'\n", tokens[i]);
-            return NULL;
-        }
+        const char *name = p;
+        uint32_t len = 0;
+        while (p[len] && p[len] != '/') len++;
+        p += len;
 
         if (current->type != FILE_TYPE_DIRECTORY) {
-            PRINT(YELLOW, BLACK, "[VFS] resolve_path: '%s' is not a directory\n", tokens[i]);
-            return NULL;
+            current = NULL;
+            break;
         }
 
-        current = vfs_finddir(current, tokens[i]);
-        if (!current) {
-            PRINT(YELLOW, BLACK, "[VFS] resolve_path: component not found: '%s'\n", tokens[i]);
-            return NULL;
+        dentry_t *d = NULL;
+        current = lookup_component(current, name, len, dentry ? &d : NULL);
+        if (dentry) {
+            dcache_put(*dentry);
+            *dentry = d;
+        }
+        if (!current) break;
+
+        vfs_node_t *mounted = cross_mounts(current);
+        if (mounted != current) {
+            // The dentry names the covered directory, not the mounted root
+            if (dentry) {
+                dcache_put(*dentry);
+                *dentry = NULL;
+            }
+            current = mounted;
         }
-        PRINT(MAGENTA, BLACK, "[VFS] resolve_path: found '%s'\n", tokens[i]);
     }
 
-    PRINT(MAGENTA, BLACK, "[VFS] resolve_path: success, returning %p\n", current);
+    if (!current && dentry) {
+        dcache_put(*dentry);
+        *dentry = NULL;
+    }
     return current;
 }
 
+vfs_node_t* vfs_resolve_path(const char *path) {
+    return walk_path(path, NULL);
+}
+
 int vfs_open(const char *path, uint32_t flags) {
-    vfs_node_t *node = vfs_resolve_path(path);
+    dentry_t *dentry;
+    vfs_node_t *node = walk_path(path, &dentry);
     if (!node) return -1;
 
-    int fd = allocate_fd();
-    if (fd < 0) return -1;
+    file_descriptor_t *file = (file_descriptor_t*)kmalloc(sizeof(file_descriptor_t));
+    if (!file) {
+        dcache_put(dentry);
+        return -1;
+    }
 
-    vfs_fd_table[fd].node = node;
-    vfs_fd_table[fd].position = 0;
-    vfs_fd_table[fd].flags = flags;
+    // The walk's pin keeps the open file's entry resident
+    file->refcount = 1;
+    file->dentry = dentry;
+    file->node = node;
+    file->position = 0;
+    file->flags = flags;
+    file->ra.next = 0;
+    file->ra.window = 0;
+
+    int fd = fdt_alloc(fdt_current(), file);
+    if (fd < 0) {
+        dcache_put(dentry);
+        kfree(file);
+        return -1;
+    }
 
     if (node->ops && node->ops->open) {
         node->ops->open(node, flags);
@@ -283,68 +472,76 @@ int vfs_open(const char *path, uint32_t flags) {
     return fd;
 }
 
-int vfs_close(int fd) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !vfs_fd_table[fd].used) {
-        return -1;
-    }
+void vfs_file_get(file_descriptor_t *file) {
+    __sync_fetch_and_add(&file->refcount, 1);
+}
 
-    vfs_node_t *node = vfs_fd_table[fd].node;
+void vfs_file_put(file_descriptor_t *file) {
+    if (!file || __sync_sub_and_fetch(&file->refcount, 1) > 0) return;
 
+    vfs_node_t *node = file->node;
     if (node && node->ops && node->ops->close) {
         node->ops->close(node);
     }
+    dcache_put(file->dentry);
+    kfree(file);
+}
 
-    vfs_fd_table[fd].used = 0;
-    vfs_fd_table[fd].node = NULL;
-    vfs_fd_table[fd].position = 0;
+int vfs_close(int fd) {
+    file_descriptor_t *file = fdt_remove(fdt_current(), fd);
+    if (!file) return -1;
 
+    vfs_file_put(file);
     return 0;
 }
 
 int vfs_read(int fd, uint8_t *buffer, uint32_t size) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !vfs_fd_table[fd].used) {
-        return -1;
-    }
+    file_descriptor_t *file = fd_file(fd);
+    if (!file) return -1;
 
-    vfs_node_t *node = vfs_fd_table[fd].node;
+    vfs_node_t *node = file->node;
     if (!node || !node->ops || !node->ops->read) {
+        vfs_file_put(file);
         return -1;
     }
 
-    int bytes_read = node->ops->read(node, buffer, size, vfs_fd_table[fd].position);
+    int bytes_read = pcache_read(node, buffer, size, file->position, &file->ra);
 
     if (bytes_read > 0) {
-        vfs_fd_table[fd].position += bytes_read;
+        file->position += bytes_read;
     }
 
+    vfs_file_put(file);
     return bytes_read;
 }
 
 int vfs_write(int fd, uint8_t *buffer, uint32_t size) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !vfs_fd_table[fd].used) {
-        return -1;
-    }
+    file_descriptor_t *file = fd_file(fd);
+    if (!file) return -1;
 
-    vfs_node_t *node = vfs_fd_table[fd].node;
-    if (!node || !node->ops || !node->ops->write) {
+    vfs_node_t *node = file->node;
+    if (!node || !node->ops || !node->ops->write ||
+        (node->fs && (node->fs->flags & FS_FLAG_RDONLY))) {
+        vfs_file_put(file);
         return -1;
     }
 
-    int bytes_written = node->ops->write(node, buffer, size, vfs_fd_table[fd].position);
+    int bytes_written = node->ops->write(node, buffer, size, file->position);
 
     if (bytes_written > 0) {
-        vfs_fd_table[fd].position += bytes_written;
+        pcache_write(node, buffer, bytes_written, file->position);
+        file->position += bytes_written;
     }
 
+    vfs_file_put(file);
     return bytes_written;
 }
 
 int vfs_seek(int fd, int offset, int whence) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !vfs_fd_table[fd].used) {
-        return -1;
-    }
+    file_descriptor_t *file = fd_file(fd);
+    if (!file) return -1;
 
-    uint32_t new_pos = vfs_fd_table[fd].position;
+    uint32_t new_pos = file->position;
 
     switch (whence) {
         case SEEK_SET:
@@ -354,16 +551,339 @@ int vfs_seek(int fd, int offset, int whence) {
             new_pos += offset;
             break;
         case SEEK_END:
-            new_pos = vfs_fd_table[fd].node->size + offset;
+            new_pos = file->node->size + offset;
             break;
         default:
+            vfs_file_put(file);
             return -1;
     }
 
-    vfs_fd_table[fd].position = new_pos;
+    file->position = new_pos;
+    vfs_file_put(file);
     return new_pos;
 }
 
+
+// Node sizes are 32-bit, so no byte of any file lies at or past this offset
+#define VFS_MAX_OFFSET 0xFFFFFFFFULL
+
+static int64_t readv_at(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt,
+                        uint64_t offset, vfs_readahead_t *ra) {
+    int64_t total = 0;
+
+    for (int i = 0; i < iovcnt; i++) {
+        uint8_t *base = (uint8_t*)iov[i].base;
+        uint64_t len = iov[i].len;
+
+        while (len > 0) {
+            uint64_t pos = offset + total;
+            if (pos >= VFS_MAX_OFFSET) return total;
+
+            uint64_t chunk = len;
+            if (chunk > VFS_MAX_OFFSET - pos) chunk = VFS_MAX_OFFSET - pos;
+            if (chunk > 0x7FFFFFFF) chunk = 0x7FFFFFFF;
+
+            int got = pcache_read(node, base, (uint32_t)chunk, (uint32_t)pos, ra);
+            if (got < 0) return total ? total : -1;
+
+            total += got;
+            base += got;
+            len -= got;
+
+            // End of file or a short read
+            if ((uint64_t)got < chunk) return total;
+        }
+    }
+
+    return total;
+}
+
+// Filesystems without writev get one write call per segment
+static int64_t writev_at(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, uint64_t offset) {
+    int64_t written = 0;
+
+    if (node->fs && (node->fs->flags & FS_FLAG_RDONLY)) return -1;
+
+    if (node->ops->writev) {
+        written = node->ops->writev(node, iov, iovcnt, offset);
+    } else {
+        for (int i = 0; i < iovcnt; i++) {
+            uint8_t *base = (uint8_t*)iov[i].base;
+            uint64_t len = iov[i].len;
+
+            while (len > 0) {
+                uint64_t pos = offset + written;
+                if (pos >= VFS_MAX_OFFSET) break;
+
+                uint64_t chunk = len;
+                if (chunk > VFS_MAX_OFFSET - pos) chunk = VFS_MAX_OFFSET - pos;
+                if (chunk > 0x7FFFFFFF) chunk = 0x7FFFFFFF;
+
+                int n = node->ops->write(node, base, (uint32_t)chunk, (uint32_t)pos);
+                if (n <= 0) {
+                    if (written == 0) written = n < 0 ? -1 : 0;
+                    goto done;
+                }
+
+                written += n;
+                base += n;
+                len -= n;
+                if ((uint64_t)n < chunk) goto done;
+            }
+        }
+    }
+
+done:
+    // Bring cached pages up to date with what reached the filesystem
+    if (written > 0) {
+        uint64_t left = (uint64_t)written;
+        uint64_t pos = offset;
+        for (int i = 0; i < iovcnt && left > 0; i++) {
+            uint64_t len = iov[i].len < left ? iov[i].len : left;
+            if (len > 0) pcache_write(node, (const uint8_t*)iov[i].base, (uint32_t)len, (uint32_t)pos);
+            pos += len;
+            left -= len;
+        }
+    }
+
+    return written;
+}
+
+
+int64_t vfs_readv(int fd, const vfs_iovec_t *iov, int iovcnt) {
+    if (!iov || iovcnt <= 0 || iovcnt > VFS_IOV_MAX) return -1;
+
+    file_descriptor_t *file = fd_file(fd);
+    vfs_node_t *node = file ? file->node : NULL;
+    int64_t bytes_read = -1;
+
+    if (node && node->ops && node->ops->read) {
+        bytes_read = readv_at(node, iov, iovcnt, file->position, &file->ra);
+        if (bytes_read > 0) file->position += (uint32_t)bytes_read;
+    }
+
+    vfs_file_put(file);
+    return bytes_read;
+}
+
+int64_t vfs_writev(int fd, const vfs_iovec_t *iov, int iovcnt) {
+    if (!iov || iovcnt <= 0 || iovcnt > VFS_IOV_MAX) return -1;
+
+    file_descriptor_t *file = fd_file(fd);
+    vfs_node_t *node = file ? file->node : NULL;
+    int64_t bytes_written = -1;
+
+    if (node && node->ops && (node->ops->write || node->ops->writev)) {
+        bytes_written = writev_at(node, iov, iovcnt, file->position);
+        if (bytes_written > 0) file->position += (uint32_t)bytes_written;
+    }
+
+    vfs_file_put(file);
+    return bytes_written;
+}
+
+int64_t vfs_pread(int fd, void *buffer, uint64_t size, uint64_t offset) {
+    file_descriptor_t *file = fd_file(fd);
+    vfs_node_t *node = file ? file->node : NULL;
+    int64_t bytes_read = -1;
+
+    if (node && node->ops && node->ops->read) {
+        vfs_iovec_t iov = { buffer, size };
+        bytes_read = offset >= VFS_MAX_OFFSET ? 0 : readv_at(node, &iov, 1, offset, &file->ra);
+    }
+
+    vfs_file_put(file);
+    return bytes_read;
+}
+
+int64_t vfs_pwrite(int fd, const void *buffer, uint64_t size, uint64_t offset) {
+    file_descriptor_t *file = fd_file(fd);
+    vfs_node_t *node = file ? file->node : NULL;
+    int64_t bytes_written = -1;
+
+    if (node && node->ops && (node->ops->write || node->ops->writev) && offset < VFS_MAX_OFFSET) {
+        vfs_iovec_t iov = { (void*)buffer, size };
+        bytes_written = writev_at(node, &iov, 1, offset);
+    }
+
+    vfs_file_put(file);
+    return bytes_written;
+}
+
+
+static vfs_map_t* map_file(file_descriptor_t *file, uint32_t offset, uint32_t len, uint32_t prot) {
+    vfs_node_t *node = file ? file->node : NULL;
+    if (!node || node->type != FILE_TYPE_REGULAR || !node->ops || !node->ops->read) return NULL;
+    if (offset % PCACHE_PAGE_SIZE != 0 || offset >= node->size) return NULL;
+
+    // RAM filesystems stay out of the page cache, so there is nothing to map
+    if (node->fs && (node->fs->flags & FS_FLAG_RAM)) return NULL;
+
+    // Nothing can catch stores into the pages to write them back
+    if (prot & VFS_PROT_WRITE) return NULL;
+
+    if (len == 0 || len > node->size - offset) len = node->size - offset;
+    uint32_t npages = (len + PCACHE_PAGE_SIZE - 1) / PCACHE_PAGE_SIZE;
+
+    vfs_map_t *map = (vfs_map_t*)kmalloc(sizeof(vfs_map_t));
+    pcache_page_t **pages = (pcache_page_t**)kmalloc(npages * sizeof(pcache_page_t*));
+    if (!map || !pages) {
+        if (map) kfree(map);
+        if (pages) kfree(pages);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < npages; i++) {
+        pages[i] = NULL;
+    }
+
+    // Hold the node the way an open file does
+    dcache_get(file->dentry);
+    if (node->ops->open) node->ops->open(node, FILE_READ);
+
+    map->node = node;
+    map->dentry = file->dentry;
+    map->offset = offset;
+    map->length = len;
+    map->prot = prot;
+    map->faults = 0;
+    map->pages = pages;
+    map->next = live_maps;
+    live_maps = map;
+
+    return map;
+}
+
+vfs_map_t* vfs_mmap(int fd, uint32_t offset, uint32_t len, uint32_t prot) {
+    file_descriptor_t *file = fd_file(fd);
+    vfs_map_t *map = map_file(file, offset, len, prot);
+    vfs_file_put(file);
+    return map;
+}
+
+const uint8_t* vfs_map_get(vfs_map_t *map, uint32_t offset, uint32_t *avail) {
+    if (!map || offset >= map->length) return NULL;
+
+    uint32_t i = offset / PCACHE_PAGE_SIZE;
+    if (!map->pages[i]) {
+        map->pages[i] = pcache_get_page(map->node, map->offset / PCACHE_PAGE_SIZE + i);
+        if (!map->pages[i]) return NULL;
+        map->faults++;
+    }
+
+    uint32_t page_off = offset % PCACHE_PAGE_SIZE;
+    uint32_t n = PCACHE_PAGE_SIZE - page_off;
+    if (n > map->length - offset) n = map->length - offset;
+    if (avail) *avail = n;
+
+    return map->pages[i]->data + page_off;
+}
+
+int vfs_munmap(vfs_map_t *map) {
+    vfs_map_t **link = &live_maps;
+    while (*link && *link != map) link = &(*link)->next;
+    if (!map || !*link) return -1;
+    *link = map->next;
+
+    uint32_t npages = (map->length + PCACHE_PAGE_SIZE - 1) / PCACHE_PAGE_SIZE;
+    for (uint32_t i = 0; i < npages; i++) {
+        if (map->pages[i]) pcache_put_page(map->pages[i]);
+    }
+
+    if (map->node->ops && map->node->ops->close) map->node->ops->close(map->node);
+    dcache_put(map->dentry);
+
+    kfree(map->pages);
+    kfree(map);
+    return 0;
+}
+
+
+int vfs_pipe(int fds[2]) {
+    pipe_t *pipe = pipe_create();
+    if (!pipe) return -1;
+
+    vfs_node_t *rnode = pipe_open_end(pipe, 0);
+    vfs_node_t *wnode = pipe_open_end(pipe, 1);
+    file_descriptor_t *rfile = (file_descriptor_t*)kcalloc(1, sizeof(file_descriptor_t));
+    file_descriptor_t *wfile = (file_descriptor_t*)kcalloc(1, sizeof(file_descriptor_t));
+    if (!rnode || !wnode || !rfile || !wfile) {
+        if (rnode) kfree(rnode);
+        if (wnode) kfree(wnode);
+        if (rfile) kfree(rfile);
+        if (wfile) kfree(wfile);
+        pipe_close_reader(pipe);
+        pipe_close_writer(pipe);
+        return -1;
+    }
+
+    rfile->refcount = 1;
+    rfile->node = rnode;
+    rfile->flags = FILE_READ;
+    wfile->refcount = 1;
+    wfile->node = wnode;
+    wfile->flags = FILE_WRITE;
+
+    fd_table_t *fdt = fdt_current();
+    fds[0] = fdt_alloc(fdt, rfile);
+    fds[1] = fds[0] >= 0 ? fdt_alloc(fdt, wfile) : -1;
+    if (fds[1] < 0) {
+        if (fds[0] >= 0) fdt_remove(fdt, fds[0]);
+        // Each end closes its side of the pipe
+        vfs_file_put(rfile);
+        vfs_file_put(wfile);
+        return -1;
+    }
+    return 0;
+}
+
+static int splice_file(file_descriptor_t *file, pipe_t *pipe, uint32_t len) {
+    vfs_node_t *node = file ? file->node : NULL;
+    if (!node || !pipe || node->type != FILE_TYPE_REGULAR || !node->ops || !node->ops->read) return -1;
+    if (file->position >= node->size) return 0;
+    if (len > node->size - file->position) len = node->size - file->position;
+
+    uint8_t *bounce = NULL;
+    uint32_t done = 0;
+
+    while (done < len) {
+        uint32_t pos = file->position;
+        uint32_t page_off = pos % PCACHE_PAGE_SIZE;
+        uint32_t n = PCACHE_PAGE_SIZE - page_off;
+        if (n > len - done) n = len - done;
+
+        int moved;
+        pcache_page_t *page = pcache_get_page(node, pos / PCACHE_PAGE_SIZE);
+        if (page) {
+            moved = pipe_splice_page(pipe, page, page_off, n);
+            if (moved < 0) pcache_put_page(page);
+        } else {
+            // Not cacheable (RAM filesystem, or every page pinned): copy
+            if (!bounce) bounce = (uint8_t*)kmalloc(PCACHE_PAGE_SIZE);
+            if (!bounce) break;
+
+            moved = pcache_read(node, bounce, n, pos, &file->ra);
+            if (moved > 0) moved = pipe_write(pipe, bounce, (uint32_t)moved);
+        }
+
+        if (moved <= 0) {
+            if (bounce) kfree(bounce);
+            return done ? (int)done : -1;
+        }
+        file->position += moved;
+        done += moved;
+    }
+
+    if (bounce) kfree(bounce);
+    return (int)done;
+}
+
+int vfs_splice(int fd, pipe_t *pipe, uint32_t len) {
+    file_descriptor_t *file = fd_file(fd);
+    int moved = splice_file(file, pipe, len);
+    vfs_file_put(file);
+    return moved;
+}
+
 vfs_node_t* vfs_readdir(vfs_node_t *node, uint32_t index) {
     if (!node || node->type != FILE_TYPE_DIRECTORY) return NULL;
     if (!node->ops || !node->ops->readdir) return NULL;
@@ -371,6 +891,24 @@ vfs_node_t* vfs_readdir(vfs_node_t *node, uint32_t index) {
     return node->ops->readdir(node, index);
 }
 
+int vfs_opendir(vfs_node_t *node, vfs_dir_t *dir) {
+    if (!node || node->type != FILE_TYPE_DIRECTORY || !dir) return -1;
+
+    dir->node = node;
+    dir->cookie = 0;
+    return 0;
+}
+
+// Filesystems without a cursor fall back to readdir by index
+vfs_node_t* vfs_readdir_next(vfs_dir_t *dir) {
+    if (!dir || !dir->node || !dir->node->ops) return NULL;
+
+    if (dir->node->ops->readdir_next) {
+        return dir->node->ops->readdir_next(dir->node, &dir->cookie);
+    }
+    return vfs_readdir(dir->node, dir->cookie++);
+}
+
 vfs_node_t* vfs_finddir(vfs_node_t *node, const char *name) {
     if (!node || node->type != FILE_TYPE_DIRECTORY) return NULL;
     if (!node->ops || !node->ops->finddir) return NULL;
@@ -435,11 +973,17 @@ int vfs_create(const char *path, uint32_t permissions) {
         return -1;
     }
 
+    if (parent->fs && (parent->fs->flags & FS_FLAG_RDONLY)) {
+        PRINT(YELLOW, BLACK, "[VFS] vfs_create: Read-only filesystem\n");
+        return -1;
+    }
+
     PRINT(WHITE, BLACK, "[VFS] vfs_create: Calling parent->ops->create()...\n");
 
     int result = parent->ops->create(parent, filename, FILE_TYPE_REGULAR, permissions);
 
     if (result == 0) {
+        dcache_invalidate(parent, filename, j);
         PRINT(MAGENTA, BLACK, "[VFS] vfs_create: SUCCESS\n");
     } else {
         PRINT(YELLOW, BLACK, "[VFS] vfs_create: FAILED\n");
@@ -505,11 +1049,17 @@ int vfs_mkdir(const char *path, uint32_t permissions) {
         return -1;
     }
 
+    if (parent->fs && (parent->fs->flags & FS_FLAG_RDONLY)) {
+        PRINT(YELLOW, BLACK, "[VFS] vfs_mkdir: Read-only filesystem\n");
+        return -1;
+    }
+
     PRINT(WHITE, BLACK, "[VFS] vfs_mkdir: Calling parent->ops->create()...\n");
 
     int result = parent->ops->create(parent, dirname, FILE_TYPE_DIRECTORY, permissions);
 
     if (result == 0) {
+        dcache_invalidate(parent, dirname, j);
         PRINT(MAGENTA, BLACK, "[VFS] vfs_mkdir: SUCCESS\n");
     } else {
         PRINT(YELLOW, BLACK, "[VFS] vfs_mkdir: FAILED\n");
@@ -551,8 +1101,25 @@ int vfs_unlink(const char *path) {
     if (!parent || parent->type != FILE_TYPE_DIRECTORY) return -1;
 
     if (!parent->ops || !parent->ops->unlink) return -1;
+    if (parent->fs && (parent->fs->flags & FS_FLAG_RDONLY)) return -1;
 
-    return parent->ops->unlink(parent, name);
+    // The node may be freed by the unlink, so note what it was first
+    vfs_node_t *victim = lookup_component(parent, name, j, NULL);
+    if (victim && num_mounts > 1 && mount_covering(victim)) {
+        PRINT(YELLOW, BLACK, "[VFS] %s is a mount point\n", path);
+        return -1;
+    }
+    int was_dir = victim && victim->type == FILE_TYPE_DIRECTORY;
+    filesystem_t *victim_fs = victim ? victim->fs : NULL;
+    uint32_t victim_inode = victim ? victim->inode : 0;
+
+    int result = parent->ops->unlink(parent, name);
+    if (result == 0) {
+        dcache_invalidate(parent, name, j);
+        if (was_dir) dcache_invalidate_dir(victim_fs, victim_inode);
+        if (victim) pcache_invalidate(victim_fs, victim_inode);
+    }
+    return result;
 }
 
 void vfs_list_directory(const char *path) {
@@ -571,16 +1138,15 @@ void vfs_list_directory(const char *path) {
 
     PRINT(WHITE, BLACK, "Contents of %s:\n", path);
 
-    uint32_t i = 0;
+    vfs_dir_t cursor;
     vfs_node_t *entry;
     int count = 0;
 
-    while ((entry = vfs_readdir(dir, i++)) != NULL) {
+    vfs_opendir(dir, &cursor);
+    while ((entry = vfs_readdir_next(&cursor)) != NULL) {
         char type = (entry->type == FILE_TYPE_DIRECTORY) ? 'd' : 'f';
         PRINT(WHITE, BLACK, "  [%c] %s %d bytes\n", type, entry->name, entry->size);
         count++;
-
-        kfree(entry);
     }
 
     if (count == 0) {
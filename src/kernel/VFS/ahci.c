@@ -0,0 +1,613 @@
+#include "ahci.h"
+#include "ata.h"
+#include "PCI.h"
+#include "apic.h"
+#include "irq.h"
+#include "memory.h"
+#include "process.h"
+#include "print.h"
+#include "string_helpers.h"
+
+extern int get_scheduler_enabled(void);
+
+static volatile uint8_t *abar = NULL;
+static uint32_t hba_slots = 0;
+static int hba_s64 = 0;
+static int hba_ncq = 0;
+static int irq_vector = -1;
+
+static ahci_port_t disks[AHCI_MAX_DISKS];
+static int disk_count = 0;
+
+
+static inline uint32_t hba_read(uint32_t reg) {
+    return *(volatile uint32_t*)(abar + reg);
+}
+
+static inline void hba_write(uint32_t reg, uint32_t value) {
+    *(volatile uint32_t*)(abar + reg) = value;
+}
+
+static inline uint32_t port_read(ahci_port_t *p, uint32_t reg) {
+    return *(volatile uint32_t*)(p->regs + reg);
+}
+
+static inline void port_write(ahci_port_t *p, uint32_t reg, uint32_t value) {
+    *(volatile uint32_t*)(p->regs + reg) = value;
+}
+
+static void zero(void *ptr, uint32_t bytes) {
+    uint8_t *b = (uint8_t*)ptr;
+    for (uint32_t i = 0; i < bytes; i++) b[i] = 0;
+}
+
+static inline uint64_t read_rflags(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq\n pop %0" : "=r"(flags));
+    return flags;
+}
+
+// Memory is identity mapped; the HBA needs word alignment and, without
+// S64A, addresses below 4 GiB
+static int dma_ok(const void *buffer, uint64_t bytes) {
+    uint64_t addr = (uint64_t)buffer;
+    if (addr & 1) return 0;
+    return hba_s64 || addr + bytes <= 0x100000000ULL;
+}
+
+
+static int port_stop(ahci_port_t *p) {
+    port_write(p, PX_CMD, port_read(p, PX_CMD) & ~PX_CMD_ST);
+    for (int i = 0; i < 1000000 && (port_read(p, PX_CMD) & PX_CMD_CR); i++);
+
+    port_write(p, PX_CMD, port_read(p, PX_CMD) & ~PX_CMD_FRE);
+    for (int i = 0; i < 1000000 && (port_read(p, PX_CMD) & PX_CMD_FR); i++);
+
+    return (port_read(p, PX_CMD) & (PX_CMD_CR | PX_CMD_FR)) ? -1 : 0;
+}
+
+static void port_start(ahci_port_t *p) {
+    for (int i = 0; i < 1000000 && (port_read(p, PX_TFD) & (PX_TFD_BSY | PX_TFD_DRQ)); i++);
+
+    port_write(p, PX_CMD, port_read(p, PX_CMD) | PX_CMD_FRE);
+    port_write(p, PX_CMD, port_read(p, PX_CMD) | PX_CMD_ST);
+}
+
+
+// Fill the command table for `slot` and return its H2D FIS for the caller
+// to finish (count and feature fields differ between NCQ and plain DMA)
+static fis_reg_h2d_t* port_build(ahci_port_t *p, int slot, uint8_t command, uint64_t lba,
+                                 const blk_seg_t *segs, uint32_t nsegs, int write) {
+    ahci_cmd_header_t *hdr = &p->cmd_list[slot];
+    ahci_cmd_table_t *tbl = &p->tables[slot];
+
+    zero(tbl, sizeof(ahci_cmd_table_t));
+
+    int n = 0;
+    for (uint32_t i = 0; i < nsegs; i++) {
+        uint64_t addr = (uint64_t)segs[i].buffer;
+        uint32_t bytes = segs[i].sectors * SECTOR_SIZE;
+
+        while (bytes > 0 && n < AHCI_PRDT_ENTRIES) {
+            uint32_t chunk = bytes > AHCI_PRD_MAX_BYTES ? AHCI_PRD_MAX_BYTES : bytes;
+            tbl->prdt[n].dba = (uint32_t)addr;
+            tbl->prdt[n].dbau = (uint32_t)(addr >> 32);
+            tbl->prdt[n].dbc = chunk - 1;
+            addr += chunk;
+            bytes -= chunk;
+            n++;
+        }
+    }
+
+    hdr->flags = (sizeof(fis_reg_h2d_t) / 4) | (write ? AHCI_CMD_WRITE : 0);
+    hdr->prdtl = (uint16_t)n;
+    hdr->prdbc = 0;
+
+    fis_reg_h2d_t *fis = (fis_reg_h2d_t*)tbl->cfis;
+    fis->type = FIS_TYPE_REG_H2D;
+    fis->flags = 0x80;
+    fis->command = command;
+    fis->device = 0x40;
+    fis->lba0 = (uint8_t)lba;
+    fis->lba1 = (uint8_t)(lba >> 8);
+    fis->lba2 = (uint8_t)(lba >> 16);
+    fis->lba3 = (uint8_t)(lba >> 24);
+    fis->lba4 = (uint8_t)(lba >> 32);
+    fis->lba5 = (uint8_t)(lba >> 40);
+    return fis;
+}
+
+static int request_queued(ahci_port_t *p, ahci_request_t *req) {
+    return p->ncq && req->op != AHCI_OP_FLUSH;
+}
+
+static void port_issue(ahci_port_t *p, int slot, ahci_request_t *req) {
+    int write = req->op == AHCI_OP_WRITE;
+    fis_reg_h2d_t *fis;
+
+    if (req->op == AHCI_OP_FLUSH) {
+        fis = port_build(p, slot, ATA_CMD_FLUSH_CACHE_EXT, 0, NULL, 0, 0);
+        fis->device = 0;
+    } else if (p->ncq) {
+        // FPDMA QUEUED: sector count in FEATURE, tag in COUNT bits 7:3
+        fis = port_build(p, slot, write ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED,
+                         req->lba, req->segs, req->nsegs, write);
+        fis->feature_lo = (uint8_t)req->count;
+        fis->feature_hi = (uint8_t)(req->count >> 8);
+        fis->count_lo = (uint8_t)(slot << 3);
+    } else {
+        fis = port_build(p, slot, write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT,
+                         req->lba, req->segs, req->nsegs, write);
+        fis->count_lo = (uint8_t)req->count;
+        fis->count_hi = (uint8_t)(req->count >> 8);
+    }
+
+    p->slots[slot] = req;
+    p->issued |= 1U << slot;
+    p->commands++;
+
+    uint32_t outstanding = 0;
+    for (uint32_t m = p->issued; m; m &= m - 1) outstanding++;
+    if (outstanding > p->max_outstanding) p->max_outstanding = outstanding;
+
+    if (request_queued(p, req)) port_write(p, PX_SACT, 1U << slot);
+    port_write(p, PX_CI, 1U << slot);
+}
+
+// Start as many pending requests as there are free slots. Interrupts are off.
+static void port_dispatch(ahci_port_t *p) {
+    uint32_t depth_mask = p->queue_depth >= 32 ? 0xFFFFFFFF : (1U << p->queue_depth) - 1;
+
+    while (!list_empty(&p->pending) && !p->unqueued_active) {
+        ahci_request_t *req = list_entry(p->pending.next, ahci_request_t, link);
+        int queued = request_queued(p, req);
+
+        // NCQ and non-NCQ commands may not be outstanding together
+        if (!queued && p->issued) break;
+
+        uint32_t free = ~p->issued & depth_mask;
+        if (!free) break;
+
+        list_del(&req->link);
+        if (!queued) p->unqueued_active = 1;
+        port_issue(p, __builtin_ctz(free), req);
+    }
+}
+
+static void port_complete(ahci_port_t *p, uint32_t mask, int status) {
+    ahci_request_t *finished[AHCI_MAX_SLOTS];
+    int n = 0;
+
+    while (mask) {
+        int slot = __builtin_ctz(mask);
+        mask &= mask - 1;
+
+        if (p->slots[slot]) finished[n++] = p->slots[slot];
+        p->slots[slot] = NULL;
+        p->issued &= ~(1U << slot);
+    }
+
+    if (!p->issued) p->unqueued_active = 0;
+
+    // Slots are free again before callbacks run, so they may submit more
+    for (int i = 0; i < n; i++) {
+        finished[i]->status = status;
+        finished[i]->done = 1;
+        if (finished[i]->complete) finished[i]->complete(finished[i]);
+    }
+}
+
+// A queued error aborts every outstanding tag; the failing one is only named
+// by READ LOG EXT page 10h, so fail them all and restart the port
+static void port_recover(ahci_port_t *p) {
+    p->errors++;
+    PRINT(YELLOW, BLACK, "[AHCI] Port %d error: TFD=0x%x SERR=0x%x\n", p->port,
+          port_read(p, PX_TFD), port_read(p, PX_SERR));
+
+    port_stop(p);
+    port_write(p, PX_SERR, 0xFFFFFFFF);
+    port_write(p, PX_IS, 0xFFFFFFFF);
+
+    port_complete(p, p->issued, -1);
+    port_start(p);
+    port_dispatch(p);
+}
+
+static void port_service(ahci_port_t *p) {
+    uint32_t is = port_read(p, PX_IS);
+    port_write(p, PX_IS, is);
+
+    if (is & PX_IS_ERRORS) {
+        port_recover(p);
+        return;
+    }
+
+    uint32_t busy = port_read(p, PX_SACT) | port_read(p, PX_CI);
+    port_complete(p, p->issued & ~busy, 0);
+    port_dispatch(p);
+}
+
+static void ahci_irq_handler(void) {
+    uint32_t is = hba_read(AHCI_IS);
+    if (!is) return;
+
+    for (int i = 0; i < disk_count; i++) {
+        if (is & (1U << disks[i].port)) port_service(&disks[i]);
+    }
+
+    hba_write(AHCI_IS, is);
+}
+
+
+int ahci_submit(ahci_port_t *p, ahci_request_t *req) {
+    if (!p || !req) return -1;
+
+    if (req->op != AHCI_OP_FLUSH) {
+        if (req->nsegs == 0 || req->nsegs > AHCI_PRDT_ENTRIES) return -1;
+        if (req->count == 0 || req->count > AHCI_MAX_SECTORS) return -1;
+        if (req->lba + req->count > p->sectors) return -1;
+
+        uint32_t total = 0;
+        for (uint32_t i = 0; i < req->nsegs; i++) {
+            if (!req->segs[i].buffer) return -1;
+            if (!dma_ok(req->segs[i].buffer, req->segs[i].sectors * SECTOR_SIZE)) return -1;
+            total += req->segs[i].sectors;
+        }
+        if (total != req->count) return -1;
+    }
+
+    req->done = 0;
+    req->status = -1;
+
+    uint64_t flags = irq_save();
+    list_add_tail(&req->link, &p->pending);
+    port_dispatch(p);
+    irq_restore(flags);
+
+    return 0;
+}
+
+static void ahci_abort(ahci_port_t *p, ahci_request_t *req) {
+    uint64_t flags = irq_save();
+
+    if (!req->done) {
+        int issued = 0;
+        for (int i = 0; i < AHCI_MAX_SLOTS; i++) {
+            if (p->slots[i] == req) issued = 1;
+        }
+
+        PRINT(YELLOW, BLACK, "[AHCI] Request for LBA %llu timed out\n", req->lba);
+        if (issued) {
+            port_recover(p);
+        } else {
+            list_del(&req->link);
+            req->status = -1;
+            req->done = 1;
+            if (req->complete) req->complete(req);
+        }
+    }
+
+    irq_restore(flags);
+}
+
+int ahci_wait(ahci_port_t *p, ahci_request_t *req) {
+    uint64_t deadline = get_timer_ticks() + AHCI_TIMEOUT;
+    int polled = irq_vector < 0 || !(read_rflags() & 0x200);
+
+    for (int spins = 0; !req->done; spins++) {
+        if (polled) {
+            uint64_t flags = irq_save();
+            port_service(p);
+            irq_restore(flags);
+
+            if (spins > 50000000) {
+                ahci_abort(p, req);
+                break;
+            }
+            continue;
+        }
+
+        if (get_timer_ticks() >= deadline) {
+            ahci_abort(p, req);
+            break;
+        }
+
+        if (get_scheduler_enabled()) {
+            thread_yield();
+        } else {
+            __asm__ volatile("hlt");
+        }
+    }
+
+    return req->status;
+}
+
+
+// Block-layer adapter: each dispatched io rides in one of the port's
+// blk_reqs, so the queue can keep up to queue_depth of them on the drive
+static void ahci_blk_complete(ahci_request_t *req) {
+    blk_io_t *io = (blk_io_t*)req->private_data;
+    ahci_port_t *p = (ahci_port_t*)blkdev_get(io->dev)->private_data;
+
+    p->blk_busy &= ~(1U << (req - p->blk_reqs));
+    blk_io_done(io, req->status);
+}
+
+static int ahci_blk_submit(blkdev_t *dev, blk_io_t *io) {
+    ahci_port_t *p = (ahci_port_t*)dev->private_data;
+    if (p->blk_busy == 0xFFFFFFFF) return -1;
+
+    int index = __builtin_ctz(~p->blk_busy);
+    ahci_request_t *req = &p->blk_reqs[index];
+
+    req->lba = io->lba;
+    req->count = io->count;
+    req->nsegs = io->nsegs;
+    for (uint32_t i = 0; i < io->nsegs; i++) req->segs[i] = io->segs[i];
+    req->op = io->op == BLK_WRITE ? AHCI_OP_WRITE : AHCI_OP_READ;
+    req->complete = ahci_blk_complete;
+    req->private_data = io;
+
+    if (ahci_submit(p, req) != 0) return -1;
+    p->blk_busy |= 1U << index;
+    return 0;
+}
+
+static void ahci_blk_poll(blkdev_t *dev) {
+    port_service((ahci_port_t*)dev->private_data);
+}
+
+static int ahci_blk_flush(blkdev_t *dev) {
+    ahci_port_t *p = (ahci_port_t*)dev->private_data;
+    ahci_request_t req;
+
+    req.op = AHCI_OP_FLUSH;
+    req.nsegs = 0;
+    req.count = 0;
+    req.lba = 0;
+    req.complete = NULL;
+    if (ahci_submit(p, &req) != 0) return -1;
+    return ahci_wait(p, &req);
+}
+
+
+// IDENTIFY runs before interrupts are enabled: issue on slot 0 and poll CI
+static int port_identify(ahci_port_t *p, uint16_t *identify) {
+    blk_seg_t seg = { (uint8_t*)identify, 1 };
+
+    port_build(p, 0, ATA_CMD_IDENTIFY, 0, &seg, 1, 0)->device = 0;
+    port_write(p, PX_CI, 1);
+
+    for (int i = 0; i < 10000000; i++) {
+        if (port_read(p, PX_IS) & PX_IS_TFES) break;
+        if (!(port_read(p, PX_CI) & 1)) {
+            return (port_read(p, PX_TFD) & PX_TFD_ERR) ? -1 : 0;
+        }
+    }
+
+    port_write(p, PX_IS, 0xFFFFFFFF);
+    return -1;
+}
+
+static int port_alloc(ahci_port_t *p) {
+    uint32_t table_bytes = AHCI_MAX_SLOTS * sizeof(ahci_cmd_table_t);
+    uint8_t *page = (uint8_t*)pmm_alloc_page();
+    p->tables = (ahci_cmd_table_t*)pmm_alloc_pages((table_bytes + 4095) / 4096);
+    if (!page || !p->tables) return -1;
+
+    // Command list: 1 KiB aligned; received FIS area: 256 bytes aligned
+    p->cmd_list = (ahci_cmd_header_t*)page;
+    p->fis = page + 1024;
+
+    // Tables are 128-byte aligned as long as their size is a multiple of 128
+    if (!dma_ok(page, 4096) || !dma_ok(p->tables, table_bytes)) return -1;
+
+    zero(page, 4096);
+    zero(p->tables, table_bytes);
+
+    for (int i = 0; i < AHCI_MAX_SLOTS; i++) {
+        uint64_t ctba = (uint64_t)&p->tables[i];
+        p->cmd_list[i].ctba = (uint32_t)ctba;
+        p->cmd_list[i].ctbau = (uint32_t)(ctba >> 32);
+    }
+    return 0;
+}
+
+static void port_name(ahci_port_t *p) {
+    char *name = p->blk.name;
+    const char *prefix = "sata";
+    int n = 0;
+
+    while (prefix[n]) {
+        name[n] = prefix[n];
+        n++;
+    }
+    if (p->port >= 10) name[n++] = '0' + p->port / 10;
+    name[n++] = '0' + p->port % 10;
+    name[n] = '\0';
+}
+
+static int port_probe(ahci_port_t *p, int port) {
+    p->port = port;
+    p->regs = abar + AHCI_PORT_BASE + port * AHCI_PORT_SIZE;
+    p->issued = 0;
+    p->unqueued_active = 0;
+    p->commands = 0;
+    p->errors = 0;
+    p->max_outstanding = 0;
+    p->blk_busy = 0;
+    list_init(&p->pending);
+    for (int i = 0; i < AHCI_MAX_SLOTS; i++) p->slots[i] = NULL;
+
+    if (port_stop(p) != 0) {
+        PRINT(YELLOW, BLACK, "[AHCI] Port %d will not stop\n", port);
+        return -1;
+    }
+
+    if (port_alloc(p) != 0) {
+        PRINT(YELLOW, BLACK, "[AHCI] Port %d: no DMA-reachable memory\n", port);
+        return -1;
+    }
+
+    uint64_t clb = (uint64_t)p->cmd_list;
+    uint64_t fb = (uint64_t)p->fis;
+    port_write(p, PX_CLB, (uint32_t)clb);
+    port_write(p, PX_CLBU, (uint32_t)(clb >> 32));
+    port_write(p, PX_FB, (uint32_t)fb);
+    port_write(p, PX_FBU, (uint32_t)(fb >> 32));
+
+    port_write(p, PX_SERR, 0xFFFFFFFF);
+    port_write(p, PX_IS, 0xFFFFFFFF);
+    port_start(p);
+
+    uint16_t *identify = (uint16_t*)kmalloc(512);
+    if (!identify) return -1;
+
+    if (port_identify(p, identify) != 0) {
+        PRINT(YELLOW, BLACK, "[AHCI] Port %d: IDENTIFY failed\n", port);
+        kfree(identify);
+        return -1;
+    }
+
+    if (identify[83] & (1 << 10)) {
+        p->sectors = (uint64_t)identify[100] | ((uint64_t)identify[101] << 16) |
+                     ((uint64_t)identify[102] << 32) | ((uint64_t)identify[103] << 48);
+    } else {
+        p->sectors = (uint64_t)identify[60] | ((uint64_t)identify[61] << 16);
+    }
+
+    int n = 0;
+    for (int i = 27; i < 47; i++) {
+        p->model[n++] = (char)(identify[i] >> 8);
+        p->model[n++] = (char)(identify[i] & 0xFF);
+    }
+    while (n > 0 && p->model[n - 1] == ' ') n--;
+    p->model[n] = '\0';
+
+    // Word 76 bit 8: NCQ; word 75: queue depth - 1
+    p->ncq = hba_ncq && (identify[76] & (1 << 8));
+    if (p->ncq) {
+        uint32_t depth = (identify[75] & 0x1F) + 1;
+        p->queue_depth = depth < hba_slots ? depth : hba_slots;
+    } else {
+        p->queue_depth = 1;
+    }
+
+    kfree(identify);
+
+    port_write(p, PX_IS, 0xFFFFFFFF);
+    port_write(p, PX_IE, PX_IS_DHRS | PX_IS_PSS | PX_IS_SDBS | PX_IS_ERRORS);
+
+    port_name(p);
+    p->blk.sectors = p->sectors;
+    p->blk.private_data = p;
+    p->blk.submit = ahci_blk_submit;
+    p->blk.poll = ahci_blk_poll;
+    p->blk.queue_depth = p->queue_depth;
+    p->blk.flush = ahci_blk_flush;
+
+    PRINT(MAGENTA, BLACK, "[AHCI] Port %d: %s, %llu MB, %s depth %u\n", port, p->model,
+          p->sectors / 2048, p->ncq ? "NCQ" : "DMA", p->queue_depth);
+    return 0;
+}
+
+
+static int find_controller(uint8_t *out_bus, uint8_t *out_dev, uint8_t *out_func) {
+    for (int bus = 0; bus < 256; bus++) {
+        for (int dev = 0; dev < 32; dev++) {
+            for (int func = 0; func < 8; func++) {
+                if (pci_read_word(bus, dev, func, PCI_VENDOR_ID) == 0xFFFF) {
+                    if (func == 0) break;
+                    continue;
+                }
+
+                if (pci_read_byte(bus, dev, func, PCI_CLASS_CODE) == PCI_CLASS_STORAGE &&
+                    pci_read_byte(bus, dev, func, PCI_SUBCLASS) == PCI_SUBCLASS_SATA &&
+                    pci_read_byte(bus, dev, func, PCI_PROG_IF) == PCI_PROGIF_AHCI) {
+                    *out_bus = bus;
+                    *out_dev = dev;
+                    *out_func = func;
+                    return 0;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+int ahci_init(void) {
+    uint8_t bus, dev, func;
+    if (find_controller(&bus, &dev, &func) != 0) {
+        PRINT(WHITE, BLACK, "[AHCI] No AHCI controller found\n");
+        return -1;
+    }
+
+    uint16_t cmd = pci_read_word(bus, dev, func, PCI_COMMAND);
+    pci_write_word(bus, dev, func, PCI_COMMAND, cmd | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+
+    uint32_t bar5 = pci_read_dword(bus, dev, func, PCI_BAR5) & ~0xFU;
+    if (!bar5) {
+        PRINT(YELLOW, BLACK, "[AHCI] ABAR not assigned\n");
+        return -1;
+    }
+    abar = (volatile uint8_t*)(uint64_t)bar5;
+
+    hba_write(AHCI_GHC, hba_read(AHCI_GHC) | AHCI_GHC_AE);
+
+    uint32_t cap = hba_read(AHCI_CAP);
+    hba_slots = ((cap >> AHCI_CAP_NCS_SHIFT) & 0x1F) + 1;
+    hba_s64 = (cap & AHCI_CAP_S64A) ? 1 : 0;
+    hba_ncq = (cap & AHCI_CAP_SNCQ) ? 1 : 0;
+
+    uint32_t vs = hba_read(AHCI_VS);
+    PRINT(MAGENTA, BLACK, "[AHCI] %x:%x.%x ABAR 0x%x, version %u.%u, %u slots, NCQ %s\n",
+          bus, dev, func, bar5, vs >> 16, (vs >> 8) & 0xFF, hba_slots, hba_ncq ? "yes" : "no");
+
+    uint32_t pi = hba_read(AHCI_PI);
+    for (int port = 0; port < AHCI_MAX_PORTS && disk_count < AHCI_MAX_DISKS; port++) {
+        if (!(pi & (1U << port))) continue;
+
+        volatile uint8_t *regs = abar + AHCI_PORT_BASE + port * AHCI_PORT_SIZE;
+        uint32_t ssts = *(volatile uint32_t*)(regs + PX_SSTS);
+        uint32_t sig = *(volatile uint32_t*)(regs + PX_SIG);
+
+        if ((ssts & 0xF) != PX_SSTS_DET_PRESENT || ((ssts >> 8) & 0xF) != PX_SSTS_IPM_ACTIVE) continue;
+        if (sig != SATA_SIG_ATA) continue;
+
+        if (port_probe(&disks[disk_count], port) == 0) disk_count++;
+    }
+
+    if (disk_count == 0) {
+        PRINT(WHITE, BLACK, "[AHCI] No SATA disks attached\n");
+        return -1;
+    }
+
+    irq_vector = pci_irq_setup(bus, dev, func, ahci_irq_handler);
+    hba_write(AHCI_IS, 0xFFFFFFFF);
+    if (irq_vector >= 0) {
+        hba_write(AHCI_GHC, hba_read(AHCI_GHC) | AHCI_GHC_IE);
+    } else {
+        PRINT(YELLOW, BLACK, "[AHCI] No interrupt, completions will be polled\n");
+    }
+
+    for (int i = 0; i < disk_count; i++) {
+        blkdev_register(&disks[i].blk);
+    }
+    return 0;
+}
+
+
+void ahci_print_info(void) {
+    if (!disk_count) return;
+
+    PRINT(CYAN, BLACK, "\n=== AHCI ===\n");
+    PRINT(WHITE, BLACK, "%u slots, 64-bit %s, vector 0x%x\n", hba_slots,
+          hba_s64 ? "yes" : "no", irq_vector);
+
+    for (int i = 0; i < disk_count; i++) {
+        ahci_port_t *p = &disks[i];
+        PRINT(WHITE, BLACK, "%s: %s, %s depth %u, %llu commands, max %u outstanding, %llu errors\n",
+              p->blk.name, p->model, p->ncq ? "NCQ" : "DMA", p->queue_depth,
+              p->commands, p->max_outstanding, p->errors);
+    }
+}
@@ -1,27 +1,46 @@
 #include "ata.h"
+#include "blkdev.h"
 #include "IO.h"
 #include "print.h"
 #include "string_helpers.h"
 
+// Status polls before giving up; each inb on the legacy bus is ~1us
 #define ATA_TIMEOUT 5000000
-#define ATA_PRIMARY_ALTSTATUS 0x3F6
 
-static int ata_wait_ready(void) {
-    int timeout = ATA_TIMEOUT;
-    while (timeout > 0) {
-        uint8_t status = inb(ATA_PRIMARY_STATUS);
+static ata_device_t ata_dev;
 
-        if (!(status & ATA_STATUS_BSY) && (status & ATA_STATUS_RDY)) {
-            return 0;
-        }
+static void ata_register_blkdev(void);
+
+
+static inline void ata_delay_400ns(void) {
+    inb(ATA_PRIMARY_ALTSTATUS);
+    inb(ATA_PRIMARY_ALTSTATUS);
+    inb(ATA_PRIMARY_ALTSTATUS);
+    inb(ATA_PRIMARY_ALTSTATUS);
+}
 
-        if (status & ATA_STATUS_ERR) {
+static int ata_wait_not_busy(void) {
+    for (int timeout = ATA_TIMEOUT; timeout > 0; timeout--) {
+        uint8_t status = inb(ATA_PRIMARY_ALTSTATUS);
+        if (!(status & ATA_STATUS_BSY)) return status;
+    }
+
+    PRINT(YELLOW, BLACK, "[ATA] Timeout waiting for BSY clear\n");
+    return -1;
+}
+
+int ata_wait_ready(void) {
+    for (int timeout = ATA_TIMEOUT; timeout > 0; timeout--) {
+        uint8_t status = inb(ATA_PRIMARY_ALTSTATUS);
+
+        if (status & ATA_STATUS_BSY) continue;
+
+        if (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
             PRINT(YELLOW, BLACK, "[ATA] Error bit set in status: 0x%x\n", status);
             return -1;
         }
 
-        timeout--;
-        for (volatile int i = 0; i < 100; i++);
+        if (status & ATA_STATUS_RDY) return 0;
     }
 
     PRINT(YELLOW, BLACK, "[ATA] Timeout waiting for ready\n");
@@ -29,52 +48,153 @@ static int ata_wait_ready(void) {
 }
 
 static int ata_wait_drq(void) {
-    int timeout = ATA_TIMEOUT;
+    for (int timeout = ATA_TIMEOUT; timeout > 0; timeout--) {
+        uint8_t status = inb(ATA_PRIMARY_ALTSTATUS);
+
+        if (status & ATA_STATUS_BSY) continue;
+
+        if (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+            PRINT(YELLOW, BLACK, "[ATA] Error waiting for DRQ: status=0x%x error=0x%x\n",
+                  status, inb(ATA_PRIMARY_ERROR));
+            return -1;
+        }
+
+        if (status & ATA_STATUS_DRQ) return 0;
+    }
+
+    PRINT(YELLOW, BLACK, "[ATA] Timeout waiting for DRQ\n");
+    return -1;
+}
+
+static void ata_soft_reset(void) {
+    outb(ATA_PRIMARY_CONTROL, ATA_CTRL_SRST | ATA_CTRL_NIEN);
+    ata_delay_400ns();
+    ata_delay_400ns();
+    outb(ATA_PRIMARY_CONTROL, ATA_CTRL_NIEN);
+    ata_delay_400ns();
+}
+
+int ata_reset_channel(void) {
+    ata_soft_reset();
+    return ata_wait_not_busy() < 0 ? -1 : 0;
+}
+
+
+// Program the task file. LBA48 writes each register twice, high byte first.
+void ata_setup_command(uint64_t lba, uint32_t count, int ext) {
+    if (ext) {
+        outb(ATA_PRIMARY_DRIVE, 0x40);
+        ata_delay_400ns();
 
-    while (timeout > 0) {
-        uint8_t status = inb(ATA_PRIMARY_STATUS);
+        outb(ATA_PRIMARY_SECCOUNT, (uint8_t)(count >> 8));
+        outb(ATA_PRIMARY_LBA_LO, (uint8_t)(lba >> 24));
+        outb(ATA_PRIMARY_LBA_MID, (uint8_t)(lba >> 32));
+        outb(ATA_PRIMARY_LBA_HI, (uint8_t)(lba >> 40));
+    } else {
+        outb(ATA_PRIMARY_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
+        ata_delay_400ns();
+    }
 
-        if (!(status & ATA_STATUS_BSY)) break;
+    outb(ATA_PRIMARY_SECCOUNT, (uint8_t)count);
+    outb(ATA_PRIMARY_LBA_LO, (uint8_t)lba);
+    outb(ATA_PRIMARY_LBA_MID, (uint8_t)(lba >> 8));
+    outb(ATA_PRIMARY_LBA_HI, (uint8_t)(lba >> 16));
+}
 
-        timeout--;
-        for (volatile int i = 0; i < 100; i++);
+int ata_needs_ext(uint64_t lba, uint32_t count) {
+    return lba + count - 1 > ATA_LBA28_MAX;
+}
+
+
+static void ata_identify_string(uint16_t *identify, int first, int words, char *out) {
+    int n = 0;
+    for (int i = 0; i < words; i++) {
+        out[n++] = (char)(identify[first + i] >> 8);
+        out[n++] = (char)(identify[first + i] & 0xFF);
     }
+    while (n > 0 && out[n - 1] == ' ') n--;
+    out[n] = '\0';
+}
 
-    if (timeout == 0) {
-        PRINT(YELLOW, BLACK, "[ATA] Timeout waiting for BSY clear\n");
+static int ata_identify(void) {
+    uint16_t identify[256];
+
+    outb(ATA_PRIMARY_DRIVE, 0xA0);
+    ata_delay_400ns();
+
+    outb(ATA_PRIMARY_SECCOUNT, 0);
+    outb(ATA_PRIMARY_LBA_LO, 0);
+    outb(ATA_PRIMARY_LBA_MID, 0);
+    outb(ATA_PRIMARY_LBA_HI, 0);
+    outb(ATA_PRIMARY_COMMAND, ATA_CMD_IDENTIFY);
+    ata_delay_400ns();
+
+    if (inb(ATA_PRIMARY_STATUS) == 0) {
+        PRINT(YELLOW, BLACK, "ATA disk: No drive present\n");
         return -1;
     }
 
-    timeout = ATA_TIMEOUT;
-    while (timeout > 0) {
-        uint8_t status = inb(ATA_PRIMARY_STATUS);
+    // ATAPI and SATA bridges in non-ATA mode report a signature instead
+    if (ata_wait_not_busy() < 0) return -1;
+    if (inb(ATA_PRIMARY_LBA_MID) || inb(ATA_PRIMARY_LBA_HI)) {
+        PRINT(YELLOW, BLACK, "ATA disk: Not an ATA device\n");
+        return -1;
+    }
 
-        if (status & ATA_STATUS_DRQ) return 0;
+    if (ata_wait_drq() != 0) return -1;
+    insw(ATA_PRIMARY_DATA, identify, 256);
 
-        if (status & ATA_STATUS_ERR) {
-            PRINT(YELLOW, BLACK, "[ATA] Error bit set waiting for DRQ: 0x%x\n", status);
-            return -1;
-        }
+    ata_dev.present = 1;
+    ata_dev.lba48 = (identify[83] & (1 << 10)) ? 1 : 0;
+    ata_dev.dma = (identify[49] & (1 << 8)) ? 1 : 0;
 
-        timeout--;
-        for (volatile int i = 0; i < 100; i++);
+    if (ata_dev.lba48) {
+        ata_dev.sectors = (uint64_t)identify[100] | ((uint64_t)identify[101] << 16) |
+                          ((uint64_t)identify[102] << 32) | ((uint64_t)identify[103] << 48);
+    } else {
+        ata_dev.sectors = (uint64_t)identify[60] | ((uint64_t)identify[61] << 16);
     }
 
-    PRINT(YELLOW, BLACK, "[ATA] Timeout waiting for DRQ\n");
-    return -1;
+    ata_identify_string(identify, 27, 20, ata_dev.model);
+
+    // Word 47 low byte: largest DRQ block READ/WRITE MULTIPLE supports
+    uint16_t max_multiple = identify[47] & 0xFF;
+    uint16_t multiple = 1;
+    while (multiple * 2 <= max_multiple && multiple < 16) multiple *= 2;
+    ata_dev.multiple = (max_multiple >= 2) ? multiple : 0;
+
+    PRINT(MAGENTA, BLACK, "[ATA] IDENTIFY successful\n");
+    return 0;
 }
 
-static void ata_soft_reset(void) {
-    outb(ATA_PRIMARY_CONTROL, 0x04);
-    for (volatile int i = 0; i < 100000; i++);
-    outb(ATA_PRIMARY_CONTROL, 0x00);
-    for (volatile int i = 0; i < 100000; i++);
+static void ata_set_multiple(void) {
+    if (!ata_dev.multiple) return;
+
+    if (ata_wait_ready() != 0) {
+        ata_dev.multiple = 0;
+        return;
+    }
+
+    outb(ATA_PRIMARY_DRIVE, 0xE0);
+    ata_delay_400ns();
+    outb(ATA_PRIMARY_SECCOUNT, (uint8_t)ata_dev.multiple);
+    outb(ATA_PRIMARY_COMMAND, ATA_CMD_SET_MULTIPLE);
+    ata_delay_400ns();
+
+    int status = ata_wait_not_busy();
+    if (status < 0 || (status & ATA_STATUS_ERR)) {
+        PRINT(YELLOW, BLACK, "[ATA] SET MULTIPLE MODE rejected, using single-sector PIO\n");
+        ata_dev.multiple = 0;
+    }
 }
 
+
 void ata_init(void) {
     PRINT(MAGENTA, BLACK, "[ATA] Initializing...\n");
 
-    ata_soft_reset();
+    ata_dev.present = 0;
+    ata_dev.dma = 0;
+    ata_dev.multiple = 0;
 
     uint8_t status = inb(ATA_PRIMARY_STATUS);
     if (status == 0xFF) {
@@ -82,122 +202,190 @@ void ata_init(void) {
         return;
     }
 
-    PRINT(MAGENTA, BLACK, "[ATA] Controller found, status=0x%x\n", status);
+    ata_soft_reset();
 
-    outb(ATA_PRIMARY_COMMAND, ATA_CMD_WRITE_SECTORS);
-    for (volatile int i = 0; i < 100000; i++);
+    PRINT(MAGENTA, BLACK, "[ATA] Controller found, status=0x%x\n", inb(ATA_PRIMARY_STATUS));
 
-    if (ata_wait_ready() != 0) {
+    if (ata_wait_not_busy() < 0) {
         PRINT(YELLOW, BLACK, "ATA disk timeout (not ready)\n");
         return;
     }
 
-    PRINT(MAGENTA, BLACK, "[ATA] Drive ready\n");
+    if (ata_identify() != 0) return;
 
-    outb(ATA_PRIMARY_COMMAND, 0xEC);
-    for (volatile int i = 0; i < 100000; i++);
+    ata_set_multiple();
 
-    status = inb(ATA_PRIMARY_STATUS);
-    if (status == 0) {
-        PRINT(YELLOW, BLACK, "ATA disk: No drive present\n");
-        return;
-    }
+    PRINT(MAGENTA, BLACK, "[ATA] %s: %llu sectors (%llu MB), LBA%d, %u sectors/DRQ\n",
+          ata_dev.model, ata_dev.sectors, ata_dev.sectors / 2048,
+          ata_dev.lba48 ? 48 : 28, ata_dev.multiple ? ata_dev.multiple : 1);
+    PRINT(MAGENTA, BLACK, "ATA disk initialized\n");
 
-    if (ata_wait_drq() == 0) {
-        uint16_t identify[256];
-        for (int i = 0; i < 256; i++) identify[i] = inw(ATA_PRIMARY_DATA);
-        PRINT(MAGENTA, BLACK, "[ATA] IDENTIFY successful\n");
-    }
+    ata_register_blkdev();
+}
 
-    PRINT(MAGENTA, BLACK, "ATA disk initialized\n");
+const ata_device_t* ata_get_device(void) {
+    return &ata_dev;
 }
 
-int ata_read_sectors(uint32_t lba, uint8_t sector_count, uint8_t *buffer) {
-    if (!buffer || sector_count == 0) return -1;
+
+static int ata_read_chunk(uint64_t lba, uint32_t count, uint8_t *buffer) {
+    int ext = ata_needs_ext(lba, count);
+    uint32_t block = ata_dev.multiple ? ata_dev.multiple : 1;
+    uint8_t cmd;
+
+    if (ata_dev.multiple) {
+        cmd = ext ? ATA_CMD_READ_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE;
+    } else {
+        cmd = ext ? ATA_CMD_READ_SECTORS_EXT : ATA_CMD_READ_SECTORS;
+    }
 
     if (ata_wait_ready() != 0) return -1;
 
-    outb(ATA_PRIMARY_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
-    for (volatile int i = 0; i < 10000; i++);
+    ata_setup_command(lba, count, ext);
+    outb(ATA_PRIMARY_COMMAND, cmd);
+    ata_delay_400ns();
 
-    outb(ATA_PRIMARY_SECCOUNT, sector_count);
-    outb(ATA_PRIMARY_LBA_LO, (uint8_t)lba);
-    outb(ATA_PRIMARY_LBA_MID, (uint8_t)(lba >> 8));
-    outb(ATA_PRIMARY_LBA_HI, (uint8_t)(lba >> 16));
-    outb(ATA_PRIMARY_COMMAND, ATA_CMD_READ_SECTORS);
+    // One DRQ per block of `block` sectors; the last one may be short
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t n = count - done;
+        if (n > block) n = block;
 
-    for (int i = 0; i < sector_count; i++) {
         if (ata_wait_drq() != 0) return -1;
-        uint8_t status = inb(ATA_PRIMARY_STATUS);
-        if (status & ATA_STATUS_ERR) return -1;
-
-        uint16_t *buf16 = (uint16_t*)(buffer + i * SECTOR_SIZE);
-        for (int j = 0; j < 256; j++) buf16[j] = inw(ATA_PRIMARY_DATA);
-        for (volatile int k = 0; k < 400; k++);
+        insw(ATA_PRIMARY_DATA, buffer + done * SECTOR_SIZE, n * (SECTOR_SIZE / 2));
+        done += n;
     }
+
+    // Reading STATUS acknowledges the device interrupt
+    inb(ATA_PRIMARY_STATUS);
     return 0;
 }
 
-int ata_write_sectors(uint32_t lba, uint8_t sector_count, uint8_t *buffer) {
-    if (!buffer || sector_count == 0) {
-        PRINT(YELLOW, BLACK, "[ATA] write_sectors: invalid parameters\n");
-        return -1;
-    }
+static int ata_write_chunk(uint64_t lba, uint32_t count, uint8_t *buffer) {
+    int ext = ata_needs_ext(lba, count);
+    uint32_t block = ata_dev.multiple ? ata_dev.multiple : 1;
+    uint8_t cmd;
 
-    if (ata_wait_ready() != 0) {
-        PRINT(YELLOW, BLACK, "[ATA] write_sectors: Drive not ready (1)\n");
-        return -1;
+    if (ata_dev.multiple) {
+        cmd = ext ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_WRITE_MULTIPLE;
+    } else {
+        cmd = ext ? ATA_CMD_WRITE_SECTORS_EXT : ATA_CMD_WRITE_SECTORS;
     }
 
-    outb(ATA_PRIMARY_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
-    for (volatile int i = 0; i < 50000; i++);
-
     if (ata_wait_ready() != 0) {
-        PRINT(YELLOW, BLACK, "[ATA] write_sectors: Drive not ready (2)\n");
+        PRINT(YELLOW, BLACK, "[ATA] write_sectors: Drive not ready\n");
         return -1;
     }
 
-    outb(ATA_PRIMARY_SECCOUNT, sector_count);
-    outb(ATA_PRIMARY_LBA_LO, (uint8_t)lba);
-    outb(ATA_PRIMARY_LBA_MID, (uint8_t)(lba >> 8));
-    outb(ATA_PRIMARY_LBA_HI, (uint8_t)(lba >> 16));
-    outb(ATA_PRIMARY_COMMAND, ATA_CMD_WRITE_SECTORS);
-    for (volatile int i = 0; i < 10000; i++);
+    ata_setup_command(lba, count, ext);
+    outb(ATA_PRIMARY_COMMAND, cmd);
+    ata_delay_400ns();
+
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t n = count - done;
+        if (n > block) n = block;
 
-    for (int i = 0; i < sector_count; i++) {
         if (ata_wait_drq() != 0) {
-            PRINT(YELLOW, BLACK, "[ATA] write_sectors: DRQ timeout on sector %d\n", i);
-            return -1;
-        }
-        uint8_t status = inb(ATA_PRIMARY_STATUS);
-        if (status & ATA_STATUS_ERR) {
-            uint8_t error = inb(ATA_PRIMARY_ERROR);
-            PRINT(YELLOW, BLACK, "[ATA] write_sectors: Error on sector %d, status=0x%x, error=0x%x\n", i, status, error);
+            PRINT(YELLOW, BLACK, "[ATA] write_sectors: DRQ timeout on sector %u\n", done);
             return -1;
         }
+        outsw(ATA_PRIMARY_DATA, buffer + done * SECTOR_SIZE, n * (SECTOR_SIZE / 2));
+        done += n;
+    }
 
-        uint16_t *buf16 = (uint16_t*)(buffer + i * SECTOR_SIZE);
-        for (int j = 0; j < 256; j++) {
-            outw(ATA_PRIMARY_DATA, buf16[j]);
-            for (volatile int k = 0; k < 10; k++);
-        }
-        for (volatile int k = 0; k < 10000; k++);
+    int status = ata_wait_not_busy();
+    if (status < 0 || (status & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        PRINT(YELLOW, BLACK, "[ATA] write_sectors: status=0x%x, error=0x%x\n",
+              status, inb(ATA_PRIMARY_ERROR));
+        return -1;
     }
 
-    outb(ATA_PRIMARY_COMMAND, 0xE7);
-    for (volatile int i = 0; i < 100000; i++);
+    inb(ATA_PRIMARY_STATUS);
+    return 0;
+}
 
-    if (ata_wait_ready() != 0) {
-        PRINT(YELLOW, BLACK, "[ATA] write_sectors: Flush failed\n");
+
+int ata_read_sectors(uint64_t lba, uint32_t sector_count, uint8_t *buffer) {
+    if (!buffer || sector_count == 0) return -1;
+    if (!ata_dev.present) return -1;
+    if (lba + sector_count > ata_dev.sectors) return -1;
+    if (!ata_dev.lba48 && ata_needs_ext(lba, sector_count)) return -1;
+
+    while (sector_count > 0) {
+        uint32_t n = sector_count > ATA_MAX_TRANSFER ? ATA_MAX_TRANSFER : sector_count;
+        if (ata_read_chunk(lba, n, buffer) != 0) return -1;
+
+        lba += n;
+        buffer += n * SECTOR_SIZE;
+        sector_count -= n;
+    }
+    return 0;
+}
+
+int ata_write_sectors(uint64_t lba, uint32_t sector_count, uint8_t *buffer) {
+    if (!buffer || sector_count == 0) {
+        PRINT(YELLOW, BLACK, "[ATA] write_sectors: invalid parameters\n");
         return -1;
     }
+    if (!ata_dev.present) return -1;
+    if (lba + sector_count > ata_dev.sectors) return -1;
+    if (!ata_dev.lba48 && ata_needs_ext(lba, sector_count)) return -1;
+
+    while (sector_count > 0) {
+        uint32_t n = sector_count > ATA_MAX_TRANSFER ? ATA_MAX_TRANSFER : sector_count;
+        if (ata_write_chunk(lba, n, buffer) != 0) return -1;
 
+        lba += n;
+        buffer += n * SECTOR_SIZE;
+        sector_count -= n;
+    }
     return 0;
 }
 
-static inline void ata_delay_400ns(void) {
-    inb(ATA_PRIMARY_ALTSTATUS);
-    inb(ATA_PRIMARY_ALTSTATUS);
-    inb(ATA_PRIMARY_ALTSTATUS);
-    inb(ATA_PRIMARY_ALTSTATUS);
-}
\ No newline at end of file
+// Commit the drive's write cache; the buffer cache calls this after write-back
+int ata_flush(void) {
+    if (!ata_dev.present) return -1;
+    if (ata_wait_ready() != 0) return -1;
+
+    outb(ATA_PRIMARY_DRIVE, 0xE0);
+    ata_delay_400ns();
+    outb(ATA_PRIMARY_COMMAND, ata_dev.lba48 ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE);
+    ata_delay_400ns();
+
+    int status = ata_wait_not_busy();
+    if (status < 0 || (status & ATA_STATUS_ERR)) {
+        PRINT(YELLOW, BLACK, "[ATA] Cache flush failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+// Block device "ata0": synchronous PIO; ide_dma_init() adds the async DMA path
+static int ata_blk_read(blkdev_t *dev, uint64_t lba, uint32_t count, uint8_t *buffer) {
+    (void)dev;
+    return ata_read_sectors(lba, count, buffer);
+}
+
+static int ata_blk_write(blkdev_t *dev, uint64_t lba, uint32_t count, uint8_t *buffer) {
+    (void)dev;
+    return ata_write_sectors(lba, count, buffer);
+}
+
+static int ata_blk_flush(blkdev_t *dev) {
+    (void)dev;
+    return ata_flush();
+}
+
+static blkdev_t ata_blkdev = {
+    .name = "ata0",
+    .read = ata_blk_read,
+    .write = ata_blk_write,
+    .flush = ata_blk_flush
+};
+
+static void ata_register_blkdev(void) {
+    ata_blkdev.sectors = ata_dev.sectors;
+    blkdev_register(&ata_blkdev);
+}
@@ -0,0 +1,379 @@
+#include "bcache.h"
+#include "ata.h"
+#include "blkdev.h"
+#include "irq.h"
+#include "memory.h"
+#include "process.h"
+#include "print.h"
+#include "string_helpers.h"
+
+static bcache_buf_t *buffers = NULL;
+static list_head_t hash_table[BCACHE_HASH_SIZE];
+static list_head_t lru_list = LIST_HEAD_INIT(lru_list);
+
+static uint8_t *staging = NULL;
+static blk_request_t flush_reqs[BCACHE_FLUSH_WINDOW];
+static bcache_buf_t *flush_bufs[BCACHE_FLUSH_WINDOW];
+
+static bcache_stats_t stats;
+static volatile int bcache_busy = 0;
+static int flusher_tid = -1;
+
+
+// Yield-spin lock: holders do disk I/O, so waiters yield the CPU instead
+// of spinning with IRQs off
+static void bcache_lock(void) {
+    while (__sync_lock_test_and_set(&bcache_busy, 1)) {
+        thread_yield();
+    }
+}
+
+static void bcache_unlock(void) {
+    __sync_lock_release(&bcache_busy);
+}
+
+static inline uint32_t bcache_hash(uint32_t dev, uint32_t lba) {
+    return (lba ^ (dev << 7) ^ (lba >> 8)) & (BCACHE_HASH_SIZE - 1);
+}
+
+static void copy_sector(uint8_t *dst, const uint8_t *src) {
+    uint64_t *d = (uint64_t*)dst;
+    const uint64_t *s = (const uint64_t*)src;
+    for (int i = 0; i < SECTOR_SIZE / 8; i++) d[i] = s[i];
+}
+
+
+static int dev_read(uint32_t dev, uint32_t lba, uint32_t count, uint8_t *buffer) {
+    stats.reads++;
+    return blkdev_read(dev, lba, count, buffer);
+}
+
+static int dev_write(uint32_t dev, uint32_t lba, uint32_t count, uint8_t *buffer) {
+    stats.writes++;
+    stats.sectors_written += count;
+    return blkdev_write(dev, lba, count, buffer);
+}
+
+
+static bcache_buf_t* bcache_lookup(uint32_t dev, uint32_t lba) {
+    bcache_buf_t *buf;
+    list_head_t *bucket = &hash_table[bcache_hash(dev, lba)];
+
+    list_for_each_entry(buf, bucket, bcache_buf_t, hash_link) {
+        if (buf->dev == dev && buf->lba == lba && (buf->flags & BCACHE_VALID)) {
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+static void bcache_touch(bcache_buf_t *buf) {
+    list_del(&buf->lru_link);
+    list_add(&buf->lru_link, &lru_list);
+}
+
+static void mark_clean(bcache_buf_t *buf) {
+    if (buf->flags & BCACHE_DIRTY) {
+        buf->flags &= ~BCACHE_DIRTY;
+        stats.dirty--;
+    }
+}
+
+static void mark_dirty(bcache_buf_t *buf) {
+    if (!(buf->flags & BCACHE_DIRTY)) {
+        buf->flags |= BCACHE_DIRTY;
+        buf->dirty_since = get_timer_ticks();
+        stats.dirty++;
+    }
+}
+
+// Take the least recently used buffer, writing it back first if dirty
+static bcache_buf_t* bcache_evict(void) {
+    bcache_buf_t *buf = list_entry(lru_list.prev, bcache_buf_t, lru_link);
+
+    if (buf->flags & BCACHE_DIRTY) {
+        stats.dirty_evictions++;
+        if (dev_write(buf->dev, buf->lba, 1, buf->data) != 0) {
+            PRINT(YELLOW, BLACK, "[BCACHE] Write-back of LBA %u failed on eviction\n", buf->lba);
+            return NULL;
+        }
+        mark_clean(buf);
+    }
+
+    if (buf->flags & BCACHE_VALID) {
+        stats.evictions++;
+        stats.cached--;
+    }
+
+    list_del(&buf->hash_link);
+    buf->flags = 0;
+    return buf;
+}
+
+static bcache_buf_t* bcache_install(uint32_t dev, uint32_t lba) {
+    bcache_buf_t *buf = bcache_evict();
+    if (!buf) return NULL;
+
+    buf->dev = dev;
+    buf->lba = lba;
+    buf->flags = BCACHE_VALID;
+    list_add(&buf->hash_link, &hash_table[bcache_hash(dev, lba)]);
+    bcache_touch(buf);
+    stats.cached++;
+    return buf;
+}
+
+
+int bcache_init(void) {
+    if (buffers) return 0;
+
+    buffers = (bcache_buf_t*)kmalloc(sizeof(bcache_buf_t) * BCACHE_BUFFERS);
+    staging = (uint8_t*)kmalloc(SECTOR_SIZE * BCACHE_BATCH);
+    if (!buffers || !staging) {
+        PRINT(YELLOW, BLACK, "[BCACHE] Failed to allocate cache\n");
+        if (buffers) kfree(buffers);
+        if (staging) kfree(staging);
+        buffers = NULL;
+        staging = NULL;
+        return -1;
+    }
+
+    for (int i = 0; i < BCACHE_HASH_SIZE; i++) {
+        list_init(&hash_table[i]);
+    }
+
+    for (int i = 0; i < BCACHE_BUFFERS; i++) {
+        buffers[i].flags = 0;
+        list_init(&buffers[i].hash_link);
+        list_add_tail(&buffers[i].lru_link, &lru_list);
+    }
+
+    PRINT(MAGENTA, BLACK, "[BCACHE] %d buffers (%u KB)\n", BCACHE_BUFFERS,
+          (BCACHE_BUFFERS * SECTOR_SIZE) / 1024);
+    return 0;
+}
+
+
+int bcache_read(uint32_t dev, uint32_t lba, uint32_t count, uint8_t *buffer) {
+    if (!buffers) return dev_read(dev, lba, count, buffer);
+    if (!buffer || count == 0) return -1;
+
+    bcache_lock();
+
+    uint32_t i = 0;
+    while (i < count) {
+        bcache_buf_t *buf = bcache_lookup(dev, lba + i);
+        if (buf) {
+            stats.hits++;
+            bcache_touch(buf);
+            copy_sector(buffer + i * SECTOR_SIZE, buf->data);
+            i++;
+            continue;
+        }
+
+        // Fetch the whole run of missing sectors with one command
+        uint32_t run = 1;
+        while (i + run < count && run < BCACHE_BATCH && !bcache_lookup(dev, lba + i + run)) {
+            run++;
+        }
+
+        stats.misses += run;
+        if (dev_read(dev, lba + i, run, staging) != 0) {
+            bcache_unlock();
+            return -1;
+        }
+
+        for (uint32_t j = 0; j < run; j++) {
+            copy_sector(buffer + (i + j) * SECTOR_SIZE, staging + j * SECTOR_SIZE);
+
+            buf = bcache_install(dev, lba + i + j);
+            if (buf) copy_sector(buf->data, staging + j * SECTOR_SIZE);
+        }
+        i += run;
+    }
+
+    bcache_unlock();
+    return 0;
+}
+
+int bcache_write(uint32_t dev, uint32_t lba, uint32_t count, const uint8_t *buffer) {
+    if (!buffers) return dev_write(dev, lba, count, (uint8_t*)buffer);
+    if (!buffer || count == 0) return -1;
+
+    bcache_lock();
+
+    for (uint32_t i = 0; i < count; i++) {
+        bcache_buf_t *buf = bcache_lookup(dev, lba + i);
+        if (buf) {
+            bcache_touch(buf);
+        } else {
+            // Whole-sector write: no need to read the old contents
+            buf = bcache_install(dev, lba + i);
+            if (!buf) {
+                bcache_unlock();
+                return -1;
+            }
+        }
+
+        copy_sector(buf->data, buffer + i * SECTOR_SIZE);
+        mark_dirty(buf);
+    }
+
+    bcache_unlock();
+    return 0;
+}
+
+
+static int flush_wait(int n) {
+    int errors = 0;
+
+    for (uint32_t dev = 0; dev < blkdev_count(); dev++) blk_unplug(dev);
+
+    for (int i = 0; i < n; i++) {
+        if (blk_wait(flush_bufs[i]->dev, &flush_reqs[i]) == 0) {
+            mark_clean(flush_bufs[i]);
+        } else {
+            PRINT(YELLOW, BLACK, "[BCACHE] Write-back of LBA %u failed\n", flush_bufs[i]->lba);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+// Write back dirty buffers older than min_age ticks. Each goes to the block
+// queue as a one-sector request straight from the buffer; with the queues
+// plugged, the elevator sorts a window of them and merges neighbouring
+// sectors into multi-segment commands. Caller holds the lock.
+static int bcache_flush(uint64_t min_age) {
+    uint64_t now = get_timer_ticks();
+    int errors = 0;
+    int n = 0;
+
+    for (uint32_t dev = 0; dev < blkdev_count(); dev++) blk_plug(dev);
+
+    for (int i = 0; i < BCACHE_BUFFERS; i++) {
+        bcache_buf_t *buf = &buffers[i];
+        if (!(buf->flags & BCACHE_DIRTY)) continue;
+        if (now - buf->dirty_since < min_age) continue;
+
+        blk_request_t *req = &flush_reqs[n];
+        req->op = BLK_WRITE;
+        req->lba = buf->lba;
+        req->segs[0].buffer = buf->data;
+        req->segs[0].sectors = 1;
+        req->nsegs = 1;
+        req->complete = NULL;
+
+        stats.writes++;
+        stats.sectors_written++;
+        if (blk_submit(buf->dev, req) != 0) {
+            PRINT(YELLOW, BLACK, "[BCACHE] Write-back of LBA %u failed\n", buf->lba);
+            errors++;
+            continue;
+        }
+
+        flush_bufs[n++] = buf;
+        if (n == BCACHE_FLUSH_WINDOW) {
+            errors += flush_wait(n);
+            n = 0;
+            for (uint32_t dev = 0; dev < blkdev_count(); dev++) blk_plug(dev);
+        }
+    }
+
+    errors += flush_wait(n);
+    return errors ? -1 : 0;
+}
+
+int bcache_sync(void) {
+    if (!buffers) return 0;
+
+    bcache_lock();
+    int result = bcache_flush(0);
+
+    // Writes no longer flush the drive cache individually
+    for (uint32_t dev = 0; dev < blkdev_count(); dev++) {
+        if (blkdev_flush(dev) != 0) result = -1;
+    }
+    bcache_unlock();
+    return result;
+}
+
+int bcache_quiesce(void) {
+    if (!buffers) return 0;
+
+    bcache_lock();
+    return bcache_flush(0);
+}
+
+void bcache_resume(void) {
+    if (buffers) bcache_unlock();
+}
+
+void bcache_invalidate(uint32_t dev) {
+    if (!buffers) return;
+
+    bcache_lock();
+    bcache_flush(0);
+
+    for (int i = 0; i < BCACHE_BUFFERS; i++) {
+        bcache_buf_t *buf = &buffers[i];
+        if (!(buf->flags & BCACHE_VALID) || buf->dev != dev || (buf->flags & BCACHE_DIRTY)) continue;
+
+        list_del(&buf->hash_link);
+        buf->flags = 0;
+        stats.cached--;
+
+        // Free buffers are reused first
+        list_del(&buf->lru_link);
+        list_add_tail(&buf->lru_link, &lru_list);
+    }
+
+    bcache_unlock();
+}
+
+
+static void bcache_flusher_thread(void) {
+    while (1) {
+        thread_sleep_until(get_timer_ticks() + BCACHE_FLUSH_INTERVAL);
+
+        if (stats.dirty == 0) continue;
+
+        bcache_lock();
+        bcache_flush(BCACHE_DIRTY_EXPIRE);
+        bcache_unlock();
+    }
+}
+
+void bcache_start_flusher(void) {
+    if (!buffers || flusher_tid >= 0) return;
+
+    flusher_tid = thread_create(1, bcache_flusher_thread, 16384,
+                                5000000, 1000000000, 1000000000);
+    if (flusher_tid < 0) {
+        PRINT(YELLOW, BLACK, "[BCACHE] Failed to start flusher, writes stay cached until sync\n");
+        return;
+    }
+
+    PRINT(MAGENTA, BLACK, "[BCACHE] Flusher thread TID=%d\n", flusher_tid);
+}
+
+
+void bcache_get_stats(bcache_stats_t *out) {
+    uint64_t flags = irq_save();
+    *out = stats;
+    irq_restore(flags);
+}
+
+void bcache_print_stats(void) {
+    bcache_stats_t s;
+    bcache_get_stats(&s);
+
+    uint64_t lookups = s.hits + s.misses;
+    uint64_t hit_pct = lookups ? (s.hits * 100) / lookups : 0;
+
+    PRINT(CYAN, BLACK, "\n=== Buffer Cache ===\n");
+    PRINT(WHITE, BLACK, "Buffers: %u cached, %u dirty, %d total\n", s.cached, s.dirty, BCACHE_BUFFERS);
+    PRINT(WHITE, BLACK, "Lookups: %llu hits, %llu misses (%llu%% hit ratio)\n", s.hits, s.misses, hit_pct);
+    PRINT(WHITE, BLACK, "Disk: %llu reads, %llu writes (%llu sectors)\n", s.reads, s.writes, s.sectors_written);
+    PRINT(WHITE, BLACK, "Evictions: %llu (%llu dirty)\n", s.evictions, s.dirty_evictions);
+}
@@ -0,0 +1,82 @@
+#include "blkdev.h"
+#include "print.h"
+#include "string_helpers.h"
+
+static blkdev_t *devices[BLKDEV_MAX];
+static uint32_t device_count = 0;
+
+
+static int name_equal(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+int blkdev_register(blkdev_t *dev) {
+    if (!dev) return -1;
+    if (!dev->submit && (!dev->read || !dev->write)) return -1;
+
+    if (device_count >= BLKDEV_MAX) {
+        PRINT(YELLOW, BLACK, "[BLKDEV] Table full, %s not registered\n", dev->name);
+        return -1;
+    }
+
+    if (blkdev_lookup(dev->name) >= 0) {
+        PRINT(YELLOW, BLACK, "[BLKDEV] Duplicate device name %s\n", dev->name);
+        return -1;
+    }
+
+    if (!dev->queue_depth) dev->queue_depth = 1;
+    blk_queue_init(device_count);
+
+    devices[device_count] = dev;
+    PRINT(MAGENTA, BLACK, "[BLKDEV] %s: %llu sectors (%llu MB)\n", dev->name,
+          dev->sectors, dev->sectors / 2048);
+    return (int)device_count++;
+}
+
+blkdev_t* blkdev_get(uint32_t id) {
+    return id < device_count ? devices[id] : NULL;
+}
+
+int blkdev_lookup(const char *name) {
+    if (!name) return -1;
+
+    for (uint32_t i = 0; i < device_count; i++) {
+        if (name_equal(devices[i]->name, name)) return (int)i;
+    }
+    return -1;
+}
+
+uint32_t blkdev_count(void) {
+    return device_count;
+}
+
+
+int blkdev_flush(uint32_t id) {
+    blkdev_t *dev = blkdev_get(id);
+    if (!dev) return -1;
+    return dev->flush ? dev->flush(dev) : 0;
+}
+
+
+void blkdev_print_list(void) {
+    PRINT(CYAN, BLACK, "\n=== Block Devices ===\n");
+    if (device_count == 0) {
+        PRINT(WHITE, BLACK, "None registered\n");
+        return;
+    }
+
+    for (uint32_t i = 0; i < device_count; i++) {
+        blk_queue_stats_t q;
+        blk_get_queue_stats(i, &q);
+
+        PRINT(WHITE, BLACK, "%u: %s, %llu sectors (%llu MB), %s, depth %u\n", i, devices[i]->name,
+              devices[i]->sectors, devices[i]->sectors / 2048,
+              devices[i]->submit ? "async" : "sync", devices[i]->queue_depth);
+        PRINT(WHITE, BLACK, "   %llu requests, %llu merged, %llu dispatched (%llu sectors), %llu expired, max %u queued\n",
+              q.submitted, q.merged, q.dispatched, q.sectors, q.expired, q.max_queued);
+    }
+}
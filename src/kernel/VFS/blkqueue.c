@@ -0,0 +1,452 @@
+#include "blkdev.h"
+#include "irq.h"
+#include "process.h"
+#include "print.h"
+#include "string_helpers.h"
+
+extern int get_scheduler_enabled(void);
+
+// Per-device elevator state. Everything here is touched with interrupts off,
+// because completions arrive from driver interrupt handlers.
+typedef struct {
+    list_head_t sorted[2];    // Queued ios per direction, ascending LBA
+    list_head_t fifo[2];      // Same ios in arrival order, for deadlines
+    uint64_t next_lba;        // Where the last dispatch ended
+    int batch_op;
+    uint32_t batch_count;     // Dispatches in the current batch
+    uint32_t writes_starved;  // Read batches started while writes waited
+    int running;              // Someone is inside blk_run_queue
+    int plugged;
+    int stopped;              // blk_quiesce: nothing is dispatched at all
+    blk_queue_stats_t stats;
+} blk_queue_t;
+
+static blk_queue_t queues[BLKDEV_MAX];
+
+static blk_io_t io_pool[BLK_IO_POOL];
+static list_head_t io_free = LIST_HEAD_INIT(io_free);
+static int pool_ready = 0;
+
+
+static inline uint64_t read_rflags(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq\n pop %0" : "=r"(flags));
+    return flags;
+}
+
+static uint32_t seg_sectors(const blk_seg_t *segs, uint32_t nsegs) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < nsegs; i++) total += segs[i].sectors;
+    return total;
+}
+
+// Fold segments that continue one another in memory
+static void io_compact(blk_io_t *io) {
+    uint32_t out = 0;
+
+    for (uint32_t i = 0; i < io->nsegs; i++) {
+        blk_seg_t *prev = out ? &io->segs[out - 1] : NULL;
+        if (prev && prev->buffer + prev->sectors * BLK_SECTOR_SIZE == io->segs[i].buffer) {
+            prev->sectors += io->segs[i].sectors;
+        } else {
+            io->segs[out++] = io->segs[i];
+        }
+    }
+    io->nsegs = out;
+}
+
+static int io_merge(blk_io_t *io, blk_request_t *req, uint32_t count, int front) {
+    if (io->nsegs + req->nsegs > BLK_MAX_SEGS) return -1;
+    if (io->count + count > BLK_MAX_SECTORS) return -1;
+
+    if (front) {
+        for (int i = (int)io->nsegs - 1; i >= 0; i--) io->segs[i + req->nsegs] = io->segs[i];
+        for (uint32_t i = 0; i < req->nsegs; i++) io->segs[i] = req->segs[i];
+        io->lba = req->lba;
+        list_add(&req->link, &io->requests);
+    } else {
+        for (uint32_t i = 0; i < req->nsegs; i++) io->segs[io->nsegs + i] = req->segs[i];
+        list_add_tail(&req->link, &io->requests);
+    }
+
+    io->nsegs += req->nsegs;
+    io->count += count;
+    io_compact(io);
+    return 0;
+}
+
+// Back or front merge with a queued io in the same direction
+static int try_merge(blk_queue_t *q, blk_request_t *req, uint32_t count) {
+    blk_io_t *io;
+
+    list_for_each_entry(io, &q->sorted[req->op], blk_io_t, sort_link) {
+        if (io->lba + io->count == req->lba && io_merge(io, req, count, 0) == 0) return 0;
+        if (req->lba + count == io->lba && io_merge(io, req, count, 1) == 0) {
+            // The io now starts earlier; it may have to move back in LBA order
+            blk_io_t *prev;
+            while (io->sort_link.prev != &q->sorted[req->op]) {
+                prev = list_entry(io->sort_link.prev, blk_io_t, sort_link);
+                if (prev->lba <= io->lba) break;
+                list_del(&io->sort_link);
+                list_add_tail(&io->sort_link, &prev->sort_link);
+            }
+            return 0;
+        }
+        if (io->lba > req->lba + count) break;
+    }
+    return -1;
+}
+
+static void sort_insert(blk_queue_t *q, blk_io_t *io) {
+    blk_io_t *pos;
+
+    list_for_each_entry(pos, &q->sorted[io->op], blk_io_t, sort_link) {
+        if (pos->lba > io->lba) {
+            list_add_tail(&io->sort_link, &pos->sort_link);
+            return;
+        }
+    }
+    list_add_tail(&io->sort_link, &q->sorted[io->op]);
+}
+
+
+// First io at or past the head position, wrapping to the lowest LBA
+static blk_io_t* sorted_next(blk_queue_t *q, int op) {
+    blk_io_t *io;
+
+    list_for_each_entry(io, &q->sorted[op], blk_io_t, sort_link) {
+        if (io->lba >= q->next_lba) return io;
+    }
+    return list_first_entry(&q->sorted[op], blk_io_t, sort_link);
+}
+
+// Deadline elevator: batches of up to BLK_FIFO_BATCH ios in LBA order, reads
+// preferred over writes until writes have been passed over BLK_WRITES_STARVED
+// times, and an expired FIFO head starting the next batch wherever it is
+static blk_io_t* elevator_next(blk_queue_t *q) {
+    int have_read = !list_empty(&q->sorted[BLK_READ]);
+    int have_write = !list_empty(&q->sorted[BLK_WRITE]);
+    if (!have_read && !have_write) return NULL;
+
+    blk_io_t *io;
+    int op = q->batch_op;
+
+    if (q->batch_count > 0 && q->batch_count < BLK_FIFO_BATCH && !list_empty(&q->sorted[op])) {
+        io = sorted_next(q, op);
+    } else {
+        if (have_read && (!have_write || q->writes_starved < BLK_WRITES_STARVED)) {
+            op = BLK_READ;
+            if (have_write) q->writes_starved++;
+        } else {
+            op = BLK_WRITE;
+            q->writes_starved = 0;
+        }
+
+        blk_io_t *oldest = list_first_entry(&q->fifo[op], blk_io_t, fifo_link);
+        if (get_timer_ticks() >= oldest->expires) {
+            io = oldest;
+            q->stats.expired++;
+        } else {
+            io = sorted_next(q, op);
+        }
+
+        q->batch_op = op;
+        q->batch_count = 0;
+    }
+
+    list_del(&io->sort_link);
+    list_del(&io->fifo_link);
+    q->batch_count++;
+    q->next_lba = io->lba + io->count;
+    return io;
+}
+
+
+// Drivers without submit(): one command per segment from the caller's context
+static int io_run_sync(blkdev_t *dev, blk_io_t *io) {
+    uint64_t lba = io->lba;
+
+    for (uint32_t i = 0; i < io->nsegs; i++) {
+        int result = io->op == BLK_WRITE
+            ? dev->write(dev, lba, io->segs[i].sectors, io->segs[i].buffer)
+            : dev->read(dev, lba, io->segs[i].sectors, io->segs[i].buffer);
+        if (result != 0) return -1;
+        lba += io->segs[i].sectors;
+    }
+    return 0;
+}
+
+static void blk_run_queue(uint32_t id) {
+    blkdev_t *dev = blkdev_get(id);
+    if (!dev) return;
+
+    blk_queue_t *q = &queues[id];
+    uint32_t depth = dev->submit && dev->queue_depth ? dev->queue_depth : 1;
+
+    uint64_t flags = irq_save();
+    if (q->running || q->plugged || q->stopped) {
+        irq_restore(flags);
+        return;
+    }
+    q->running = 1;
+
+    while (q->stats.in_flight < depth) {
+        blk_io_t *io = elevator_next(q);
+        if (!io) break;
+
+        q->stats.queued--;
+        q->stats.in_flight++;
+        q->stats.dispatched++;
+        q->stats.sectors += io->count;
+
+        if (dev->submit) {
+            if (dev->submit(dev, io) != 0) blk_io_done(io, -1);
+            continue;
+        }
+
+        irq_restore(flags);
+        int status = io_run_sync(dev, io);
+        blk_io_done(io, status);
+        flags = irq_save();
+    }
+
+    q->running = 0;
+    irq_restore(flags);
+}
+
+void blk_io_done(blk_io_t *io, int status) {
+    uint32_t id = io->dev;
+    blk_queue_t *q = &queues[id];
+    blk_request_t *req, *tmp;
+
+    uint64_t flags = irq_save();
+    q->stats.in_flight--;
+
+    list_for_each_entry_safe(req, tmp, &io->requests, blk_request_t, link) {
+        list_del(&req->link);
+        req->status = status;
+        if (req->complete) req->complete(req);
+        req->done = 1;
+    }
+
+    list_add(&io->fifo_link, &io_free);
+    irq_restore(flags);
+
+    blk_run_queue(id);
+}
+
+
+// Give completions a chance: poll the driver if nothing else will run it
+static void blk_idle(blkdev_t *dev, int force_poll) {
+    int irqs_on = (read_rflags() & 0x200) != 0;
+
+    if ((!irqs_on || force_poll) && dev->poll) {
+        uint64_t flags = irq_save();
+        dev->poll(dev);
+        irq_restore(flags);
+    }
+    if (!irqs_on) return;
+
+    if (get_scheduler_enabled()) {
+        thread_yield();
+    } else {
+        __asm__ volatile("hlt");
+    }
+}
+
+void blk_queue_init(uint32_t id) {
+    if (id >= BLKDEV_MAX) return;
+
+    if (!pool_ready) {
+        for (int i = 0; i < BLK_IO_POOL; i++) list_add_tail(&io_pool[i].fifo_link, &io_free);
+        pool_ready = 1;
+    }
+
+    blk_queue_t *q = &queues[id];
+    for (int op = 0; op < 2; op++) {
+        list_init(&q->sorted[op]);
+        list_init(&q->fifo[op]);
+    }
+    q->next_lba = 0;
+    q->batch_op = BLK_READ;
+    q->batch_count = 0;
+    q->writes_starved = 0;
+    q->running = 0;
+    q->plugged = 0;
+    q->stopped = 0;
+}
+
+int blk_submit(uint32_t id, blk_request_t *req) {
+    blkdev_t *dev = blkdev_get(id);
+    if (!dev || !req || req->nsegs == 0 || req->nsegs > BLK_REQ_SEGS) return -1;
+    if (req->op != BLK_READ && req->op != BLK_WRITE) return -1;
+
+    uint32_t count = seg_sectors(req->segs, req->nsegs);
+    if (count == 0 || count > BLK_MAX_SECTORS || req->lba + count > dev->sectors) return -1;
+
+    blk_queue_t *q = &queues[id];
+    req->done = 0;
+    req->status = -1;
+
+    uint64_t flags = irq_save();
+    q->stats.submitted++;
+
+    if (try_merge(q, req, count) == 0) {
+        q->stats.merged++;
+    } else {
+        while (list_empty(&io_free)) {
+            // Every io is queued or in flight; a plug must not hold them all back
+            q->plugged = 0;
+            irq_restore(flags);
+            blk_run_queue(id);
+            blk_idle(dev, 0);
+            flags = irq_save();
+        }
+
+        blk_io_t *io = list_first_entry(&io_free, blk_io_t, fifo_link);
+        list_del(&io->fifo_link);
+
+        io->dev = id;
+        io->op = req->op;
+        io->lba = req->lba;
+        io->count = count;
+        io->nsegs = req->nsegs;
+        for (uint32_t i = 0; i < req->nsegs; i++) io->segs[i] = req->segs[i];
+        io_compact(io);
+        io->expires = get_timer_ticks() + (req->op == BLK_READ ? BLK_READ_EXPIRE : BLK_WRITE_EXPIRE);
+
+        list_init(&io->requests);
+        list_add_tail(&req->link, &io->requests);
+        sort_insert(q, io);
+        list_add_tail(&io->fifo_link, &q->fifo[req->op]);
+
+        q->stats.queued++;
+        if (q->stats.queued > q->stats.max_queued) q->stats.max_queued = q->stats.queued;
+    }
+
+    irq_restore(flags);
+
+    blk_run_queue(id);
+    return 0;
+}
+
+int blk_wait(uint32_t id, blk_request_t *req) {
+    blkdev_t *dev = blkdev_get(id);
+    if (!dev || !req) return -1;
+
+    uint64_t deadline = get_timer_ticks() + BLK_TIMEOUT;
+    int stalled = 0;
+
+    while (!req->done) {
+        if (!stalled && get_timer_ticks() >= deadline) {
+            // Lost interrupt or a wedged drive: keep going by polling
+            PRINT(YELLOW, BLACK, "[BLKDEV] %s: request for LBA %llu stalled, polling\n",
+                  dev->name, req->lba);
+            stalled = 1;
+        }
+        blk_idle(dev, stalled);
+    }
+
+    return req->status;
+}
+
+void blk_plug(uint32_t id) {
+    if (id >= BLKDEV_MAX) return;
+
+    uint64_t flags = irq_save();
+    queues[id].plugged = 1;
+    irq_restore(flags);
+}
+
+void blk_unplug(uint32_t id) {
+    if (id >= BLKDEV_MAX) return;
+
+    uint64_t flags = irq_save();
+    queues[id].plugged = 0;
+    irq_restore(flags);
+
+    blk_run_queue(id);
+}
+
+void blk_quiesce(uint32_t id) {
+    blkdev_t *dev = blkdev_get(id);
+    if (!dev) return;
+
+    blk_queue_t *q = &queues[id];
+    uint64_t flags = irq_save();
+    q->stopped = 1;
+    while (q->stats.in_flight > 0) {
+        irq_restore(flags);
+        blk_idle(dev, 0);
+        flags = irq_save();
+    }
+    irq_restore(flags);
+}
+
+void blk_resume(uint32_t id) {
+    if (id >= BLKDEV_MAX) return;
+
+    uint64_t flags = irq_save();
+    queues[id].stopped = 0;
+    irq_restore(flags);
+
+    blk_run_queue(id);
+}
+
+void blk_get_queue_stats(uint32_t id, blk_queue_stats_t *out) {
+    if (id >= BLKDEV_MAX) return;
+
+    uint64_t flags = irq_save();
+    *out = queues[id].stats;
+    irq_restore(flags);
+}
+
+
+// Blocking transfers: split into dispatch-sized requests and keep a few queued
+#define BLK_SYNC_BATCH 8
+
+static int blkdev_transfer(uint32_t id, int op, uint64_t lba, uint32_t count, uint8_t *buffer) {
+    blkdev_t *dev = blkdev_get(id);
+    if (!dev || !buffer || lba + count > dev->sectors) return -1;
+
+    blk_request_t reqs[BLK_SYNC_BATCH];
+
+    while (count > 0) {
+        int n = 0;
+        int result = 0;
+
+        while (count > 0 && n < BLK_SYNC_BATCH) {
+            uint32_t chunk = count > BLK_MAX_SECTORS ? BLK_MAX_SECTORS : count;
+
+            reqs[n].op = op;
+            reqs[n].lba = lba;
+            reqs[n].segs[0].buffer = buffer;
+            reqs[n].segs[0].sectors = chunk;
+            reqs[n].nsegs = 1;
+            reqs[n].complete = NULL;
+            if (blk_submit(id, &reqs[n]) != 0) {
+                result = -1;
+                break;
+            }
+
+            n++;
+            lba += chunk;
+            buffer += chunk * BLK_SECTOR_SIZE;
+            count -= chunk;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (blk_wait(id, &reqs[i]) != 0) result = -1;
+        }
+        if (result != 0) return -1;
+    }
+    return 0;
+}
+
+int blkdev_read(uint32_t id, uint64_t lba, uint32_t count, uint8_t *buffer) {
+    return blkdev_transfer(id, BLK_READ, lba, count, buffer);
+}
+
+int blkdev_write(uint32_t id, uint64_t lba, uint32_t count, uint8_t *buffer) {
+    return blkdev_transfer(id, BLK_WRITE, lba, count, buffer);
+}
@@ -0,0 +1,227 @@
+#include "dcache.h"
+#include "irq.h"
+#include "print.h"
+#include "string_helpers.h"
+
+static dentry_t entries[DCACHE_ENTRIES];
+static list_head_t hash_table[DCACHE_HASH_SIZE];
+static list_head_t lru_list = LIST_HEAD_INIT(lru_list);
+
+// Every list and refcount change happens with interrupts off; nothing in
+// here sleeps or does I/O
+static dcache_stats_t stats;
+
+
+static uint32_t dcache_hash(filesystem_t *fs, uint32_t parent, const char *name, uint32_t len) {
+    uint32_t h = 2166136261U ^ parent ^ (uint32_t)(uint64_t)fs;
+    for (uint32_t i = 0; i < len; i++) {
+        h ^= (uint8_t)name[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static int name_equal(const dentry_t *d, const char *name, uint32_t len) {
+    if (d->len != len) return 0;
+    for (uint32_t i = 0; i < len; i++) {
+        if (d->name[i] != name[i]) return 0;
+    }
+    return 1;
+}
+
+static void dcache_touch(dentry_t *d) {
+    list_del(&d->lru_link);
+    list_add(&d->lru_link, &lru_list);
+}
+
+// Unhash; a pinned entry stays allocated until its last dcache_put()
+static void dcache_unhash(dentry_t *d) {
+    if (!d->hashed) return;
+
+    list_del(&d->hash_link);
+    d->hashed = 0;
+    d->node = NULL;
+    stats.cached--;
+
+    // Unused entries go to the cold end to be reused first
+    list_del(&d->lru_link);
+    list_add_tail(&d->lru_link, &lru_list);
+}
+
+
+void dcache_init(void) {
+    for (int i = 0; i < DCACHE_HASH_SIZE; i++) {
+        list_init(&hash_table[i]);
+    }
+
+    list_init(&lru_list);
+    for (int i = 0; i < DCACHE_ENTRIES; i++) {
+        entries[i].hashed = 0;
+        entries[i].refcount = 0;
+        entries[i].node = NULL;
+        list_init(&entries[i].hash_link);
+        list_add_tail(&entries[i].lru_link, &lru_list);
+    }
+
+    stats = (dcache_stats_t){0};
+}
+
+static dentry_t* dcache_find(vfs_node_t *dir, const char *name, uint32_t len) {
+    if (len >= DCACHE_NAME_LEN) return NULL;
+
+    uint32_t h = dcache_hash(dir->fs, dir->inode, name, len);
+    dentry_t *d;
+
+    list_for_each_entry(d, &hash_table[h & (DCACHE_HASH_SIZE - 1)], dentry_t, hash_link) {
+        if (d->hash == h && d->fs == dir->fs && d->parent == dir->inode && name_equal(d, name, len)) {
+            return d;
+        }
+    }
+    return NULL;
+}
+
+static void dcache_pin(dentry_t *d) {
+    if (d->refcount++ == 0) stats.pinned++;
+}
+
+dentry_t* dcache_lookup(vfs_node_t *dir, const char *name, uint32_t len) {
+    uint64_t flags = irq_save();
+    dentry_t *d = dcache_find(dir, name, len);
+
+    if (!d) {
+        stats.misses++;
+        irq_restore(flags);
+        return NULL;
+    }
+
+    if (d->node) {
+        stats.hits++;
+    } else {
+        stats.negative_hits++;
+    }
+    dcache_touch(d);
+    dcache_pin(d);
+    irq_restore(flags);
+    return d;
+}
+
+// Reuses the least recently used unpinned entry; returns NULL when every
+// entry is pinned or the name is too long, and the caller goes uncached
+dentry_t* dcache_add(vfs_node_t *dir, const char *name, uint32_t len, vfs_node_t *node) {
+    if (len >= DCACHE_NAME_LEN) return NULL;
+
+    uint64_t flags = irq_save();
+
+    // Another thread may have added the name since our lookup missed
+    dentry_t *d = dcache_find(dir, name, len);
+    if (d) {
+        dcache_touch(d);
+        dcache_pin(d);
+        irq_restore(flags);
+        return d;
+    }
+
+    for (list_head_t *pos = lru_list.prev; pos != &lru_list; pos = pos->prev) {
+        dentry_t *candidate = list_entry(pos, dentry_t, lru_link);
+        if (candidate->refcount == 0) {
+            d = candidate;
+            break;
+        }
+    }
+    if (!d) {
+        irq_restore(flags);
+        return NULL;
+    }
+
+    if (d->hashed) {
+        stats.evictions++;
+        dcache_unhash(d);
+    }
+
+    d->fs = dir->fs;
+    d->parent = dir->inode;
+    d->hash = dcache_hash(dir->fs, dir->inode, name, len);
+    d->len = len;
+    for (uint32_t i = 0; i < len; i++) {
+        d->name[i] = name[i];
+    }
+    d->name[len] = '\0';
+    d->node = node;
+    d->hashed = 1;
+
+    list_add(&d->hash_link, &hash_table[d->hash & (DCACHE_HASH_SIZE - 1)]);
+    dcache_touch(d);
+    dcache_pin(d);
+    stats.cached++;
+    irq_restore(flags);
+    return d;
+}
+
+void dcache_get(dentry_t *dentry) {
+    if (!dentry) return;
+    uint64_t flags = irq_save();
+    dcache_pin(dentry);
+    irq_restore(flags);
+}
+
+void dcache_put(dentry_t *dentry) {
+    if (!dentry) return;
+    uint64_t flags = irq_save();
+    if (dentry->refcount && --dentry->refcount == 0) stats.pinned--;
+    irq_restore(flags);
+}
+
+
+void dcache_invalidate(vfs_node_t *dir, const char *name, uint32_t len) {
+    uint64_t flags = irq_save();
+    dentry_t *d = dcache_find(dir, name, len);
+    if (d) {
+        stats.invalidations++;
+        dcache_unhash(d);
+    }
+    irq_restore(flags);
+}
+
+void dcache_invalidate_dir(filesystem_t *fs, uint32_t inode) {
+    uint64_t flags = irq_save();
+    for (int i = 0; i < DCACHE_ENTRIES; i++) {
+        dentry_t *d = &entries[i];
+        if (d->hashed && d->fs == fs && d->parent == inode) {
+            stats.invalidations++;
+            dcache_unhash(d);
+        }
+    }
+    irq_restore(flags);
+}
+
+void dcache_invalidate_fs(filesystem_t *fs) {
+    uint64_t flags = irq_save();
+    for (int i = 0; i < DCACHE_ENTRIES; i++) {
+        if (entries[i].hashed && entries[i].fs == fs) {
+            stats.invalidations++;
+            dcache_unhash(&entries[i]);
+        }
+    }
+    irq_restore(flags);
+}
+
+
+void dcache_get_stats(dcache_stats_t *out) {
+    uint64_t flags = irq_save();
+    *out = stats;
+    irq_restore(flags);
+}
+
+void dcache_print_stats(void) {
+    dcache_stats_t s;
+    dcache_get_stats(&s);
+
+    uint64_t lookups = s.hits + s.negative_hits + s.misses;
+    uint64_t hit_pct = lookups ? ((s.hits + s.negative_hits) * 100) / lookups : 0;
+
+    PRINT(CYAN, BLACK, "\n=== Dentry Cache ===\n");
+    PRINT(WHITE, BLACK, "Entries: %u cached, %u pinned, %d total\n", s.cached, s.pinned, DCACHE_ENTRIES);
+    PRINT(WHITE, BLACK, "Lookups: %llu hits, %llu negative, %llu misses (%llu%% hit ratio)\n",
+          s.hits, s.negative_hits, s.misses, hit_pct);
+    PRINT(WHITE, BLACK, "Evictions: %llu, invalidations: %llu\n", s.evictions, s.invalidations);
+}
@@ -0,0 +1,225 @@
+#include "fdtable.h"
+#include "irq.h"
+#include "memory.h"
+#include "print.h"
+#include "process.h"
+#include "string_helpers.h"
+
+static list_head_t tables = LIST_HEAD_INIT(tables);
+static fd_table_t *kernel_fdt = NULL;
+
+
+// Move to `size` slots (a multiple of 64, never smaller than now)
+static int fdt_resize(fd_table_t *fdt, uint32_t size) {
+    uint32_t words = size / 64;
+    uint32_t full_words = (words + 63) / 64;
+    uint32_t old_words = fdt->size / 64;
+    uint32_t old_full = (old_words + 63) / 64;
+
+    file_descriptor_t **files = (file_descriptor_t**)kmalloc(size * sizeof(file_descriptor_t*));
+    uint64_t *used = (uint64_t*)kmalloc(words * sizeof(uint64_t));
+    uint64_t *full = (uint64_t*)kmalloc(full_words * sizeof(uint64_t));
+    if (!files || !used || !full) {
+        if (files) kfree(files);
+        if (used) kfree(used);
+        if (full) kfree(full);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < size; i++) {
+        files[i] = i < fdt->size ? fdt->files[i] : NULL;
+    }
+    for (uint32_t i = 0; i < words; i++) {
+        used[i] = i < old_words ? fdt->used[i] : 0;
+    }
+    for (uint32_t i = 0; i < full_words; i++) {
+        full[i] = i < old_full ? fdt->full[i] : 0;
+    }
+
+    if (fdt->files) kfree(fdt->files);
+    if (fdt->used) kfree(fdt->used);
+    if (fdt->full) kfree(fdt->full);
+
+    fdt->files = files;
+    fdt->used = used;
+    fdt->full = full;
+    fdt->size = size;
+    return 0;
+}
+
+// First summary word with a gap, then the first gap in that bitmap word
+static int64_t fdt_find_free(fd_table_t *fdt) {
+    uint32_t words = fdt->size / 64;
+
+    for (uint32_t s = 0; s < (words + 63) / 64; s++) {
+        uint64_t avail = ~fdt->full[s];
+
+        // Summary bits past the last bitmap word stand for nothing
+        if (s == words / 64) avail &= (1ULL << (words % 64)) - 1;
+        if (!avail) continue;
+
+        uint32_t w = s * 64 + __builtin_ctzll(avail);
+        return (int64_t)w * 64 + __builtin_ctzll(~fdt->used[w]);
+    }
+    return -1;
+}
+
+static void fdt_set(fd_table_t *fdt, uint32_t fd) {
+    uint32_t w = fd / 64;
+    fdt->used[w] |= 1ULL << (fd % 64);
+    if (fdt->used[w] == ~0ULL) fdt->full[w / 64] |= 1ULL << (w % 64);
+}
+
+static void fdt_clear(fd_table_t *fdt, uint32_t fd) {
+    uint32_t w = fd / 64;
+    fdt->used[w] &= ~(1ULL << (fd % 64));
+    fdt->full[w / 64] &= ~(1ULL << (w % 64));
+}
+
+
+fd_table_t* fdt_create(void) {
+    fd_table_t *fdt = (fd_table_t*)kcalloc(1, sizeof(fd_table_t));
+    if (!fdt) return NULL;
+
+    if (fdt_resize(fdt, FDT_MIN_SLOTS) != 0) {
+        kfree(fdt);
+        return NULL;
+    }
+
+    for (uint32_t fd = 0; fd < FDT_RESERVED; fd++) {
+        fdt_set(fdt, fd);
+    }
+    fdt->refcount = 1;
+
+    uint64_t flags = irq_save();
+    list_add_tail(&fdt->link, &tables);
+    irq_restore(flags);
+
+    return fdt;
+}
+
+void fdt_get(fd_table_t *fdt) {
+    uint64_t flags = irq_save();
+    fdt->refcount++;
+    irq_restore(flags);
+}
+
+void fdt_put(fd_table_t *fdt) {
+    if (!fdt) return;
+
+    uint64_t flags = irq_save();
+    if (--fdt->refcount > 0) {
+        irq_restore(flags);
+        return;
+    }
+    list_del(&fdt->link);
+    irq_restore(flags);
+
+    for (uint32_t fd = FDT_RESERVED; fd < fdt->size; fd++) {
+        if (fdt->files[fd]) vfs_file_put(fdt->files[fd]);
+    }
+
+    kfree(fdt->files);
+    kfree(fdt->used);
+    kfree(fdt->full);
+    kfree(fdt);
+}
+
+fd_table_t* fdt_current(void) {
+    thread_t *thread = get_current_thread();
+    if (thread && thread->parent && thread->parent->files) {
+        return thread->parent->files;
+    }
+
+    if (!kernel_fdt) kernel_fdt = fdt_create();
+    return kernel_fdt;
+}
+
+
+int fdt_alloc(fd_table_t *fdt, file_descriptor_t *file) {
+    if (!fdt || !file) return -1;
+
+    uint64_t flags = irq_save();
+
+    int64_t fd = fdt_find_free(fdt);
+    if (fd < 0) {
+        if (fdt->size >= FDT_MAX_SLOTS || fdt_resize(fdt, fdt->size * 2) != 0) {
+            irq_restore(flags);
+            return -1;
+        }
+        fd = fdt_find_free(fdt);
+    }
+
+    fdt_set(fdt, (uint32_t)fd);
+    fdt->files[fd] = file;
+    fdt->count++;
+
+    irq_restore(flags);
+    return (int)fd;
+}
+
+file_descriptor_t* fdt_lookup(fd_table_t *fdt, int fd) {
+    if (!fdt || fd < FDT_RESERVED) return NULL;
+
+    // A resize frees the slot array and a close drops the table's
+    // reference, so read the slot and pin its file in one go
+    uint64_t flags = irq_save();
+
+    file_descriptor_t *file = NULL;
+    if ((uint32_t)fd < fdt->size) file = fdt->files[fd];
+    if (file) vfs_file_get(file);
+
+    irq_restore(flags);
+    return file;
+}
+
+file_descriptor_t* fdt_remove(fd_table_t *fdt, int fd) {
+    if (!fdt || fd < FDT_RESERVED) return NULL;
+
+    uint64_t flags = irq_save();
+
+    if ((uint32_t)fd >= fdt->size || !fdt->files[fd]) {
+        irq_restore(flags);
+        return NULL;
+    }
+
+    file_descriptor_t *file = fdt->files[fd];
+    fdt->files[fd] = NULL;
+    fdt_clear(fdt, (uint32_t)fd);
+    fdt->count--;
+
+    irq_restore(flags);
+    return file;
+}
+
+
+int fdt_uses_fs(filesystem_t *fs) {
+    int found = 0;
+    uint64_t flags = irq_save();
+
+    fd_table_t *fdt;
+    list_for_each_entry(fdt, &tables, fd_table_t, link) {
+        for (uint32_t fd = FDT_RESERVED; fd < fdt->size && !found; fd++) {
+            file_descriptor_t *file = fdt->files[fd];
+            if (file && file->node && file->node->fs == fs) found = 1;
+        }
+        if (found) break;
+    }
+
+    irq_restore(flags);
+    return found;
+}
+
+void fdt_print(fd_table_t *fdt) {
+    if (!fdt) return;
+
+    PRINT(CYAN, BLACK, "\n=== Descriptors ===\n");
+    PRINT(WHITE, BLACK, "%u open, %u slots, shared by %u\n", fdt->count, fdt->size, fdt->refcount);
+
+    for (uint32_t fd = FDT_RESERVED; fd < fdt->size; fd++) {
+        file_descriptor_t *file = fdt->files[fd];
+        if (!file) continue;
+
+        PRINT(WHITE, BLACK, "  %u: %s (pos %u)\n", fd, file->node ? file->node->name : "?", file->position);
+    }
+}
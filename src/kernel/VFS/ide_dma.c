@@ -0,0 +1,486 @@
+#include "ide_dma.h"
+#include "ata.h"
+#include "PCI.h"
+#include "IO.h"
+#include "irq.h"
+#include "irqstat.h"
+#include "memory.h"
+#include "process.h"
+#include "print.h"
+#include "string_helpers.h"
+
+extern int get_scheduler_enabled(void);
+
+static uint16_t bmide = 0;
+static int dma_ready = 0;
+
+static ide_prd_t *prdt = NULL;
+static uint8_t *bounce = NULL;
+
+static list_head_t pending = LIST_HEAD_INIT(pending);
+static ide_dma_request_t *active = NULL;
+static uint32_t depth = 0;
+
+static ide_dma_stats_t stats;
+
+
+static void copy_bytes(uint8_t *dst, const uint8_t *src, uint32_t bytes) {
+    uint64_t *d = (uint64_t*)dst;
+    const uint64_t *s = (const uint64_t*)src;
+    for (uint32_t i = 0; i < bytes / 8; i++) d[i] = s[i];
+}
+
+static inline uint64_t read_rflags(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq\n pop %0" : "=r"(flags));
+    return flags;
+}
+
+// The bus master only sees 32-bit physical addresses; memory is identity
+// mapped, so a buffer qualifies if it is word aligned and below 4 GiB
+static int dma_addressable(const uint8_t *buffer, uint32_t bytes) {
+    uint64_t addr = (uint64_t)buffer;
+    return !(addr & 1) && addr + bytes <= 0x100000000ULL;
+}
+
+
+static int segs_addressable(const ide_dma_request_t *req) {
+    for (uint32_t i = 0; i < req->nsegs; i++) {
+        if (!dma_addressable(req->segs[i].buffer, req->segs[i].sectors * SECTOR_SIZE)) return 0;
+    }
+    return 1;
+}
+
+// Copy between the request's segments and the bounce buffer
+static void bounce_copy(ide_dma_request_t *req, int to_bounce) {
+    uint8_t *b = bounce;
+    for (uint32_t i = 0; i < req->nsegs; i++) {
+        uint32_t bytes = req->segs[i].sectors * SECTOR_SIZE;
+        if (to_bounce) {
+            copy_bytes(b, req->segs[i].buffer, bytes);
+        } else {
+            copy_bytes(req->segs[i].buffer, b, bytes);
+        }
+        b += bytes;
+    }
+}
+
+// Describe one buffer from PRD n on; -1 once the table is full
+static int build_prd(int n, const uint8_t *buffer, uint32_t bytes) {
+    uint64_t addr = (uint64_t)buffer;
+
+    while (bytes > 0) {
+        if (n >= IDE_DMA_PRD_MAX) return -1;
+
+        uint32_t chunk = 0x10000 - (uint32_t)(addr & 0xFFFF);
+        if (chunk > bytes) chunk = bytes;
+
+        prdt[n].addr = (uint32_t)addr;
+        prdt[n].bytes = (uint16_t)(chunk & 0xFFFF);
+        prdt[n].flags = 0;
+
+        addr += chunk;
+        bytes -= chunk;
+        n++;
+    }
+    return n;
+}
+
+static int build_prdt(ide_dma_request_t *req) {
+    int n = 0;
+
+    if (req->bounced) {
+        n = build_prd(n, bounce, req->count * SECTOR_SIZE);
+    } else {
+        for (uint32_t i = 0; i < req->nsegs && n >= 0; i++) {
+            n = build_prd(n, req->segs[i].buffer, req->segs[i].sectors * SECTOR_SIZE);
+        }
+    }
+    if (n <= 0) return -1;
+
+    prdt[n - 1].flags = PRD_EOT;
+    return 0;
+}
+
+// Program the controller and the drive for req. Interrupts are off.
+static void ide_dma_start(ide_dma_request_t *req) {
+    int ext = ata_needs_ext(req->lba, req->count);
+
+    // A scatter list too fragmented for the table goes through the bounce
+    // buffer, which is contiguous and always fits
+    req->bounced = !segs_addressable(req) || build_prdt(req) != 0;
+    if (req->bounced) {
+        if (req->write) bounce_copy(req, 1);
+        stats.bounced++;
+        build_prdt(req);
+    }
+
+    outb(bmide + BM_COMMAND, 0);
+    outl(bmide + BM_PRDT, (uint32_t)(uint64_t)prdt);
+    outb(bmide + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+    outb(bmide + BM_COMMAND, req->write ? 0 : BM_CMD_READ);
+
+    ata_setup_command(req->lba, req->count, ext);
+    if (req->write) {
+        outb(ATA_PRIMARY_COMMAND, ext ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA);
+    } else {
+        outb(ATA_PRIMARY_COMMAND, ext ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA);
+    }
+
+    outb(bmide + BM_COMMAND, (req->write ? 0 : BM_CMD_READ) | BM_CMD_START);
+
+    active = req;
+    stats.requests++;
+    stats.sectors += req->count;
+}
+
+static void ide_dma_start_next(void) {
+    if (active || list_empty(&pending)) return;
+
+    ide_dma_request_t *req = list_entry(pending.next, ide_dma_request_t, link);
+    list_del(&req->link);
+    depth--;
+    ide_dma_start(req);
+}
+
+static void ide_dma_finish(int status) {
+    ide_dma_request_t *req = active;
+    active = NULL;
+
+    if (status == 0 && req->bounced && !req->write) bounce_copy(req, 0);
+
+    if (status != 0) stats.errors++;
+    req->status = status;
+    req->done = 1;
+    if (req->complete) req->complete(req);
+
+    ide_dma_start_next();
+}
+
+
+static void ide_dma_irq_handler(void) {
+    stats.irqs++;
+
+    uint8_t bm = inb(bmide + BM_STATUS);
+    if (!active || !(bm & BM_STATUS_IRQ)) {
+        // PIO command or stale edge: reading STATUS deasserts INTRQ
+        inb(ATA_PRIMARY_STATUS);
+        stats.spurious++;
+        return;
+    }
+
+    outb(bmide + BM_COMMAND, 0);
+    uint8_t ata_status = inb(ATA_PRIMARY_STATUS);
+    outb(bmide + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+
+    int failed = (bm & BM_STATUS_ERR) || (ata_status & (ATA_STATUS_ERR | ATA_STATUS_DF));
+    ide_dma_finish(failed ? -1 : 0);
+}
+
+
+// ata0 asynchronous path: the queue hands over one merged io at a time
+static ide_dma_request_t blk_req;
+
+static void ide_dma_blk_complete(ide_dma_request_t *req) {
+    blk_io_done((blk_io_t*)req->private_data, req->status);
+}
+
+static int ide_dma_blk_submit(blkdev_t *dev, blk_io_t *io) {
+    (void)dev;
+
+    blk_req.lba = io->lba;
+    blk_req.count = io->count;
+    blk_req.nsegs = io->nsegs;
+    for (uint32_t i = 0; i < io->nsegs; i++) blk_req.segs[i] = io->segs[i];
+    blk_req.write = io->op == BLK_WRITE;
+    blk_req.complete = ide_dma_blk_complete;
+    blk_req.private_data = io;
+    return ide_dma_submit(&blk_req);
+}
+
+static void ide_dma_blk_poll(blkdev_t *dev) {
+    (void)dev;
+    if (inb(bmide + BM_STATUS) & BM_STATUS_IRQ) ide_dma_irq_handler();
+}
+
+static void ide_dma_attach_blkdev(void) {
+    blkdev_t *blk = blkdev_get((uint32_t)blkdev_lookup("ata0"));
+    if (!blk) return;
+
+    blk->poll = ide_dma_blk_poll;
+    blk->queue_depth = 1;
+    blk->submit = ide_dma_blk_submit;
+}
+
+
+static int find_controller(uint8_t *out_bus, uint8_t *out_dev, uint8_t *out_func) {
+    for (int bus = 0; bus < 256; bus++) {
+        for (int dev = 0; dev < 32; dev++) {
+            for (int func = 0; func < 8; func++) {
+                if (pci_read_word(bus, dev, func, PCI_VENDOR_ID) == 0xFFFF) {
+                    if (func == 0) break;
+                    continue;
+                }
+
+                if (pci_read_byte(bus, dev, func, PCI_CLASS_CODE) == PCI_CLASS_STORAGE &&
+                    pci_read_byte(bus, dev, func, PCI_SUBCLASS) == PCI_SUBCLASS_IDE) {
+                    *out_bus = bus;
+                    *out_dev = dev;
+                    *out_func = func;
+                    return 0;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+int ide_dma_init(void) {
+    const ata_device_t *disk = ata_get_device();
+    if (!disk->present) return -1;
+
+    if (!disk->dma) {
+        PRINT(YELLOW, BLACK, "[IDE-DMA] Drive does not support DMA, staying on PIO\n");
+        return -1;
+    }
+
+    uint8_t bus, dev, func;
+    if (find_controller(&bus, &dev, &func) != 0) {
+        PRINT(YELLOW, BLACK, "[IDE-DMA] No PCI IDE controller found\n");
+        return -1;
+    }
+
+    uint8_t progif = pci_read_byte(bus, dev, func, PCI_PROG_IF);
+    if (!(progif & PCI_IDE_PROGIF_BUSMASTER)) {
+        PRINT(YELLOW, BLACK, "[IDE-DMA] Controller is not bus-master capable\n");
+        return -1;
+    }
+
+    // ata.c talks to the legacy 0x1F0 ports, which only exist in compatibility mode
+    if (progif & PCI_IDE_PROGIF_NATIVE0) {
+        PRINT(YELLOW, BLACK, "[IDE-DMA] Primary channel in native mode, not supported\n");
+        return -1;
+    }
+
+    uint32_t bar4 = pci_read_dword(bus, dev, func, PCI_BAR4);
+    if (!(bar4 & 1) || (bar4 & 0xFFFC) == 0) {
+        PRINT(YELLOW, BLACK, "[IDE-DMA] Bus master BAR4 not assigned\n");
+        return -1;
+    }
+    bmide = bar4 & 0xFFFC;
+
+    // PRDT: dword aligned and may not cross 64 KiB, a page satisfies both
+    prdt = (ide_prd_t*)pmm_alloc_page();
+    bounce = (uint8_t*)pmm_alloc_pages(IDE_DMA_BOUNCE_SECTORS * SECTOR_SIZE / 4096);
+    if (!prdt || !bounce || !dma_addressable((uint8_t*)prdt, 4096) ||
+        !dma_addressable(bounce, IDE_DMA_BOUNCE_SECTORS * SECTOR_SIZE)) {
+        PRINT(YELLOW, BLACK, "[IDE-DMA] No DMA-reachable memory for PRDT/bounce buffer\n");
+        return -1;
+    }
+
+    uint16_t cmd = pci_read_word(bus, dev, func, PCI_COMMAND);
+    pci_write_word(bus, dev, func, PCI_COMMAND, cmd | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+    outb(bmide + BM_COMMAND, 0);
+    outb(bmide + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+
+    irq_install_handler(IDE_PRIMARY_IRQ, ide_dma_irq_handler);
+
+    // ata_init left nIEN set; completions need INTRQ
+    inb(ATA_PRIMARY_STATUS);
+    outb(ATA_PRIMARY_CONTROL, 0);
+
+    dma_ready = 1;
+    ide_dma_attach_blkdev();
+    PRINT(MAGENTA, BLACK, "[IDE-DMA] Controller %x:%x.%x, bus master at 0x%x, IRQ %d\n",
+          bus, dev, func, bmide, IDE_PRIMARY_IRQ);
+    return 0;
+}
+
+int ide_dma_available(void) {
+    return dma_ready;
+}
+
+
+int ide_dma_submit(ide_dma_request_t *req) {
+    if (!dma_ready || !req || req->nsegs == 0 || req->nsegs > BLK_MAX_SEGS) return -1;
+    if (req->count == 0 || req->count > IDE_DMA_BOUNCE_SECTORS) return -1;
+
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < req->nsegs; i++) {
+        if (!req->segs[i].buffer) return -1;
+        total += req->segs[i].sectors;
+    }
+    if (total != req->count) return -1;
+
+    const ata_device_t *disk = ata_get_device();
+    if (req->lba + req->count > disk->sectors) return -1;
+    if (!disk->lba48 && ata_needs_ext(req->lba, req->count)) return -1;
+
+    req->done = 0;
+    req->status = -1;
+
+    uint64_t flags = irq_save();
+    list_add_tail(&req->link, &pending);
+    depth++;
+    if (depth > stats.max_depth) stats.max_depth = depth;
+    ide_dma_start_next();
+    irq_restore(flags);
+
+    return 0;
+}
+
+static void ide_dma_abort(ide_dma_request_t *req) {
+    uint64_t flags = irq_save();
+
+    if (!req->done) {
+        stats.timeouts++;
+        if (active == req) {
+            // The drive may still be mid-command; reset it before the next
+            // request is programmed, and let INTRQ through again
+            outb(bmide + BM_COMMAND, 0);
+            outb(bmide + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+            if (ata_reset_channel() != 0) {
+                PRINT(YELLOW, BLACK, "[IDE-DMA] Drive still busy after reset\n");
+            }
+            inb(ATA_PRIMARY_STATUS);
+            outb(ATA_PRIMARY_CONTROL, 0);
+            ide_dma_finish(-1);
+        } else {
+            list_del(&req->link);
+            depth--;
+            req->status = -1;
+            req->done = 1;
+            if (req->complete) req->complete(req);
+        }
+        PRINT(YELLOW, BLACK, "[IDE-DMA] Request for LBA %llu timed out\n", req->lba);
+    }
+
+    irq_restore(flags);
+}
+
+// Wait out req, aborting it after IDE_DMA_TIMEOUT. `idle`, if given,
+// counts the times the CPU was handed to something else meanwhile.
+static int dma_wait(ide_dma_request_t *req, volatile uint64_t *idle) {
+    // With interrupts off nothing will complete the request but us
+    if (!(read_rflags() & 0x200)) {
+        for (int spins = 0; !req->done; spins++) {
+            if (spins > 50000000) {
+                ide_dma_abort(req);
+                break;
+            }
+            if (inb(bmide + BM_STATUS) & BM_STATUS_IRQ) ide_dma_irq_handler();
+        }
+        return req->status;
+    }
+
+    uint64_t deadline = get_timer_ticks() + IDE_DMA_TIMEOUT;
+    while (!req->done) {
+        if (get_timer_ticks() >= deadline) {
+            ide_dma_abort(req);
+            break;
+        }
+
+        if (idle) (*idle)++;
+        if (get_scheduler_enabled()) {
+            thread_yield();
+        } else {
+            __asm__ volatile("hlt");
+        }
+    }
+
+    return req->status;
+}
+
+int ide_dma_wait(ide_dma_request_t *req) {
+    return dma_wait(req, NULL);
+}
+
+
+void ide_dma_get_stats(ide_dma_stats_t *out) {
+    uint64_t flags = irq_save();
+    *out = stats;
+    irq_restore(flags);
+}
+
+
+// Count how often the CPU was free for other work while a transfer ran
+static volatile uint64_t idle_spins;
+
+static int bench_dma_read(uint64_t lba, uint32_t count, uint8_t *buffer) {
+    ide_dma_request_t req;
+    req.lba = lba;
+    req.count = count;
+    req.segs[0].buffer = buffer;
+    req.segs[0].sectors = count;
+    req.nsegs = 1;
+    req.write = 0;
+    req.complete = NULL;
+
+    if (ide_dma_submit(&req) != 0) return -1;
+    return dma_wait(&req, &idle_spins);
+}
+
+void ide_dma_benchmark(uint32_t sectors) {
+    const ata_device_t *disk = ata_get_device();
+    const uint32_t chunk = 128;
+
+    if (!dma_ready) {
+        PRINT(YELLOW, BLACK, "[IDE-DMA] DMA not available\n");
+        return;
+    }
+    if (sectors > disk->sectors) sectors = (uint32_t)disk->sectors;
+    sectors -= sectors % chunk;
+    if (sectors == 0) return;
+
+    uint8_t *buffer = (uint8_t*)kmalloc(chunk * SECTOR_SIZE);
+    if (!buffer) return;
+
+    uint64_t per_us = irqstat_tsc_per_us();
+
+    PRINT(CYAN, BLACK, "\n=== Sequential read, %u sectors in %u-sector requests ===\n", sectors, chunk);
+
+    // PIO drives the task file behind the ata0 queue, which must have
+    // nothing in flight and dispatch nothing until it is done
+    int blk = blkdev_lookup("ata0");
+    if (blk >= 0) blk_quiesce((uint32_t)blk);
+
+    uint64_t start = rdtsc();
+    int failed = 0;
+    for (uint32_t s = 0; s < sectors && !failed; s += chunk) {
+        if (ata_read_sectors(s, chunk, buffer) != 0) {
+            PRINT(YELLOW, BLACK, "[IDE-DMA] PIO read failed at LBA %u\n", s);
+            failed = 1;
+        }
+    }
+    uint64_t pio_us = (rdtsc() - start) / per_us;
+
+    if (blk >= 0) blk_resume((uint32_t)blk);
+    if (failed) {
+        kfree(buffer);
+        return;
+    }
+
+    idle_spins = 0;
+    start = rdtsc();
+    for (uint32_t s = 0; s < sectors; s += chunk) {
+        if (bench_dma_read(s, chunk, buffer) != 0) {
+            PRINT(YELLOW, BLACK, "[IDE-DMA] DMA read failed at LBA %u\n", s);
+            kfree(buffer);
+            return;
+        }
+    }
+    uint64_t dma_us = (rdtsc() - start) / per_us;
+
+    kfree(buffer);
+
+    uint64_t kb = (uint64_t)sectors / 2;
+    if (pio_us == 0) pio_us = 1;
+    if (dma_us == 0) dma_us = 1;
+
+    PRINT(WHITE, BLACK, "PIO: %llu us, %llu KB/s\n", pio_us, kb * 1000000 / pio_us);
+    PRINT(WHITE, BLACK, "DMA: %llu us, %llu KB/s, %llu idle polls while in flight\n",
+          dma_us, kb * 1000000 / dma_us, idle_spins);
+    PRINT(WHITE, BLACK, "DMA stats: %llu requests, %llu IRQs, %llu bounced, %llu errors\n",
+          stats.requests, stats.irqs, stats.bounced, stats.errors);
+}
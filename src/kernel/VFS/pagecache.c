@@ -0,0 +1,340 @@
+#include "pagecache.h"
+#include "memory.h"
+#include "print.h"
+#include "process.h"
+#include "string_helpers.h"
+
+static pcache_page_t *pages = NULL;
+static list_head_t hash_table[PCACHE_HASH_SIZE];
+static list_head_t lru_list = LIST_HEAD_INIT(lru_list);
+
+// Filesystems fill a whole readahead window with one read call
+static uint8_t *staging = NULL;
+
+static pcache_stats_t stats;
+static volatile int pcache_busy = 0;
+
+
+// Yield-spin lock: fills read from the filesystem through the one staging
+// buffer, so lookup, fill and copy-out all happen under it, and waiters
+// yield the CPU rather than spin through that I/O
+static void pcache_lock(void) {
+    while (__sync_lock_test_and_set(&pcache_busy, 1)) {
+        thread_yield();
+    }
+}
+
+static void pcache_unlock(void) {
+    __sync_lock_release(&pcache_busy);
+}
+
+
+static inline uint32_t pcache_hash(filesystem_t *fs, uint32_t inode, uint32_t index) {
+    return (index ^ (inode << 6) ^ (inode >> 4) ^ (uint32_t)((uint64_t)fs >> 4)) & (PCACHE_HASH_SIZE - 1);
+}
+
+static void copy_bytes(uint8_t *dst, const uint8_t *src, uint32_t n) {
+    if ((((uint64_t)dst | (uint64_t)src) & 7) == 0) {
+        while (n >= 8) {
+            *(uint64_t*)dst = *(const uint64_t*)src;
+            dst += 8;
+            src += 8;
+            n -= 8;
+        }
+    }
+    while (n--) *dst++ = *src++;
+}
+
+static void zero_bytes(uint8_t *dst, uint32_t n) {
+    while (n--) *dst++ = 0;
+}
+
+
+static pcache_page_t* pcache_lookup(filesystem_t *fs, uint32_t inode, uint32_t index) {
+    pcache_page_t *page;
+    list_head_t *bucket = &hash_table[pcache_hash(fs, inode, index)];
+
+    list_for_each_entry(page, bucket, pcache_page_t, hash_link) {
+        if (page->fs == fs && page->inode == inode && page->index == index &&
+            (page->flags & PCACHE_VALID)) {
+            return page;
+        }
+    }
+    return NULL;
+}
+
+static void pcache_touch(pcache_page_t *page) {
+    list_del(&page->lru_link);
+    list_add(&page->lru_link, &lru_list);
+}
+
+static void pcache_unhash(pcache_page_t *page) {
+    if (page->flags & PCACHE_VALID) stats.cached--;
+    list_del(&page->hash_link);
+    page->flags = 0;
+}
+
+// Take the least recently used unpinned page, or NULL if all are pinned
+static pcache_page_t* pcache_evict(void) {
+    for (list_head_t *pos = lru_list.prev; pos != &lru_list; pos = pos->prev) {
+        pcache_page_t *page = list_entry(pos, pcache_page_t, lru_link);
+        if (page->refcount) continue;
+
+        if (page->flags & PCACHE_VALID) stats.evictions++;
+        pcache_unhash(page);
+        return page;
+    }
+    return NULL;
+}
+
+static pcache_page_t* pcache_install(filesystem_t *fs, uint32_t inode, uint32_t index) {
+    pcache_page_t *page = pcache_evict();
+    if (!page) return NULL;
+
+    page->fs = fs;
+    page->inode = inode;
+    page->index = index;
+    list_add(&page->hash_link, &hash_table[pcache_hash(fs, inode, index)]);
+    pcache_touch(page);
+    return page;
+}
+
+// Read pages index..index+count-1 with a single filesystem call; the part
+// of the last page past end of file reads as zeros
+static int pcache_fill(vfs_node_t *node, uint32_t index, uint32_t count) {
+    uint32_t start = index * PCACHE_PAGE_SIZE;
+    if (start >= node->size) return -1;
+
+    uint32_t bytes = count * PCACHE_PAGE_SIZE;
+    if (bytes > node->size - start) bytes = node->size - start;
+
+    stats.fills++;
+    int got = node->ops->read(node, staging, bytes, start);
+    if (got <= 0) return -1;
+
+    for (uint32_t i = 0; i < count && i * PCACHE_PAGE_SIZE < (uint32_t)got; i++) {
+        pcache_page_t *page = pcache_install(node->fs, node->inode, index + i);
+        if (!page) break;
+
+        uint32_t off = i * PCACHE_PAGE_SIZE;
+        uint32_t n = (uint32_t)got - off;
+        if (n > PCACHE_PAGE_SIZE) n = PCACHE_PAGE_SIZE;
+
+        copy_bytes(page->data, staging + off, n);
+        zero_bytes(page->data + n, PCACHE_PAGE_SIZE - n);
+        page->flags = PCACHE_VALID;
+        stats.cached++;
+    }
+    return 0;
+}
+
+
+int pcache_init(void) {
+    if (pages) return 0;
+
+    pages = (pcache_page_t*)kmalloc(sizeof(pcache_page_t) * PCACHE_PAGES);
+    uint8_t *data = (uint8_t*)pmm_alloc_pages(PCACHE_PAGES);
+    staging = (uint8_t*)pmm_alloc_pages(PCACHE_RA_MAX);
+    if (!pages || !data || !staging) {
+        PRINT(YELLOW, BLACK, "[PCACHE] Failed to allocate cache, file reads go uncached\n");
+        if (pages) kfree(pages);
+        for (int i = 0; data && i < PCACHE_PAGES; i++) {
+            pmm_free_page(data + i * PCACHE_PAGE_SIZE);
+        }
+        for (int i = 0; staging && i < PCACHE_RA_MAX; i++) {
+            pmm_free_page(staging + i * PCACHE_PAGE_SIZE);
+        }
+        pages = NULL;
+        staging = NULL;
+        return -1;
+    }
+
+    for (int i = 0; i < PCACHE_HASH_SIZE; i++) {
+        list_init(&hash_table[i]);
+    }
+
+    for (int i = 0; i < PCACHE_PAGES; i++) {
+        pages[i].flags = 0;
+        pages[i].refcount = 0;
+        pages[i].data = data + i * PCACHE_PAGE_SIZE;
+        list_init(&pages[i].hash_link);
+        list_add_tail(&pages[i].lru_link, &lru_list);
+    }
+
+    PRINT(MAGENTA, BLACK, "[PCACHE] %d pages (%u KB)\n", PCACHE_PAGES,
+          (PCACHE_PAGES * PCACHE_PAGE_SIZE) / 1024);
+    return 0;
+}
+
+
+int pcache_read(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset, vfs_readahead_t *ra) {
+    if (!pages || node->type != FILE_TYPE_REGULAR || (node->fs && (node->fs->flags & FS_FLAG_RAM))) {
+        return node->ops->read(node, buffer, size, offset);
+    }
+
+    if (offset >= node->size) return 0;
+    if (size > node->size - offset) size = node->size - offset;
+    if (size == 0) return 0;
+
+    pcache_lock();
+
+    // A read that starts where the last one ended grows the window; any
+    // other read turns readahead off until the pattern is sequential again
+    uint32_t window = 0;
+    if (ra) {
+        if (offset == ra->next) {
+            ra->window = ra->window ? ra->window * 2 : PCACHE_RA_MIN;
+            if (ra->window > PCACHE_RA_MAX) ra->window = PCACHE_RA_MAX;
+        } else {
+            ra->window = 0;
+        }
+        window = ra->window;
+    }
+
+    uint32_t last = (offset + size - 1) / PCACHE_PAGE_SIZE;
+    uint32_t done = 0;
+
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t index = pos / PCACHE_PAGE_SIZE;
+        uint32_t page_off = pos % PCACHE_PAGE_SIZE;
+        uint32_t n = PCACHE_PAGE_SIZE - page_off;
+        if (n > size - done) n = size - done;
+
+        pcache_page_t *page = pcache_lookup(node->fs, node->inode, index);
+        if (page) {
+            stats.hits++;
+        } else {
+            // The pages this read still needs plus the window, stopping
+            // short of anything already cached
+            uint32_t needed = last - index + 1;
+            uint32_t want = needed + window;
+            if (want > PCACHE_RA_MAX) want = PCACHE_RA_MAX;
+
+            uint32_t count = 1;
+            while (count < want && !pcache_lookup(node->fs, node->inode, index + count)) count++;
+
+            stats.misses += count < needed ? count : needed;
+            if (count > needed) stats.readahead += count - needed;
+
+            if (pcache_fill(node, index, count) != 0) break;
+
+            page = pcache_lookup(node->fs, node->inode, index);
+            if (!page) {
+                // Every page is pinned: serve this piece uncached
+                int got = node->ops->read(node, buffer + done, n, pos);
+                if (got <= 0) break;
+                done += got;
+                continue;
+            }
+        }
+
+        pcache_touch(page);
+        copy_bytes(buffer + done, page->data + page_off, n);
+        done += n;
+    }
+
+    if (ra) ra->next = offset + done;
+    pcache_unlock();
+    return done ? (int)done : -1;
+}
+
+void pcache_write(vfs_node_t *node, const uint8_t *buffer, uint32_t size, uint32_t offset) {
+    if (!pages || node->type != FILE_TYPE_REGULAR || size == 0) return;
+
+    pcache_lock();
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t page_off = pos % PCACHE_PAGE_SIZE;
+        uint32_t n = PCACHE_PAGE_SIZE - page_off;
+        if (n > size - done) n = size - done;
+
+        pcache_page_t *page = pcache_lookup(node->fs, node->inode, pos / PCACHE_PAGE_SIZE);
+        if (page) copy_bytes(page->data + page_off, buffer + done, n);
+
+        done += n;
+    }
+    pcache_unlock();
+}
+
+
+pcache_page_t* pcache_get_page(vfs_node_t *node, uint32_t index) {
+    if (!pages || node->type != FILE_TYPE_REGULAR || (node->fs && (node->fs->flags & FS_FLAG_RAM))) {
+        return NULL;
+    }
+    if (index >= (node->size + PCACHE_PAGE_SIZE - 1) / PCACHE_PAGE_SIZE) return NULL;
+
+    pcache_lock();
+
+    pcache_page_t *page = pcache_lookup(node->fs, node->inode, index);
+    if (page) {
+        stats.hits++;
+    } else {
+        stats.misses++;
+        if (pcache_fill(node, index, 1) == 0) {
+            page = pcache_lookup(node->fs, node->inode, index);
+        }
+    }
+
+    if (page) {
+        __sync_fetch_and_add(&page->refcount, 1);
+        pcache_touch(page);
+    }
+
+    pcache_unlock();
+    return page;
+}
+
+// No lock: pipes drop their pins with interrupts off, and eviction only
+// needs to see the count reach zero
+void pcache_put_page(pcache_page_t *page) {
+    if (page) __sync_fetch_and_sub(&page->refcount, 1);
+}
+
+// Pinned pages are dropped from the index but stay mapped until put
+void pcache_invalidate(filesystem_t *fs, uint32_t inode) {
+    if (!pages) return;
+
+    pcache_lock();
+    for (int i = 0; i < PCACHE_PAGES; i++) {
+        pcache_page_t *page = &pages[i];
+        if ((page->flags & PCACHE_VALID) && page->fs == fs && page->inode == inode) {
+            pcache_unhash(page);
+        }
+    }
+    pcache_unlock();
+}
+
+void pcache_invalidate_fs(filesystem_t *fs) {
+    if (!pages) return;
+
+    pcache_lock();
+    for (int i = 0; i < PCACHE_PAGES; i++) {
+        if ((pages[i].flags & PCACHE_VALID) && pages[i].fs == fs) {
+            pcache_unhash(&pages[i]);
+        }
+    }
+    pcache_unlock();
+}
+
+
+void pcache_get_stats(pcache_stats_t *out) {
+    pcache_lock();
+    *out = stats;
+    pcache_unlock();
+}
+
+void pcache_print_stats(void) {
+    pcache_stats_t s;
+    pcache_get_stats(&s);
+
+    uint64_t lookups = s.hits + s.misses;
+    uint64_t hit_pct = lookups ? (s.hits * 100) / lookups : 0;
+
+    PRINT(CYAN, BLACK, "\n=== Page Cache ===\n");
+    PRINT(WHITE, BLACK, "Pages: %u cached, %d total\n", s.cached, PCACHE_PAGES);
+    PRINT(WHITE, BLACK, "Lookups: %llu hits, %llu misses (%llu%% hit ratio)\n", s.hits, s.misses, hit_pct);
+    PRINT(WHITE, BLACK, "Readahead: %llu pages in %llu fills\n", s.readahead, s.fills);
+    PRINT(WHITE, BLACK, "Evictions: %llu\n", s.evictions);
+}
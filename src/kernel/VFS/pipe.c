@@ -0,0 +1,249 @@
+#include "pipe.h"
+#include "irq.h"
+#include "memory.h"
+#include "pagecache.h"
+
+static int pipe_end_read(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset);
+static int pipe_end_write(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset);
+static int pipe_end_close_reader(vfs_node_t *node);
+static int pipe_end_close_writer(vfs_node_t *node);
+
+static vfs_operations_t pipe_read_ops = {
+    .read = pipe_end_read,
+    .close = pipe_end_close_reader
+};
+
+static vfs_operations_t pipe_write_ops = {
+    .write = pipe_end_write,
+    .close = pipe_end_close_writer
+};
+
+
+static void copy_bytes(uint8_t *dst, const uint8_t *src, uint32_t n) {
+    if ((((uint64_t)dst | (uint64_t)src) & 7) == 0) {
+        while (n >= 8) {
+            *(uint64_t*)dst = *(const uint64_t*)src;
+            dst += 8;
+            src += 8;
+            n -= 8;
+        }
+    }
+    while (n--) *dst++ = *src++;
+}
+
+// Hand a drained slot's page back: a spliced one to the page cache, the
+// pipe's own to the spare or the allocator
+static void release_slot(pipe_t *pipe, pipe_slot_t *slot) {
+    if (slot->cached) {
+        pcache_put_page(slot->cached);
+    } else if (!pipe->spare) {
+        pipe->spare = slot->data;
+    } else {
+        pmm_free_page(slot->data);
+    }
+    slot->data = NULL;
+    slot->cached = NULL;
+}
+
+static void pipe_free(pipe_t *pipe) {
+    while (pipe->tail != pipe->head) {
+        release_slot(pipe, &pipe->slots[pipe->tail % PIPE_SLOTS]);
+        pipe->tail++;
+    }
+    if (pipe->spare) pmm_free_page(pipe->spare);
+    kfree(pipe);
+}
+
+// Sleep on wq with interrupts saved off in *flags, and save them off
+// again on wakeup. -1 if the caller cannot sleep.
+static int pipe_wait(wait_queue_t *wq, uint64_t *flags) {
+    if (wait_queue_sleep(wq) != 0) return -1;
+    *flags = irq_save();
+    return 0;
+}
+
+
+pipe_t* pipe_create(void) {
+    pipe_t *pipe = (pipe_t*)kcalloc(1, sizeof(pipe_t));
+    if (!pipe) return NULL;
+
+    pipe->readers = 1;
+    pipe->writers = 1;
+    wait_queue_init(&pipe->read_wait);
+    wait_queue_init(&pipe->write_wait);
+    return pipe;
+}
+
+void pipe_close_reader(pipe_t *pipe) {
+    uint64_t flags = irq_save();
+    int last = --pipe->readers == 0 && pipe->writers == 0;
+    irq_restore(flags);
+
+    // A writer blocked on a full pipe gets its error
+    wait_queue_wake(&pipe->write_wait);
+    if (last) pipe_free(pipe);
+}
+
+void pipe_close_writer(pipe_t *pipe) {
+    uint64_t flags = irq_save();
+    int last = --pipe->writers == 0 && pipe->readers == 0;
+    irq_restore(flags);
+
+    // A reader blocked on an empty pipe gets end of file
+    wait_queue_wake(&pipe->read_wait);
+    if (last) pipe_free(pipe);
+}
+
+
+int pipe_read(pipe_t *pipe, uint8_t *buffer, uint32_t size) {
+    if (size == 0) return 0;
+
+    uint64_t flags = irq_save();
+
+    while (pipe->tail == pipe->head) {
+        if (!pipe->writers) {
+            irq_restore(flags);
+            return 0;
+        }
+        if (pipe_wait(&pipe->read_wait, &flags) != 0) {
+            irq_restore(flags);
+            return -1;
+        }
+    }
+
+    uint32_t done = 0;
+    while (done < size && pipe->tail != pipe->head) {
+        pipe_slot_t *slot = &pipe->slots[pipe->tail % PIPE_SLOTS];
+
+        uint32_t n = slot->end - slot->start;
+        if (n > size - done) n = size - done;
+
+        copy_bytes(buffer + done, slot->data + slot->start, n);
+        slot->start += n;
+        done += n;
+
+        if (slot->start == slot->end) {
+            release_slot(pipe, slot);
+            pipe->tail++;
+        }
+    }
+
+    irq_restore(flags);
+
+    wait_queue_wake(&pipe->write_wait);
+    return (int)done;
+}
+
+int pipe_write(pipe_t *pipe, const uint8_t *buffer, uint32_t size) {
+    uint32_t done = 0;
+    uint64_t flags = irq_save();
+
+    while (done < size && pipe->readers) {
+        // Top up the newest slot while it is one of ours with room left
+        pipe_slot_t *slot = NULL;
+        if (pipe->head != pipe->tail) {
+            pipe_slot_t *last = &pipe->slots[(pipe->head - 1) % PIPE_SLOTS];
+            if (!last->cached && last->end < PIPE_PAGE_SIZE) slot = last;
+        }
+
+        if (!slot) {
+            if (pipe->head - pipe->tail == PIPE_SLOTS) {
+                wait_queue_wake(&pipe->read_wait);
+                if (pipe_wait(&pipe->write_wait, &flags) != 0) break;
+                continue;
+            }
+
+            uint8_t *page = pipe->spare;
+            pipe->spare = NULL;
+            if (!page) page = (uint8_t*)pmm_alloc_page();
+            if (!page) break;
+
+            slot = &pipe->slots[pipe->head % PIPE_SLOTS];
+            slot->data = page;
+            slot->cached = NULL;
+            slot->start = 0;
+            slot->end = 0;
+            pipe->head++;
+        }
+
+        uint32_t n = PIPE_PAGE_SIZE - slot->end;
+        if (n > size - done) n = size - done;
+
+        copy_bytes(slot->data + slot->end, buffer + done, n);
+        slot->end += n;
+        done += n;
+        pipe->bytes_copied += n;
+    }
+
+    int readers = pipe->readers;
+    irq_restore(flags);
+
+    wait_queue_wake(&pipe->read_wait);
+    if (!readers) return -1;
+    return (int)done;
+}
+
+int pipe_splice_page(pipe_t *pipe, pcache_page_t *page, uint32_t offset, uint32_t len) {
+    uint64_t flags = irq_save();
+
+    while (pipe->readers && pipe->head - pipe->tail == PIPE_SLOTS) {
+        if (pipe_wait(&pipe->write_wait, &flags) != 0) {
+            irq_restore(flags);
+            return -1;
+        }
+    }
+    if (!pipe->readers) {
+        irq_restore(flags);
+        return -1;
+    }
+
+    pipe_slot_t *slot = &pipe->slots[pipe->head % PIPE_SLOTS];
+    slot->data = page->data;
+    slot->cached = page;
+    slot->start = offset;
+    slot->end = offset + len;
+    pipe->head++;
+    pipe->bytes_spliced += len;
+
+    irq_restore(flags);
+
+    wait_queue_wake(&pipe->read_wait);
+    return (int)len;
+}
+
+
+vfs_node_t* pipe_open_end(pipe_t *pipe, int write_end) {
+    vfs_node_t *node = (vfs_node_t*)kcalloc(1, sizeof(vfs_node_t));
+    if (!node) return NULL;
+
+    const char *name = write_end ? "pipe:w" : "pipe:r";
+    for (int i = 0; name[i]; i++) {
+        node->name[i] = name[i];
+    }
+    node->type = FILE_TYPE_PIPE;
+    node->ops = write_end ? &pipe_write_ops : &pipe_read_ops;
+    node->private_data = pipe;
+    return node;
+}
+
+static int pipe_end_read(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset) {
+    (void)offset;
+    return pipe_read((pipe_t*)node->private_data, buffer, size);
+}
+
+static int pipe_end_write(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset) {
+    (void)offset;
+    return pipe_write((pipe_t*)node->private_data, buffer, size);
+}
+
+static int pipe_end_close_reader(vfs_node_t *node) {
+    pipe_close_reader((pipe_t*)node->private_data);
+    kfree(node);
+    return 0;
+}
+
+static int pipe_end_close_writer(vfs_node_t *node) {
+    pipe_close_writer((pipe_t*)node->private_data);
+    kfree(node);
+    return 0;
+}
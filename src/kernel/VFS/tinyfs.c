@@ -1,7 +1,11 @@
 #include "tinyfs.h"
 #include "ata.h"
+#include "bcache.h"
+#include "blkdev.h"
+#include "irq.h"
 #include "memory.h"
 #include "print.h"
+#include "process.h"
 #include "vfs.h"
 #include "string_helpers.h"
 
@@ -11,12 +15,15 @@ static int tinyfs_mount(filesystem_t *fs, const char *device);
 static int tinyfs_unmount(filesystem_t *fs);
 static vfs_node_t* tinyfs_get_root(filesystem_t *fs);
 static int tinyfs_get_stats(filesystem_t *fs, fs_stats_t *stats);
+static int tinyfs_sync(filesystem_t *fs);
 
 static int tinyfs_open(vfs_node_t *node, uint32_t flags);
 static int tinyfs_close(vfs_node_t *node);
 static int tinyfs_read(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset);
 static int tinyfs_write(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset);
+static int64_t tinyfs_writev(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, uint64_t offset);
 static vfs_node_t* tinyfs_readdir(vfs_node_t *node, uint32_t index);
+static vfs_node_t* tinyfs_readdir_next(vfs_node_t *node, uint32_t *cookie);
 static vfs_node_t* tinyfs_finddir(vfs_node_t *node, const char *name);
 static int tinyfs_create_node(vfs_node_t *parent, const char *name, uint8_t type, uint32_t permissions);
 static int tinyfs_unlink(vfs_node_t *parent, const char *name);
@@ -25,7 +32,8 @@ static filesystem_operations_t tinyfs_fs_ops = {
     .mount = tinyfs_mount,
     .unmount = tinyfs_unmount,
     .get_root = tinyfs_get_root,
-    .get_stats = tinyfs_get_stats
+    .get_stats = tinyfs_get_stats,
+    .sync = tinyfs_sync
 };
 
 static vfs_operations_t tinyfs_vfs_ops = {
@@ -33,12 +41,35 @@ static vfs_operations_t tinyfs_vfs_ops = {
     .close = tinyfs_close,
     .read = tinyfs_read,
     .write = tinyfs_write,
+    .writev = tinyfs_writev,
     .readdir = tinyfs_readdir,
+    .readdir_next = tinyfs_readdir_next,
     .finddir = tinyfs_finddir,
     .create = tinyfs_create_node,
     .unlink = tinyfs_unlink
 };
 
+// Operations and the commit thread take turns on the metadata; holders do
+// disk I/O, so it yields rather than spins
+static volatile int tinyfs_busy = 0;
+static list_head_t mounted = LIST_HEAD_INIT(mounted);
+static int commit_tid = -1;
+
+static tinyfs_journal_stats_t jstats = {
+    .interval_ms = TINYFS_COMMIT_INTERVAL,
+    .max_blocks = TINYFS_COMMIT_BLOCKS
+};
+
+static void tinyfs_lock(void) {
+    while (__sync_lock_test_and_set(&tinyfs_busy, 1)) {
+        thread_yield();
+    }
+}
+
+static void tinyfs_unlock(void) {
+    __sync_lock_release(&tinyfs_busy);
+}
+
 static void strcpy_safe(char *dest, const char *src, int max_len) {
     int i;
     for (i = 0; i < max_len - 1 && src[i]; i++) {
@@ -56,20 +87,62 @@ static int strcmp_safe(const char *s1, const char *s2) {
 }
 
 
+static int read_blocks(tinyfs_data_t *data, uint32_t block, uint32_t count, uint8_t *buffer) {
+    return bcache_read(data->dev, block * data->sectors_per_block,
+                       count * data->sectors_per_block, buffer);
+}
+
+static int write_blocks(tinyfs_data_t *data, uint32_t block, uint32_t count, const uint8_t *buffer) {
+    return bcache_write(data->dev, block * data->sectors_per_block,
+                        count * data->sectors_per_block, buffer);
+}
+
+
+static int block_used(tinyfs_data_t *data, uint32_t block) {
+    return (data->bitmap[block / 8] >> (block % 8)) & 1;
+}
+
+static void mark_map_dirty(tinyfs_data_t *data, uint32_t block) {
+    uint32_t map_block = block / (data->block_size * 8);
+    data->map_dirty[map_block / 32] |= 1U << (map_block % 32);
+}
+
+static void set_block(tinyfs_data_t *data, uint32_t block, int used) {
+    if (used) {
+        data->bitmap[block / 8] |= 1 << (block % 8);
+    } else {
+        data->bitmap[block / 8] &= ~(1 << (block % 8));
+    }
+    mark_map_dirty(data, block);
+}
+
+static void mark_dirent_dirty(tinyfs_data_t *data, uint32_t idx) {
+    uint32_t block = idx / data->dirents_per_block;
+    data->dir_dirty[block / 32] |= 1U << (block % 32);
+}
+
+static void mark_all_dirty(tinyfs_data_t *data) {
+    data->sb_dirty = 1;
+    for (uint32_t i = 0; i < data->sb.map_blocks; i++) {
+        data->map_dirty[i / 32] |= 1U << (i % 32);
+    }
+    for (uint32_t i = 0; i < data->sb.dir_blocks; i++) {
+        data->dir_dirty[i / 32] |= 1U << (i % 32);
+    }
+}
+
+
 static int write_superblock(tinyfs_data_t *data) {
-    uint8_t buffer[TINYFS_BLOCK_SIZE];
+    uint8_t buffer[TINYFS_SECTOR_SIZE];
 
-    for (int i = 0; i < TINYFS_BLOCK_SIZE; i++) {
+    for (int i = 0; i < TINYFS_SECTOR_SIZE; i++) {
         buffer[i] = 0;
     }
 
     tinyfs_superblock_t *sb = (tinyfs_superblock_t*)buffer;
     *sb = data->sb;
 
-    PRINT(WHITE, BLACK, "[TINYFS] Writing superblock (free_blocks=%u)...\n", sb->free_blocks);
-
-    int result = ata_write_sectors(0, 1, buffer);
-    if (result != 0) {
+    if (bcache_write(data->dev, 0, 1, buffer) != 0) {
         PRINT(YELLOW, BLACK, "[TINYFS] Failed to write superblock\n");
         return -1;
     }
@@ -77,90 +150,228 @@ static int write_superblock(tinyfs_data_t *data) {
     return 0;
 }
 
-static int write_fat(tinyfs_data_t *data) {
-    uint8_t buffer[TINYFS_BLOCK_SIZE];
-    int entries_per_block = TINYFS_BLOCK_SIZE / sizeof(uint32_t);
-
-    PRINT(WHITE, BLACK, "[TINYFS] Writing FAT...\n");
-
-    for (int i = 0; i < 10; i++) {
-        for (int k = 0; k < TINYFS_BLOCK_SIZE; k++) {
-            buffer[k] = 0;
+// The bitmap and directory are kept in memory exactly as on disk, so runs
+// of dirty blocks go straight from there
+static int write_region(tinyfs_data_t *data, uint32_t start, uint32_t blocks,
+                        const uint8_t *mem, uint32_t *dirty) {
+    uint32_t i = 0;
+    while (i < blocks) {
+        if (i % 32 == 0 && dirty[i / 32] == 0) {
+            i += 32;
+            continue;
         }
-
-        for (int j = 0; j < entries_per_block; j++) {
-            int idx = i * entries_per_block + j;
-            if (idx < 1024) {
-                ((uint32_t*)buffer)[j] = data->fat[idx];
-            }
+        if (!(dirty[i / 32] & (1U << (i % 32)))) {
+            i++;
+            continue;
         }
 
-        if (ata_write_sectors(data->sb.fat_start + i, 1, buffer) != 0) {
-            PRINT(YELLOW, BLACK, "[TINYFS] Failed to write FAT block %d\n", i);
+        uint32_t run = 1;
+        while (i + run < blocks && (dirty[(i + run) / 32] & (1U << ((i + run) % 32)))) run++;
+
+        if (write_blocks(data, start + i, run, mem + i * data->block_size) != 0) {
+            PRINT(YELLOW, BLACK, "[TINYFS] Failed to write metadata block %u\n", start + i);
             return -1;
         }
+
+        for (uint32_t j = i; j < i + run; j++) {
+            dirty[j / 32] &= ~(1U << (j % 32));
+        }
+        i += run;
     }
 
-    PRINT(MAGENTA, BLACK, "[TINYFS] FAT written successfully\n");
     return 0;
 }
 
-static int write_directory(tinyfs_data_t *data) {
-    uint8_t buffer[TINYFS_BLOCK_SIZE];
-    int entries_per_block = TINYFS_BLOCK_SIZE / sizeof(tinyfs_dirent_t);
+// Push changed metadata blocks into the buffer cache. That is only memory
+// copies; the cache's flusher coalesces them onto the disk after
+// BCACHE_DIRTY_EXPIRE, or sooner on sync.
+static int tinyfs_writeback(tinyfs_data_t *data) {
+    int result = 0;
 
-    PRINT(WHITE, BLACK, "[TINYFS] Writing directory (90 blocks)...\n");
+    if (write_region(data, data->sb.dir_start, data->sb.dir_blocks,
+                     (const uint8_t*)data->dirents, data->dir_dirty) != 0) {
+        result = -1;
+    }
+    if (write_region(data, data->sb.map_start, data->sb.map_blocks,
+                     data->bitmap, data->map_dirty) != 0) {
+        result = -1;
+    }
 
-    for (int i = 0; i < 90; i++) {
-        for (int k = 0; k < TINYFS_BLOCK_SIZE; k++) {
-            buffer[k] = 0;
+    if (data->sb_dirty) {
+        if (write_superblock(data) == 0) {
+            data->sb_dirty = 0;
+        } else {
+            result = -1;
         }
+    }
 
-        for (int j = 0; j < entries_per_block; j++) {
-            int idx = i * entries_per_block + j;
-            if (idx < TINYFS_MAX_FILES) {
-                ((tinyfs_dirent_t*)buffer)[j] = data->dirents[idx];
-            }
+    return result;
+}
+
+
+// Next-fit: look from the cursor for a free run of `want` blocks, wrapping
+// once. Settles for the longest run seen when none is that long.
+static uint32_t find_free_run(tinyfs_data_t *data, uint32_t want, uint32_t *len) {
+    uint32_t total = data->sb.total_blocks;
+    uint32_t span = total - data->sb.data_start;
+    uint32_t best_start = 0;
+    uint32_t best_len = 0;
+    uint32_t scanned = 0;
+    uint32_t b = data->alloc_cursor;
+
+    while (scanned < span && best_len < want) {
+        if (b >= total) b = data->sb.data_start;
+
+        // Skip fully allocated bytes without testing each bit
+        if (b % 8 == 0 && b + 8 <= total && data->bitmap[b / 8] == 0xFF) {
+            b += 8;
+            scanned += 8;
+            continue;
         }
+        if (block_used(data, b)) {
+            b++;
+            scanned++;
+            continue;
+        }
+
+        uint32_t start = b;
+        while (b < total && !block_used(data, b) && b - start < want) b++;
+        scanned += b - start;
+        if (b - start > best_len) {
+            best_start = start;
+            best_len = b - start;
+        }
+    }
 
-        if (ata_write_sectors(data->sb.dir_start + i, 1, buffer) != 0) {
-            PRINT(YELLOW, BLACK, "[TINYFS] Failed to write dir block %d\n", i);
+    *len = best_len;
+    return best_start;
+}
+
+// Allocate up to `want` contiguous blocks, growing in place at `goal` when
+// it is free, else from the next-fit search
+static int allocate_run(tinyfs_data_t *data, uint32_t goal, uint32_t want, uint32_t *got) {
+    uint32_t total = data->sb.total_blocks;
+    uint32_t start = goal;
+
+    if (goal < data->sb.data_start || goal >= total || block_used(data, goal)) {
+        uint32_t len;
+        start = find_free_run(data, want, &len);
+        if (len == 0) {
+            PRINT(YELLOW, BLACK, "[TINYFS] No free blocks available\n");
             return -1;
         }
     }
 
-    PRINT(MAGENTA, BLACK, "[TINYFS] Directory written successfully\n");
-    return 0;
+    uint32_t n = 0;
+    while (n < want && start + n < total && !block_used(data, start + n)) {
+        set_block(data, start + n, 1);
+        n++;
+    }
+
+    data->alloc_cursor = start + n;
+    data->sb.free_blocks -= n;
+    data->sb_dirty = 1;
+    *got = n;
+    return (int)start;
 }
 
+static void free_run(tinyfs_data_t *data, uint32_t start, uint32_t length) {
+    for (uint32_t b = start; b < start + length; b++) {
+        set_block(data, b, 0);
+    }
+    data->sb.free_blocks += length;
+    data->sb_dirty = 1;
+}
 
-static int allocate_block(tinyfs_data_t *data) {
-    for (int i = data->sb.data_start; i < data->sb.total_blocks; i++) {
-        if (data->fat[i] == 0) {
-            data->fat[i] = EOF;
-            data->sb.free_blocks--;
-            PRINT(MAGENTA, BLACK, "[TINYFS] Allocated block %d (free_blocks=%u)\n",
-                   i, data->sb.free_blocks);
-            return i;
+static void journal_make_room(tinyfs_data_t *data);
+
+// Bitmap bits, and so the blocks, one allocation or free step may cover:
+// a step dirties at most two bitmap blocks
+static uint32_t step_blocks(tinyfs_data_t *data) {
+    return data->block_size * 8;
+}
+
+// Free a removed file's extents a step at a time, committing between steps
+// when the transaction fills up
+static void free_extents(tinyfs_data_t *data, const tinyfs_extent_t *extents, uint32_t count) {
+    uint32_t step = step_blocks(data);
+
+    for (uint32_t e = 0; e < count; e++) {
+        for (uint32_t done = 0; done < extents[e].length; done += step) {
+            uint32_t n = extents[e].length - done;
+            if (n > step) n = step;
+
+            free_run(data, extents[e].start + done, n);
+            journal_make_room(data);
         }
     }
-    PRINT(YELLOW, BLACK, "[TINYFS] No free blocks available\n");
-    return -1;
 }
 
-static void free_block_chain(tinyfs_data_t *data, uint32_t first_block) {
-    uint32_t current = first_block;
+static uint32_t file_blocks(const tinyfs_dirent_t *dirent) {
+    if (dirent->nextents == 0) return 0;
+    const tinyfs_extent_t *last = &dirent->extents[dirent->nextents - 1];
+    return last->logical + last->length;
+}
+
+// Binary search for the extent holding file block `fblock`. Returns the
+// physical block and how many blocks follow it contiguously, 0 if unmapped.
+static uint32_t extent_map(const tinyfs_dirent_t *dirent, uint32_t fblock, uint32_t *pblock) {
+    int lo = 0;
+    int hi = (int)dirent->nextents - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const tinyfs_extent_t *ext = &dirent->extents[mid];
+
+        if (fblock < ext->logical) {
+            hi = mid - 1;
+        } else if (fblock >= ext->logical + ext->length) {
+            lo = mid + 1;
+        } else {
+            *pblock = ext->start + (fblock - ext->logical);
+            return ext->length - (fblock - ext->logical);
+        }
+    }
+    return 0;
+}
+
+// Grow the file's allocation to `blocks`, extending the last extent when
+// the blocks after it are free
+static int file_extend(tinyfs_data_t *data, tinyfs_dirent_t *dirent, uint32_t idx, uint32_t blocks) {
+    uint32_t have = file_blocks(dirent);
+
+    while (have < blocks) {
+        tinyfs_extent_t *last = dirent->nextents ? &dirent->extents[dirent->nextents - 1] : NULL;
+        uint32_t goal = last ? last->start + last->length : data->alloc_cursor;
+        uint32_t got;
+        uint32_t want = blocks - have;
+        if (want > step_blocks(data)) want = step_blocks(data);
+
+        int start = allocate_run(data, goal, want, &got);
+        if (start < 0) return -1;
+
+        if (last && last->start + last->length == (uint32_t)start) {
+            last->length += got;
+        } else if (dirent->nextents < TINYFS_EXTENTS) {
+            tinyfs_extent_t *ext = &dirent->extents[dirent->nextents++];
+            ext->logical = have;
+            ext->start = (uint32_t)start;
+            ext->length = got;
+        } else {
+            free_run(data, (uint32_t)start, got);
+            PRINT(YELLOW, BLACK, "[TINYFS] '%s' is too fragmented to grow\n", dirent->name);
+            return -1;
+        }
 
-    while (current != EOF && current != 0) {
-        uint32_t next = data->fat[current];
-        data->fat[current] = 0;
-        data->sb.free_blocks++;
-        current = next;
+        have += got;
+        mark_dirent_dirty(data, idx);
+        journal_make_room(data);
     }
+    return 0;
 }
 
 static int find_free_dirent(tinyfs_data_t *data) {
-    for (int i = 1; i < TINYFS_MAX_FILES; i++) {
+    for (uint32_t i = 1; i < data->sb.max_files; i++) {
         if (!data->dirents[i].used) {
             return i;
         }
@@ -169,74 +380,848 @@ static int find_free_dirent(tinyfs_data_t *data) {
 }
 
 
+static uint32_t name_hash(uint32_t parent, const char *name) {
+    uint32_t h = 2166136261U ^ parent;
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static int index_lookup(tinyfs_data_t *data, uint32_t parent, const char *name) {
+    list_head_t *bucket = &data->hash[name_hash(parent, name) & data->hash_mask];
+    tinyfs_inode_t *ino;
+
+    list_for_each_entry(ino, bucket, tinyfs_inode_t, hash_link) {
+        uint32_t idx = (uint32_t)(ino - data->inodes);
+        if (data->dirents[idx].parent_inode == parent &&
+            strcmp_safe(data->dirents[idx].name, name) == 0) {
+            return (int)idx;
+        }
+    }
+    return -1;
+}
+
+static void index_add(tinyfs_data_t *data, uint32_t idx) {
+    tinyfs_dirent_t *dirent = &data->dirents[idx];
+    tinyfs_inode_t *ino = &data->inodes[idx];
+
+    list_add(&ino->hash_link,
+             &data->hash[name_hash(dirent->parent_inode, dirent->name) & data->hash_mask]);
+    list_add_tail(&ino->sibling_link, &data->inodes[dirent->parent_inode].children);
+}
+
+static void index_del(tinyfs_data_t *data, uint32_t idx) {
+    list_del(&data->inodes[idx].hash_link);
+    list_del(&data->inodes[idx].sibling_link);
+}
+
+static int valid_parent(tinyfs_data_t *data, uint32_t idx) {
+    uint32_t parent = data->dirents[idx].parent_inode;
+
+    if (parent == 0) return 1;
+    if (parent == idx || parent >= data->sb.max_files) return 0;
+    return data->dirents[parent].used && data->dirents[parent].is_directory;
+}
+
+// Hash every live entry by (parent, name) and thread it onto its parent's
+// children list. Entries whose parent is gone stay out of the index.
+static int build_index(tinyfs_data_t *data) {
+    uint32_t max_files = data->sb.max_files;
+    uint32_t buckets = 1;
+    while (buckets < max_files) buckets <<= 1;
+
+    data->hash = (list_head_t*)kmalloc(buckets * sizeof(list_head_t));
+    data->inodes = (tinyfs_inode_t*)kmalloc(max_files * sizeof(tinyfs_inode_t));
+    if (!data->hash || !data->inodes) return -1;
+
+    data->hash_mask = buckets - 1;
+    for (uint32_t i = 0; i < buckets; i++) {
+        list_init(&data->hash[i]);
+    }
+
+    for (uint32_t i = 0; i < max_files; i++) {
+        list_init(&data->inodes[i].hash_link);
+        list_init(&data->inodes[i].sibling_link);
+        list_init(&data->inodes[i].children);
+        data->inodes[i].node = NULL;
+        data->inodes[i].opens = 0;
+    }
+
+    uint32_t orphans = 0;
+    for (uint32_t i = 1; i < max_files; i++) {
+        if (!data->dirents[i].used) continue;
+
+        if (valid_parent(data, i)) {
+            index_add(data, i);
+        } else {
+            orphans++;
+        }
+    }
+
+    if (orphans) {
+        PRINT(YELLOW, BLACK, "[TINYFS] %u entries have no parent directory\n", orphans);
+    }
+    return 0;
+}
+
+// One node per entry, allocated on first lookup and kept until the entry
+// is removed or the filesystem unmounted
+static vfs_node_t* get_node(filesystem_t *fs, tinyfs_data_t *data, uint32_t idx) {
+    tinyfs_inode_t *ino = &data->inodes[idx];
+    tinyfs_dirent_t *dirent = &data->dirents[idx];
+
+    if (!ino->node) {
+        vfs_node_t *node = (vfs_node_t*)kmalloc(sizeof(vfs_node_t));
+        if (!node) return NULL;
+
+        strcpy_safe(node->name, dirent->name, MAX_FILENAME);
+        node->type = dirent->is_directory ? FILE_TYPE_DIRECTORY : FILE_TYPE_REGULAR;
+        node->permissions = FILE_READ | FILE_WRITE;
+        node->inode = idx;
+        node->fs = fs;
+        node->ops = &tinyfs_vfs_ops;
+        node->private_data = dirent;
+        ino->node = node;
+    }
+
+    ino->node->size = dirent->size;
+    return ino->node;
+}
+
+
+// Lay the volume out for the device: a block of superblock, one bitmap bit
+// per block, a directory with an entry per TINYFS_BLOCKS_PER_FILE blocks
+// and, when the device can spare it, the metadata journal
 int tinyfs_format(const char *device) {
     PRINT(WHITE, BLACK, "[TINYFS] Formatting disk...\n");
 
-    uint8_t buffer[TINYFS_BLOCK_SIZE];
+    int dev = blkdev_lookup(device);
+    if (dev < 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] No block device %s\n", device);
+        return -1;
+    }
+
+    // The buffer cache addresses sectors with 32 bits
+    uint64_t sectors = blkdev_get(dev)->sectors;
+    if (sectors > 0xFFFFFFFFULL) sectors = 0xFFFFFFFFULL;
+
+    uint32_t block_size = TINYFS_BLOCK_SIZE;
+    uint32_t spb = block_size / TINYFS_SECTOR_SIZE;
+    uint32_t total = (uint32_t)(sectors / spb);
+
+    uint32_t max_files = total / TINYFS_BLOCKS_PER_FILE;
+    if (max_files < TINYFS_MIN_FILES) max_files = TINYFS_MIN_FILES;
+    if (max_files > TINYFS_MAX_FILES) max_files = TINYFS_MAX_FILES;
 
-    for (int i = 0; i < TINYFS_BLOCK_SIZE; i++) {
+    uint32_t per_block = block_size / sizeof(tinyfs_dirent_t);
+    uint32_t map_blocks = (total + block_size * 8 - 1) / (block_size * 8);
+    uint32_t dir_blocks = (max_files + per_block - 1) / per_block;
+    uint32_t journal_start = 1 + map_blocks + dir_blocks;
+    uint32_t journal_blocks = 0;
+    if (total >= journal_start + 4 * TINYFS_JOURNAL_BLOCKS) journal_blocks = TINYFS_JOURNAL_BLOCKS;
+    uint32_t data_start = journal_start + journal_blocks;
+
+    if (total < data_start + TINYFS_BLOCKS_PER_FILE) {
+        PRINT(YELLOW, BLACK, "[TINYFS] %s is too small (%u blocks)\n", device, total);
+        return -1;
+    }
+
+    uint8_t *buffer = (uint8_t*)kmalloc(block_size);
+    if (!buffer) {
+        PRINT(YELLOW, BLACK, "[TINYFS] Failed to allocate memory\n");
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < block_size; i++) {
         buffer[i] = 0;
     }
 
     tinyfs_superblock_t *sb = (tinyfs_superblock_t*)buffer;
-    sb->magic = TINYFS_MAGIC;
-    sb->total_blocks = 1024;
-    sb->fat_start = 1;
-    sb->dir_start = 11;
-    sb->data_start = 101;
-    sb->free_blocks = 1024 - 101;
+    sb->magic = TINYFS3_MAGIC;
+    sb->total_blocks = total;
+    sb->map_start = 1;
+    sb->dir_start = 1 + map_blocks;
+    sb->data_start = data_start;
+    sb->free_blocks = total - data_start;
+    sb->block_size = block_size;
+    sb->map_blocks = map_blocks;
+    sb->dir_blocks = dir_blocks;
+    sb->max_files = max_files;
+    if (journal_blocks) sb->journal_start = journal_start;
+    sb->journal_blocks = journal_blocks;
+
+    PRINT(WHITE, BLACK, "[TINYFS] %u blocks of %u bytes, %u files, %u journal blocks\n",
+          total, block_size, max_files, journal_blocks);
 
     PRINT(WHITE, BLACK, "[TINYFS] Writing superblock...\n");
-    if (ata_write_sectors(0, 1, buffer) != 0) {
+    if (bcache_write(dev, 0, spb, buffer) != 0) {
         PRINT(YELLOW, BLACK, "[TINYFS] Failed to write superblock\n");
+        kfree(buffer);
         return -1;
     }
 
-    PRINT(WHITE, BLACK, "[TINYFS] Writing FAT (10 blocks)...\n");
-    for (int i = 1; i <= 10; i++) {
-        for (int k = 0; k < TINYFS_BLOCK_SIZE; k++) {
-            buffer[k] = 0;
+    PRINT(WHITE, BLACK, "[TINYFS] Writing bitmap (%u blocks)...\n", map_blocks);
+    for (uint32_t i = 0; i < map_blocks; i++) {
+        for (uint32_t j = 0; j < block_size; j++) {
+            buffer[j] = 0;
         }
 
-        int entries_per_block = TINYFS_BLOCK_SIZE / sizeof(uint32_t);
-        for (int j = 0; j < entries_per_block; j++) {
-            uint32_t block_num = (i - 1) * entries_per_block + j;
-            if (block_num < 1024) {
-                if (block_num < 101) {
-                    ((uint32_t*)buffer)[j] = EOF;
-                } else {
-                    ((uint32_t*)buffer)[j] = 0;
-                }
-            }
+        // Metadata blocks are in use from the start
+        uint32_t first = i * block_size * 8;
+        for (uint32_t b = first; b < data_start && b < first + block_size * 8; b++) {
+            buffer[(b - first) / 8] |= 1 << (b % 8);
         }
 
-        if (ata_write_sectors(i, 1, buffer) != 0) {
-            PRINT(YELLOW, BLACK, "[TINYFS] Failed to write FAT block %d\n", i);
+        if (bcache_write(dev, (1 + i) * spb, spb, buffer) != 0) {
+            PRINT(YELLOW, BLACK, "[TINYFS] Failed to write bitmap block %u\n", i);
+            kfree(buffer);
             return -1;
         }
     }
 
-    PRINT(WHITE, BLACK, "[TINYFS] Clearing directory (90 blocks)...\n");
-    for (int i = 0; i < TINYFS_BLOCK_SIZE; i++) {
+    PRINT(WHITE, BLACK, "[TINYFS] Clearing directory (%u blocks)...\n", dir_blocks);
+    for (uint32_t i = 0; i < block_size; i++) {
         buffer[i] = 0;
     }
 
-    for (int i = 11; i <= 100; i++) {
-        if (ata_write_sectors(i, 1, buffer) != 0) {
-            PRINT(YELLOW, BLACK, "[TINYFS] Failed to write dir block %d\n", i);
+    for (uint32_t i = 0; i < dir_blocks; i++) {
+        if (bcache_write(dev, (1 + map_blocks + i) * spb, spb, buffer) != 0) {
+            PRINT(YELLOW, BLACK, "[TINYFS] Failed to write dir block %u\n", i);
+            kfree(buffer);
             return -1;
         }
     }
 
+    // An empty descriptor: nothing to replay
+    if (journal_blocks && bcache_write(dev, journal_start * spb, spb, buffer) != 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] Failed to clear journal\n");
+        kfree(buffer);
+        return -1;
+    }
+
+    kfree(buffer);
+
+    if (bcache_sync() != 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] Failed to flush format to disk\n");
+        return -1;
+    }
+
     PRINT(MAGENTA, BLACK, "[TINYFS] Format successful\n");
     return 0;
 }
 
 
+static void free_data(tinyfs_data_t *data) {
+    if (data->inodes) {
+        for (uint32_t i = 0; i < data->sb.max_files; i++) {
+            if (data->inodes[i].node) kfree(data->inodes[i].node);
+        }
+        kfree(data->inodes);
+    }
+    if (data->hash) kfree(data->hash);
+    if (data->bitmap) kfree(data->bitmap);
+    if (data->dirents) kfree(data->dirents);
+    if (data->scratch) kfree(data->scratch);
+    if (data->map_dirty) kfree(data->map_dirty);
+    if (data->dir_dirty) kfree(data->dir_dirty);
+    if (data->journal_buf) kfree(data->journal_buf);
+    kfree(data);
+}
+
+static void *kzalloc(uint32_t size) {
+    uint8_t *p = (uint8_t*)kmalloc(size);
+    if (p) {
+        for (uint32_t i = 0; i < size; i++) {
+            p[i] = 0;
+        }
+    }
+    return p;
+}
+
+// Allocate the in-memory regions once the superblock gives the geometry
+static int alloc_data(tinyfs_data_t *data) {
+    tinyfs_superblock_t *sb = &data->sb;
+
+    data->block_size = sb->block_size;
+    data->sectors_per_block = sb->block_size / TINYFS_SECTOR_SIZE;
+    data->dirents_per_block = sb->block_size / sizeof(tinyfs_dirent_t);
+    data->alloc_cursor = sb->data_start;
+
+    data->bitmap = (uint8_t*)kzalloc(sb->map_blocks * sb->block_size);
+    data->dirents = (tinyfs_dirent_t*)kzalloc(sb->dir_blocks * sb->block_size);
+    data->scratch = (uint8_t*)kmalloc(sb->block_size);
+    data->map_dirty = (uint32_t*)kzalloc(((sb->map_blocks + 31) / 32) * sizeof(uint32_t));
+    data->dir_dirty = (uint32_t*)kzalloc(((sb->dir_blocks + 31) / 32) * sizeof(uint32_t));
+
+    if (!data->bitmap || !data->dirents || !data->scratch ||
+        !data->map_dirty || !data->dir_dirty) {
+        return -1;
+    }
+
+    if (sb->journal_blocks) {
+        data->journal_buf = (uint8_t*)kmalloc(sb->block_size);
+        if (!data->journal_buf) return -1;
+    }
+    return 0;
+}
+
+// Sanity-check the geometry before sizing allocations from it
+static int check_geometry(const tinyfs_superblock_t *sb) {
+    uint32_t bs = sb->block_size;
+
+    if (bs < TINYFS_SECTOR_SIZE || bs > 65536 || (bs & (bs - 1)) != 0) return -1;
+    if (sb->max_files < 2 || sb->max_files > TINYFS_MAX_FILES) return -1;
+    if ((uint64_t)sb->map_blocks * bs * 8 < sb->total_blocks) return -1;
+    if ((uint64_t)sb->dir_blocks * (bs / sizeof(tinyfs_dirent_t)) < sb->max_files) return -1;
+    if (sb->dir_start < sb->map_start + sb->map_blocks) return -1;
+    if (sb->data_start < sb->dir_start + sb->dir_blocks) return -1;
+    if (sb->data_start >= sb->total_blocks) return -1;
+    if (sb->journal_blocks) {
+        if (sb->journal_blocks < 3) return -1;
+        if (sb->journal_start < sb->dir_start + sb->dir_blocks) return -1;
+        if (sb->data_start < sb->journal_start + sb->journal_blocks) return -1;
+    }
+    return 0;
+}
+
+
+// v1 directory: turn each FAT chain into extents
+static int upgrade_v1_dirents(tinyfs_data_t *data, const uint32_t *fat) {
+    uint8_t buffer[TINYFS_SECTOR_SIZE];
+    uint32_t per_sector = TINYFS_SECTOR_SIZE / sizeof(tinyfs_dirent_v1_t);
+
+    for (uint32_t i = 0; i < TINYFS_LEGACY_FILES; i++) {
+        uint32_t sector = i / per_sector;
+        if (i % per_sector == 0 &&
+            bcache_read(data->dev, data->sb.dir_start + sector, 1, buffer) != 0) {
+            PRINT(YELLOW, BLACK, "[TINYFS] Failed to read directory block %u\n", sector);
+            return -1;
+        }
+
+        tinyfs_dirent_v1_t *old = &((tinyfs_dirent_v1_t*)buffer)[i % per_sector];
+        tinyfs_dirent_t *dirent = &data->dirents[i];
+
+        strcpy_safe(dirent->name, old->name, TINYFS_MAX_FILENAME);
+        dirent->size = old->size;
+        dirent->parent_inode = old->parent_inode;
+        dirent->is_directory = old->is_directory;
+        dirent->used = old->used;
+        dirent->nextents = 0;
+
+        if (!old->used || old->first_block == 0) continue;
+
+        uint32_t block = old->first_block;
+        uint32_t logical = 0;
+        while (block != EOF && block != 0 && block < TINYFS_LEGACY_BLOCKS &&
+               logical < TINYFS_LEGACY_BLOCKS) {
+            tinyfs_extent_t *last = dirent->nextents ? &dirent->extents[dirent->nextents - 1] : NULL;
+            if (last && last->start + last->length == block) {
+                last->length++;
+            } else if (dirent->nextents < TINYFS_EXTENTS) {
+                tinyfs_extent_t *ext = &dirent->extents[dirent->nextents++];
+                ext->logical = logical;
+                ext->start = block;
+                ext->length = 1;
+            } else {
+                PRINT(YELLOW, BLACK, "[TINYFS] '%s' has more than %d fragments\n",
+                      dirent->name, TINYFS_EXTENTS);
+                return -1;
+            }
+
+            logical++;
+            block = fat[block];
+        }
+    }
+
+    return 0;
+}
+
+// v1 and v2 volumes keep their 512-byte geometry: the FAT or uint32_t map
+// becomes a bitmap in place and all metadata is rewritten as v3
+static int tinyfs_upgrade(tinyfs_data_t *data) {
+    uint32_t table_sectors = TINYFS_LEGACY_BLOCKS * sizeof(uint32_t) / TINYFS_SECTOR_SIZE;
+    uint32_t *table = (uint32_t*)kmalloc(TINYFS_LEGACY_BLOCKS * sizeof(uint32_t));
+    if (!table) return -1;
+
+    PRINT(WHITE, BLACK, "[TINYFS] Upgrading v%d volume...\n",
+          data->sb.magic == TINYFS_MAGIC ? 1 : 2);
+
+    if (read_blocks(data, data->sb.map_start, table_sectors, (uint8_t*)table) != 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] Failed to read block map\n");
+        kfree(table);
+        return -1;
+    }
+
+    int result;
+    if (data->sb.magic == TINYFS_MAGIC) {
+        result = upgrade_v1_dirents(data, table);
+    } else {
+        // v2 entries already have the current layout
+        result = read_blocks(data, data->sb.dir_start, data->sb.dir_blocks,
+                             (uint8_t*)data->dirents);
+    }
+
+    for (uint32_t b = 0; b < TINYFS_LEGACY_BLOCKS; b++) {
+        if (table[b]) data->bitmap[b / 8] |= 1 << (b % 8);
+    }
+    kfree(table);
+
+    if (result != 0) return -1;
+
+    data->sb.magic = TINYFS3_MAGIC;
+    mark_all_dirty(data);
+    return tinyfs_writeback(data);
+}
+
+
+// Read sector 0 of `dev` into `sb`, filling in the fixed geometry of v1
+// and v2 volumes. Fails unless it holds a tinyfs superblock that makes sense.
+static int read_superblock(uint32_t dev, tinyfs_superblock_t *sb) {
+    uint8_t buffer[TINYFS_SECTOR_SIZE];
+    if (bcache_read(dev, 0, 1, buffer) != 0) return -1;
+
+    *sb = *(tinyfs_superblock_t*)buffer;
+    if (sb->magic != TINYFS_MAGIC && sb->magic != TINYFS2_MAGIC && sb->magic != TINYFS3_MAGIC) {
+        return -1;
+    }
+
+    if (sb->magic != TINYFS3_MAGIC) {
+        sb->block_size = TINYFS_SECTOR_SIZE;
+        sb->map_blocks = TINYFS_LEGACY_MAP_BLOCKS;
+        sb->dir_blocks = TINYFS_LEGACY_DIR_BLOCKS;
+        sb->max_files = TINYFS_LEGACY_FILES;
+        sb->journal_start = 0;
+        sb->journal_blocks = 0;
+        sb->journal_seq = 0;
+    }
+
+    return check_geometry(sb);
+}
+
+int tinyfs_probe(const char *device) {
+    int dev = blkdev_lookup(device);
+    if (dev < 0) return -1;
+
+    tinyfs_superblock_t sb;
+    return read_superblock((uint32_t)dev, &sb);
+}
+
+
+static uint32_t count_bits(const uint32_t *words, uint32_t bits) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < (bits + 31) / 32; i++) {
+        uint32_t w = words[i];
+        while (w) {
+            w &= w - 1;
+            n++;
+        }
+    }
+    return n;
+}
+
+// Metadata blocks the next writeback would touch
+static uint32_t dirty_blocks(tinyfs_data_t *data) {
+    return count_bits(data->map_dirty, data->sb.map_blocks) +
+           count_bits(data->dir_dirty, data->sb.dir_blocks) + (data->sb_dirty ? 1 : 0);
+}
+
+// Logged blocks per transaction: the journal minus descriptor and commit,
+// and no more than the descriptor has room to list
+static uint32_t journal_capacity(tinyfs_data_t *data) {
+    uint32_t cap = data->sb.journal_blocks - 2;
+    uint32_t fit = (data->block_size - sizeof(tinyfs_journal_header_t)) / sizeof(uint32_t);
+    return cap < fit ? cap : fit;
+}
+
+static uint32_t journal_hash(uint32_t hash, const uint8_t *block, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        hash ^= block[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+// Copy one metadata block into the next journal slot
+static int journal_log(tinyfs_data_t *data, uint32_t home, const uint8_t *block, uint32_t *hash) {
+    tinyfs_journal_header_t *desc = (tinyfs_journal_header_t*)data->journal_buf;
+
+    if (write_blocks(data, data->sb.journal_start + 1 + desc->count, 1, block) != 0) return -1;
+    *hash = journal_hash(*hash, block, data->block_size);
+    desc->blocks[desc->count++] = home;
+    return 0;
+}
+
+static int journal_log_region(tinyfs_data_t *data, uint32_t start, uint32_t blocks,
+                              const uint8_t *mem, const uint32_t *dirty, uint32_t *hash) {
+    for (uint32_t i = 0; i < blocks; i++) {
+        if (!(dirty[i / 32] & (1U << (i % 32)))) continue;
+        if (journal_log(data, start + i, mem + i * data->block_size, hash) != 0) return -1;
+    }
+    return 0;
+}
+
+// Close the open transaction. Ordered: file data and the previous
+// transaction's in-place writes reach the disk, then the logged copies and
+// descriptor, then the commit block; only after that do the blocks go home,
+// through the buffer cache like any other write. The superblock is always
+// logged since it records the sequence number.
+static int journal_commit(tinyfs_data_t *data) {
+    tinyfs_superblock_t *sb = &data->sb;
+
+    jstats.ops += data->txn_ops;
+    data->txn_ops = 0;
+    data->txn_since = 0;
+
+    if (sb->journal_blocks == 0) return tinyfs_writeback(data);
+    if (dirty_blocks(data) == 0) return 0;
+
+    data->sb_dirty = 1;
+    uint32_t count = dirty_blocks(data);
+
+    if (count > journal_capacity(data)) {
+        // Whole-volume rewrites at mount, where no older transaction can be
+        // replayed over them as the sequence number does not move. Updates
+        // on a mounted volume commit in steps well inside the journal, so
+        // one landing here lost that guarantee and is reported.
+        jstats.direct++;
+        if (data->live) {
+            jstats.overflows++;
+            PRINT(YELLOW, BLACK, "[TINYFS] %u dirty blocks overflow the journal, writing in place\n", count);
+        }
+        if (bcache_sync() != 0) return -1;
+        if (tinyfs_writeback(data) != 0) return -1;
+        return bcache_sync();
+    }
+
+    if (bcache_sync() != 0) return -1;
+
+    uint32_t bs = data->block_size;
+    tinyfs_journal_header_t *desc = (tinyfs_journal_header_t*)data->journal_buf;
+    for (uint32_t i = 0; i < bs; i++) {
+        data->journal_buf[i] = 0;
+    }
+    sb->journal_seq++;
+    desc->magic = TINYFS_JOURNAL_MAGIC;
+    desc->type = TINYFS_JOURNAL_DESC;
+    desc->seq = sb->journal_seq;
+    desc->count = 0;
+
+    uint32_t hash = 2166136261U;
+
+    for (uint32_t i = 0; i < bs; i++) {
+        data->scratch[i] = 0;
+    }
+    *(tinyfs_superblock_t*)data->scratch = *sb;
+
+    if (journal_log(data, 0, data->scratch, &hash) != 0 ||
+        journal_log_region(data, sb->dir_start, sb->dir_blocks, (const uint8_t*)data->dirents,
+                           data->dir_dirty, &hash) != 0 ||
+        journal_log_region(data, sb->map_start, sb->map_blocks, data->bitmap,
+                           data->map_dirty, &hash) != 0) {
+        return -1;
+    }
+
+    count = desc->count;
+    if (write_blocks(data, sb->journal_start, 1, data->journal_buf) != 0 || bcache_sync() != 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < bs; i++) {
+        data->journal_buf[i] = 0;
+    }
+    desc->magic = TINYFS_JOURNAL_MAGIC;
+    desc->type = TINYFS_JOURNAL_COMMIT;
+    desc->seq = sb->journal_seq;
+    desc->count = count;
+    desc->checksum = hash;
+
+    if (write_blocks(data, sb->journal_start + 1 + count, 1, data->journal_buf) != 0 ||
+        bcache_sync() != 0) {
+        return -1;
+    }
+
+    jstats.commits++;
+    jstats.blocks_logged += count;
+    return tinyfs_writeback(data);
+}
+
+// Dirty blocks that close the transaction. At most half the journal, so
+// the step that crosses it still fits.
+static uint32_t journal_threshold(tinyfs_data_t *data) {
+    uint32_t limit = journal_capacity(data) / 2;
+    return jstats.max_blocks < limit ? jstats.max_blocks : limit;
+}
+
+// Between the steps of one long update (allocating or freeing a large
+// file): commit what is there once the transaction is full
+static void journal_make_room(tinyfs_data_t *data) {
+    if (data->sb.journal_blocks != 0 && dirty_blocks(data) >= journal_threshold(data)) {
+        journal_commit(data);
+    }
+}
+
+// Every metadata update ends here, with the lock held. It joins the open
+// transaction, which commits now only when it is big enough or when no
+// commit thread will get to it later.
+static void journal_dirty(tinyfs_data_t *data) {
+    if (data->txn_ops++ == 0) data->txn_since = get_timer_ticks();
+
+    if (commit_tid < 0 || data->sb.journal_blocks == 0 || jstats.interval_ms == 0 ||
+        dirty_blocks(data) >= journal_threshold(data)) {
+        journal_commit(data);
+    }
+}
+
+// Bring the metadata up to the last complete transaction. One that never
+// got its commit block, or whose copies fail the checksum, is ignored.
+static int journal_replay(tinyfs_data_t *data) {
+    tinyfs_superblock_t *sb = &data->sb;
+    if (sb->journal_blocks == 0) return 0;
+
+    uint32_t bs = data->block_size;
+    tinyfs_journal_header_t *desc = (tinyfs_journal_header_t*)data->journal_buf;
+    tinyfs_journal_header_t *commit = (tinyfs_journal_header_t*)data->scratch;
+
+    if (read_blocks(data, sb->journal_start, 1, data->journal_buf) != 0) return -1;
+    if (desc->magic != TINYFS_JOURNAL_MAGIC || desc->type != TINYFS_JOURNAL_DESC) return 0;
+    if (desc->seq <= sb->journal_seq) return 0;
+    if (desc->count == 0 || desc->count > journal_capacity(data)) return 0;
+
+    uint32_t count = desc->count;
+    uint32_t seq = desc->seq;
+    if (read_blocks(data, sb->journal_start + 1 + count, 1, data->scratch) != 0) return -1;
+    if (commit->magic != TINYFS_JOURNAL_MAGIC || commit->type != TINYFS_JOURNAL_COMMIT ||
+        commit->seq != seq || commit->count != count) {
+        return 0;
+    }
+    uint32_t checksum = commit->checksum;
+
+    uint32_t hash = 2166136261U;
+    for (uint32_t k = 0; k < count; k++) {
+        if (desc->blocks[k] >= sb->data_start) return 0;
+        if (read_blocks(data, sb->journal_start + 1 + k, 1, data->scratch) != 0) return -1;
+        hash = journal_hash(hash, data->scratch, bs);
+    }
+    if (hash != checksum) return 0;
+
+    PRINT(WHITE, BLACK, "[TINYFS] Replaying journal transaction %u (%u blocks)\n", seq, count);
+
+    for (uint32_t k = 0; k < count; k++) {
+        if (read_blocks(data, sb->journal_start + 1 + k, 1, data->scratch) != 0 ||
+            write_blocks(data, desc->blocks[k], 1, data->scratch) != 0) {
+            return -1;
+        }
+    }
+    if (bcache_sync() != 0) return -1;
+
+    jstats.replays++;
+    return read_superblock(data->dev, sb);
+}
+
+
+typedef struct {
+    uint32_t start;
+    uint32_t length;
+    uint32_t idx;             // Owning entry
+    uint32_t ext;             // Position in its extent list
+} check_extent_t;
+
+static void sort_extents(check_extent_t *list, uint32_t count) {
+    for (uint32_t gap = count / 2; gap > 0; gap /= 2) {
+        for (uint32_t i = gap; i < count; i++) {
+            check_extent_t tmp = list[i];
+            uint32_t j = i;
+            while (j >= gap && list[j - gap].start > tmp.start) {
+                list[j] = list[j - gap];
+                j -= gap;
+            }
+            list[j] = tmp;
+        }
+    }
+}
+
+static void truncate_extents(tinyfs_data_t *data, uint32_t idx, uint32_t keep) {
+    tinyfs_dirent_t *dirent = &data->dirents[idx];
+
+    dirent->nextents = (uint16_t)keep;
+    uint64_t bytes = (uint64_t)file_blocks(dirent) * data->block_size;
+    if (dirent->size > bytes) dirent->size = (uint32_t)bytes;
+    mark_dirent_dirty(data, idx);
+}
+
+// Consistency check run on every mount. One sweep of the in-memory
+// directory finds the entries in use; every later pass, the repeated
+// overlap passes included, walks only those and their extents. The bitmap
+// is rebuilt in full only when it disagrees with them.
+static int tinyfs_check(tinyfs_data_t *data) {
+    tinyfs_superblock_t *sb = &data->sb;
+    uint32_t fixes = 0;
+    uint32_t nextents = 0;
+
+    uint32_t nused = 0;
+    for (uint32_t i = 1; i < sb->max_files; i++) {
+        if (data->dirents[i].used) nused++;
+    }
+
+    uint32_t *in_use = NULL;
+    if (nused) {
+        in_use = (uint32_t*)kmalloc(nused * sizeof(uint32_t));
+        if (!in_use) return -1;
+    }
+    nused = 0;
+    for (uint32_t i = 1; i < sb->max_files; i++) {
+        if (data->dirents[i].used) in_use[nused++] = i;
+    }
+
+    for (uint32_t u = 0; u < nused; u++) {
+        uint32_t i = in_use[u];
+        tinyfs_dirent_t *dirent = &data->dirents[i];
+
+        if (dirent->name[TINYFS_MAX_FILENAME - 1] != '\0') {
+            dirent->name[TINYFS_MAX_FILENAME - 1] = '\0';
+            mark_dirent_dirty(data, i);
+            fixes++;
+        }
+
+        // Lost entries go back under the root rather than leak their blocks
+        if (!valid_parent(data, i)) {
+            dirent->parent_inode = 0;
+            mark_dirent_dirty(data, i);
+            fixes++;
+        }
+
+        uint32_t keep = dirent->nextents;
+        if (keep > TINYFS_EXTENTS) keep = TINYFS_EXTENTS;
+        if (dirent->is_directory) keep = 0;
+
+        uint32_t logical = 0;
+        for (uint32_t e = 0; e < keep; e++) {
+            tinyfs_extent_t *ext = &dirent->extents[e];
+            if (ext->logical != logical || ext->length == 0 || ext->start < sb->data_start ||
+                ext->start >= sb->total_blocks || ext->length > sb->total_blocks - ext->start) {
+                keep = e;
+                break;
+            }
+            logical += ext->length;
+        }
+
+        uint64_t bytes = (uint64_t)logical * data->block_size;
+        if (keep != dirent->nextents || dirent->size > bytes) {
+            truncate_extents(data, i, keep);
+            fixes++;
+        }
+        nextents += dirent->nextents;
+    }
+
+    // Blocks claimed twice: sort every extent by start and compare
+    // neighbours. The later claim is cut off; repeat until none overlap.
+    check_extent_t *list = NULL;
+    if (nextents) {
+        list = (check_extent_t*)kmalloc(nextents * sizeof(check_extent_t));
+        if (!list) {
+            kfree(in_use);
+            return -1;
+        }
+    }
+
+    uint64_t used;
+    for (;;) {
+        uint32_t count = 0;
+        used = 0;
+        for (uint32_t u = 0; u < nused; u++) {
+            uint32_t i = in_use[u];
+            tinyfs_dirent_t *dirent = &data->dirents[i];
+
+            for (uint32_t e = 0; e < dirent->nextents; e++) {
+                list[count].start = dirent->extents[e].start;
+                list[count].length = dirent->extents[e].length;
+                list[count].idx = i;
+                list[count].ext = e;
+                used += list[count].length;
+                count++;
+            }
+        }
+
+        sort_extents(list, count);
+
+        uint32_t clash = count;
+        for (uint32_t k = 1; k < count; k++) {
+            if (list[k - 1].start + list[k - 1].length > list[k].start) {
+                clash = k;
+                break;
+            }
+        }
+        if (clash == count) break;
+
+        PRINT(YELLOW, BLACK, "[TINYFS] '%s' shares blocks with '%s', truncating\n",
+              data->dirents[list[clash].idx].name, data->dirents[list[clash - 1].idx].name);
+        truncate_extents(data, list[clash].idx, list[clash].ext);
+        fixes++;
+    }
+
+    // Every claimed block and every metadata block must be marked, and
+    // the free count must match what is left
+    uint64_t expect_free = (uint64_t)sb->total_blocks - sb->data_start - used;
+    int rebuild = sb->free_blocks != expect_free;
+
+    for (uint32_t b = 0; b < sb->data_start && !rebuild; b++) {
+        if (!block_used(data, b)) rebuild = 1;
+    }
+    for (uint32_t u = 0; u < nused && !rebuild; u++) {
+        tinyfs_dirent_t *dirent = &data->dirents[in_use[u]];
+
+        for (uint32_t e = 0; e < dirent->nextents && !rebuild; e++) {
+            tinyfs_extent_t *ext = &dirent->extents[e];
+            for (uint32_t b = ext->start; b < ext->start + ext->length; b++) {
+                if (!block_used(data, b)) {
+                    rebuild = 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (list) kfree(list);
+
+    if (rebuild) {
+        PRINT(YELLOW, BLACK, "[TINYFS] Free space map out of date, rebuilding\n");
+
+        for (uint32_t i = 0; i < sb->map_blocks * data->block_size; i++) {
+            data->bitmap[i] = 0;
+        }
+        for (uint32_t b = 0; b < sb->data_start; b++) {
+            data->bitmap[b / 8] |= 1 << (b % 8);
+        }
+        for (uint32_t u = 0; u < nused; u++) {
+            tinyfs_dirent_t *dirent = &data->dirents[in_use[u]];
+
+            for (uint32_t e = 0; e < dirent->nextents; e++) {
+                tinyfs_extent_t *ext = &dirent->extents[e];
+                for (uint32_t b = ext->start; b < ext->start + ext->length; b++) {
+                    data->bitmap[b / 8] |= 1 << (b % 8);
+                }
+            }
+        }
+
+        sb->free_blocks = (uint32_t)expect_free;
+        mark_all_dirty(data);
+        fixes++;
+    }
+    if (in_use) kfree(in_use);
+
+    if (fixes == 0) return 0;
+
+    PRINT(YELLOW, BLACK, "[TINYFS] Repaired %u problems\n", fixes);
+    return journal_commit(data);
+}
+
+
 static int tinyfs_mount(filesystem_t *fs, const char *device) {
     PRINT(WHITE, BLACK, "[TINYFS] Mounting filesystem...\n");
 
-    tinyfs_data_t *data = (tinyfs_data_t*)kmalloc(sizeof(tinyfs_data_t));
+    tinyfs_data_t *data = (tinyfs_data_t*)kzalloc(sizeof(tinyfs_data_t));
     if (!data) {
         PRINT(YELLOW, BLACK, "[TINYFS] Failed to allocate memory\n");
         return -1;
@@ -244,59 +1229,70 @@ static int tinyfs_mount(filesystem_t *fs, const char *device) {
 
     strcpy_safe(data->device, device, 32);
 
-    uint8_t buffer[TINYFS_BLOCK_SIZE];
-    if (ata_read_sectors(0, 1, buffer) != 0) {
-        PRINT(YELLOW, BLACK, "[TINYFS] Failed to read superblock\n");
+    int dev = blkdev_lookup(device);
+    if (dev < 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] No block device %s\n", device);
         kfree(data);
         return -1;
     }
+    data->dev = (uint32_t)dev;
 
-    tinyfs_superblock_t *sb = (tinyfs_superblock_t*)buffer;
-    if (sb->magic != TINYFS_MAGIC) {
-        PRINT(YELLOW, BLACK, "[TINYFS] Invalid magic: 0x%x (expected 0x%x)\n",
-               sb->magic, TINYFS_MAGIC);
+    if (read_superblock(data->dev, &data->sb) != 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] No valid superblock on %s\n", device);
         kfree(data);
         return -1;
     }
+    uint32_t magic = data->sb.magic;
+
+    if (alloc_data(data) != 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] Failed to allocate memory\n");
+        free_data(data);
+        return -1;
+    }
 
-    data->sb = *sb;
-    PRINT(MAGENTA, BLACK, "[TINYFS] Superblock loaded (free_blocks=%u)\n",
-           data->sb.free_blocks);
+    if (journal_replay(data) != 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] Failed to replay journal\n");
+        free_data(data);
+        return -1;
+    }
 
-    PRINT(WHITE, BLACK, "[TINYFS] Reading FAT...\n");
-    int fat_entries_per_block = TINYFS_BLOCK_SIZE / sizeof(uint32_t);
-    for (int i = 0; i < 10; i++) {
-        if (ata_read_sectors(data->sb.fat_start + i, 1, buffer) != 0) {
-            PRINT(YELLOW, BLACK, "[TINYFS] Failed to read FAT block %d\n", i);
-            kfree(data);
+    PRINT(MAGENTA, BLACK, "[TINYFS] Superblock loaded (%u blocks of %u bytes, free_blocks=%u)\n",
+           data->sb.total_blocks, data->block_size, data->sb.free_blocks);
+
+    if (magic != TINYFS3_MAGIC) {
+        if (tinyfs_upgrade(data) != 0) {
+            PRINT(YELLOW, BLACK, "[TINYFS] Upgrade failed\n");
+            free_data(data);
             return -1;
         }
-
-        for (int j = 0; j < fat_entries_per_block; j++) {
-            int idx = i * fat_entries_per_block + j;
-            if (idx < 1024) {
-                data->fat[idx] = ((uint32_t*)buffer)[j];
-            }
+    } else {
+        PRINT(WHITE, BLACK, "[TINYFS] Reading bitmap and directory...\n");
+        if (read_blocks(data, data->sb.map_start, data->sb.map_blocks, data->bitmap) != 0 ||
+            read_blocks(data, data->sb.dir_start, data->sb.dir_blocks,
+                        (uint8_t*)data->dirents) != 0) {
+            PRINT(YELLOW, BLACK, "[TINYFS] Failed to read metadata\n");
+            free_data(data);
+            return -1;
         }
     }
 
-    PRINT(WHITE, BLACK, "[TINYFS] Reading directory...\n");
-    int entries_per_block = TINYFS_BLOCK_SIZE / sizeof(tinyfs_dirent_t);
-    for (int i = 0; i < 90; i++) {
-        if (ata_read_sectors(data->sb.dir_start + i, 1, buffer) != 0) {
-            PRINT(YELLOW, BLACK, "[TINYFS] Failed to read directory block %d\n", i);
-            kfree(data);
-            return -1;
-        }
+    if (tinyfs_check(data) != 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] Consistency check failed\n");
+        free_data(data);
+        return -1;
+    }
 
-        for (int j = 0; j < entries_per_block; j++) {
-            int idx = i * entries_per_block + j;
-            if (idx < TINYFS_MAX_FILES) {
-                data->dirents[idx] = ((tinyfs_dirent_t*)buffer)[j];
-            }
-        }
+    if (build_index(data) != 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] Failed to allocate directory index\n");
+        free_data(data);
+        return -1;
     }
 
+    tinyfs_lock();
+    list_add_tail(&data->mount_link, &mounted);
+    data->live = 1;
+    tinyfs_unlock();
+
     fs->private_data = data;
     PRINT(MAGENTA, BLACK, "[TINYFS] Mount successful\n");
     return 0;
@@ -306,17 +1302,22 @@ static int tinyfs_unmount(filesystem_t *fs) {
     if (fs->private_data) {
         tinyfs_data_t *data = (tinyfs_data_t*)fs->private_data;
 
-        write_superblock(data);
-        write_fat(data);
-        write_directory(data);
+        tinyfs_lock();
+        list_del(&data->mount_link);
+        journal_commit(data);
+        tinyfs_unlock();
+        bcache_sync();
 
-        kfree(data);
+        free_data(data);
         fs->private_data = NULL;
     }
     return 0;
 }
 
 static vfs_node_t* tinyfs_get_root(filesystem_t *fs) {
+    tinyfs_data_t *data = (tinyfs_data_t*)fs->private_data;
+    if (data && data->inodes[0].node) return data->inodes[0].node;
+
     vfs_node_t *root = (vfs_node_t*)kmalloc(sizeof(vfs_node_t));
     if (!root) return NULL;
 
@@ -328,11 +1329,13 @@ static vfs_node_t* tinyfs_get_root(filesystem_t *fs) {
     root->fs = fs;
     root->ops = &tinyfs_vfs_ops;
     root->private_data = NULL;
+    if (data) data->inodes[0].node = root;
 
     PRINT(MAGENTA, BLACK, "[TINYFS] Root node created\n");
     return root;
 }
 
+
 static int tinyfs_get_stats(filesystem_t *fs, fs_stats_t *stats) {
     if (!fs || !fs->private_data || !stats) return -1;
 
@@ -340,22 +1343,39 @@ static int tinyfs_get_stats(filesystem_t *fs, fs_stats_t *stats) {
 
     stats->total_blocks = data->sb.total_blocks;
     stats->free_blocks = data->sb.free_blocks;
-    stats->block_size = TINYFS_BLOCK_SIZE;
+    stats->block_size = data->block_size;
 
     return 0;
 }
 
+static int tinyfs_sync(filesystem_t *fs) {
+    if (!fs || !fs->private_data) return -1;
+
+    tinyfs_lock();
+    int result = journal_commit((tinyfs_data_t*)fs->private_data);
+    tinyfs_unlock();
+    return result;
+}
+
 
 static int tinyfs_open(vfs_node_t *node, uint32_t flags) {
+    if (node->private_data && node->fs->private_data) {
+        tinyfs_data_t *data = (tinyfs_data_t*)node->fs->private_data;
+        data->inodes[node->inode].opens++;
+    }
     return 0;
 }
 
 static int tinyfs_close(vfs_node_t *node) {
+    if (node->private_data && node->fs->private_data) {
+        tinyfs_data_t *data = (tinyfs_data_t*)node->fs->private_data;
+        if (data->inodes[node->inode].opens > 0) data->inodes[node->inode].opens--;
+    }
     return 0;
 }
 
 
-static int tinyfs_read(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset) {
+static int read_locked(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset) {
     if (!node || !node->fs || !node->fs->private_data) return -1;
 
     tinyfs_data_t *data = (tinyfs_data_t*)node->fs->private_data;
@@ -367,181 +1387,298 @@ static int tinyfs_read(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_
         size = dirent->size - offset;
     }
 
+    uint32_t bs = data->block_size;
     uint32_t bytes_read = 0;
-    uint32_t current_block = dirent->first_block;
-    uint32_t block_offset = offset / TINYFS_BLOCK_SIZE;
-    uint32_t byte_offset = offset % TINYFS_BLOCK_SIZE;
 
-    for (uint32_t i = 0; i < block_offset && current_block != EOF; i++) {
-        current_block = data->fat[current_block];
-    }
+    while (bytes_read < size) {
+        uint32_t pos = offset + bytes_read;
+        uint32_t byte_offset = pos % bs;
+        uint32_t block;
+        uint32_t run = extent_map(dirent, pos / bs, &block);
+        if (run == 0) break;
 
-    uint8_t block_buffer[TINYFS_BLOCK_SIZE];
+        // Whole blocks go straight into the caller's buffer, a run at a time
+        if (byte_offset == 0 && size - bytes_read >= bs) {
+            uint32_t blocks = (size - bytes_read) / bs;
+            if (blocks > run) blocks = run;
 
-    while (bytes_read < size && current_block != EOF) {
-        if (ata_read_sectors(current_block, 1, block_buffer) != 0) {
+            if (read_blocks(data, block, blocks, buffer + bytes_read) != 0) {
+                return -1;
+            }
+            bytes_read += blocks * bs;
+            continue;
+        }
+
+        if (read_blocks(data, block, 1, data->scratch) != 0) {
             return -1;
         }
 
-        uint32_t to_copy = TINYFS_BLOCK_SIZE - byte_offset;
+        uint32_t to_copy = bs - byte_offset;
         if (to_copy > size - bytes_read) {
             to_copy = size - bytes_read;
         }
 
         for (uint32_t i = 0; i < to_copy; i++) {
-            buffer[bytes_read + i] = block_buffer[byte_offset + i];
+            buffer[bytes_read + i] = data->scratch[byte_offset + i];
         }
 
         bytes_read += to_copy;
-        byte_offset = 0;
-        current_block = data->fat[current_block];
     }
 
     return bytes_read;
 }
 
+static int tinyfs_read(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset) {
+    tinyfs_lock();
+    int result = read_locked(node, buffer, size, offset);
+    tinyfs_unlock();
+    return result;
+}
+
+// Position within a scatter list
+typedef struct {
+    const vfs_iovec_t *iov;
+    int left;                 // Segments from the current one on
+    uint64_t off;             // Bytes of the current segment consumed
+} iov_cursor_t;
+
+// Bytes left in the current segment, skipping past exhausted ones
+static uint64_t iov_avail(iov_cursor_t *cur) {
+    while (cur->left > 0 && cur->off >= cur->iov->len) {
+        cur->iov++;
+        cur->left--;
+        cur->off = 0;
+    }
+    return cur->left > 0 ? cur->iov->len - cur->off : 0;
+}
+
+static const uint8_t* iov_ptr(iov_cursor_t *cur) {
+    return (const uint8_t*)cur->iov->base + cur->off;
+}
+
+static void iov_gather(iov_cursor_t *cur, uint8_t *dst, uint32_t n) {
+    while (n > 0) {
+        uint64_t avail = iov_avail(cur);
+        uint32_t take = avail < n ? (uint32_t)avail : n;
+        const uint8_t *src = iov_ptr(cur);
+
+        for (uint32_t i = 0; i < take; i++) {
+            dst[i] = src[i];
+        }
+        dst += take;
+        cur->off += take;
+        n -= take;
+    }
+}
+
+
 static int tinyfs_write(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset) {
+    vfs_iovec_t iov = { buffer, size };
+    return (int)tinyfs_writev(node, &iov, 1, offset);
+}
+
+// The whole list lands in one pass: the file is extended once and the
+// metadata written back once, however many segments there are
+static int64_t writev_locked(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, uint64_t offset) {
     if (!node || !node->fs || !node->fs->private_data) return -1;
 
     tinyfs_data_t *data = (tinyfs_data_t*)node->fs->private_data;
     tinyfs_dirent_t *dirent = (tinyfs_dirent_t*)node->private_data;
 
     if (!dirent) return -1;
+    if (offset >= 0xFFFFFFFFULL) return -1;
 
-    if (dirent->first_block == 0) {
-        int block = allocate_block(data);
-        if (block < 0) return -1;
-        dirent->first_block = block;
+    uint64_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += iov[i].len;
+    }
+    if (total > 0xFFFFFFFFULL - offset) total = 0xFFFFFFFFULL - offset;
+    if (total == 0) return 0;
+
+    uint32_t size = (uint32_t)total;
+    uint32_t bs = data->block_size;
+    uint8_t *block_buffer = data->scratch;
+    uint32_t idx = (uint32_t)(dirent - data->dirents);
+    uint32_t old_blocks = file_blocks(dirent);
+    uint32_t need = (uint32_t)((offset + size + bs - 1) / bs);
+
+    if (need > old_blocks && file_extend(data, dirent, idx, need) != 0) {
+        // Write as much as the blocks we did get cover
+        uint64_t have = (uint64_t)file_blocks(dirent) * bs;
+        if (have <= offset) {
+            journal_dirty(data);
+            return -1;
+        }
+        if (have - offset < size) size = (uint32_t)(have - offset);
     }
 
-    uint32_t bytes_written = 0;
-    uint32_t current_block = dirent->first_block;
-    uint32_t block_offset = offset / TINYFS_BLOCK_SIZE;
-    uint32_t byte_offset = offset % TINYFS_BLOCK_SIZE;
-
-    for (uint32_t i = 0; i < block_offset; i++) {
-        if (data->fat[current_block] == EOF) {
-            int new_block = allocate_block(data);
-            if (new_block < 0) return bytes_written;
-            data->fat[current_block] = new_block;
+    // New blocks the write skips over must not expose whatever was there
+    for (uint32_t i = 0; i < bs; i++) {
+        block_buffer[i] = 0;
+    }
+    for (uint32_t fblock = old_blocks; fblock < offset / bs; fblock++) {
+        uint32_t block;
+        if (extent_map(dirent, fblock, &block) == 0 ||
+            write_blocks(data, block, 1, block_buffer) != 0) {
+            journal_dirty(data);
+            return -1;
         }
-        current_block = data->fat[current_block];
     }
 
-    uint8_t block_buffer[TINYFS_BLOCK_SIZE];
+    iov_cursor_t cur = { iov, iovcnt, 0 };
+    uint32_t bytes_written = 0;
 
     while (bytes_written < size) {
-        if (byte_offset > 0 || (size - bytes_written) < TINYFS_BLOCK_SIZE) {
-            ata_read_sectors(current_block, 1, block_buffer);
+        uint32_t pos = (uint32_t)offset + bytes_written;
+        uint32_t fblock = pos / bs;
+        uint32_t byte_offset = pos % bs;
+        uint32_t block;
+        uint32_t run = extent_map(dirent, fblock, &block);
+        if (run == 0) break;
+
+        // Whole blocks that sit in one segment go straight from it
+        uint64_t avail = iov_avail(&cur);
+        if (avail > size - bytes_written) avail = size - bytes_written;
+
+        if (byte_offset == 0 && avail >= bs) {
+            uint32_t blocks = (uint32_t)(avail / bs);
+            if (blocks > run) blocks = run;
+
+            if (write_blocks(data, block, blocks, iov_ptr(&cur)) != 0) {
+                journal_dirty(data);
+                return -1;
+            }
+            cur.off += (uint64_t)blocks * bs;
+            bytes_written += blocks * bs;
+            continue;
         }
 
-        uint32_t to_write = TINYFS_BLOCK_SIZE - byte_offset;
+        uint32_t to_write = bs - byte_offset;
         if (to_write > size - bytes_written) {
             to_write = size - bytes_written;
         }
 
-        for (uint32_t i = 0; i < to_write; i++) {
-            block_buffer[byte_offset + i] = buffer[bytes_written + i];
+        // Partial block: keep the bytes around the write
+        if (to_write < bs) {
+            if (fblock < old_blocks) {
+                read_blocks(data, block, 1, block_buffer);
+            } else {
+                for (uint32_t i = 0; i < bs; i++) {
+                    block_buffer[i] = 0;
+                }
+            }
         }
 
-        if (ata_write_sectors(current_block, 1, block_buffer) != 0) {
+        iov_gather(&cur, block_buffer + byte_offset, to_write);
+
+        if (write_blocks(data, block, 1, block_buffer) != 0) {
+            journal_dirty(data);
             return -1;
         }
 
         bytes_written += to_write;
-        byte_offset = 0;
-
-        if (bytes_written < size) {
-            if (data->fat[current_block] == EOF) {
-                int new_block = allocate_block(data);
-                if (new_block < 0) break;
-                data->fat[current_block] = new_block;
-            }
-            current_block = data->fat[current_block];
-        }
     }
 
     if (offset + bytes_written > dirent->size) {
-        dirent->size = offset + bytes_written;
+        dirent->size = (uint32_t)offset + bytes_written;
         node->size = dirent->size;
+        mark_dirent_dirty(data, idx);
     }
 
-    write_directory(data);
-    write_fat(data);
-    write_superblock(data);
+    journal_dirty(data);
 
     return bytes_written;
 }
 
+static int64_t tinyfs_writev(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, uint64_t offset) {
+    tinyfs_lock();
+    int64_t result = writev_locked(node, iov, iovcnt, offset);
+    tinyfs_unlock();
+    return result;
+}
 
-static vfs_node_t* tinyfs_readdir(vfs_node_t *node, uint32_t index) {
+
+static vfs_node_t* readdir_locked(vfs_node_t *node, uint32_t index) {
     if (!node || node->type != FILE_TYPE_DIRECTORY) return NULL;
     if (!node->fs || !node->fs->private_data) return NULL;
 
     tinyfs_data_t *data = (tinyfs_data_t*)node->fs->private_data;
-
-    uint32_t current_inode = node->inode;
+    tinyfs_inode_t *ino;
 
     uint32_t count = 0;
-    for (int i = 0; i < TINYFS_MAX_FILES; i++) {
-        if (data->dirents[i].used && data->dirents[i].parent_inode == current_inode) {
-            if (count == index) {
-                vfs_node_t *entry = (vfs_node_t*)kmalloc(sizeof(vfs_node_t));
-                if (!entry) return NULL;
-
-                strcpy_safe(entry->name, data->dirents[i].name, MAX_FILENAME);
-                entry->type = data->dirents[i].is_directory ?
-                             FILE_TYPE_DIRECTORY : FILE_TYPE_REGULAR;
-                entry->permissions = FILE_READ | FILE_WRITE;
-                entry->size = data->dirents[i].size;
-                entry->inode = i;
-                entry->fs = node->fs;
-                entry->ops = &tinyfs_vfs_ops;
-                entry->private_data = &data->dirents[i];
-
-                return entry;
-            }
-            count++;
+    list_for_each_entry(ino, &data->inodes[node->inode].children, tinyfs_inode_t, sibling_link) {
+        if (count == index) {
+            return get_node(node->fs, data, (uint32_t)(ino - data->inodes));
         }
+        count++;
     }
 
     return NULL;
 }
 
+static vfs_node_t* tinyfs_readdir(vfs_node_t *node, uint32_t index) {
+    tinyfs_lock();
+    vfs_node_t *result = readdir_locked(node, index);
+    tinyfs_unlock();
+    return result;
+}
 
-static vfs_node_t* tinyfs_finddir(vfs_node_t *node, const char *name) {
+// The cookie is one past the index of the entry returned last. If that
+// entry has since been removed from this directory the listing ends.
+static vfs_node_t* readdir_next_locked(vfs_node_t *node, uint32_t *cookie) {
     if (!node || node->type != FILE_TYPE_DIRECTORY) return NULL;
     if (!node->fs || !node->fs->private_data) return NULL;
 
     tinyfs_data_t *data = (tinyfs_data_t*)node->fs->private_data;
-    uint32_t current_inode = node->inode;
+    list_head_t *children = &data->inodes[node->inode].children;
+    list_head_t *next;
+
+    if (*cookie == 0) {
+        next = children->next;
+    } else {
+        uint32_t last = *cookie - 1;
+        if (last >= data->sb.max_files || !data->dirents[last].used ||
+            data->dirents[last].parent_inode != node->inode) {
+            return NULL;
+        }
+        next = data->inodes[last].sibling_link.next;
+    }
 
-    for (int i = 0; i < TINYFS_MAX_FILES; i++) {
-        if (data->dirents[i].used &&
-            data->dirents[i].parent_inode == current_inode &&
-            strcmp_safe(data->dirents[i].name, name) == 0) {
+    if (next == children) return NULL;
 
-            vfs_node_t *entry = (vfs_node_t*)kmalloc(sizeof(vfs_node_t));
-            if (!entry) return NULL;
+    uint32_t idx = (uint32_t)(list_entry(next, tinyfs_inode_t, sibling_link) - data->inodes);
+    *cookie = idx + 1;
+    return get_node(node->fs, data, idx);
+}
 
-            strcpy_safe(entry->name, data->dirents[i].name, MAX_FILENAME);
-            entry->type = data->dirents[i].is_directory ?
-                         FILE_TYPE_DIRECTORY : FILE_TYPE_REGULAR;
-            entry->permissions = FILE_READ | FILE_WRITE;
-            entry->size = data->dirents[i].size;
-            entry->inode = i;
-            entry->fs = node->fs;
-            entry->ops = &tinyfs_vfs_ops;
-            entry->private_data = &data->dirents[i];
+static vfs_node_t* tinyfs_readdir_next(vfs_node_t *node, uint32_t *cookie) {
+    tinyfs_lock();
+    vfs_node_t *result = readdir_next_locked(node, cookie);
+    tinyfs_unlock();
+    return result;
+}
 
-            return entry;
-        }
-    }
 
-    return NULL;
+static vfs_node_t* finddir_locked(vfs_node_t *node, const char *name) {
+    if (!node || node->type != FILE_TYPE_DIRECTORY) return NULL;
+    if (!node->fs || !node->fs->private_data) return NULL;
+
+    tinyfs_data_t *data = (tinyfs_data_t*)node->fs->private_data;
+
+    int idx = index_lookup(data, node->inode, name);
+    if (idx < 0) return NULL;
+
+    return get_node(node->fs, data, (uint32_t)idx);
 }
 
-static int tinyfs_create_node(vfs_node_t *parent, const char *name, uint8_t type, uint32_t permissions) {
+static vfs_node_t* tinyfs_finddir(vfs_node_t *node, const char *name) {
+    tinyfs_lock();
+    vfs_node_t *result = finddir_locked(node, name);
+    tinyfs_unlock();
+    return result;
+}
+
+static int create_locked(vfs_node_t *parent, const char *name, uint8_t type) {
     if (!parent || !parent->fs || !parent->fs->private_data) {
         PRINT(YELLOW, BLACK, "[TINYFS] create_node: invalid parent\n");
         return -1;
@@ -557,13 +1694,9 @@ static int tinyfs_create_node(vfs_node_t *parent, const char *name, uint8_t type
     PRINT(WHITE, BLACK, "[TINYFS] create_node: Creating '%s' (type=%d)\n", name, type);
 
     uint32_t parent_inode = parent->inode;
-    for (int i = 0; i < TINYFS_MAX_FILES; i++) {
-        if (data->dirents[i].used &&
-            data->dirents[i].parent_inode == parent_inode &&
-            strcmp_safe(data->dirents[i].name, name) == 0) {
-            PRINT(YELLOW, BLACK, "[TINYFS] File '%s' already exists\n", name);
-            return -1;
-        }
+    if (index_lookup(data, parent_inode, name) >= 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] File '%s' already exists\n", name);
+        return -1;
     }
 
     int free_idx = find_free_dirent(data);
@@ -576,54 +1709,148 @@ static int tinyfs_create_node(vfs_node_t *parent, const char *name, uint8_t type
 
     tinyfs_dirent_t *dirent = &data->dirents[free_idx];
     strcpy_safe(dirent->name, name, TINYFS_MAX_FILENAME);
-    dirent->first_block = 0;
+    dirent->nextents = 0;
     dirent->size = 0;
     dirent->is_directory = (type == FILE_TYPE_DIRECTORY) ? 1 : 0;
     dirent->used = 1;
     dirent->parent_inode = parent_inode;
-
-    PRINT(WHITE, BLACK, "[TINYFS] create_node: Writing directory to disk...\n");
-
-    if (write_directory(data) != 0) {
-        PRINT(YELLOW, BLACK, "[TINYFS] Failed to write directory\n");
-        dirent->used = 0;
-        return -1;
-    }
+    mark_dirent_dirty(data, free_idx);
+    index_add(data, free_idx);
+    journal_dirty(data);
 
     PRINT(MAGENTA, BLACK, "[TINYFS] Created %s '%s' at index %d (parent=%d)\n",
            (type == FILE_TYPE_DIRECTORY) ? "directory" : "file", name, free_idx, parent_inode);
     return 0;
 }
 
+static int tinyfs_create_node(vfs_node_t *parent, const char *name, uint8_t type, uint32_t permissions) {
+    tinyfs_lock();
+    int result = create_locked(parent, name, type);
+    tinyfs_unlock();
+    return result;
+}
 
-static int tinyfs_unlink(vfs_node_t *parent, const char *name) {
+
+static int unlink_locked(vfs_node_t *parent, const char *name) {
     if (!parent || !parent->fs || !parent->fs->private_data) return -1;
     if (parent->type != FILE_TYPE_DIRECTORY) return -1;
 
     tinyfs_data_t *data = (tinyfs_data_t*)parent->fs->private_data;
 
-    for (int i = 0; i < TINYFS_MAX_FILES; i++) {
-        if (data->dirents[i].used && strcmp_safe(data->dirents[i].name, name) == 0) {
+    int idx = index_lookup(data, parent->inode, name);
+    if (idx < 0) return -1;
 
-            if (data->dirents[i].first_block != 0) {
-                free_block_chain(data, data->dirents[i].first_block);
-            }
+    tinyfs_dirent_t *dirent = &data->dirents[idx];
+    tinyfs_inode_t *ino = &data->inodes[idx];
 
-            data->dirents[i].used = 0;
-            data->dirents[i].name[0] = '\0';
-            data->dirents[i].first_block = 0;
-            data->dirents[i].size = 0;
+    if (dirent->is_directory && !list_empty(&ino->children)) {
+        PRINT(YELLOW, BLACK, "[TINYFS] Directory '%s' is not empty\n", name);
+        return -1;
+    }
 
-            write_fat(data);
-            write_directory(data);
-            write_superblock(data);
+    index_del(data, idx);
 
-            PRINT(MAGENTA, BLACK, "[TINYFS] Removed '%s'\n", name);
-            return 0;
+    // Handles still open on the node keep it, detached, so their I/O fails
+    // instead of touching a reused entry. Directories may still be the cwd.
+    if (ino->node) {
+        ino->node->private_data = NULL;
+        if (ino->opens == 0 && !dirent->is_directory) {
+            kfree(ino->node);
         }
+        ino->node = NULL;
+    }
+    ino->opens = 0;
+
+    // The entry goes before its blocks: a commit between free steps then
+    // leaks blocks, which the mount-time check reclaims, rather than
+    // leaving the file pointing at freed ones
+    tinyfs_extent_t extents[TINYFS_EXTENTS];
+    uint32_t nextents = dirent->nextents;
+    for (uint32_t e = 0; e < nextents; e++) {
+        extents[e] = dirent->extents[e];
     }
 
-    return -1;
+    dirent->nextents = 0;
+    dirent->used = 0;
+    dirent->name[0] = '\0';
+    dirent->size = 0;
+    mark_dirent_dirty(data, idx);
+
+    free_extents(data, extents, nextents);
+    journal_dirty(data);
+
+    PRINT(MAGENTA, BLACK, "[TINYFS] Removed '%s'\n", name);
+    return 0;
+}
+
+static int tinyfs_unlink(vfs_node_t *parent, const char *name) {
+    tinyfs_lock();
+    int result = unlink_locked(parent, name);
+    tinyfs_unlock();
+    return result;
+}
+
+
+// Commit each volume's open transaction once it has been open for the
+// interval; the block threshold commits busier ones sooner
+static void tinyfs_commit_thread(void) {
+    while (1) {
+        uint32_t interval = jstats.interval_ms;
+        thread_sleep_until(get_timer_ticks() + (interval > 20 ? interval / 2 : 10));
+
+        tinyfs_lock();
+        uint64_t now = get_timer_ticks();
+        tinyfs_data_t *data;
+        list_for_each_entry(data, &mounted, tinyfs_data_t, mount_link) {
+            if (data->txn_ops && now - data->txn_since >= jstats.interval_ms) {
+                journal_commit(data);
+            }
+        }
+        tinyfs_unlock();
+    }
+}
+
+void tinyfs_start_journal(void) {
+    if (commit_tid >= 0) return;
+
+    commit_tid = thread_create(1, tinyfs_commit_thread, 16384,
+                               5000000, 1000000000, 1000000000);
+    if (commit_tid < 0) {
+        PRINT(YELLOW, BLACK, "[TINYFS] Failed to start commit thread, every update commits\n");
+        return;
+    }
+
+    PRINT(MAGENTA, BLACK, "[TINYFS] Commit thread TID=%d (%u ms, %u blocks)\n",
+          commit_tid, jstats.interval_ms, jstats.max_blocks);
+}
+
+// An interval of 0 commits every update as it happens
+void tinyfs_set_commit(uint32_t interval_ms, uint32_t max_blocks) {
+    if (max_blocks < 1) max_blocks = 1;
+    if (max_blocks > TINYFS_COMMIT_MAX) max_blocks = TINYFS_COMMIT_MAX;
+
+    tinyfs_lock();
+    jstats.interval_ms = interval_ms;
+    jstats.max_blocks = max_blocks;
+    tinyfs_unlock();
+}
+
+void tinyfs_get_journal_stats(tinyfs_journal_stats_t *out) {
+    *out = jstats;
+}
+
+void tinyfs_print_journal_stats(void) {
+    tinyfs_journal_stats_t s;
+    tinyfs_get_journal_stats(&s);
+
+    uint64_t per_commit = s.commits ? s.ops / s.commits : 0;
+
+    PRINT(CYAN, BLACK, "\n=== TinyFS Journal ===\n");
+    PRINT(WHITE, BLACK, "Commit: every %u ms or %u blocks\n", s.interval_ms, s.max_blocks);
+    PRINT(WHITE, BLACK, "Commits: %llu (%llu updates, %llu per commit)\n", s.commits, s.ops, per_commit);
+    PRINT(WHITE, BLACK, "Blocks logged: %llu\n", s.blocks_logged);
+    PRINT(WHITE, BLACK, "Unjournaled writebacks: %llu (%llu while mounted)\n", s.direct, s.overflows);
+    PRINT(WHITE, BLACK, "Replays at mount: %llu\n", s.replays);
 }
 
 
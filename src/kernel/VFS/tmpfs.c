@@ -0,0 +1,587 @@
+#include "tmpfs.h"
+#include "memory.h"
+#include "print.h"
+#include "process.h"
+#include "vfs.h"
+#include "string_helpers.h"
+
+static int tmpfs_mount(filesystem_t *fs, const char *device);
+static int tmpfs_unmount(filesystem_t *fs);
+static vfs_node_t* tmpfs_get_root(filesystem_t *fs);
+static int tmpfs_get_stats(filesystem_t *fs, fs_stats_t *stats);
+
+static int tmpfs_open(vfs_node_t *node, uint32_t flags);
+static int tmpfs_close(vfs_node_t *node);
+static int tmpfs_read(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset);
+static int tmpfs_write(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset);
+static int64_t tmpfs_writev(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, uint64_t offset);
+static vfs_node_t* tmpfs_readdir(vfs_node_t *node, uint32_t index);
+static vfs_node_t* tmpfs_readdir_next(vfs_node_t *node, uint32_t *cookie);
+static vfs_node_t* tmpfs_finddir(vfs_node_t *node, const char *name);
+static int tmpfs_create_node(vfs_node_t *parent, const char *name, uint8_t type, uint32_t permissions);
+static int tmpfs_unlink(vfs_node_t *parent, const char *name);
+
+static filesystem_operations_t tmpfs_fs_ops = {
+    .mount = tmpfs_mount,
+    .unmount = tmpfs_unmount,
+    .get_root = tmpfs_get_root,
+    .get_stats = tmpfs_get_stats
+};
+
+static vfs_operations_t tmpfs_vfs_ops = {
+    .open = tmpfs_open,
+    .close = tmpfs_close,
+    .read = tmpfs_read,
+    .write = tmpfs_write,
+    .writev = tmpfs_writev,
+    .readdir = tmpfs_readdir,
+    .readdir_next = tmpfs_readdir_next,
+    .finddir = tmpfs_finddir,
+    .create = tmpfs_create_node,
+    .unlink = tmpfs_unlink
+};
+
+
+// One lock for every instance, as in tinyfs. Pipeline stages look names
+// up and read files concurrently; holders may allocate pages, so waiters
+// yield rather than spin.
+static volatile int tmpfs_busy = 0;
+
+static void tmpfs_lock(void) {
+    while (__sync_lock_test_and_set(&tmpfs_busy, 1)) {
+        thread_yield();
+    }
+}
+
+static void tmpfs_unlock(void) {
+    __sync_lock_release(&tmpfs_busy);
+}
+
+
+static void *kzalloc(uint32_t size) {
+    uint8_t *p = (uint8_t*)kmalloc(size);
+    if (p) {
+        for (uint32_t i = 0; i < size; i++) {
+            p[i] = 0;
+        }
+    }
+    return p;
+}
+
+static uint32_t name_len(const char *name) {
+    uint32_t len = 0;
+    while (name[len]) len++;
+    return len;
+}
+
+static int name_equal(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static uint32_t name_hash(tmpfs_inode_t *dir, const char *name) {
+    uint32_t h = 2166136261U ^ dir->node.inode;
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+
+static tmpfs_inode_t* hash_lookup(tmpfs_data_t *data, tmpfs_inode_t *dir, const char *name) {
+    uint32_t h = name_hash(dir, name);
+    tmpfs_inode_t *ino;
+
+    list_for_each_entry(ino, &data->hash[h & data->hash_mask], tmpfs_inode_t, hash_link) {
+        if (ino->hash == h && ino->parent == dir && name_equal(ino->node.name, name)) {
+            return ino;
+        }
+    }
+    return NULL;
+}
+
+// Keep chains short by doubling the table once it averages two per bucket.
+// A failed allocation just leaves the old table in place.
+static void hash_grow(tmpfs_data_t *data) {
+    uint32_t buckets = (data->hash_mask + 1) * 2;
+    list_head_t *table = (list_head_t*)kmalloc(sizeof(list_head_t) * buckets);
+    if (!table) return;
+
+    for (uint32_t i = 0; i < buckets; i++) {
+        list_init(&table[i]);
+    }
+
+    tmpfs_inode_t *ino;
+    list_for_each_entry(ino, &data->inodes, tmpfs_inode_t, inode_link) {
+        if (ino->parent) {
+            list_del(&ino->hash_link);
+            list_add(&ino->hash_link, &table[ino->hash & (buckets - 1)]);
+        }
+    }
+
+    kfree(data->hash);
+    data->hash = table;
+    data->hash_mask = buckets - 1;
+}
+
+static void hash_add(tmpfs_data_t *data, tmpfs_inode_t *ino) {
+    ino->hash = name_hash(ino->parent, ino->node.name);
+    list_add(&ino->hash_link, &data->hash[ino->hash & data->hash_mask]);
+
+    if (++data->entries > (data->hash_mask + 1) * 2) {
+        hash_grow(data);
+    }
+}
+
+
+static tmpfs_inode_t* inode_alloc(filesystem_t *fs, tmpfs_data_t *data, const char *name, uint8_t type) {
+    tmpfs_inode_t *ino = (tmpfs_inode_t*)kzalloc(sizeof(tmpfs_inode_t));
+    if (!ino) return NULL;
+
+    uint32_t i;
+    for (i = 0; name[i] && i < MAX_FILENAME - 1; i++) {
+        ino->node.name[i] = name[i];
+    }
+    ino->node.name[i] = '\0';
+
+    // Numbers are never reused, so stale cache keys can never match
+    ino->node.type = type;
+    ino->node.permissions = FILE_READ | FILE_WRITE;
+    ino->node.inode = data->next_inode++;
+    ino->node.fs = fs;
+    ino->node.ops = &tmpfs_vfs_ops;
+    ino->node.private_data = ino;
+
+    list_init(&ino->hash_link);
+    list_init(&ino->sibling_link);
+    list_init(&ino->children);
+    list_add_tail(&ino->inode_link, &data->inodes);
+    return ino;
+}
+
+static void inode_free(tmpfs_data_t *data, tmpfs_inode_t *ino) {
+    for (uint32_t i = 0; i < ino->page_slots; i++) {
+        if (ino->pages[i]) {
+            pmm_free_page(ino->pages[i]);
+            data->used_pages--;
+        }
+    }
+    if (ino->pages) kfree(ino->pages);
+
+    list_del(&ino->inode_link);
+    kfree(ino);
+}
+
+// Page `index` of a file, allocated (zeroed) when `create` is set
+static uint8_t* file_page(tmpfs_data_t *data, tmpfs_inode_t *ino, uint32_t index, int create) {
+    if (index < ino->page_slots && ino->pages[index]) return ino->pages[index];
+    if (!create) return NULL;
+
+    if (index >= ino->page_slots) {
+        uint32_t slots = ino->page_slots ? ino->page_slots * 2 : 8;
+        if (slots <= index) slots = index + 1;
+
+        uint8_t **pages = (uint8_t**)kzalloc(sizeof(uint8_t*) * slots);
+        if (!pages) return NULL;
+
+        for (uint32_t i = 0; i < ino->page_slots; i++) {
+            pages[i] = ino->pages[i];
+        }
+        if (ino->pages) kfree(ino->pages);
+        ino->pages = pages;
+        ino->page_slots = slots;
+    }
+
+    if (data->used_pages >= data->max_pages) return NULL;
+
+    uint8_t *page = (uint8_t*)pmm_alloc_page();
+    if (!page) return NULL;
+
+    for (uint32_t i = 0; i < TMPFS_PAGE_SIZE; i += 8) {
+        *(uint64_t*)(page + i) = 0;
+    }
+
+    data->used_pages++;
+    ino->pages[index] = page;
+    return page;
+}
+
+
+filesystem_t* tmpfs_create(void) {
+    filesystem_t *fs = (filesystem_t*)kzalloc(sizeof(filesystem_t));
+    if (!fs) {
+        PRINT(YELLOW, BLACK, "[TMPFS] Failed to allocate filesystem\n");
+        return NULL;
+    }
+
+    const char *name = "tmpfs";
+    for (int i = 0; name[i]; i++) {
+        fs->name[i] = name[i];
+    }
+
+    fs->ops = &tmpfs_fs_ops;
+    fs->flags = FS_FLAG_RAM;
+    fs->private_data = NULL;
+    return fs;
+}
+
+// `device` is ignored; there is nothing behind a tmpfs
+static int tmpfs_mount(filesystem_t *fs, const char *device) {
+    if (fs->private_data) {
+        PRINT(YELLOW, BLACK, "[TMPFS] Instance already mounted\n");
+        return -1;
+    }
+
+    tmpfs_data_t *data = (tmpfs_data_t*)kzalloc(sizeof(tmpfs_data_t));
+    if (!data) return -1;
+
+    data->hash = (list_head_t*)kmalloc(sizeof(list_head_t) * TMPFS_HASH_MIN);
+    if (!data->hash) {
+        kfree(data);
+        return -1;
+    }
+    for (int i = 0; i < TMPFS_HASH_MIN; i++) {
+        list_init(&data->hash[i]);
+    }
+    data->hash_mask = TMPFS_HASH_MIN - 1;
+
+    // Never let scratch files take more than a quarter of free memory
+    data->max_pages = TMPFS_MAX_PAGES;
+    uint64_t quarter = pmm_get_free_pages() / 4;
+    if (quarter < data->max_pages) data->max_pages = (uint32_t)quarter;
+
+    list_init(&data->inodes);
+    data->next_inode = 1;
+
+    data->root = inode_alloc(fs, data, "/", FILE_TYPE_DIRECTORY);
+    if (!data->root) {
+        kfree(data->hash);
+        kfree(data);
+        return -1;
+    }
+
+    fs->private_data = data;
+    PRINT(MAGENTA, BLACK, "[TMPFS] Mounted (%u KB limit)\n", data->max_pages * (TMPFS_PAGE_SIZE / 1024));
+    return 0;
+}
+
+static int tmpfs_unmount(filesystem_t *fs) {
+    tmpfs_data_t *data = (tmpfs_data_t*)fs->private_data;
+    if (!data) return 0;
+
+    tmpfs_inode_t *ino, *tmp;
+    list_for_each_entry_safe(ino, tmp, &data->inodes, tmpfs_inode_t, inode_link) {
+        inode_free(data, ino);
+    }
+
+    kfree(data->hash);
+    kfree(data);
+    fs->private_data = NULL;
+    return 0;
+}
+
+static vfs_node_t* tmpfs_get_root(filesystem_t *fs) {
+    tmpfs_data_t *data = (tmpfs_data_t*)fs->private_data;
+    return data ? &data->root->node : NULL;
+}
+
+static int tmpfs_get_stats(filesystem_t *fs, fs_stats_t *stats) {
+    if (!fs || !fs->private_data || !stats) return -1;
+
+    tmpfs_data_t *data = (tmpfs_data_t*)fs->private_data;
+
+    stats->total_blocks = data->max_pages;
+    stats->free_blocks = data->max_pages - data->used_pages;
+    stats->block_size = TMPFS_PAGE_SIZE;
+
+    return 0;
+}
+
+
+static int open_locked(vfs_node_t *node, uint32_t flags) {
+    ((tmpfs_inode_t*)node->private_data)->opens++;
+    return 0;
+}
+
+static int tmpfs_open(vfs_node_t *node, uint32_t flags) {
+    tmpfs_lock();
+    int result = open_locked(node, flags);
+    tmpfs_unlock();
+    return result;
+}
+
+// The last close of a removed file frees it
+static int close_locked(vfs_node_t *node) {
+    tmpfs_inode_t *ino = (tmpfs_inode_t*)node->private_data;
+    tmpfs_data_t *data = (tmpfs_data_t*)node->fs->private_data;
+
+    if (ino->opens > 0) ino->opens--;
+
+    if (ino->opens == 0 && !ino->parent && data && ino != data->root &&
+        node->type == FILE_TYPE_REGULAR) {
+        inode_free(data, ino);
+    }
+    return 0;
+}
+
+static int tmpfs_close(vfs_node_t *node) {
+    tmpfs_lock();
+    int result = close_locked(node);
+    tmpfs_unlock();
+    return result;
+}
+
+static int read_locked(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset) {
+    if (!node || !node->fs || !node->fs->private_data) return -1;
+    if (node->type != FILE_TYPE_REGULAR) return -1;
+
+    tmpfs_data_t *data = (tmpfs_data_t*)node->fs->private_data;
+    tmpfs_inode_t *ino = (tmpfs_inode_t*)node->private_data;
+
+    if (offset >= node->size) return 0;
+    if (size > node->size - offset) size = node->size - offset;
+
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t page_off = pos % TMPFS_PAGE_SIZE;
+        uint32_t n = TMPFS_PAGE_SIZE - page_off;
+        if (n > size - done) n = size - done;
+
+        uint8_t *page = file_page(data, ino, pos / TMPFS_PAGE_SIZE, 0);
+        if (page) {
+            for (uint32_t i = 0; i < n; i++) {
+                buffer[done + i] = page[page_off + i];
+            }
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                buffer[done + i] = 0;
+            }
+        }
+        done += n;
+    }
+
+    return done;
+}
+
+static int tmpfs_read(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset) {
+    tmpfs_lock();
+    int result = read_locked(node, buffer, size, offset);
+    tmpfs_unlock();
+    return result;
+}
+
+static int tmpfs_write(vfs_node_t *node, uint8_t *buffer, uint32_t size, uint32_t offset) {
+    vfs_iovec_t iov = { buffer, size };
+    return (int)tmpfs_writev(node, &iov, 1, offset);
+}
+
+// Stops short when the mount runs out of pages
+static int64_t writev_locked(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, uint64_t offset) {
+    if (!node || !node->fs || !node->fs->private_data) return -1;
+    if (node->type != FILE_TYPE_REGULAR) return -1;
+    if (offset >= 0xFFFFFFFFULL) return -1;
+
+    tmpfs_data_t *data = (tmpfs_data_t*)node->fs->private_data;
+    tmpfs_inode_t *ino = (tmpfs_inode_t*)node->private_data;
+
+    uint64_t limit = 0xFFFFFFFFULL - offset;
+    uint64_t written = 0;
+    int full = 0;
+
+    for (int s = 0; s < iovcnt && written < limit; s++) {
+        const uint8_t *src = (const uint8_t*)iov[s].base;
+        uint64_t len = iov[s].len;
+        if (len > limit - written) len = limit - written;
+
+        while (len > 0) {
+            uint32_t pos = (uint32_t)(offset + written);
+            uint32_t page_off = pos % TMPFS_PAGE_SIZE;
+            uint32_t n = TMPFS_PAGE_SIZE - page_off;
+            if (n > len) n = (uint32_t)len;
+
+            uint8_t *page = file_page(data, ino, pos / TMPFS_PAGE_SIZE, 1);
+            if (!page) {
+                full = 1;
+                goto done;
+            }
+
+            for (uint32_t i = 0; i < n; i++) {
+                page[page_off + i] = src[i];
+            }
+            src += n;
+            len -= n;
+            written += n;
+        }
+    }
+
+done:
+    if (offset + written > node->size) {
+        node->size = (uint32_t)(offset + written);
+    }
+
+    if (written == 0 && full) return -1;
+    return (int64_t)written;
+}
+
+static int64_t tmpfs_writev(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, uint64_t offset) {
+    tmpfs_lock();
+    int64_t result = writev_locked(node, iov, iovcnt, offset);
+    tmpfs_unlock();
+    return result;
+}
+
+
+static vfs_node_t* readdir_locked(vfs_node_t *node, uint32_t index) {
+    if (!node || node->type != FILE_TYPE_DIRECTORY) return NULL;
+
+    tmpfs_inode_t *dir = (tmpfs_inode_t*)node->private_data;
+    tmpfs_inode_t *child;
+
+    uint32_t count = 0;
+    list_for_each_entry(child, &dir->children, tmpfs_inode_t, sibling_link) {
+        if (count == index) return &child->node;
+        count++;
+    }
+
+    return NULL;
+}
+
+static vfs_node_t* tmpfs_readdir(vfs_node_t *node, uint32_t index) {
+    tmpfs_lock();
+    vfs_node_t *result = readdir_locked(node, index);
+    tmpfs_unlock();
+    return result;
+}
+
+// The cookie is the seq of the entry returned last. Sequential listings
+// resume from the directory's cursor; anything else scans for the first
+// entry created after it, so removing entries mid-listing skips nothing.
+static vfs_node_t* readdir_next_locked(vfs_node_t *node, uint32_t *cookie) {
+    if (!node || node->type != FILE_TYPE_DIRECTORY) return NULL;
+
+    tmpfs_inode_t *dir = (tmpfs_inode_t*)node->private_data;
+    list_head_t *next;
+
+    if (*cookie == 0) {
+        next = dir->children.next;
+    } else if (dir->cursor && dir->cursor->seq == *cookie) {
+        next = dir->cursor->sibling_link.next;
+    } else {
+        next = &dir->children;
+
+        tmpfs_inode_t *child;
+        list_for_each_entry(child, &dir->children, tmpfs_inode_t, sibling_link) {
+            if (child->seq > *cookie) {
+                next = &child->sibling_link;
+                break;
+            }
+        }
+    }
+
+    if (next == &dir->children) return NULL;
+
+    tmpfs_inode_t *child = list_entry(next, tmpfs_inode_t, sibling_link);
+    dir->cursor = child;
+    *cookie = child->seq;
+    return &child->node;
+}
+
+static vfs_node_t* tmpfs_readdir_next(vfs_node_t *node, uint32_t *cookie) {
+    tmpfs_lock();
+    vfs_node_t *result = readdir_next_locked(node, cookie);
+    tmpfs_unlock();
+    return result;
+}
+
+static vfs_node_t* finddir_locked(vfs_node_t *node, const char *name) {
+    if (!node || node->type != FILE_TYPE_DIRECTORY) return NULL;
+    if (!node->fs || !node->fs->private_data) return NULL;
+
+    tmpfs_data_t *data = (tmpfs_data_t*)node->fs->private_data;
+    tmpfs_inode_t *ino = hash_lookup(data, (tmpfs_inode_t*)node->private_data, name);
+
+    return ino ? &ino->node : NULL;
+}
+
+static vfs_node_t* tmpfs_finddir(vfs_node_t *node, const char *name) {
+    tmpfs_lock();
+    vfs_node_t *result = finddir_locked(node, name);
+    tmpfs_unlock();
+    return result;
+}
+
+static int create_locked(vfs_node_t *parent, const char *name, uint8_t type) {
+    if (!parent || !parent->fs || !parent->fs->private_data) return -1;
+    if (parent->type != FILE_TYPE_DIRECTORY) return -1;
+
+    uint32_t len = name_len(name);
+    if (len == 0 || len >= TMPFS_MAX_FILENAME) {
+        PRINT(YELLOW, BLACK, "[TMPFS] Bad name '%s'\n", name);
+        return -1;
+    }
+
+    tmpfs_data_t *data = (tmpfs_data_t*)parent->fs->private_data;
+    tmpfs_inode_t *dir = (tmpfs_inode_t*)parent->private_data;
+
+    if (hash_lookup(data, dir, name)) {
+        PRINT(YELLOW, BLACK, "[TMPFS] File '%s' already exists\n", name);
+        return -1;
+    }
+
+    tmpfs_inode_t *ino = inode_alloc(parent->fs, data, name, type);
+    if (!ino) return -1;
+
+    ino->parent = dir;
+    ino->seq = ++dir->next_seq;
+    list_add_tail(&ino->sibling_link, &dir->children);
+    hash_add(data, ino);
+    return 0;
+}
+
+static int tmpfs_create_node(vfs_node_t *parent, const char *name, uint8_t type, uint32_t permissions) {
+    tmpfs_lock();
+    int result = create_locked(parent, name, type);
+    tmpfs_unlock();
+    return result;
+}
+
+static int unlink_locked(vfs_node_t *parent, const char *name) {
+    if (!parent || !parent->fs || !parent->fs->private_data) return -1;
+    if (parent->type != FILE_TYPE_DIRECTORY) return -1;
+
+    tmpfs_data_t *data = (tmpfs_data_t*)parent->fs->private_data;
+    tmpfs_inode_t *dir = (tmpfs_inode_t*)parent->private_data;
+
+    tmpfs_inode_t *ino = hash_lookup(data, dir, name);
+    if (!ino) return -1;
+
+    if (ino->node.type == FILE_TYPE_DIRECTORY && !list_empty(&ino->children)) {
+        PRINT(YELLOW, BLACK, "[TMPFS] Directory '%s' is not empty\n", name);
+        return -1;
+    }
+
+    list_del(&ino->hash_link);
+    list_del(&ino->sibling_link);
+    data->entries--;
+    if (dir->cursor == ino) dir->cursor = NULL;
+    ino->parent = NULL;
+
+    // Open files are freed on their last close. A removed directory that
+    // is still open or the cwd stays allocated until unmount.
+    if (ino->opens == 0 && &ino->node != vfs_get_cwd()) {
+        inode_free(data, ino);
+    }
+    return 0;
+}
+
+static int tmpfs_unlink(vfs_node_t *parent, const char *name) {
+    tmpfs_lock();
+    int result = unlink_locked(parent, name);
+    tmpfs_unlock();
+    return result;
+}